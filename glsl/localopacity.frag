@@ -16,6 +16,8 @@ out vec4 outColor; // contains only an alpha value (to write to the alpha textur
 
 //********* UNIFORMS *************** //
 uniform sampler3D volumeData;
+// the mip level of volumeData that matches the resolution of the opacity volume
+uniform float volumeLod = 0.f;
 uniform sampler1D transferFunction;
 uniform VolumeProps properties;
 
@@ -54,7 +56,7 @@ void main(void)
         if(pos != clamp(pos, vec3(0.f), vec3(1.f))) {
             break;
         }
-        curAlpha = 1.f - transFunc(texture(volumeData, pos).r).a;
+        curAlpha = 1.f - transFunc(textureLod(volumeData, pos, volumeLod).r).a;
         curAlpha = 1.f - pow(1.f - curAlpha, stepLength * baseStep);
         alphaSum *= curAlpha;
         if(alphaSum <= 0.f)
@@ -18,6 +18,8 @@ out vec4 outColor; // contains only an alpha value (to write to the alpha textur
 
 //********* UNIFORMS *************** //
 uniform sampler3D volumeData;
+// the mip level of volumeData that matches the resolution of the opacity volume
+uniform float volumeLod = 0.f;
 uniform sampler1D transferFunction;
 uniform VolumeProps properties;
 
@@ -56,7 +58,7 @@ float raycast(vec3 position, vec3 dir) {
         if(pos != clamp(pos, vec3(0.f), vec3(1.f))) {
             break;
         }
-        curAlpha = 1.f - transFunc(texture(volumeData, pos).r).a;
+        curAlpha = 1.f - transFunc(textureLod(volumeData, pos, volumeLod).r).a;
         curAlpha = 1.f - pow(1.f - curAlpha, stepLength * baseStep);
         light += (1.f - texture(globalOpacity, pos).r) * curAlpha; // intensity * (1.f - tex..) = light from shadow map
     }
@@ -1,6 +1,9 @@
 #version 400
 
 const float BASE_STEP = 200.f, OPACITY_TERMINATION = 1.f;
+// baked gradient magnitudes (square root encoded, relative to the value range
+// of the data) below which the lighting fades out
+const float FLAT_GRADIENT = 0.1f;
 
 struct VolumeProps {
     int width;
@@ -36,34 +39,172 @@ uniform VolumeProps properties;
 // ---- Textures ----------------- //
 uniform sampler3D volumeData;
 uniform sampler1D transferFunction;
+// the color (rgb) and the extinction per base step (a) of the ray segments
+// from a front (y) to a back (x) transfer function coordinate
+uniform sampler2D preIntegrationTable;
+uniform bool preIntegrated = false;
 
 uniform sampler2D entryPoints;
 uniform sampler2D exitPoints;
+// the rays are intersected with the volume here instead of reading the
+// entry and exit points, clipToTex maps clip space to texture coordinates
+uniform bool analyticRays = false;
+uniform mat4 clipToTex;
 
 uniform sampler3D shadowVolume;
 
+// the gradients baked on the CPU: the normalized direction in xyz and the
+// square root of the relative magnitude in w
+uniform sampler3D gradientVolume;
+uniform bool gradientReady = false;
+
+// ---- Level of Detail ---------- //
+// the mip levels of volumeData are the averaged pyramid levels, maxVolume
+// holds the maximum pyramid levels starting with level 1
+uniform sampler3D maxVolume;
+uniform bool maxVolumeReady = false;
+// the footprint of a pixel in voxels at view depth 1 (or everywhere for
+// orthographic projections), 0 disables the level of detail
+uniform float lodScale = 0.f;
+uniform bool lodPerspective = true;
+// maps texture coordinates to the view depth
+uniform vec4 viewDepth;
+uniform float lodBias = 0.f;
+uniform float maxLod = 0.f;
+// the pyramid level of the base level of volumeData (the reduced texture
+// of the virtual texture mode), finer levels are only in the brick atlas
+uniform float volumeLevel = 0.f;
+
+// ---- Virtual Texture ---------- //
+// in the virtual texture mode volumeData holds a reduced resolution version
+// of the volume and the full resolution bricks are looked up in the atlas
+uniform bool virtualTexture = false;
+uniform usampler3D pageTable;
+uniform sampler3D brickAtlas;
+uniform vec3 volumeSize;
+uniform float brickSize;
+uniform vec3 atlasSize;
+// the feedback pass reports the bricks needed by the rays
+uniform bool feedbackPass = false;
+uniform int frameIndex = 0;
+
+// ---- Empty Space Skipping ----- //
+// one texel per cell of the occupancy grid, 0 if the transfer function is
+// transparent over the value range of the cell
+uniform sampler3D occupancy;
+uniform bool emptySkipping = false;
+// the extent of a cell in texture coordinates
+uniform vec3 occupancyCell;
+// outputs the number of samples of the ray instead of its color
+uniform bool countSamples = false;
+
 //*********** UNIFORM END ***************** //
 
+const uint BRICK_MISSING = 0u, BRICK_RESIDENT = 1u;
+// a ray reports one of every FEEDBACK_ROTATION resident bricks it uses
+const int FEEDBACK_ROTATION = 4;
+
+// the pyramid level used by sampleVolume
+float currentLod = 0.f;
+// the volume samples taken by directRendering
+int sampleCount = 0;
+
+// returns the pyramid level for a sample at samplePos, where one
+// voxel of the level covers about one pixel
+float lodAt(vec3 samplePos) {
+    if(lodScale <= 0.f)
+        return 0.f;
+    float footprint = lodScale;
+    if(lodPerspective)
+        footprint *= max(dot(viewDepth, vec4(samplePos, 1.f)), 0.f);
+    return clamp(log2(max(footprint, 1.f)) + lodBias, 0.f, maxLod);
+}
+
+// returns the brick containing samplePos (virtual texture mode)
+ivec3 brickAt(vec3 samplePos) {
+    vec3 voxel = clamp(samplePos, 0.f, 1.f) * volumeSize - 0.5f;
+    return clamp(ivec3(floor(voxel / brickSize)), ivec3(0), textureSize(pageTable, 0) - 1);
+}
+
+// returns the normalized intensity at samplePos on the level currentLod. In the
+// virtual texture mode resident bricks are read from the atlas for the levels
+// below the reduced volume, others from the reduced volume
+float sampleVolume(vec3 samplePos) {
+    if(virtualTexture && currentLod < volumeLevel) {
+        ivec3 brick = brickAt(samplePos);
+        uvec4 page = texelFetch(pageTable, brick, 0);
+        if(page.a == BRICK_RESIDENT) {
+            // position in the slot, which has a border of one voxel
+            vec3 local = clamp(samplePos, 0.f, 1.f) * volumeSize - 0.5f - vec3(brick) * brickSize + 1.5f;
+            return texture(brickAtlas, (vec3(page.xyz) * (brickSize + 2.f) + local) / atlasSize).r;
+        }
+    }
+    return textureLod(volumeData, samplePos, max(currentLod - volumeLevel, 0.f)).r;
+}
+
+// like sampleVolume, but coarser levels return the maximum of the voxels they cover
+float sampleMaximum(vec3 samplePos) {
+    if(maxVolumeReady && currentLod >= 1.f)
+        return textureLod(maxVolume, samplePos, currentLod - 1.f).r;
+    return sampleVolume(samplePos);
+}
+
+// returns the distance along dir (normalized) from samplePos to the exit
+// of its cell if the cell is empty, 0 otherwise
+float emptyDistance(vec3 samplePos, vec3 dir) {
+    ivec3 cell = clamp(ivec3(samplePos / occupancyCell), ivec3(0), textureSize(occupancy, 0) - 1);
+    if(texelFetch(occupancy, cell, 0).r > 0.f)
+        return 0.f;
+    vec3 cellMin = vec3(cell) * occupancyCell;
+    vec3 bound = mix(cellMin, cellMin + occupancyCell, greaterThan(dir, vec3(0.f)));
+    vec3 dist = mix((bound - samplePos) / dir, vec3(1e10), equal(dir, vec3(0.f)));
+    return max(min(dist.x, min(dist.y, dist.z)), 0.f);
+}
+
+// fits the normalized intensity value to the relevant transfer function interval
+float tfCoordinate(float intensity) {
+    return intensity / (properties.maxValue - properties.minValue) + properties.minValue;
+}
+
 // applies the transfer function to the given normalized intensity value
 // in [0;1]. The transfunc is stretched to fit over the actually occuring
 // scalar data domain in the volume dataset given by VolumeProps.min/maxValue
 vec4 transFunc(float intensity) {
-    // fit the value to the relevant transfer function interval
-    intensity = (intensity / (properties.maxValue - properties.minValue) + properties.minValue);
     // perform classification with the look up texture
-    return texture(transferFunction, intensity);
+    return texture(transferFunction, tfCoordinate(intensity));
+}
+
+// classifies the segment of length step between the samples with the
+// transfer function coordinates front and back, with opacity correction
+vec4 preIntegratedTransFunc(float front, float back) {
+    vec4 segment = texture(preIntegrationTable, vec2(back, front));
+    return vec4(segment.rgb, 1.f - exp(-segment.a * step * BASE_STEP));
 }
 
-// calculates the gradient at samplePos with forward differences
-vec3 gradient(vec3 samplePos) {
+// reads the direction and the encoded magnitude of the baked gradient at
+// samplePos, the filtered direction of flat regions may be zero
+vec4 bakedGradient(vec3 samplePos) {
+    vec4 g = texture(gradientVolume, samplePos);
+    float len = length(g.xyz);
+    return vec4(len > 0.f ? g.xyz / len : vec3(0.f), g.w);
+}
+
+// calculates the gradient at samplePos with central differences, or
+// reads it from the baked gradients. w is the weight of the lighting,
+// which fades out in flat regions of the baked gradients
+vec4 gradient(vec3 samplePos) {
+    if(gradientReady) {
+        vec4 g = bakedGradient(samplePos);
+        return vec4(g.xyz, smoothstep(0.f, FLAT_GRADIENT, g.w));
+    }
     float h = 3.f/(properties.width + properties.height + properties.depth);
-    float x = texture(volumeData, samplePos + vec3(h, 0, 0)).r
-            - texture(volumeData, samplePos - vec3(h, 0, 0)).r;
-    float y = texture(volumeData, samplePos + vec3(0, h, 0)).r
-            - texture(volumeData, samplePos - vec3(0, h, 0)).r;
-    float z = texture(volumeData, samplePos + vec3(0, 0, h)).r
-            - texture(volumeData, samplePos - vec3(0, 0, h)).r;
-    return normalize(vec3(x,y,z));
+    float x = sampleVolume(samplePos + vec3(h, 0, 0))
+            - sampleVolume(samplePos - vec3(h, 0, 0));
+    float y = sampleVolume(samplePos + vec3(0, h, 0))
+            - sampleVolume(samplePos - vec3(0, h, 0));
+    float z = sampleVolume(samplePos + vec3(0, 0, h))
+            - sampleVolume(samplePos - vec3(0, 0, h));
+    return vec4(normalize(vec3(x,y,z)), 1.f);
 }
 
 
@@ -79,7 +220,8 @@ vec4 lighting(vec3 samplePos, vec3 color, float opacity) {
     const float intensity = 1, shininess = 10;
 
     // calculate the surface normal with the gradient
-    vec3 normal = gradient(samplePos);
+    vec4 grad = gradient(samplePos);
+    vec3 normal = grad.xyz;
 
     // the eye vector (since we're in view space it's the position)
     vec3 toEye = normalize(eyePos - samplePos);
@@ -106,7 +248,8 @@ vec4 lighting(vec3 samplePos, vec3 color, float opacity) {
     if(specular)
         result += specularSum;
 
-    return result;
+    // flat regions have no meaningful normal and keep their unlit color
+    return mix(diffuseCol, result, grad.w);
 }
 
 
@@ -129,20 +272,43 @@ vec4 directRendering(vec3 start, vec3 end) {
     // iterative direct volume rendering sum:
     vec3 samplePos;
     bool cont = true;
+    // the transfer function coordinate of the previous sample (pre-integration),
+    // negative at the start of the ray and behind skipped cells
+    float lastCoord = -1.f, coord;
 
     for(float t = 0; t <= t_end; t += diff) {   // diff vormals step
 
         // iterate along the ray
         samplePos = start + t*dir;
+        currentLod = lodAt(samplePos);
+
+        // jump to the first step behind an empty cell. The value ranges of
+        // the cells only bound the samples of the full resolution level
+        if(emptySkipping && currentLod <= 0.f) {
+            float skip = emptyDistance(samplePos, dir);
+            if(skip > 0.f) {
+                t = max(t, floor((t + skip) / diff) * diff);
+                lastCoord = -1.f;
+                continue;
+            }
+        }
 
         // get the intensity value from the dataset
-        intensity = texture(volumeData, samplePos).r;
-        // apply the transfer function
-        curCol = transFunc(intensity);
-
-        if(curCol.a > 0.f) {
+        intensity = sampleVolume(samplePos);
+        sampleCount++;
+        // apply the transfer function, to the segment from the previous
+        // sample with the pre-integration
+        if(preIntegrated) {
+            coord = tfCoordinate(intensity);
+            curCol = preIntegratedTransFunc(lastCoord < 0.f ? coord : lastCoord, coord);
+            lastCoord = coord;
+        } else {
+            curCol = transFunc(intensity);
             // alpha correction for different step sizes
             curCol.a = 1.f - pow(1.f - curCol.a, step * BASE_STEP);
+        }
+
+        if(curCol.a > 0.f) {
             curOpacity = (1.f - alpha) * curCol.a;
 
             // apply local lighting at current position for the resulting color
@@ -186,8 +352,12 @@ vec4 maximumIntensity(vec3 start, vec3 end) {
     float maxInt = -1.f;
     vec4 color = vec4(0.f);
 
+    vec3 samplePos;
+
     for(float t = 0; t <= t_end; t += diff) {
-        intensity = texture(volumeData, start + t*dir).r;
+        samplePos = start + t*dir;
+        currentLod = lodAt(samplePos);
+        intensity = sampleMaximum(samplePos);
         if(intensity > maxInt) {
             color = transFunc(intensity);
             maxInt = intensity;
@@ -197,18 +367,107 @@ vec4 maximumIntensity(vec3 start, vec3 end) {
     return color;
 }
 
+// encodes a brick index in the rgb channels with the given state in alpha
+vec4 encodeBrick(ivec3 brick, float state) {
+    ivec3 count = textureSize(pageTable, 0);
+    int index = (brick.z * count.y + brick.y) * count.x + brick.x;
+    return vec4(index & 255, (index >> 8) & 255, (index >> 16) & 255, 0.f) / 255.f + vec4(0.f, 0.f, 0.f, state);
+}
+
+// marches the ray like directRendering and returns the first missing brick
+// that is not empty (alpha 1) or one of the used resident bricks (alpha 0.5).
+// Samples that use the reduced volume (level of detail) need no bricks
+vec4 brickFeedback(vec3 start, vec3 end) {
+    if(start == end)
+        return vec4(0.f);
+
+    vec3 dir = (end - start);
+    float t_end = length(dir);
+    dir = normalize(dir);
+    float diff = abs(step/t_end);
+
+    float alpha = 0.f, a;
+    vec3 samplePos;
+    ivec3 brick, lastBrick = ivec3(-1);
+    uvec4 page;
+    vec4 used = vec4(0.f);
+    int usedCount = 0;
+
+    for(float t = 0; t <= t_end; t += diff) {
+        samplePos = start + t*dir;
+        currentLod = lodAt(samplePos);
+        if(currentLod < volumeLevel) {
+            brick = brickAt(samplePos);
+            page = texelFetch(pageTable, brick, 0);
+            if(page.a == BRICK_MISSING)
+                return encodeBrick(brick, 1.f);
+            if(page.a == BRICK_RESIDENT && brick != lastBrick) {
+                // rotate through the used bricks over the frames
+                if(usedCount++ % FEEDBACK_ROTATION == frameIndex % FEEDBACK_ROTATION)
+                    used = encodeBrick(brick, 0.5f);
+                lastBrick = brick;
+            }
+        }
+
+        // accumulate the opacity for the early ray termination
+        a = transFunc(sampleVolume(samplePos)).a;
+        a = 1.f - pow(1.f - a, step * BASE_STEP);
+        alpha += (1.f - alpha) * a;
+        if(alpha >= OPACITY_TERMINATION)
+            break;
+    }
+    return used;
+}
+
+// intersects the ray of the fragment between the near and the far plane
+// with the volume [0,1]^3, returns false if it misses the volume
+bool intersectVolume(out vec3 entryPoint, out vec3 exitPoint) {
+    vec2 ndc = fragPos * 2.f - 1.f;
+    vec4 near = clipToTex * vec4(ndc, -1.f, 1.f);
+    vec4 far = clipToTex * vec4(ndc, 1.f, 1.f);
+    vec3 origin = near.xyz / near.w;
+    vec3 dir = far.xyz / far.w - origin;
+    dir = mix(dir, vec3(1e-8f), equal(dir, vec3(0.f)));
+
+    // the slabs of the box, the ray is parameterized from the near (0) to the far plane (1)
+    vec3 t0 = -origin / dir, t1 = (vec3(1.f) - origin) / dir;
+    vec3 tMin = min(t0, t1), tMax = max(t0, t1);
+    float tNear = max(max(tMin.x, tMin.y), max(tMin.z, 0.f));
+    float tFar = min(min(tMax.x, tMax.y), min(tMax.z, 1.f));
+    entryPoint = clamp(origin + tNear * dir, 0.f, 1.f);
+    exitPoint = clamp(origin + tFar * dir, 0.f, 1.f);
+    return tNear < tFar;
+}
+
 void main() {
 
-    // obtain entry and exit points from the prerendered textures
-    vec3 entryPoint = texture(entryPoints, fragPos).xyz;
-    vec3 exitPoint = texture(exitPoints, fragPos).xyz;
+    vec3 entryPoint, exitPoint;
+    if(analyticRays) {
+        if(!intersectVolume(entryPoint, exitPoint))
+            discard;
+    } else {
+        // obtain entry and exit points from the prerendered textures
+        entryPoint = texture(entryPoints, fragPos).xyz;
+        exitPoint = texture(exitPoints, fragPos).xyz;
+    }
 
     if(entryPoint == exitPoint) {
         discard;
     }
 
+    if(feedbackPass) {
+        outColor = brickFeedback(entryPoint, exitPoint);
+        return;
+    }
+
     // -------------- Render the volume with the given render mode ------------ //
 
+    if(countSamples) {
+        directRendering(entryPoint, exitPoint);
+        outColor = vec4(sampleCount & 255, (sampleCount >> 8) & 255, (sampleCount >> 16) & 255, 255) / 255.f;
+        return;
+    }
+
     // volume rendering modes
     if(displayMode == 0)      // Direct rendering
         outColor = directRendering(entryPoint, exitPoint);
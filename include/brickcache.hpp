@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QOpenGLShaderProgram>
+#ifdef WIN32
+    #include <Windows.h>
+#endif
+#include <GL/gl.h>
+
+#include <list>
+#include <vector>
+
+#include "transferfunction.hpp"
+#include "volumedata.hpp"
+
+/**
+ * The BrickCache implements a virtual 3D texture for volumes that do not fit
+ * into GPU memory. The volume is divided into bricks which are streamed into
+ * slots of a fixed size atlas texture. A page table texture with one texel per
+ * brick tells volume.frag where a brick resides in the atlas, or that it is
+ * not resident (the shader then falls back to a reduced resolution texture).
+ *
+ * Which bricks are needed is determined by a feedback pass: the rays report
+ * the first missing brick they hit and, to keep the LRU order up to date,
+ * one of the resident bricks they use. Bricks that are completely transparent
+ * under the current transfer function (according to their min/max values) are
+ * marked empty and are never loaded.
+ */
+class BrickCache
+{
+public:
+    // page table states (alpha channel of the page table texels)
+    enum PageState { MISSING = 0, RESIDENT = 1, EMPTY = 2 };
+
+    static const int DEFAULT_BRICK_SIZE = 64;
+    static const qint64 DEFAULT_BUDGET_BYTES = 512 * 1024 * 1024;
+    static const qint64 DEFAULT_UPLOAD_BYTES_PER_FRAME = 32 * 1024 * 1024;
+
+    BrickCache(VolumeData *volume, qint64 budgetBytes = DEFAULT_BUDGET_BYTES,
+               qint64 uploadBytesPerFrame = DEFAULT_UPLOAD_BYTES_PER_FRAME);
+    ~BrickCache();
+
+    bool isValid();
+
+    // marks the bricks that are transparent under the transfer function as empty
+    void setTransferFunction(TransferFunction *tf);
+
+    // evaluates the feedback (RGBA8 texels) of the current frame and streams the
+    // missing bricks into the atlas within the upload budget. Returns true if
+    // bricks were loaded or the budget left missing bricks that the next frame
+    // can load, so another frame should be rendered
+    bool update(const std::vector<uchar> &feedback);
+
+    // sets the uniforms of the virtual texture and binds the page
+    // table and the atlas to the given texture units
+    void bind(QOpenGLShaderProgram *prog, int pageTableUnit, int atlasUnit);
+
+private:
+    void computeBrickRanges();
+    void uploadPageTable();
+    void touch(int brick);
+    // copies the brick with a border of one voxel into dst (as upload values)
+    void gatherBrick(int brick, char *scratch, char *dst);
+
+    VolumeData *volume;
+    int brickSize, slotSize;
+    int bricksX, bricksY, bricksZ;
+    int slotsX, slotsY, slotsZ;
+    qint64 budgetBytes, uploadBytesPerFrame;
+
+    GLuint atlasTexture, pageTableTexture;
+
+    // normalized value range of every brick
+    std::vector<float> brickMin, brickMax;
+    std::vector<bool> brickVisible;
+
+    // RGBA page table texels: slot x, y, z and state
+    std::vector<quint16> pageTable;
+    bool pageTableDirty;
+
+    // least recently used resident bricks at the back
+    std::list<int> lru;
+    std::vector<std::list<int>::iterator> lruPos;
+    std::vector<int> brickSlot, slotBrick;
+    std::vector<int> freeSlots;
+    // the frame in which each brick was used last (it must not be evicted in the same frame)
+    std::vector<qint64> brickFrame;
+    qint64 frame;
+
+    std::vector<char> staging;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <QString>
+
+#include <vector>
+
+#include "volumereader.hpp"
+#include "voxelbuffer.hpp"
+#include "voxeltype.hpp"
+
+class QFile;
+
+/**
+ * A bricked container format for volumes. The volume is split into cubic
+ * bricks (64^3 by default) that are stored one after another, each aligned
+ * to VoxelBuffer::ALIGNMENT in the file. An index table at the end of the
+ * file stores the position, the min/max value, a histogram summary and an
+ * optional CRC32 checksum of every brick. Bricks with a single value are
+ * not stored at all and are filled from their metadata.
+ *
+ * Layout (little endian):
+ * header - magic "VLBRICK1", quint32 version, qint32 width/height/depth,
+ *          double aspectX/Y/Z, quint32 voxel type, quint32 brick size,
+ *          quint32 histogram buckets, quint32 flags, double data min/max,
+ *          quint64 index offset
+ * bricks - the voxels of each brick, x fastest, bricks at the border are cropped
+ * index  - per brick: quint64 offset, quint64 size, double min/max,
+ *          quint32 checksum, quint32 histogram[buckets]
+ */
+class BrickedVolume
+{
+public:
+    static const int DEFAULT_BRICK_SIZE = 64;
+    // the per brick histograms cover the value range of the whole volume
+    static const int HISTOGRAM_BUCKETS = 256;
+
+    struct Brick {
+        qint64 offset, size;  // position of the voxels in the file, size 0 for uniform bricks
+        double minValue, maxValue;
+        quint32 checksum;
+    };
+
+    BrickedVolume();
+
+    // true if the file at path starts with the bricked format magic
+    static bool isBricked(QString path);
+
+    // reads the header and the index table of a bricked file
+    bool open(QString path);
+    // reads the bricks into a linear volume (x fastest). Bricks are read in parallel,
+    // uniform bricks are filled from the index without touching the file
+    bool readVolume(VoxelBuffer &target, bool verify, const VolumeReader::ProgressCallback &progress);
+
+    // writes the linear volume data (in host byte order) as bricked file
+    static bool write(QString path, const char *data, int width, int height, int depth,
+                      float aspectX, float aspectY, float aspectZ, VoxelType::Type type,
+                      int brickSize, bool checksums);
+    // converts a RAW volume file into a bricked file
+    static bool convert(QString rawPath, QString brickedPath, int brickSize = DEFAULT_BRICK_SIZE, bool checksums = true);
+
+    // sums up the brick histograms into the given number of buckets over [dataMin, dataMax].
+    // Returns false if the buckets cannot be derived from the stored histograms
+    bool histogram(int buckets, std::vector<qint64> &counts);
+
+    QString getPath();
+    int getWidth();
+    int getHeight();
+    int getDepth();
+    float getAspectX();
+    float getAspectY();
+    float getAspectZ();
+    VoxelType::Type getVoxelType();
+    double getDataMin();
+    double getDataMax();
+    bool hasChecksums();
+
+    int getBrickSize();
+    // number of bricks along each axis
+    int getBricksX();
+    int getBricksY();
+    int getBricksZ();
+    int getBrickCount();
+    int brickIndex(int bx, int by, int bz);
+    const Brick& getBrick(int index);
+
+private:
+    static const quint32 VERSION = 1;
+    static const quint32 FLAG_CHECKSUMS = 1;
+
+    bool readBrick(QFile &file, int index, char *dst, bool verify);
+
+    QString path;
+    int width, height, depth;
+    float aspectX, aspectY, aspectZ;
+    VoxelType::Type type;
+    int brickSize;
+    int bricksX, bricksY, bricksZ;
+    quint32 flags;
+    double dataMin, dataMax;
+
+    std::vector<Brick> bricks;
+    // HISTOGRAM_BUCKETS counts per brick
+    std::vector<quint32> histograms;
+};
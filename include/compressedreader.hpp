@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include <functional>
+#include <vector>
+
+/**
+ * Decompresses gzip or zstd compressed volume files on the fly, so they can
+ * be loaded without a temporary uncompressed copy. The codec is detected from
+ * the magic bytes of the file. Files made of independent blocks are
+ * decompressed in parallel directly into the target:
+ * - BGZF (bgzip), a gzip variant whose members store their compressed size
+ * - zstd files with several frames that store their content size (pzstd,
+ *   zstd --format=zstd with a frame per block)
+ * Other files are decompressed as a stream on the calling thread.
+ *
+ * The codecs are optional dependencies (VOLLIGHT_ZLIB, VOLLIGHT_ZSTD).
+ */
+class CompressedReader
+{
+public:
+    enum Codec { NONE, GZIP, ZSTD };
+
+    // called with the number of leading bytes of the target that are
+    // decompressed completely (never from two threads at once). Returning
+    // false cancels the read
+    typedef std::function<bool(qint64 bytesDone)> FrontCallback;
+
+    static Codec detect(QString path);
+    static QString codecName(Codec codec);
+    // false if the codec was not compiled in
+    static bool isAvailable(Codec codec);
+
+    // the first (at most) maxBytes of the decompressed data, e.g. for parsing a header
+    static QByteArray readHead(QString path, qint64 maxBytes);
+    // the size of the decompressed data if it can be determined without
+    // decompressing it, -1 otherwise
+    static qint64 uncompressedSize(QString path);
+
+    // decompresses size bytes starting at offset of the decompressed data into target
+    static bool read(QString path, qint64 offset, qint64 size, char *target,
+                     const FrontCallback &front = FrontCallback());
+
+private:
+    CompressedReader();
+
+    // an independently decompressible block of the file
+    struct Block {
+        qint64 compressedOffset, compressedSize;
+        qint64 offset, size;  // position in the decompressed data
+    };
+
+    // split the file into its blocks, false if it is not made of such blocks
+    static bool findBlocks(Codec codec, const uchar *data, qint64 size, std::vector<Block> &blocks);
+    static bool findBgzfBlocks(const uchar *data, qint64 size, std::vector<Block> &blocks);
+    static bool findZstdFrames(const uchar *data, qint64 size, std::vector<Block> &blocks);
+    static bool readBlocks(Codec codec, const uchar *data, const std::vector<Block> &blocks,
+                           qint64 offset, qint64 size, char *target, const FrontCallback &front);
+    static bool decompressBlock(Codec codec, const uchar *src, qint64 srcSize, char *dst, qint64 dstSize);
+    // returns the number of bytes written into target (less than size if the
+    // data ends early or is corrupt), -1 if the read was canceled
+    static qint64 readStream(Codec codec, const uchar *data, qint64 dataSize,
+                             qint64 offset, qint64 size, char *target, const FrontCallback &front);
+
+    // the front is reported in steps of at least this size
+    static const qint64 FRONT_STEP = 8 * 1024 * 1024;
+    // the decompressed data before the requested offset goes through a buffer of this size
+    static const qint64 SKIP_BUFFER_SIZE = 64 * 1024;
+    // deflate does not compress by more than this factor, so the 32 bit
+    // size in the gzip trailer is exact for small enough files
+    static const qint64 MAX_DEFLATE_RATIO = 1032;
+};
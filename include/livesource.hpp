@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include <functional>
+
+#ifndef Q_OS_UNIX
+    #include <QFile>
+#endif
+
+/**
+ * Reads a file that is still being written (e.g. by an acquisition) or a
+ * named pipe front to back. A read that reaches the current end of the data
+ * waits for more instead of failing, so the reader follows the writer. The
+ * end of a pipe or file is not distinguished from a pause of the writer, the
+ * reads only end when all requested bytes arrived or the callback cancels.
+ */
+class LiveSource
+{
+public:
+    // called with the number of bytes of the current read that arrived,
+    // after every chunk and regularly while waiting for more data.
+    // Returning false cancels the read
+    typedef std::function<bool(qint64 bytesDone)> WaitCallback;
+
+    LiveSource();
+    ~LiveSource();
+
+    bool open(QString path);
+    void close();
+    QString getPath();
+
+    // reads exactly size bytes into target, waiting for data as needed
+    bool read(char *target, qint64 size, const WaitCallback &callback = WaitCallback());
+    // reads up to and including the next line break
+    bool readLine(QByteArray &line, const WaitCallback &callback = WaitCallback());
+    // reads and drops size bytes (pipes cannot seek)
+    bool skip(qint64 size, const WaitCallback &callback = WaitCallback());
+
+private:
+    // reads what is available right now: the number of bytes read, 0 if there
+    // is no new data yet and -1 on errors
+    qint64 readAvailable(char *target, qint64 maxSize);
+
+    // the time to wait before polling for new data again in ms
+    static const int POLL_INTERVAL = 50;
+    // the callback is called at least once per chunk
+    static const qint64 CHUNK_SIZE = 4 * 1024 * 1024;
+    static const qint64 SKIP_BUFFER_SIZE = 64 * 1024;
+
+    QString path;
+#ifdef Q_OS_UNIX
+    int fd;
+#else
+    QFile file;
+#endif
+};
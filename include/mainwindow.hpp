@@ -30,6 +30,8 @@ private:
     QToolBar *mainToolBar, *lightToolBar;
     QMenu *fileMenu;
     QStatusBar *statusBar;
+    QProgressBar *loadProgressBar;
+    QPushButton *cancelLoadButton;
 
     // Menu bar Actions
     QAction *aboutAction, *exitAction;
@@ -41,7 +43,15 @@ private:
     QAction *homeAction, *cameraRotationAction;
 
     // Volume Data Actions
-    QAction *openVolumeAction;
+    QAction *openVolumeAction, *openSliceStackAction, *openVolumeRegionAction, *openLiveVolumeAction;
+    QAction *openSharedVolumeAction;
+    // Volume Series Playback
+    QAction *openSeriesAction, *playSeriesAction;
+    QSpinBox *seriesFpsSpin;
+    QMenu *readerMenu, *memoryMenu, *precisionMenu, *uploadSlabMenu;
+    QAction *convertVolumeAction, *virtualTextureAction, *levelOfDetailAction, *analyticRaysAction;
+    QAction *preIntegrationAction, *gradientAction;
+    QAction *volumeCacheAction, *clearCacheAction;
     // Sampling Step Slider
     QSlider *stepSlider;
     // Render Mode Selection
@@ -84,6 +94,24 @@ public slots:
     void saveProject();
     // volume rendering
     void openVolumeData();
+    void openSliceStack();
+    void openVolumeRegion();
+    void openLiveVolume();
+    void openSharedVolume();
+    void openVolumeSeries();
+    void seriesOpenChanged(bool open);
+    void playSeriesToggled(bool play);
+    void seriesFpsChanged(int fps);
+    void seriesStepShown(int step);
+    void convertVolumeData();
+    void volumeLoadProgress(int percent);
+    void volumeLoadFinished(bool success);
+    void readerBackendSelected(QAction *action);
+    void memoryPolicySelected(QAction *action);
+    void texturePrecisionSelected(QAction *action);
+    void uploadSlabSelected(QAction *action);
+    void volumeCacheToggled(bool enabled);
+    void clearVolumeCache();
     void showTfEditor();
     void saveTf();
     void loadTf();
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <vector>
+
+#include "voxeltype.hpp"
+
+class BrickedVolume;
+
+/**
+ * A coarse grid over a volume that stores the minimum and maximum value of
+ * every cell of CELL_SIZE^3 voxels. The range of a cell includes a border of
+ * one voxel, so trilinear samples inside of the cell only interpolate values
+ * of that range. The grid is built in parallel while loading. For a transfer
+ * function it yields the occupancy of the cells: a cell is empty if the
+ * transfer function is transparent over its whole value range, and the rays
+ * of volume.frag skip empty cells.
+ */
+class OccupancyGrid
+{
+public:
+    static const int CELL_SIZE = 16;
+
+    OccupancyGrid();
+
+    // determines the value ranges of the cells of the volume (in host byte order)
+    bool build(const char *data, int width, int height, int depth, VoxelType::Type type);
+    // takes the value range of a cell from the metadata of the bricks it
+    // overlaps (with its border) instead of reading the voxels. The ranges are
+    // wider than the ones of build, so fewer cells are empty
+    bool build(BrickedVolume &bricks);
+
+    int getCellsX();
+    int getCellsY();
+    int getCellsZ();
+    int getCellCount();
+
+    // fills occupancy with one value per cell (x fastest): 255 if the
+    // transfer function (size RGBA entries) is visible somewhere in the value
+    // range of the cell, 0 if the cell is empty. The values are mapped to the
+    // transfer function like in volume.frag: normalized to [domainMin,
+    // domainMax] and stretched by the normalized value range [minValue,
+    // maxValue] of the volume. Returns the number of empty cells
+    int classify(const float *tf, int size, float minValue, float maxValue,
+                 double domainMin, double domainMax, std::vector<uchar> &occupancy);
+
+private:
+    int cellsX, cellsY, cellsZ;
+    std::vector<double> minValues, maxValues;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <functional>
+
+/**
+ * Minimal thread helper for the CPU side passes over volume data
+ * (reading, conversion, reductions). Work is split into chunks of
+ * at least grain elements that are handed out dynamically to a
+ * fixed number of std::threads.
+ */
+class Parallel
+{
+public:
+    // the number of worker threads (defaults to the hardware concurrency)
+    static int threadCount();
+    static void setThreadCount(int count);
+
+    // processes [0, count) in chunks on all threads. The callback receives
+    // the chunk range [begin, end) and the id of the executing thread in
+    // [0, threadCount()) which can be used to index per thread accumulators
+    static void forRange(qint64 count, qint64 grain, const std::function<void(qint64 begin, qint64 end, int thread)> &func);
+
+    // runs func(thread) once on each of the given number of threads
+    static void run(int threads, const std::function<void(int thread)> &func);
+
+private:
+    Parallel();
+    static int threads;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <vector>
+
+/**
+ * A pre-integrated transfer function: entry (f, b) holds the color and the
+ * extinction of a ray segment whose scalar value changes linearly from f at
+ * the front to b at the back sample, so thin features between two samples are
+ * not missed at large step sizes. The table is built from prefix integrals of
+ * the extinction and of the extinction weighted color (the incremental
+ * algorithm of Lum et al.), which makes every entry O(1) and the table
+ * O(n^2). The rows are filled in parallel.
+ *
+ * The RGBA entries (row f, column b) store the extinction weighted average
+ * color in rgb and the average extinction per base step in alpha. The
+ * extinction of an opacity a of the transfer function is -ln(1 - a), so a
+ * segment of length l has the opacity 1 - exp(-alpha * l * BASE_STEP) and
+ * the table does not depend on the step size.
+ */
+class PreIntegrationTable
+{
+public:
+    // larger transfer functions are resampled to this size (8 MiB as RGBA16F)
+    static const int MAX_SIZE = 1024;
+
+    PreIntegrationTable();
+
+    // builds the table from the given number of RGBA transfer function entries
+    void build(const float *tf, int tfSize);
+
+    int getSize();
+    // getSize()^2 RGBA entries, the back value runs fastest
+    const float* getData();
+
+private:
+    int size;
+    std::vector<float> table;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QVector3D>
+#ifdef WIN32
+    #include <Windows.h>
+#endif
+#include <GL/gl.h>
+
+#include <vector>
+
+/**
+ * A proxy mesh around the occupied cells of an OccupancyGrid, which replaces
+ * the bounding cube when rendering the entry and exit points. Only the faces
+ * between occupied and empty cells (or the border of the volume) are kept,
+ * and neighbouring faces of the same orientation are merged into larger
+ * quads: the faces along z into rectangles, the side faces of a layer of
+ * cells into runs. The vertices are in the model space of the unit cube
+ * around the origin, like the cube of PrimitiveUtils.
+ *
+ * The faces of a layer of cells only depend on the occupancy of the layer and
+ * of its two neighbours, so after a transfer function change only the layers
+ * around changed cells are generated again.
+ */
+class ProxyGeometry
+{
+public:
+    ProxyGeometry();
+    ~ProxyGeometry();
+
+    // updates the mesh to the occupancy (one value per cell, x fastest, 0 is
+    // empty) of a grid of cells with the given extent in texture coordinates.
+    // Needs a current GL context
+    void update(const std::vector<uchar> &occupancy, int cellsX, int cellsY, int cellsZ, QVector3D cellSize);
+    // forgets the mesh, the next update generates all layers
+    void clear();
+
+    bool isValid();
+    int getQuadCount();
+
+    // draws the triangles with the positions as vertex attribute 0
+    void render();
+
+private:
+    bool isOccupied(int x, int y, int z);
+    // the coordinate of the lower boundary of cell i along the axis
+    float boundary(int axis, int i);
+    void addQuad(std::vector<float> &vertices, QVector3D origin, QVector3D u, QVector3D v);
+    void buildLayer(int z);
+    void upload();
+
+    std::vector<uchar> occupancy;
+    int cellsX, cellsY, cellsZ;
+    QVector3D cellSize;
+    // the triangles of the faces of every layer of cells (3 floats per vertex)
+    std::vector<std::vector<float>> layers;
+    bool valid;
+    int vertexCount;
+
+    GLuint vao, vbo;
+};
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <QObject>
+#include <QStringList>
 
 #include "volumedata.hpp"
 #include "volumerenderprops.hpp"
+#include "volumeseries.hpp"
 
 class Scene : public QObject
 {
@@ -20,12 +22,20 @@ public:
 
     // volume rendering
     void loadVolume(QString path);
+    // loads only a region of a RAW volume, see VolumeRegion
+    void loadVolumeRegion(QString path, const VolumeRegion &region);
+    // plays the timestep files of a series in the volume, see VolumeSeries
+    bool loadVolumeSeries(QStringList paths);
+    // follows a RAW volume that is still being written or a pipe
+    void loadVolumeLive(QString path);
     VolumeData* getVolume();
+    VolumeSeries* getSeries();
     VolumeRenderProps* getVolumeRenderProps();
 
 private:
 
     // volume rendering
     VolumeData *volume;
+    VolumeSeries *series;
     VolumeRenderProps *renderProps;
 };
\ No newline at end of file
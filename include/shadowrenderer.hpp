@@ -19,6 +19,12 @@ class ShadowRenderer {
 public:
     ShadowRenderer(VolumeRenderer *volumeRenderer);
     void shadowPropsChanged();
+    // all layers of the opacity and shadow volumes are recomputed by the next update
+    void invalidate();
+    // only the voxels of the slices [zBegin, zEnd] (in texture coordinates)
+    // changed, the next update only recomputes the layers whose light rays
+    // pass these slices
+    void invalidateSlices(float zBegin, float zEnd);
     bool updateShadowVolume(PrimitiveUtils *primRenderer);
     GLuint getShadowTexture();
 
@@ -26,13 +32,17 @@ private:
     // creates empty textures with the correct size
     void updateBaseTextures();
     // calculates the local and global opacity textures
-    void renderOpacities(PrimitiveUtils *primRenderer);
+    void renderOpacities(PrimitiveUtils *primRenderer, int layerBegin, int layerEnd);
     // renders the resulting shadow volume
-    void renderShadowVolume(PrimitiveUtils *primRenderer);
+    void renderShadowVolume(PrimitiveUtils *primRenderer, int layerBegin, int layerEnd);
     // blends the light contribution from single scattering effects to the shadow volume
     void renderScattering(PrimitiveUtils *primRenderer);
-    // processes the 3D texture in the given FBO. The correct shader program has to be bound beforehand
-    void process3DTexture(QOpenGLShaderProgram *program, GLuint fbo, GLuint texture, PrimitiveUtils *primRenderer, bool blend = false);
+    // processes the layers [layerBegin, layerEnd) of the 3D texture in the given FBO.
+    // The correct shader program has to be bound beforehand
+    void process3DTexture(QOpenGLShaderProgram *program, GLuint fbo, GLuint texture, PrimitiveUtils *primRenderer,
+                          int layerBegin, int layerEnd, bool blend = false);
+    // the mip level of the volume texture that matches the shadow resolution
+    float volumeLod();
 
     int width, height, depth;
     GLuint localOpacityTex, globalOpacityTex, shadowTex;
@@ -40,6 +50,9 @@ private:
 
     QOpenGLShaderProgram *localProgram, *globalProgram, *shadowProgram, *scatteringProgram;
     float scatteringTheta, scatteringPhi;
+    // the range of layers (in texture coordinates) that have to be
+    // recomputed by the next update, all of them if it is empty
+    float dirtyBegin, dirtyEnd;
     VolumeRenderer *volumeRenderer;
 
 };
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QString>
+
+/**
+ * A volume that another process (e.g. a reconstruction service) holds in a
+ * named POSIX shared memory segment. The segment starts with a Header, the
+ * voxels follow at a page aligned offset in the byte order of the machine.
+ * Such volumes are opened with paths like "shm://name": the loader maps the
+ * voxels and uses them as the voxel store without a copy, the values are
+ * only touched for the min/max pass and the texture upload. The producer
+ * must not change the voxels while the volume is loaded.
+ *
+ * Shared memory segments are only supported on unix systems.
+ */
+class SharedVolume
+{
+public:
+    // the fixed size header at the start of a segment
+    struct Header {
+        char magic[8];          // MAGIC
+        quint32 byteOrder;      // BYTE_ORDER_MARK in the byte order of the producer
+        quint32 version;        // VERSION
+        qint32 width, height, depth;
+        float aspectX, aspectY, aspectZ;
+        char type[16];          // the voxel type tag, e.g. "uint16" (see VoxelType::fromName)
+        qint64 dataOffset;      // the start of the voxels in the segment
+        qint64 dataSize;        // the number of voxel bytes
+    };
+
+    static const char MAGIC[8];
+    static const quint32 BYTE_ORDER_MARK = 0x01020304;
+    static const quint32 VERSION = 1;
+    // the voxels start on a page boundary, so they can be mapped on their own
+    static const qint64 DATA_OFFSET = 4096;
+    static const QString PATH_PREFIX;
+
+    // true for paths of the form shm://name
+    static bool isSharedVolume(QString path);
+    // the name of the segment of a path (with a leading slash as shm_open expects it)
+    static QString segmentName(QString path);
+
+    // opens the segment, creating it with the given size if create is set.
+    // Returns the file descriptor or -1 on errors
+    static int openSegment(QString name, bool create, qint64 size = 0);
+    static bool removeSegment(QString name);
+    // reads and validates the header of the segment of a shm:// path
+    static bool readHeader(QString path, Header &header);
+
+private:
+    SharedVolume();
+};
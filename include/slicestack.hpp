@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+#include "volumeloader.hpp"
+#include "voxeltype.hpp"
+
+/**
+ * A volume stored as a directory of per-slice files. The slices are ordered
+ * by the last number in their file names, gaps in the numbering are missing
+ * slices. Supported slice formats are
+ * - binary PGM (P5) with 8 or 16 bit values
+ * - images Qt can read (e.g. PNG, 8 or 16 bit gray)
+ * - headerless RAW slices, described by a "stack.vdesc" descriptor in the
+ *   directory (see VolumeDescriptor::readSlices)
+ * The descriptor is optional for the other formats and then only provides
+ * the spacing.
+ *
+ * Every slice is decoded on its own, so the slices can be decoded in
+ * parallel directly into their place in the volume buffer.
+ */
+class SliceStack
+{
+public:
+    static const QString DESCRIPTOR_NAME;
+
+    SliceStack();
+
+    static bool isSliceStack(QString path);
+
+    // discovers the slices in the directory and reads the dimensions and
+    // the voxel type from the descriptor or the first slice
+    bool open(QString directory);
+
+    // decodes slice z in host byte order into dst (getSliceBytes() bytes).
+    // Returns false if the slice is missing or cannot be decoded
+    bool decodeSlice(int z, char *dst);
+    bool isMissing(int z);
+
+    // the header of the whole volume, dataPath is the directory
+    const VolumeLoader::Header& getHeader();
+    qint64 getSliceBytes();
+
+private:
+    enum Format { PGM, IMAGE, RAW };
+
+    // reads the header of a PGM slice, the values follow at dataOffset
+    static bool readPgmHeader(QString path, int &width, int &height, VoxelType::Type &type, qint64 &dataOffset);
+    bool decodePgm(QString path, char *dst);
+    bool decodeImage(QString path, char *dst);
+    // reads the values of a slice at offset, used for PGM slices as well
+    bool decodeRaw(QString path, qint64 offset, char *dst);
+
+    VolumeLoader::Header header;
+    Format format;
+    // the file of every slice, empty for missing slices
+    QStringList files;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QString>
+
+#include "volumeloader.hpp"
+
+/**
+ * A persistent cache of preprocessed volumes. An entry holds the voxels in
+ * native byte order together with their value range and histogram, so a
+ * warm open maps the entry without touching the voxels at all. Derived data
+ * (e.g. the volume pyramid) is stored next to the entry under the same key.
+ *
+ * The key combines a hash of sampled blocks of the file with its size and
+ * modification time, so copies of a dataset share an entry while a modified
+ * file gets a new one. When the cache grows beyond its size cap, the least
+ * recently used entries are evicted together with their derived data.
+ *
+ * Entry layout (little endian header):
+ * magic "VLCACHE1", quint32 version, qint32 width/height/depth,
+ * double aspectX/Y/Z, quint32 voxel type, double data min/max,
+ * quint32 histogram buckets, qint64 counts[buckets], quint64 voxel offset,
+ * the voxels aligned to VoxelBuffer::ALIGNMENT
+ */
+class VolumeCache
+{
+public:
+    static const qint64 DEFAULT_MAX_BYTES = Q_INT64_C(16) * 1024 * 1024 * 1024;
+    static const int HISTOGRAM_BUCKETS = 256;
+
+    VolumeCache(QString directory = defaultDirectory(), qint64 maxBytes = DEFAULT_MAX_BYTES);
+
+    // the cache directory below the user's cache location
+    static QString defaultDirectory();
+    // the key of the file at path, empty if it cannot be read. The content of
+    // a descriptor of the file is hashed as well, since it changes the volume
+    static QString key(QString path, QString descriptor = QString());
+
+    // the file of derived data with the given suffix of an entry
+    QString derivedPath(QString key, QString suffix);
+
+    // maps the voxels of the entry into result and fills its type, dimensions,
+    // value range and histogram. Marks the entry as recently used
+    bool load(QString key, VolumeLoader::Result &result);
+    // writes the loaded volume (voxels in host byte order) as entry
+    bool store(QString key, VolumeLoader::Result &result);
+    // removes the least recently used entries until the cache fits into its
+    // size cap. The entry of the given key is kept
+    void evict(QString keep);
+    // removes all entries
+    bool clear();
+
+    QString getDirectory();
+    qint64 getMaxBytes();
+
+private:
+    static const quint32 VERSION = 1;
+    // the key hashes this many blocks of SAMPLE_BYTES spread over the file
+    static const int SAMPLE_COUNT = 16;
+    static const qint64 SAMPLE_BYTES = 64 * 1024;
+
+    QString entryPath(QString key);
+
+    QString directory;
+    qint64 maxBytes;
+};
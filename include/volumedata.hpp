@@ -1,16 +1,29 @@
 #pragma once
 
 #include <QObject>
+#include <QSharedPointer>
 #include <QString>
 #include <QMatrix4x4>
+#include <QTimer>
 #ifdef WIN32
     #include <Windows.h>
 #endif
 #include <GL/gl.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "transferfunction.hpp"
+#include "volumereader.hpp"
+#include "voxelbuffer.hpp"
+#include "voxeltype.hpp"
 
 class Scene;
+class VolumeLoader;
+class BrickedVolume;
+class OccupancyGrid;
+class VolumePyramid;
 class RenderWidget;
 
 struct VolumeDataProps {
@@ -24,38 +37,260 @@ struct VolumeDataProps {
     float maxValue; // (normalized: [0,1])
 };
 
+// a box of voxels [x0, x1) x [y0, y1) x [z0, z1) of a volume file, of which
+// every stride-th voxel along each axis is loaded. An empty box (x1 <= x0)
+// stands for the whole volume
+struct VolumeRegion {
+    int x0 = 0, y0 = 0, z0 = 0;
+    int x1 = 0, y1 = 0, z1 = 0;
+    int stride = 1;
+
+    bool isWhole() const { return x1 <= x0; }
+};
+
 class VolumeData : public QObject
 {
     Q_OBJECT
 
 public:
+    // what happens to the voxels in main memory once they are in the texture:
+    // KEEP      - they stay resident
+    // RELEASE   - they are unmapped (or spilled into a file and unmapped)
+    //             shortly after the upload and mapped again when needed
+    // MAP_FILE  - they are kept as a file mapping (spilled if they were
+    //             allocated), so the system can page them out under pressure
+    enum MemoryPolicy { KEEP = 0, RELEASE = 1, MAP_FILE = 2 };
+    static const int MEMORY_POLICY_COUNT = 3;
+    static QString memoryPolicyName(MemoryPolicy policy);
+
+    // the internal format of the volume textures:
+    // AUTO_PRECISION - the most precise format of the voxel type that fits
+    //                  into the texture budget
+    // R8             - 8 bit, the range of values that occurs is quantized
+    //                  onto the full 8 bit range
+    // R16            - 16 bit normalized, native for 16 bit volumes
+    // R16F / R32F    - half and single precision floating point
+    enum TexturePrecision { AUTO_PRECISION = 0, R8 = 1, R16 = 2, R16F = 3, R32F = 4 };
+    static const int TEXTURE_PRECISION_COUNT = 5;
+    static QString texturePrecisionName(TexturePrecision precision);
+    // the bytes per texel of the format (0 for AUTO_PRECISION)
+    static int texelSize(TexturePrecision precision);
+
     VolumeData();
+    ~VolumeData();
 
+    // loads the volume on the calling thread
     void loadFrom(QString path);
+    // loads only a region of a RAW volume, the properties, the value range
+    // and the histogram are the ones of the region
+    void loadFrom(QString path, const VolumeRegion &region);
+    // loads the volume on a background thread, see loadProgress and loadFinished
+    void loadAsync(QString path);
+    void loadAsync(QString path, const VolumeRegion &region);
+    // follows a RAW volume that is still being written or a pipe on a
+    // background thread. Its slices are streamed in as they arrive, the value
+    // range and the histogram are updated with every slab
+    void loadLive(QString path);
+    bool isLoading();
+    // shows the data of a finished loader as the next step of a VolumeSeries.
+    // Steps of the same shape only replace the voxels (stepChanged)
+    void adoptStep(VolumeLoader *source);
+    // true while only the strided preview of the loading volume is available
+    bool isPreview();
+    // true while the slices of a loading slice stack are streamed in, the
+    // data is then only available through the volume texture
+    bool isStreaming();
+    // the number of slices [0, depth) of a streamed volume that are decoded
+    int getStreamedDepth();
+    // uploads the decoded slices above uploadedDepth into the volume texture
+    // of the streamed volume, returns the new uploaded depth
+    int uploadStreamedSlices(GLuint texture, int uploadedDepth);
     QString getFilePath();
+    // the loaded region of the file, whole if the complete volume was loaded
+    VolumeRegion getRegion();
+
+    // the io backend used to read the voxel data
+    void setReaderBackend(VolumeReader::Backend backend);
+    VolumeReader::Backend getReaderBackend();
+    // if enabled, RAW volumes are opened from the persistent VolumeCache
+    void setCacheEnabled(bool enabled);
+    bool isCacheEnabled();
+    void setMemoryPolicy(MemoryPolicy policy);
+    MemoryPolicy getMemoryPolicy();
+    // called by the renderers once the voxels are uploaded: allVoxels if a
+    // texture holds all of them, false if the CPU keeps reading them (brick cache)
+    void textureUploaded(bool allVoxels);
+    // textures of existing data are recreated with the new precision
+    void setTexturePrecision(TexturePrecision precision);
+    TexturePrecision getTexturePrecision();
+    // the GPU memory the textures of a volume may take with AUTO_PRECISION
+    void setTextureBudget(qint64 bytes);
+    qint64 getTextureBudget();
+    // the precision the textures of the current data are created with (never AUTO_PRECISION)
+    TexturePrecision getActivePrecision();
+    GLenum getTextureFormat();
+    // the pixel type and the size of the values that convertForTexture produces
+    GLenum getUploadType();
+    int getUploadSize();
+    // converts count voxels into their representation for the volume textures
+    // (quantized to 8 bit or as by VoxelKernels::convertForUpload)
+    void convertForTexture(const char *src, qint64 count, char *dst);
+    // the maximum number of bytes streamed to the volume texture at once
+    void setUploadSlabBytes(qint64 bytes);
+    qint64 getUploadSlabBytes();
     GLuint createTexture();
+    // a texture of the shape of the volume without any voxels, see fillTexture
+    GLuint createEmptyTexture();
+    // uploads the voxels above filledDepth into a texture of createTexture()
+    // with the current shape, at most maxBytes of them (at least one slice).
+    // Returns the new filled depth, -1 if the texture could not be filled
+    int fillTexture(GLuint texture, int filledDepth, qint64 maxBytes);
+    GLuint createReducedTexture(int factor);
+    // the texture of the maximum pyramid levels, see VolumePyramid
+    GLuint createMaxTexture();
+    // creates an RGBA8_SNORM 3D texture of the gradients of the full resolution
+    // voxels (see VoxelKernels::gradients), GL_INVALID_VALUE for streamed volumes
+    GLuint createGradientTexture();
 
     bool isReady();
+    // the voxels, mapped again if they were released
     char* getData();
+    VoxelType::Type getVoxelType();
+    // the range of values that is mapped to the normalized intensities [0,1]
+    double getDomainMin();
+    double getDomainMax();
+    // the brick metadata if the volume was loaded from a bricked file, null otherwise
+    QSharedPointer<BrickedVolume> getBricks();
+    // the reduced resolution levels of the full data, null for previews
+    QSharedPointer<VolumePyramid> getPyramid();
+    // the value ranges of the cells for the empty space skipping, null for
+    // previews and streamed volumes
+    QSharedPointer<OccupancyGrid> getOccupancyGrid();
     VolumeDataProps getProperties();
     QMatrix4x4 getNormalizeMatrix();
 
     float* createHistogram(int buckets);
 
+public slots:
+    // cancels the running load and reports it with loadFinished(false)
+    void cancelLoading();
+
+private slots:
+    void loaderProgress(int percent);
+    void loaderPreviewReady();
+    void loaderSlabReady(int depth);
+    void loaderLoaded(bool success);
+    void releaseVoxels();
+    // maps the spill file once spillThread wrote it, ignores canceled spills
+    void spillWritten(int generation, bool success);
+
 private:
+    // cancels the running load without loadFinished, for a new load or the destructor
+    void stopLoading();
+    void adopt(VolumeLoader *source, bool isPreview, bool isStep = false);
+    // shows the decoded slices of the loader until the full data is adopted
+    void adoptStream(VolumeLoader *source);
+    void dropStream();
+    GLuint uploadTexture(const char *data, int width, int height, int depth, int baseLevel, bool maximum);
+    // allocates a level of the bound texture and uploads the data unless it is
+    // null, -1 if the level is incomplete
+    qint64 uploadLevel(int level, const char *data, int width, int height, int depth);
+    // streams the slices [zBegin, zEnd) of data into a level of the bound
+    // texture, falls back to client memory if a pixel buffer cannot be mapped.
+    // Returns the uploaded bytes, -1 if the slices are incomplete
+    qint64 uploadSlices(int level, const char *data, int width, int height, int zBegin, int zEnd);
+    void updateNormalizeMatrix();
+    // resolves the texture precision for the current data and logs the
+    // texture footprint of the candidates
+    void choosePrecision(bool log = true);
+    // applies a new precision or budget to the current data
+    void updatePrecision();
+    // true if the textures hold 8 bit values quantized from the value range
+    bool isQuantized();
+    // sets the domain (the quantization window if quantized) and the normalized value range
+    void updateDomain();
+    // the voxels after mapping them again if they were released
+    char* residentData();
+    // applies MAP_FILE to newly adopted full resolution data
+    void applyMemoryPolicy();
+    // makes sure that the value range and the histogram do not need the voxels
+    void cacheDerivedData();
+    // moves allocated voxels into a file mapping, so they can be paged out.
+    // The file is written on spillThread, release pages the voxels out once
+    // the mapping is in place
+    void spillVoxels(bool release);
+    // waits for a running spill and discards its file, before the voxels change
+    void cancelSpill();
+    void pageOutVoxels();
+    // removes the spill files left behind by processes that are gone
+    static void removeStaleSpillFiles();
+
+    static const qint64 DEFAULT_UPLOAD_SLAB_BYTES = 64 * 1024 * 1024;
+    // the preview of an asynchronously loaded volume uses every n-th voxel
+    static const int PREVIEW_STRIDE = 4;
+    static const int UPLOAD_PBO_COUNT = 3;
+    // the voxels are released this long after the last upload, so all views
+    // can upload them first
+    static const int RELEASE_DELAY = 2000;
+    static const qint64 DEFAULT_TEXTURE_BUDGET = Q_INT64_C(2) * 1024 * 1024 * 1024;
+
     VolumeDataProps properties;
     QMatrix4x4 normalizeMatrix;
     bool ready;
 
-    QByteArray volumeData;
-    short byteCount;
+    VoxelBuffer volumeData;
+    VoxelType::Type voxelType;
+    // the range of values in the data and the range that
+    // is mapped to the normalized intensities [0,1]
+    double dataMin, dataMax;
+    double domainMin, domainMax;
+    VolumeReader::Backend readerBackend;
+    bool cacheEnabled;
+    qint64 uploadSlabBytes;
+    MemoryPolicy memoryPolicy;
+    QTimer *releaseTimer;
+    // the memory policy only applies to the full data of a single volume
+    bool policyApplies;
+    // the voxels are released again after a CPU pass mapped them
+    bool releaseAfterUse;
+    // the running spill into spillPath, see spillVoxels
+    std::thread spillThread;
+    std::atomic<bool> spillCanceled;
+    int spillGeneration;
+    QString spillPath;
+    bool releaseAfterSpill;
+    TexturePrecision texturePrecision;
+    TexturePrecision activePrecision;
+    qint64 textureBudget;
 
     float* histogram;
     int lastBuckets;
+    // the histogram counts computed by the loader (or taken from the cache)
+    std::vector<qint64> histogramCounts;
 
     QString filePath;
+    VolumeRegion region;
+
+    VolumeLoader *loader;
+    bool preview;
+    // the data of a streamed volume is still owned by the loader
+    bool streaming;
+    int streamedDepth;
+    QSharedPointer<BrickedVolume> bricks;
+    QSharedPointer<VolumePyramid> pyramid;
+    QSharedPointer<OccupancyGrid> occupancy;
 
 signals:
+    // the full resolution data changed
     void dataChanged();
+    // a preview of the loading volume replaced the data
+    void previewChanged();
+    // the voxels of the next step of a series replaced the data, the shape
+    // (dimensions, aspect and voxel type) did not change
+    void stepChanged();
+    // more slices of a streamed volume are decoded, see uploadStreamedSlices
+    void slicesStreamed();
+    void loadProgress(int percent);
+    void loadFinished(bool success);
 
 };
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QMap>
+#include <QString>
+
+#include "volumeloader.hpp"
+
+/**
+ * Reads detached volume headers, so headerless RAW files can be opened
+ * without rewriting them. The voxels are read (or mapped) directly at
+ * the offset the descriptor gives. Supported are
+ * - sidecar descriptors next to a RAW file (<file>.vdesc) with the
+ *   NRRD-like fields "dims", "spacing", "type", "endian", "offset" and an
+ *   optional "data" file name (defaults to the descriptor name without .vdesc)
+ * - MetaImage headers (.mhd with a detached data file, .mha with local data)
+ * - NRRD headers (.nhdr with a detached data file, .nrrd with attached data),
+ *   raw encoding or gzip encoding with a detached data file
+ * Data files may be gzip or zstd compressed, offsets then refer to the
+ * decompressed data.
+ */
+class VolumeDescriptor
+{
+public:
+    static const QString SIDECAR_SUFFIX;
+
+    // the descriptor for the volume at path: the path itself for descriptor
+    // files, the sidecar of a RAW file or an empty string if there is none
+    static QString find(QString path);
+    // fills the header from the descriptor file. The size of the data file is
+    // only checked if it is complete (and not still being written)
+    static bool read(QString path, VolumeLoader::Header &header, bool complete = true);
+    // reads a sidecar describing every slice of a SliceStack. Only width and
+    // height of "dims" are used, dataPath is set to the stack directory
+    static bool readSlices(QString path, VolumeLoader::Header &header);
+
+private:
+    VolumeDescriptor();
+
+    // headers are read line by line up to this number of lines
+    static const int MAX_HEADER_LINES = 256;
+
+    static bool readSidecar(QString path, VolumeLoader::Header &header, bool complete);
+    // the fields shared by volume and slice sidecars
+    static bool readSidecarFields(QString path, const QMap<QString, QString> &fields, VolumeLoader::Header &header);
+    static bool readMetaImage(QString path, VolumeLoader::Header &header, bool complete);
+    static bool readNrrd(QString path, VolumeLoader::Header &header, bool complete);
+
+    // reads "key<separator>value" lines until an empty line, the line of lastKey
+    // or the end of the file. Keys are lower case, the position after the
+    // header is returned in headerEnd
+    static bool readFields(QString path, QString separator, QString lastKey,
+                           QMap<QString, QString> &fields, qint64 &headerEnd);
+    // resolves the data file relative to the descriptor, handles offsets
+    // of -1 (data at the end of the file) and checks the size of complete files
+    static bool finish(QString path, QString dataFile, VolumeLoader::Header &header, bool complete);
+};
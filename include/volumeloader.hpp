@@ -0,0 +1,185 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QThread>
+
+#include <vector>
+
+#include "brickedvolume.hpp"
+#include "occupancygrid.hpp"
+#include "volumedata.hpp"
+#include "volumepyramid.hpp"
+#include "volumereader.hpp"
+#include "voxelbuffer.hpp"
+#include "voxeltype.hpp"
+
+/**
+ * Reads a volume file and prepares its data (byte order, min/max) for the
+ * VolumeData. The loading can either run synchronously with load() or on
+ * its own thread with start(). When running on its own thread, a strided low
+ * resolution preview is loaded first and announced with previewReady(), then
+ * the full resolution data is announced with loaded(). A region of a RAW
+ * volume can be loaded instead of the whole volume. Slice stacks and
+ * compressed volumes have no preview, instead their decoded slices are
+ * announced slab by slab with slabReady(). A live volume (a file that is
+ * still being written or a pipe) is followed slab by slab in the same way,
+ * together with the min/max values and the histogram of the slabs so far.
+ * Volumes in shared memory (shm://name, see SharedVolume) are mapped and
+ * used without a copy.
+ * The results are taken over by the VolumeData on its thread.
+ */
+class VolumeLoader : public QThread
+{
+    Q_OBJECT
+
+public:
+    // the header information of a volume file
+    struct Header {
+        int width, height, depth;
+        float aspectX, aspectY, aspectZ;
+        VoxelType::Type type;
+        // the file holding the voxels (the volume file itself or the data
+        // file of a descriptor), the voxels start at dataOffset
+        QString dataPath;
+        qint64 dataOffset;
+        bool bigEndian;
+    };
+
+    // one version of the loaded volume (the preview or the full data)
+    struct Result {
+        VolumeDataProps properties;
+        VoxelType::Type type;
+        // the range of values in the data and the range
+        // that is mapped to the normalized intensities
+        double dataMin, dataMax;
+        double domainMin, domainMax;
+        VoxelBuffer data;
+        // the brick metadata if the volume was read from a bricked file
+        QSharedPointer<BrickedVolume> bricks;
+        // the reduced resolution levels (only for the full data)
+        QSharedPointer<VolumePyramid> pyramid;
+        // the value ranges of the cells for the empty space skipping (only for the full data)
+        QSharedPointer<OccupancyGrid> occupancy;
+        // VolumeCache::HISTOGRAM_BUCKETS counts over [dataMin, dataMax],
+        // empty if they were not computed while loading
+        std::vector<qint64> histogram;
+        // nanoseconds spent reading the voxels (including the decompression
+        // of compressed files) and preparing them (byte order, min/max,
+        // histogram), only measured for RAW volumes
+        qint64 readTime = 0;
+        qint64 decodeTime = 0;
+    };
+
+    VolumeLoader(QString path, VolumeReader::Backend backend);
+
+    // if larger than 1, every stride-th voxel is loaded as a preview first
+    void setPreviewStride(int stride);
+    // if set, RAW volumes are opened from and stored into the VolumeCache
+    void setCacheEnabled(bool enabled);
+    // loads only a region of a RAW volume (without preview and cache), the
+    // result then describes the region alone
+    void setRegion(const VolumeRegion &region);
+    // if cleared, no pyramid is built or loaded for the full data
+    void setPyramidEnabled(bool enabled);
+    // follows a RAW volume that is still being written or read from a pipe,
+    // see loadLive (without preview, cache and region)
+    void setLive(bool live);
+
+    // loads the volume on the calling thread, returns false on errors or if canceled
+    bool load();
+    void cancel();
+    bool isCanceled();
+
+    QString getPath();
+    // the loaded region clamped to the volume, whole if there is none
+    VolumeRegion getRegion();
+    Result& getPreview();
+    Result& getResult();
+    // the value range and the histogram (VolumeCache::HISTOGRAM_BUCKETS counts
+    // over it) of the slices of a live volume that were announced so far,
+    // false before the first slab
+    bool getStreamStatistics(double &dataMin, double &dataMax, std::vector<qint64> &histogram);
+
+    // reads the header of a RAW file, its VolumeDescriptor or a SharedVolume
+    static bool parseHeader(QString path, Header &header);
+
+protected:
+    void run();
+
+private:
+    bool loadPreview(const Header &header, bool swapBytes);
+    // clamps the region to the volume, false if nothing of it is left
+    bool clampRegion(const Header &header);
+    // the header of the voxels a region of the volume consists of
+    Header regionHeader(const Header &header, const VolumeRegion &region);
+    // reads every stride-th voxel of a region of a RAW volume into target
+    bool readRegion(const Header &header, const VolumeRegion &region, VoxelBuffer &target, bool reportRead);
+    bool loadBricked();
+    // decodes the slices of a SliceStack directory in parallel
+    bool loadSliceStack();
+    // decompresses a gzip or zstd compressed volume, see CompressedReader
+    bool loadCompressed(const Header &header, bool swapBytes);
+    // reads a live volume front to back as its slices arrive, see LiveSource
+    bool loadLive();
+    // maps the voxels of a SharedVolume
+    bool loadShared();
+    // maps the volume from the cache, returns false on a cache miss. The
+    // content of the descriptor (if any) is part of the key
+    bool loadCached(QString descriptor);
+    // derives the pyramid and the occupancy grid from the full data
+    void deriveData();
+    // maps the cached pyramid of the full data or builds and caches it
+    void loadPyramid();
+    void fillProperties(Result &result, const Header &header, int stride);
+    // fills the properties, min/max and domain of a result after the data was read
+    void finishResult(Result &result, const Header &header, int stride, bool swapBytes);
+    void finishRange(Result &result);
+    void reportProgress(int percent);
+
+    // share of the progress bar used for the preview and the read of the full data
+    static const int PREVIEW_PROGRESS = 10;
+    static const int READ_PROGRESS = 70;
+    static const int PASS_PROGRESS = 10;
+    // volumes up to this size are loaded without a preview, larger
+    // volumes get a stride that keeps the preview below this size
+    static const qint64 PREVIEW_MAX_BYTES = 64 * 1024 * 1024;
+    // decoded slices of a slice stack are announced in slabs of at least this size
+    static const qint64 STREAM_SLAB_BYTES = 64 * 1024 * 1024;
+    // the RAW header of a compressed file is parsed from this many decompressed bytes
+    static const qint64 COMPRESSED_HEADER_BYTES = 4096;
+
+    QString path;
+    // the file holding the voxels, differs from path for descriptors
+    QString dataPath;
+    VolumeReader::Backend backend;
+    int previewStride;
+    bool cacheEnabled;
+    bool pyramidEnabled;
+    // the VolumeCache key of the file, empty if the cache is not used
+    QString cacheKey;
+    VolumeRegion region;
+    bool live;
+
+    // the statistics of the announced slices of a live volume
+    QMutex streamMutex;
+    bool streamStatistics;
+    double streamMin, streamMax;
+    std::vector<qint64> streamHistogram;
+
+    QAtomicInt canceled;
+    QAtomicInt lastProgress;
+
+    Result preview;
+    Result result;
+
+signals:
+    void progress(int percent);
+    void previewReady();
+    // the slices [0, depth) of the full data (getResult()) are decoded and
+    // do not change anymore. Its properties and type are set already
+    void slabReady(int depth);
+    void loaded(bool success);
+};
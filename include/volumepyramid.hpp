@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QString>
+
+#include "voxelbuffer.hpp"
+#include "voxeltype.hpp"
+
+/**
+ * A multi-resolution pyramid of a volume. Every level halves the resolution
+ * of the previous one (floor(size/2) voxels per axis like OpenGL mip levels)
+ * and stores both the average and the maximum of the 2^3 blocks. The average
+ * levels serve as mip levels of the volume texture, the maximum levels keep
+ * small bright structures visible in the maximum intensity projection.
+ *
+ * The pyramid is built in parallel and cached (next to the dataset or in
+ * the VolumeCache), so reopening a volume only maps the cache file. The cache is rebuilt if the
+ * size or modification time of the dataset changed.
+ *
+ * Cache layout (little endian header):
+ * magic "VLPYRAM1", quint32 version, quint32 byte order of the values
+ * (0 little, 1 big endian), qint64 dataset size, qint64 dataset modification
+ * time (ms since epoch), qint32 width/height/depth, quint32 voxel type,
+ * quint32 level count, per level quint64 average offset and maximum offset.
+ * The levels are aligned to VoxelBuffer::ALIGNMENT.
+ */
+class VolumePyramid
+{
+public:
+    // levels are built until the largest dimension is at most this size
+    static const int MIN_LEVEL_SIZE = 8;
+    static const int MAX_LEVELS = 16;
+
+    VolumePyramid();
+
+    // the default cache file of the dataset at path (next to the dataset)
+    static QString cachePath(QString path);
+
+    // builds the levels from the full resolution volume (in host byte order)
+    bool build(const char *data, int width, int height, int depth, VoxelType::Type type);
+    // maps the levels from the cache file of the dataset at path. Fails if
+    // there is no cache or if it does not belong to the current dataset
+    bool load(QString cacheFile, QString path, int width, int height, int depth, VoxelType::Type type);
+    // writes the levels into the cache file of the dataset at path
+    bool save(QString cacheFile, QString path);
+
+    // the number of reduced levels, level 0 is the volume itself
+    int getLevelCount();
+    int getWidth(int level);
+    int getHeight(int level);
+    int getDepth(int level);
+    VoxelType::Type getVoxelType();
+    // the data of a reduced level (1 to getLevelCount())
+    const char* getAverage(int level);
+    const char* getMaximum(int level);
+    // the number of bytes of all levels
+    qint64 getSize();
+
+private:
+    static const quint32 VERSION = 1;
+
+    void setDimensions(int width, int height, int depth, VoxelType::Type type);
+    qint64 levelSize(int level);
+
+    VoxelType::Type type;
+    int levelCount;
+    int widths[MAX_LEVELS + 1], heights[MAX_LEVELS + 1], depths[MAX_LEVELS + 1];
+    VoxelBuffer averages[MAX_LEVELS + 1], maximums[MAX_LEVELS + 1];
+};
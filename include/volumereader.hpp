@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QString>
+
+#include <functional>
+
+#include "voxelbuffer.hpp"
+
+/**
+ * The VolumeReader transfers the voxel payload of a volume file into a
+ * VoxelBuffer. Different backends suit different storage tiers:
+ * BUFFERED   - single threaded QFile reads (the previous behaviour)
+ * MMAP       - maps the file, zero copy if the data is used unmodified
+ * PARALLEL   - multi threaded chunked positioned reads (cold caches, NFS)
+ * DIRECT     - like PARALLEL but bypasses the page cache (O_DIRECT) for
+ *              very large scans that would only evict the cache anyway
+ * Every read logs its throughput so the backends can be compared.
+ */
+class VolumeReader
+{
+public:
+    enum Backend { BUFFERED = 0, MMAP = 1, PARALLEL = 2, DIRECT = 3 };
+    static const int BACKEND_COUNT = 4;
+
+    static QString backendName(Backend backend);
+
+    // called with the number of bytes read so far, possibly from several
+    // threads at once. Returning false cancels the read
+    typedef std::function<bool(qint64 bytesRead)> ProgressCallback;
+
+    // reads size bytes at offset of the file at path into target. If modify is
+    // true the caller intends to change the data in place (e.g. byte order
+    // correction), so a mapped file will be mapped copy on write
+    static bool read(Backend backend, QString path, qint64 offset, qint64 size, bool modify, VoxelBuffer &target,
+                     const ProgressCallback &progress = ProgressCallback());
+
+private:
+    VolumeReader();
+
+    static bool readBuffered(QString path, qint64 offset, qint64 size, VoxelBuffer &target, const ProgressCallback &progress);
+    static bool readMapped(QString path, qint64 offset, qint64 size, bool modify, VoxelBuffer &target, const ProgressCallback &progress);
+    static bool readParallel(QString path, qint64 offset, qint64 size, bool direct, VoxelBuffer &target, const ProgressCallback &progress);
+
+    // size of the chunks the parallel backends distribute over the threads
+    static const qint64 CHUNK_SIZE = 8 * 1024 * 1024;
+};
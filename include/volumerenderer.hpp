@@ -13,6 +13,8 @@
 
 // forward declaration
 class ShadowRenderer;
+class BrickCache;
+class ProxyGeometry;
 
 class VolumeRenderer
         : public QObject
@@ -29,11 +31,19 @@ public:
 
     void render(Camera *camera, PrimitiveUtils *primRenderer);
 
+    // called on camera interaction, coarser levels are sampled until
+    // INTERACTION_DELAY ms after the last call
+    void interacted();
+
 private:
     // the individual rendering steps
     void updateTransFuncFrom(TransferFunction *tf);
     void renderEntryExitPoints(Camera *camera, PrimitiveUtils *primRenderer);
     void renderVolume(Camera *camera, PrimitiveUtils *primRenderer);
+    void renderBrickFeedback(Camera *camera, PrimitiveUtils *primRenderer);
+    void reportSamplesPerRay(Camera *camera, PrimitiveUtils *primRenderer);
+    void setupVolumeShader(Camera *camera);
+    void setupLevelOfDetail(Camera *camera);
 
     // the connected dataset
     VolumeData *dataset;
@@ -41,11 +51,83 @@ private:
     VolumeRenderProps *renderProps;
     // volume texture
     GLuint volumeTexture;
+    bool volumeTexDirty;
+    void updateVolumeTexture();
+    bool useVirtualTexture();
+    // the pyramid level of the base level of volumeTexture (> 0 for the reduced texture)
+    int volumeTextureLevel;
+    // the maximum pyramid levels for the maximum intensity projection
+    GLuint maxVolumeTexture;
+    // the baked gradients for the Phong lighting, created when it is first needed
+    GLuint gradientTexture;
+    bool gradientDirty;
+    // the steps of a playing series use the gradients from six samples, the
+    // bake follows once the playback pauses (like the shadows)
+    bool gradientDeferred;
+    bool useGradientTexture();
+    void updateGradientTexture();
+    // logs the time of the volume pass with and without the gradient texture
+    // once per dataset after the gradients were first baked
+    bool reportGradientTiming;
+    void measureGradientTiming(Camera *camera, PrimitiveUtils *primRenderer);
+    // the slices of a streamed volume that are in volumeTexture and the
+    // normalized value range they were shadowed with
+    int streamedDepth;
+    float streamedMinValue, streamedMaxValue;
+    // the steps of a series alternate between volumeTexture and stepTexture,
+    // so a new step is not uploaded into the texture the last frames read from.
+    // stepTexture is filled over several frames, stepFilledDepth slices so far
+    GLuint stepTexture;
+    bool stepDirty;
+    int stepFilledDepth;
+    // the normalized value range of the voxels in volumeTexture. The dataset
+    // already holds the range of a step that is still being uploaded
+    float textureMinValue, textureMaxValue;
+    // the properties of the dataset with the value range of volumeTexture
+    VolumeDataProps textureProperties();
+    void updateStepTexture();
+    // the upload slabs of the next step uploaded per frame
+    static const int STEP_UPLOAD_SLABS = 2;
+
+    // the brick cache renders volumes that do not fit into a single texture,
+    // volumeTexture then holds a reduced version (at most REDUCED_TEXTURE_SIZE^3)
+    BrickCache *brickCache;
+    bool virtualTexture;
+    // the forced virtual texturing property the textures were created with
+    bool virtualForced;
+    // the rays report the bricks they need into this fbo (at a reduced resolution)
+    QOpenGLFramebufferObject *feedbackFBO;
+    int frameIndex;
+    static const int REDUCED_TEXTURE_SIZE = 256;
+    static const int FEEDBACK_DIVISOR = 4;
+    static const qint64 VIRTUAL_TEXTURE_THRESHOLD = Q_INT64_C(2) * 1024 * 1024 * 1024;
+
+    // the occupancy of the cells of the occupancy grid under the transfer
+    // function (one R8 texel per cell), the rays skip empty cells
+    GLuint occupancyTexture;
+    bool occupancyDirty;
+    bool occupancyReady;
+    void updateOccupancyTexture();
+    // the occupied cells as a mesh, the entry and exit points are rendered
+    // from it instead of the bounding cube
+    ProxyGeometry *proxyGeometry;
+    bool useProxyGeometry();
+    // the rays are intersected with the bounding box in volume.frag, the
+    // entry and exit points are only rendered for the debug modes
+    bool useAnalyticRays();
+    // logs the average samples per ray with and without skipping once per
+    // dataset, after its occupancy was first classified
+    bool reportSamples;
 
     // the connected transfer function
     TransferFunction *transFunc;
     GLuint transFuncTexture;
     bool tfTexDirty;
+    // the pre-integrated transfer function (see PreIntegrationTable), only
+    // built while the pre-integration is enabled
+    GLuint preIntegrationTexture;
+    bool preIntegrationDirty;
+    void updatePreIntegrationTexture();
 
     // screen dimensions
     int width, height;
@@ -53,7 +135,9 @@ private:
     // shader programs
     QOpenGLShaderProgram *entryExitShaderProg, *volumeShaderProg;
 
-    // FrameBuffer w. 2 color attachements for entry exit points
+    // FrameBuffer w. 2 color attachements for entry exit points and a depth
+    // attachment, so the nearest entry and the farthest exit of the proxy win.
+    // It is created on demand and not needed with the analytic ray setup
     QOpenGLFramebufferObject *entryExitFBO;
 
     // the shadow renderer takes care of all render and OpenGL operations
@@ -68,11 +152,18 @@ private:
     float scatteringTheta, scatteringPhi; // angles
     static const int SHADOW_UPDATE_DELAY = 400;
 
+    // runs while the camera is moved
+    QTimer *interactionTimer;
+    static const int INTERACTION_DELAY = 300;
+
 public slots:
     void datasetChanged();
+    void datasetSlicesStreamed();
+    void datasetStepChanged();
     void transFuncChanged();
     void shadowPropsChanged();
 
 private slots:
     void actualShadowUpdate();
+    void interactionEnded();
 };
\ No newline at end of file
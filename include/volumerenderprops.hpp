@@ -27,6 +27,19 @@ public:
     float getLightSegmentLength();
     int getScatteringStepCount();
     float getScatteringRadius();
+    // true if the volume is always rendered through the brick cache
+    bool getVirtualTexturing();
+    // true if distant parts of the volume are sampled from coarser pyramid levels
+    bool getLevelOfDetail();
+    // true if the rays are intersected with the bounding box in the shader
+    // instead of reading rendered entry and exit points (not for debug modes)
+    bool getAnalyticRays();
+    // true if the direct rendering classifies ray segments with the
+    // pre-integrated transfer function instead of single samples
+    bool getPreIntegration();
+    // true if the Phong lighting reads the normals from a precomputed gradient
+    // volume instead of computing them from six samples
+    bool getPrecomputedGradients();
 
     // getter that return normalized values
     // (useful for updating gui slider positions)
@@ -67,6 +80,11 @@ private:
     float lightOpacityBaseStep;
     int scatteringStepCount;
     float scatteringRadius;
+    bool virtualTexturing;
+    bool levelOfDetail;
+    bool analyticRays;
+    bool preIntegration;
+    bool precomputedGradients;
 
 // SLOTS ----------------- //
 public slots:
@@ -83,6 +101,11 @@ public slots:
     void setLightSegmentLength(float v);
     void setScatteringStepCount(float v);
     void setScatteringRadius(float v);
+    void setVirtualTexturing(bool v);
+    void setLevelOfDetail(bool v);
+    void setAnalyticRays(bool v);
+    void setPreIntegration(bool v);
+    void setPrecomputedGradients(bool v);
 
 private slots:
     void transFuncChangedSlot();
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+
+#include <vector>
+
+#include "volumeloader.hpp"
+
+class VolumeData;
+
+/**
+ * A time series of volumes (one file per timestep) that is played back in a
+ * VolumeData. The steps following the shown one are loaded on background
+ * threads into a bounded ring of RING_SIZE slots, so the next step is
+ * usually ready when the playback timer asks for it. A step that is not
+ * loaded in time is a dropped frame: the shown step stays until the next
+ * tick. All steps must have the shape of the first one, so the renderers
+ * only refill their textures (VolumeData::stepChanged).
+ *
+ * The read and the decode time (byte order, min/max, histogram) of every
+ * step are logged, the dropped frames are summed up when the playback stops.
+ */
+class VolumeSeries : public QObject
+{
+    Q_OBJECT
+
+public:
+    VolumeSeries(VolumeData *volume);
+    ~VolumeSeries();
+
+    // indexes the timestep files (ordered naturally by their names) and
+    // shows the first step as soon as it is loaded
+    bool open(QStringList paths);
+    // stops the playback and releases the prefetched steps
+    void close();
+    bool isOpen();
+
+    int getStepCount();
+    // the step that is shown, -1 before the first one is loaded
+    int getStep();
+    // shows the given step as soon as it is loaded
+    void setStep(int step);
+
+    void play();
+    void stop();
+    bool isPlaying();
+    void setTargetFps(double fps);
+    double getTargetFps();
+    int getDroppedFrames();
+
+signals:
+    // a new step replaced the data of the volume
+    void stepShown(int step);
+    // a series was opened or closed
+    void openChanged(bool open);
+
+private slots:
+    void nextFrame();
+    void stepLoaded(bool success);
+
+private:
+    // a slot of the prefetch ring, free if loader is null
+    struct Slot {
+        int step;
+        VolumeLoader *loader;
+        bool loaded, failed;
+    };
+
+    // fills the free slots with loaders for the steps starting at nextStep
+    void prefetch();
+    // cancels the loader of the slot and frees it
+    void release(Slot &slot);
+    Slot* findSlot(int step);
+    // shows the step of a loaded slot and frees the slot
+    void show(Slot &slot);
+    void logStatistics();
+
+    static const int RING_SIZE = 4;
+
+    VolumeData *volume;
+    QStringList paths;
+    std::vector<Slot> ring;
+    // the shown step and the one that is shown next
+    int shownStep, nextStep;
+    // nextStep is shown as soon as it is loaded (after setStep)
+    bool seeking;
+
+    QTimer *timer;
+    double targetFps;
+    // statistics of the current playback
+    int shownFrames, droppedFrames;
+    qint64 readTime, decodeTime;
+    int timedSteps;
+};
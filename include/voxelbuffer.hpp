@@ -0,0 +1,85 @@
+#pragma once
+
+#include <QString>
+
+#include <atomic>
+
+class QFile;
+
+/**
+ * Storage for the raw voxel data of a volume. The memory is either
+ * allocated on the heap (page aligned, so it can be used for unbuffered
+ * reads), a memory mapping of a file region or of a shared memory segment
+ * (see SharedVolume). Sizes are 64 bit so the
+ * buffer is not limited by the 2 GiB cap of QByteArray.
+ *
+ * Mappings that are no private copy can be paged out (unmapped) and mapped
+ * again later. Allocated data can be spilled into a file to make it pageable.
+ */
+class VoxelBuffer
+{
+public:
+    static const qint64 ALIGNMENT = 4096;
+
+    VoxelBuffer();
+    ~VoxelBuffer();
+
+    // allocates size bytes. The returned data pointer is preceded by lead
+    // bytes of padding so (data() - lead) is aligned to ALIGNMENT
+    bool allocate(qint64 size, qint64 lead = 0);
+    // maps size bytes starting at offset of the given file. A private
+    // mapping is copy on write and may be modified without touching the file
+    bool map(QString path, qint64 offset, qint64 size, bool privateCopy);
+    // maps size bytes starting at offset of a named shared memory segment,
+    // read only unless a private copy on write mapping is requested
+    bool mapSharedMemory(QString name, qint64 offset, qint64 size, bool privateCopy);
+    void release();
+
+    // writes allocated data into a new file at path. Only reads the data, so it
+    // may run on another thread while the data is not released or modified.
+    // The file is removed if the write fails or is canceled
+    bool writeSpillFile(QString path, const std::atomic<bool> &canceled);
+    // maps a file of writeSpillFile instead of the allocated data, so the data
+    // can be paged out. The file is removed when the buffer is released
+    bool mapSpillFile(QString path);
+    // true for mappings that can be paged out (files and shared memory that
+    // are not mapped as private copy)
+    bool isPageable();
+    // unmaps the data of a pageable buffer, data() is null until pageIn()
+    bool pageOut();
+    bool pageIn();
+    bool isPagedOut();
+
+    // null while the data is paged out
+    char* data();
+    qint64 size();
+    bool isEmpty();
+    bool isMapped();
+
+    // exchanges the contents with other (used to swap in fully loaded data)
+    void swap(VoxelBuffer &other);
+
+private:
+    // maps the shared memory segment sharedName as described by the members
+    bool mapSegment();
+
+    // the data is written to the spill file in chunks of this size
+    static const qint64 SPILL_CHUNK = 64 * 1024 * 1024;
+
+    VoxelBuffer(const VoxelBuffer&) = delete;
+    VoxelBuffer& operator=(const VoxelBuffer&) = delete;
+
+    char *base;     // start of the allocation or mapping
+    char *ptr;      // start of the voxel data
+    qint64 bytes;
+    QFile *mappedFile;
+    // the length of the mapping of a shared memory segment, 0 otherwise
+    qint64 sharedLength;
+    // what is needed to map the data again after it was paged out
+    QString sharedName;
+    qint64 mappedOffset;
+    bool privateMapping;
+    bool pagedOut;
+    // the mapped file was written by spill()
+    bool spilled;
+};
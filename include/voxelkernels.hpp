@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QString>
+
+#include <vector>
+
+#include "voxeltype.hpp"
+
+/**
+ * CPU kernels for the passes over the voxel data that are executed while
+ * loading a volume. Each kernel is instantiated for every VoxelType so the
+ * inner loops are plain typed loads. The kernels run multi threaded and use
+ * SSE2/SSE4.1 or AVX2 if the compiler targets them (see VOLLIGHT_AVX2 in
+ * CMakeLists.txt), otherwise a scalar fallback is used.
+ */
+class VoxelKernels
+{
+public:
+    // the instruction set the kernels were compiled for
+    static QString instructionSet();
+
+    // converts count values from big endian to the machine byte order if swap
+    // is set and determines the minimum and maximum value in the same pass
+    static void swapMinMax(char *data, qint64 count, VoxelType::Type type, bool swap, double &minV, double &maxV);
+
+    // counts the values into the given number of buckets spread over [minV, maxV]
+    static void histogram(const char *data, qint64 count, VoxelType::Type type, double minV, double maxV, int buckets, std::vector<qint64> &counts);
+
+    // converts count values to their upload representation (see VoxelType::uploadType)
+    // in dst. Floating point values in [domainMin, domainMax] are mapped to [0,1]
+    static void convertForUpload(const char *src, qint64 count, VoxelType::Type type, double domainMin, double domainMax, char *dst);
+
+    // quantizes count values to 8 bit in dst, [windowMin, windowMax] is mapped to [0,255]
+    static void quantize(const char *src, qint64 count, VoxelType::Type type, double windowMin, double windowMax, char *dst);
+
+    // averages blocks of factor^3 values of the width x height x depth volume
+    // (or takes their maximum) into dst, which has to hold floor(width/factor) x ...
+    // values (at least one per axis, the last block of each axis is larger)
+    static void downsample(const char *src, int width, int height, int depth, VoxelType::Type type, int factor, bool maximum, char *dst);
+
+    // the largest gradient magnitude the gradient volume can represent: a
+    // step over the whole value range between two neighbours along every axis
+    static const float GRADIENT_MAGNITUDE_MAX;
+    // computes the gradients of the width x height x depth volume with central
+    // differences (one sided at the borders) in units of [rangeMin, rangeMax]
+    // per voxel spacing, the spacing is the voxel aspect divided by its smallest
+    // component. dst receives four signed bytes per voxel (RGBA8_SNORM): the
+    // normalized direction in xyz (0 for a zero gradient) and
+    // sqrt(magnitude / GRADIENT_MAGNITUDE_MAX) in w. With the value range of
+    // the data, w does not depend on how much of the voxel type it uses
+    static void gradients(const char *src, int width, int height, int depth, VoxelType::Type type, double rangeMin,
+                          double rangeMax, float aspectX, float aspectY, float aspectZ, char *dst);
+
+private:
+    VoxelKernels();
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <QString>
+
+#include <vector>
+
+#include "voxeltype.hpp"
+
+/**
+ * The order in which the voxels of a volume are stored in memory. LINEAR is
+ * the x fastest order of the files and the textures. MORTON_BRICKS stores
+ * bricks of BRICK_SIZE^3 voxels one after the other (x fastest over the
+ * bricks) and the voxels of a brick in Morton (Z-)order, so the neighbours of
+ * a voxel along all three axes are close in memory. Passes that access
+ * neighbourhoods (gradients, filters, ray marching on the CPU) then touch far
+ * fewer cache lines than along z in the linear order.
+ *
+ * The index of a voxel is the sum of one table entry per axis, because the
+ * bits of the brick coordinates and of the Morton code are disjoint. The same
+ * VoxelAccessor therefore reads both layouts without branches.
+ */
+class VoxelLayout
+{
+public:
+    enum Type { LINEAR = 0, MORTON_BRICKS = 1 };
+    static const int LAYOUT_COUNT = 2;
+    static QString name(Type type);
+
+    // bricks have 2^BRICK_BITS voxels per axis (512 voxels)
+    static const int BRICK_BITS = 3;
+    static const int BRICK_SIZE = 1 << BRICK_BITS;
+
+    VoxelLayout();
+    VoxelLayout(Type type, int width, int height, int depth);
+
+    Type getType() const;
+    int getWidth() const;
+    int getHeight() const;
+    int getDepth() const;
+    // the number of values stored, including the padding of the bricks at the borders
+    qint64 getVoxelCount() const;
+
+    // the position of voxel (x, y, z) in the data of this layout
+    qint64 index(int x, int y, int z) const {
+        return xOffsets[x] + yOffsets[y] + zOffsets[z];
+    }
+    const qint64* getXOffsets() const;
+    const qint64* getYOffsets() const;
+    const qint64* getZOffsets() const;
+
+    // reorders the linear voxels of src into dst (getVoxelCount() values) in
+    // parallel. The padding of the border bricks is filled with zeros
+    void fromLinear(const char *src, VoxelType::Type type, char *dst) const;
+
+private:
+    Type type;
+    int width, height, depth;
+    qint64 voxelCount;
+    std::vector<qint64> xOffsets, yOffsets, zOffsets;
+};
+
+/**
+ * Reads the voxels of type T stored in a VoxelLayout by their coordinates.
+ * The accessor only holds pointers, the data and the layout have to outlive it.
+ */
+template<typename T>
+class VoxelAccessor
+{
+public:
+    VoxelAccessor(const char *data, const VoxelLayout &layout)
+        : data(reinterpret_cast<const T*>(data)), xOffsets(layout.getXOffsets()), yOffsets(layout.getYOffsets()),
+          zOffsets(layout.getZOffsets()), width(layout.getWidth()), height(layout.getHeight()), depth(layout.getDepth())
+    {
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getDepth() const { return depth; }
+
+    T at(int x, int y, int z) const {
+        return data[xOffsets[x] + yOffsets[y] + zOffsets[z]];
+    }
+
+    // repeats the border voxels outside of the volume
+    T clampedAt(int x, int y, int z) const {
+        return at(qBound(0, x, width - 1), qBound(0, y, height - 1), qBound(0, z, depth - 1));
+    }
+
+    // trilinear interpolation at the voxel coordinates (x, y, z), voxel
+    // centers are at integer coordinates
+    float sample(float x, float y, float z) const {
+        x = qBound(0.f, x, width - 1.f);
+        y = qBound(0.f, y, height - 1.f);
+        z = qBound(0.f, z, depth - 1.f);
+        int x0 = static_cast<int>(x), y0 = static_cast<int>(y), z0 = static_cast<int>(z);
+        int x1 = qMin(x0 + 1, width - 1), y1 = qMin(y0 + 1, height - 1), z1 = qMin(z0 + 1, depth - 1);
+        float fx = x - x0, fy = y - y0, fz = z - z0;
+        float c00 = lerp(at(x0, y0, z0), at(x1, y0, z0), fx);
+        float c10 = lerp(at(x0, y1, z0), at(x1, y1, z0), fx);
+        float c01 = lerp(at(x0, y0, z1), at(x1, y0, z1), fx);
+        float c11 = lerp(at(x0, y1, z1), at(x1, y1, z1), fx);
+        return lerp(lerp(c00, c10, fy), lerp(c01, c11, fy), fz);
+    }
+
+private:
+    static float lerp(float a, float b, float t) {
+        return a + (b - a) * t;
+    }
+
+    const T *data;
+    const qint64 *xOffsets, *yOffsets, *zOffsets;
+    int width, height, depth;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <QString>
+#ifdef WIN32
+    #include <Windows.h>
+#endif
+#include <GL/gl.h>
+
+#include <utility>
+
+/**
+ * The scalar types a volume can be stored in. The type is given as tag
+ * in the first header line of a volume file (e.g. "512 512 300 int16").
+ * Files without tag are interpreted as unsigned values with the number of
+ * bytes per value derived from the file size.
+ */
+class VoxelType
+{
+public:
+    enum Type { UINT8 = 0, UINT16 = 1, UINT32 = 2, INT16 = 3, FLOAT32 = 4 };
+    static const int TYPE_COUNT = 5;
+
+    static int size(Type type);
+    static QString name(Type type);
+    // parses a header tag like "uint16" or "int16", returns false for unknown tags
+    static bool fromName(QString name, Type &type);
+    // the unsigned type with the given number of bytes per value
+    static bool fromSize(int bytes, Type &type);
+
+    // the range of values that is mapped to the normalized intensity [0,1].
+    // Integer types use their full domain, floating point volumes the range
+    // of values that actually occurs (dataMin/dataMax)
+    static void domain(Type type, double dataMin, double dataMax, double &domainMin, double &domainMax);
+
+    // the OpenGL type of the values after VoxelKernels::convertForUpload
+    static GLenum uploadType(Type type);
+    // the size of a value after VoxelKernels::convertForUpload
+    static int uploadSize(Type type);
+    // true if the values have to be converted before they can be uploaded
+    // to a normalized texture (signed and floating point values)
+    static bool needsUploadConversion(Type type);
+    // the number of z slices of sliceBytes each that an upload slab of at
+    // most maxBytes holds, at least one and at most depth
+    static int uploadSlabDepth(qint64 sliceBytes, qint64 maxBytes, int depth);
+
+private:
+    VoxelType();
+};
+
+/**
+ * Compile time information about the C++ type used for a voxel type.
+ */
+template<typename T> struct VoxelTraits;
+
+template<> struct VoxelTraits<quint8> {
+    static const VoxelType::Type type = VoxelType::UINT8;
+};
+
+template<> struct VoxelTraits<quint16> {
+    static const VoxelType::Type type = VoxelType::UINT16;
+};
+
+template<> struct VoxelTraits<quint32> {
+    static const VoxelType::Type type = VoxelType::UINT32;
+};
+
+template<> struct VoxelTraits<qint16> {
+    static const VoxelType::Type type = VoxelType::INT16;
+};
+
+template<> struct VoxelTraits<float> {
+    static const VoxelType::Type type = VoxelType::FLOAT32;
+};
+
+/**
+ * Calls Kernel<T>::run(args...) with T being the C++ type of the given voxel
+ * type, so the runtime type is only switched on once per pass and the inner
+ * loops of the kernels work on typed values.
+ */
+template<template<typename> class Kernel, typename... Args>
+void dispatchVoxelType(VoxelType::Type type, Args&&... args) {
+    switch(type) {
+    case VoxelType::UINT8:
+        Kernel<quint8>::run(std::forward<Args>(args)...);
+        break;
+    case VoxelType::UINT16:
+        Kernel<quint16>::run(std::forward<Args>(args)...);
+        break;
+    case VoxelType::UINT32:
+        Kernel<quint32>::run(std::forward<Args>(args)...);
+        break;
+    case VoxelType::INT16:
+        Kernel<qint16>::run(std::forward<Args>(args)...);
+        break;
+    case VoxelType::FLOAT32:
+        Kernel<float>::run(std::forward<Args>(args)...);
+        break;
+    }
+}
@@ -0,0 +1,353 @@
+#include "brickcache.hpp"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "brickedvolume.hpp"
+#include "glutils.hpp"
+#include "parallel.hpp"
+#include "voxelkernels.hpp"
+
+BrickCache::BrickCache(VolumeData *volume, qint64 budgetBytes, qint64 uploadBytesPerFrame)
+{
+    this->volume = volume;
+    this->budgetBytes = budgetBytes;
+    this->uploadBytesPerFrame = uploadBytesPerFrame;
+    atlasTexture = GL_INVALID_VALUE;
+    pageTableTexture = GL_INVALID_VALUE;
+    pageTableDirty = true;
+    frame = 0;
+
+    // bricked files define the brick size, so their metadata can be used
+    QSharedPointer<BrickedVolume> bricks = volume->getBricks();
+    brickSize = bricks.isNull() ? DEFAULT_BRICK_SIZE : bricks->getBrickSize();
+    // every slot has a border of one voxel for the trilinear interpolation
+    slotSize = brickSize + 2;
+
+    VolumeDataProps props = volume->getProperties();
+    bricksX = (props.width + brickSize - 1) / brickSize;
+    bricksY = (props.height + brickSize - 1) / brickSize;
+    bricksZ = (props.depth + brickSize - 1) / brickSize;
+    int brickCount = bricksX * bricksY * bricksZ;
+
+    // arrange as many slots as the budget allows (but not more than there are bricks)
+    QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
+    GLint maxSize = 0;
+    glF->glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+    int maxSlots = qMax(1, maxSize / slotSize);
+    // the atlas uses the same internal format as the volume texture
+    qint64 slotBytes = static_cast<qint64>(slotSize) * slotSize * slotSize * VolumeData::texelSize(volume->getActivePrecision());
+    qint64 slotCount = qBound(Q_INT64_C(1), budgetBytes / slotBytes, static_cast<qint64>(brickCount));
+    slotsX = qBound(1, static_cast<int>(std::ceil(std::cbrt(static_cast<double>(slotCount)))), maxSlots);
+    slotsY = qBound(1, static_cast<int>((slotCount + slotsX - 1) / slotsX), slotsX);
+    slotsZ = qBound(1, static_cast<int>(slotCount / (static_cast<qint64>(slotsX) * slotsY)), maxSlots);
+    slotCount = static_cast<qint64>(slotsX) * slotsY * slotsZ;
+
+    // create the atlas
+    glF->glActiveTexture(GL_TEXTURE0);
+    glF->glGenTextures(1, &atlasTexture);
+    glF->glBindTexture(GL_TEXTURE_3D, atlasTexture);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glF->glTexImage3D(GL_TEXTURE_3D, 0, volume->getTextureFormat(), slotsX * slotSize, slotsY * slotSize, slotsZ * slotSize,
+                      0, GL_RED, volume->getUploadType(), nullptr);
+
+    // create the page table, integer textures must not be filtered
+    glF->glGenTextures(1, &pageTableTexture);
+    glF->glBindTexture(GL_TEXTURE_3D, pageTableTexture);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glF->glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16UI, bricksX, bricksY, bricksZ,
+                      0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+    glF->glBindTexture(GL_TEXTURE_3D, 0);
+
+    QString err = GLUtils::glError();
+    if(!err.isEmpty())
+        qWarning() << "Brick cache texture errors:" << err;
+
+    pageTable.assign(static_cast<size_t>(brickCount) * 4, 0);
+    lruPos.resize(brickCount);
+    brickSlot.assign(brickCount, -1);
+    brickFrame.assign(brickCount, -1);
+    slotBrick.assign(slotCount, -1);
+    for(int i = static_cast<int>(slotCount) - 1; i >= 0; i--)
+        freeSlots.push_back(i);
+    brickVisible.assign(brickCount, true);
+    computeBrickRanges();
+    uploadPageTable();
+
+    qInfo() << "Brick cache:" << brickCount << "bricks of" << brickSize << "^3," << slotCount << "slots ("
+            << slotsX << slotsY << slotsZ << ")," << slotCount * slotBytes / (1024.0 * 1024.0) << "MiB atlas";
+}
+
+BrickCache::~BrickCache() {
+    if(atlasTexture != GL_INVALID_VALUE)
+        GLUtils::glFunc()->glDeleteTextures(1, &atlasTexture);
+    if(pageTableTexture != GL_INVALID_VALUE)
+        GLUtils::glFunc()->glDeleteTextures(1, &pageTableTexture);
+}
+
+bool BrickCache::isValid() {
+    return atlasTexture != GL_INVALID_VALUE && pageTableTexture != GL_INVALID_VALUE && volume->getData() != nullptr;
+}
+
+/**
+ * Determines the normalized value range of every brick. Bricked files
+ * store it in their metadata, otherwise the bricks are scanned in parallel.
+ */
+void BrickCache::computeBrickRanges() {
+    int brickCount = bricksX * bricksY * bricksZ;
+    std::vector<double> minV(brickCount), maxV(brickCount);
+
+    QSharedPointer<BrickedVolume> bricks = volume->getBricks();
+    if(!bricks.isNull()) {
+        for(int i = 0; i < brickCount; i++) {
+            minV[i] = bricks->getBrick(i).minValue;
+            maxV[i] = bricks->getBrick(i).maxValue;
+        }
+    } else {
+        QElapsedTimer timer;
+        timer.start();
+        VolumeDataProps props = volume->getProperties();
+        VoxelType::Type type = volume->getVoxelType();
+        const int bytes = VoxelType::size(type);
+        const char *data = volume->getData();
+        Parallel::forRange(brickCount, 1, [&](qint64 begin, qint64 end, int) {
+            std::vector<char> brick(static_cast<size_t>(brickSize) * brickSize * brickSize * bytes);
+            for(qint64 i = begin; i < end; i++) {
+                int bx = static_cast<int>(i % bricksX), by = static_cast<int>((i / bricksX) % bricksY);
+                int bz = static_cast<int>(i / (bricksX * bricksY));
+                int ox = bx * brickSize, oy = by * brickSize, oz = bz * brickSize;
+                int ex = qMin(brickSize, props.width - ox), ey = qMin(brickSize, props.height - oy);
+                int ez = qMin(brickSize, props.depth - oz);
+                qint64 rowBytes = static_cast<qint64>(ex) * bytes;
+                for(int z = 0; z < ez; z++)
+                    for(int y = 0; y < ey; y++)
+                        memcpy(brick.data() + (static_cast<qint64>(z) * ey + y) * rowBytes,
+                               data + ((static_cast<qint64>(oz + z) * props.height + oy + y) * props.width + ox) * bytes, rowBytes);
+                VoxelKernels::swapMinMax(brick.data(), static_cast<qint64>(ex) * ey * ez, type, false, minV[i], maxV[i]);
+            }
+        });
+        qInfo() << "Brick min/max pass took" << timer.elapsed() << "ms";
+    }
+
+    double domainMin = volume->getDomainMin(), domainMax = volume->getDomainMax();
+    brickMin.resize(brickCount);
+    brickMax.resize(brickCount);
+    for(int i = 0; i < brickCount; i++) {
+        brickMin[i] = static_cast<float>((minV[i] - domainMin) / (domainMax - domainMin));
+        brickMax[i] = static_cast<float>((maxV[i] - domainMin) / (domainMax - domainMin));
+    }
+}
+
+void BrickCache::setTransferFunction(TransferFunction *tf) {
+    float *data = tf->toData();
+    int size = tf->getSize();
+    VolumeDataProps props = volume->getProperties();
+
+    // the same mapping of intensities to the transfer function as in volume.frag
+    int empty = 0;
+    for(size_t i = 0; i < brickVisible.size(); i++) {
+        float c0 = brickMin[i] / (props.maxValue - props.minValue) + props.minValue;
+        float c1 = brickMax[i] / (props.maxValue - props.minValue) + props.minValue;
+        // include the neighbouring entries used by the linear filtering
+        int i0 = qBound(0, static_cast<int>(std::floor(c0 * size - 0.5f)), size - 1);
+        int i1 = qBound(0, static_cast<int>(std::ceil(c1 * size - 0.5f)), size - 1);
+        bool visible = false;
+        for(int j = i0; j <= i1 && !visible; j++)
+            visible = data[j * 4 + 3] > 0.f;
+        brickVisible[i] = visible;
+        if(!visible)
+            empty++;
+
+        // resident bricks stay in the atlas until they are evicted
+        if(brickSlot[i] < 0)
+            pageTable[i * 4 + 3] = visible ? MISSING : EMPTY;
+    }
+    delete[] data;
+    pageTableDirty = true;
+    qInfo() << "Brick cache:" << empty << "of" << brickVisible.size() << "bricks are empty under the transfer function";
+}
+
+bool BrickCache::update(const std::vector<uchar> &feedback) {
+    frame++;
+    int brickCount = bricksX * bricksY * bricksZ;
+
+    // decode the feedback: count the pixels requesting each missing brick
+    std::vector<int> requests(brickCount, 0);
+    int hits = 0, misses = 0;
+    for(size_t i = 0; i + 3 < feedback.size(); i += 4) {
+        int state = feedback[i + 3];
+        if(state == 0)
+            continue;
+        int brick = feedback[i] | (feedback[i + 1] << 8) | (feedback[i + 2] << 16);
+        if(brick >= brickCount)
+            continue;
+        if(brickSlot[brick] >= 0) {
+            if(brickFrame[brick] != frame)
+                hits++;
+            touch(brick);
+        } else if(brickVisible[brick]) {
+            if(requests[brick]++ == 0)
+                misses++;
+        }
+    }
+
+    // the bricks requested by most pixels are loaded first
+    std::vector<int> missing;
+    missing.reserve(misses);
+    for(int i = 0; i < brickCount; i++)
+        if(requests[i] > 0)
+            missing.push_back(i);
+    std::sort(missing.begin(), missing.end(), [&](int a, int b) { return requests[a] > requests[b]; });
+
+    // assign slots within the upload budget, evicting the least recently used bricks
+    const qint64 slotVoxels = static_cast<qint64>(slotSize) * slotSize * slotSize;
+    const qint64 uploadBytes = slotVoxels * volume->getUploadSize();
+    const int maxUploads = static_cast<int>(qMax(Q_INT64_C(1), uploadBytesPerFrame / uploadBytes));
+    std::vector<int> load;
+    int evicted = 0;
+    // set if the remaining bricks have to wait until resident ones are no longer used
+    bool full = false;
+    for(int brick : missing) {
+        if(static_cast<int>(load.size()) >= maxUploads)
+            break;
+        int slot;
+        if(!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            // bricks used in this frame are not evicted, the cache is full
+            int victim = lru.back();
+            if(brickFrame[victim] == frame) {
+                full = true;
+                break;
+            }
+            lru.pop_back();
+            slot = brickSlot[victim];
+            brickSlot[victim] = -1;
+            pageTable[victim * 4 + 3] = brickVisible[victim] ? MISSING : EMPTY;
+            evicted++;
+        }
+        slotBrick[slot] = brick;
+        brickSlot[brick] = slot;
+        load.push_back(brick);
+    }
+
+    // gather the bricks in parallel and upload them into their slots
+    if(!load.empty()) {
+        QElapsedTimer timer;
+        timer.start();
+        staging.resize(load.size() * uploadBytes);
+        const int bytes = VoxelType::size(volume->getVoxelType());
+        Parallel::forRange(load.size(), 1, [&](qint64 begin, qint64 end, int) {
+            std::vector<char> scratch(slotVoxels * bytes);
+            for(qint64 i = begin; i < end; i++)
+                gatherBrick(load[i], scratch.data(), staging.data() + i * uploadBytes);
+        });
+        qint64 gatherTime = timer.nsecsElapsed();
+
+        QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
+        glF->glActiveTexture(GL_TEXTURE0);
+        glF->glBindTexture(GL_TEXTURE_3D, atlasTexture);
+        glF->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for(size_t i = 0; i < load.size(); i++) {
+            int brick = load[i], slot = brickSlot[brick];
+            int sx = slot % slotsX, sy = (slot / slotsX) % slotsY, sz = slot / (slotsX * slotsY);
+            glF->glTexSubImage3D(GL_TEXTURE_3D, 0, sx * slotSize, sy * slotSize, sz * slotSize,
+                                 slotSize, slotSize, slotSize, GL_RED, volume->getUploadType(),
+                                 staging.data() + i * uploadBytes);
+            pageTable[brick * 4 + 0] = static_cast<quint16>(sx);
+            pageTable[brick * 4 + 1] = static_cast<quint16>(sy);
+            pageTable[brick * 4 + 2] = static_cast<quint16>(sz);
+            pageTable[brick * 4 + 3] = RESIDENT;
+            lru.push_front(brick);
+            lruPos[brick] = lru.begin();
+            brickFrame[brick] = frame;
+        }
+        glF->glBindTexture(GL_TEXTURE_3D, 0);
+        pageTableDirty = true;
+
+        qInfo() << "Brick cache frame" << frame << ": hits" << hits << "misses" << misses << "uploaded" << load.size()
+                << "bricks, gather" << gatherTime / 1e6 << "ms, submit" << (timer.nsecsElapsed() - gatherTime) / 1e6
+                << "ms, evicted" << evicted << "resident" << lru.size() << "/" << slotBrick.size();
+    }
+    uploadPageTable();
+
+    // another frame only helps if it can load more bricks: the upload budget
+    // was used up, not the slots of the bricks the rays need right now
+    return !load.empty() || (static_cast<int>(load.size()) < misses && !full);
+}
+
+void BrickCache::bind(QOpenGLShaderProgram *prog, int pageTableUnit, int atlasUnit) {
+    VolumeDataProps props = volume->getProperties();
+    prog->setUniformValue("virtualTexture", true);
+    prog->setUniformValue("pageTable", pageTableUnit);
+    prog->setUniformValue("brickAtlas", atlasUnit);
+    prog->setUniformValue("volumeSize", QVector3D(props.width, props.height, props.depth));
+    prog->setUniformValue("brickSize", static_cast<float>(brickSize));
+    prog->setUniformValue("atlasSize", QVector3D(slotsX * slotSize, slotsY * slotSize, slotsZ * slotSize));
+
+    QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
+    glF->glActiveTexture(GL_TEXTURE0 + pageTableUnit);
+    glF->glBindTexture(GL_TEXTURE_3D, pageTableTexture);
+    glF->glActiveTexture(GL_TEXTURE0 + atlasUnit);
+    glF->glBindTexture(GL_TEXTURE_3D, atlasTexture);
+}
+
+void BrickCache::uploadPageTable() {
+    if(!pageTableDirty)
+        return;
+    QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
+    glF->glActiveTexture(GL_TEXTURE0);
+    glF->glBindTexture(GL_TEXTURE_3D, pageTableTexture);
+    glF->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glF->glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, bricksX, bricksY, bricksZ,
+                         GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, pageTable.data());
+    glF->glBindTexture(GL_TEXTURE_3D, 0);
+    pageTableDirty = false;
+}
+
+void BrickCache::touch(int brick) {
+    brickFrame[brick] = frame;
+    lru.splice(lru.begin(), lru, lruPos[brick]);
+}
+
+void BrickCache::gatherBrick(int brick, char *scratch, char *dst) {
+    VolumeDataProps props = volume->getProperties();
+    VoxelType::Type type = volume->getVoxelType();
+    const int bytes = VoxelType::size(type);
+    const char *data = volume->getData();
+
+    int bx = brick % bricksX, by = (brick / bricksX) % bricksY, bz = brick / (bricksX * bricksY);
+    // first voxel of the slot including the border
+    int ox = bx * brickSize - 1, oy = by * brickSize - 1, oz = bz * brickSize - 1;
+    // the part of the slot rows inside the volume, the rest repeats the edge voxels
+    int x0 = qMax(ox, 0), x1 = qMin(ox + slotSize, props.width) - 1;
+
+    char *out = scratch;
+    for(int z = 0; z < slotSize; z++) {
+        qint64 sz = qBound(0, oz + z, props.depth - 1);
+        for(int y = 0; y < slotSize; y++, out += slotSize * bytes) {
+            qint64 sy = qBound(0, oy + y, props.height - 1);
+            const char *row = data + (sz * props.height + sy) * props.width * bytes;
+            memcpy(out + (x0 - ox) * bytes, row + static_cast<qint64>(x0) * bytes, static_cast<size_t>(x1 - x0 + 1) * bytes);
+            for(int x = 0; x < x0 - ox; x++)
+                memcpy(out + x * bytes, row + static_cast<qint64>(x0) * bytes, bytes);
+            for(int x = x1 - ox + 1; x < slotSize; x++)
+                memcpy(out + x * bytes, row + static_cast<qint64>(x1) * bytes, bytes);
+        }
+    }
+
+    volume->convertForTexture(scratch, static_cast<qint64>(slotSize) * slotSize * slotSize, dst);
+}
@@ -0,0 +1,413 @@
+#include "brickedvolume.hpp"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+#include "parallel.hpp"
+#include "volumeloader.hpp"
+#include "voxelkernels.hpp"
+
+namespace {
+
+const char MAGIC[8] = { 'V', 'L', 'B', 'R', 'I', 'C', 'K', '1' };
+// byte position of the index offset in the header
+const qint64 INDEX_OFFSET_POS = 80;
+
+quint32 crc32(const char *data, qint64 size) {
+    static const std::vector<quint32> table = [] {
+        std::vector<quint32> t(256);
+        for(quint32 i = 0; i < 256; i++) {
+            quint32 c = i;
+            for(int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    quint32 crc = 0xFFFFFFFFu;
+    const uchar *d = reinterpret_cast<const uchar*>(data);
+    for(qint64 i = 0; i < size; i++)
+        crc = table[(crc ^ d[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// fills a uniform brick with its value
+template<typename T>
+struct FillKernel {
+    static void run(char *dst, qint64 count, double value) {
+        T *d = reinterpret_cast<T*>(dst);
+        std::fill(d, d + count, static_cast<T>(value));
+    }
+};
+
+QDataStream& setupStream(QDataStream &stream) {
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+    return stream;
+}
+
+}
+
+BrickedVolume::BrickedVolume()
+{
+    width = height = depth = 0;
+    aspectX = aspectY = aspectZ = 1.f;
+    type = VoxelType::UINT8;
+    brickSize = DEFAULT_BRICK_SIZE;
+    bricksX = bricksY = bricksZ = 0;
+    flags = 0;
+    dataMin = dataMax = 0.0;
+}
+
+bool BrickedVolume::isBricked(QString path) {
+    QFile file(path);
+    char magic[sizeof(MAGIC)];
+    return file.open(QIODevice::ReadOnly) && file.read(magic, sizeof(MAGIC)) == sizeof(MAGIC)
+            && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool BrickedVolume::open(QString path) {
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open file " << path << " !";
+        return false;
+    }
+    QDataStream in(&file);
+    setupStream(in);
+
+    char magic[sizeof(MAGIC)];
+    quint32 version, voxelType, size, buckets;
+    qint32 w, h, d;
+    double ax, ay, az;
+    quint64 indexOffset;
+    in.readRawData(magic, sizeof(MAGIC));
+    in >> version >> w >> h >> d >> ax >> ay >> az >> voxelType >> size >> buckets >> flags
+       >> dataMin >> dataMax >> indexOffset;
+    if(in.status() != QDataStream::Ok || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION
+            || w <= 0 || h <= 0 || d <= 0 || voxelType >= static_cast<quint32>(VoxelType::TYPE_COUNT)
+            || size == 0 || buckets != static_cast<quint32>(HISTOGRAM_BUCKETS)) {
+        qWarning() << "Invalid bricked volume header in " << path << " !";
+        return false;
+    }
+
+    this->path = path;
+    width = w;
+    height = h;
+    depth = d;
+    aspectX = static_cast<float>(ax);
+    aspectY = static_cast<float>(ay);
+    aspectZ = static_cast<float>(az);
+    type = static_cast<VoxelType::Type>(voxelType);
+    brickSize = static_cast<int>(size);
+    bricksX = (width + brickSize - 1) / brickSize;
+    bricksY = (height + brickSize - 1) / brickSize;
+    bricksZ = (depth + brickSize - 1) / brickSize;
+
+    // read the index table
+    int count = getBrickCount();
+    bricks.resize(count);
+    histograms.resize(static_cast<size_t>(count) * HISTOGRAM_BUCKETS);
+    if(!file.seek(static_cast<qint64>(indexOffset))) {
+        qWarning() << "Missing brick index in " << path << " !";
+        return false;
+    }
+    for(int i = 0; i < count; i++) {
+        Brick &b = bricks[i];
+        in >> b.offset >> b.size >> b.minValue >> b.maxValue >> b.checksum;
+        for(int j = 0; j < HISTOGRAM_BUCKETS; j++)
+            in >> histograms[static_cast<size_t>(i) * HISTOGRAM_BUCKETS + j];
+    }
+    if(in.status() != QDataStream::Ok) {
+        qWarning() << "Incomplete brick index in " << path << " !";
+        return false;
+    }
+
+    qInfo() << "Bricked volume" << width << height << depth << VoxelType::name(type)
+            << "with" << count << "bricks of" << brickSize << "^3";
+    return true;
+}
+
+bool BrickedVolume::readBrick(QFile &file, int index, char *dst, bool verify) {
+    const Brick &b = bricks[index];
+    int bx = index % bricksX, by = (index / bricksX) % bricksY, bz = index / (bricksX * bricksY);
+    qint64 count = static_cast<qint64>(qMin(brickSize, width - bx * brickSize))
+            * qMin(brickSize, height - by * brickSize) * qMin(brickSize, depth - bz * brickSize);
+
+    // uniform bricks are not stored
+    if(b.size == 0) {
+        dispatchVoxelType<FillKernel>(type, dst, count, b.minValue);
+        return true;
+    }
+    if(b.size != count * VoxelType::size(type) || !file.seek(b.offset) || file.read(dst, b.size) != b.size)
+        return false;
+    if(verify && hasChecksums() && crc32(dst, b.size) != b.checksum) {
+        qWarning() << "Checksum mismatch in brick" << index << "of" << path << "!";
+        return false;
+    }
+    return true;
+}
+
+bool BrickedVolume::readVolume(VoxelBuffer &target, bool verify, const VolumeReader::ProgressCallback &progress) {
+    const int bytes = VoxelType::size(type);
+    if(!target.allocate(static_cast<qint64>(width) * height * depth * bytes))
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // every thread reads its bricks with its own file handle into its own brick buffer
+    int threads = Parallel::threadCount();
+    std::vector<std::unique_ptr<QFile> > files(threads);
+    std::vector<std::vector<char> > buffers(threads);
+    std::atomic<bool> failed(false);
+    std::atomic<qint64> done(0), fileBytes(0);
+
+    Parallel::forRange(getBrickCount(), 1, [&](qint64 begin, qint64 end, int thread) {
+        if(!files[thread]) {
+            files[thread].reset(new QFile(path));
+            buffers[thread].resize(static_cast<size_t>(brickSize) * brickSize * brickSize * bytes);
+            if(!files[thread]->open(QIODevice::ReadOnly))
+                failed = true;
+        }
+        char *brick = buffers[thread].data();
+        for(qint64 i = begin; i < end && !failed; i++) {
+            int index = static_cast<int>(i);
+            if(!readBrick(*files[thread], index, brick, verify)) {
+                failed = true;
+                return;
+            }
+            fileBytes += bricks[index].size;
+
+            // copy the rows of the brick into the linear volume
+            int bx = index % bricksX, by = (index / bricksX) % bricksY, bz = index / (bricksX * bricksY);
+            int ox = bx * brickSize, oy = by * brickSize, oz = bz * brickSize;
+            int ex = qMin(brickSize, width - ox), ey = qMin(brickSize, height - oy), ez = qMin(brickSize, depth - oz);
+            qint64 rowBytes = static_cast<qint64>(ex) * bytes;
+            for(int z = 0; z < ez; z++)
+                for(int y = 0; y < ey; y++)
+                    memcpy(target.data() + ((static_cast<qint64>(oz + z) * height + oy + y) * width + ox) * bytes,
+                           brick + (static_cast<qint64>(z) * ey + y) * rowBytes, rowBytes);
+
+            if(progress && !progress(done += rowBytes * ey * ez))
+                failed = true;
+        }
+    });
+    if(failed) {
+        target.release();
+        return false;
+    }
+
+    double seconds = qMax(timer.nsecsElapsed(), Q_INT64_C(1)) / 1e9;
+    qInfo() << "Read" << getBrickCount() << "bricks (" << fileBytes / (1024.0 * 1024.0) << "MiB from"
+            << path << ") in" << seconds * 1000.0 << "ms (" << target.size() / (1024.0 * 1024.0) / seconds << "MiB/s )";
+    return true;
+}
+
+bool BrickedVolume::write(QString path, const char *data, int width, int height, int depth,
+                          float aspectX, float aspectY, float aspectZ, VoxelType::Type type,
+                          int brickSize, bool checksums) {
+    QElapsedTimer timer;
+    timer.start();
+
+    const int bytes = VoxelType::size(type);
+    const int bricksX = (width + brickSize - 1) / brickSize;
+    const int bricksY = (height + brickSize - 1) / brickSize;
+    const int bricksZ = (depth + brickSize - 1) / brickSize;
+    const int count = bricksX * bricksY * bricksZ;
+
+    // the brick histograms are spread over the range of the whole volume
+    double dataMin, dataMax;
+    VoxelKernels::swapMinMax(const_cast<char*>(data), static_cast<qint64>(width) * height * depth, type, false, dataMin, dataMax);
+
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Could not open file " << path << " for writing!";
+        return false;
+    }
+    QDataStream out(&file);
+    setupStream(out);
+    out.writeRawData(MAGIC, sizeof(MAGIC));
+    out << VERSION << static_cast<qint32>(width) << static_cast<qint32>(height) << static_cast<qint32>(depth)
+        << static_cast<double>(aspectX) << static_cast<double>(aspectY) << static_cast<double>(aspectZ)
+        << static_cast<quint32>(type) << static_cast<quint32>(brickSize) << static_cast<quint32>(HISTOGRAM_BUCKETS)
+        << (checksums ? FLAG_CHECKSUMS : 0u) << dataMin << dataMax << static_cast<quint64>(0);
+
+    std::vector<Brick> bricks(count);
+    std::vector<quint32> histograms(static_cast<size_t>(count) * HISTOGRAM_BUCKETS);
+    const QByteArray padding(VoxelBuffer::ALIGNMENT, 0);
+    const bool swapBytes = bytes > 1 && Q_BYTE_ORDER == Q_BIG_ENDIAN;
+    int uniform = 0;
+
+    // the bricks are gathered and summarized in parallel batches and written in order
+    const int batchSize = Parallel::threadCount() * 4;
+    std::vector<std::vector<char> > batch(batchSize);
+    for(int first = 0; first < count; first += batchSize) {
+        int batchCount = qMin(batchSize, count - first);
+        Parallel::forRange(batchCount, 1, [&](qint64 begin, qint64 end, int) {
+            std::vector<qint64> counts;
+            for(qint64 j = begin; j < end; j++) {
+                int index = first + static_cast<int>(j);
+                int bx = index % bricksX, by = (index / bricksX) % bricksY, bz = index / (bricksX * bricksY);
+                int ox = bx * brickSize, oy = by * brickSize, oz = bz * brickSize;
+                int ex = qMin(brickSize, width - ox), ey = qMin(brickSize, height - oy), ez = qMin(brickSize, depth - oz);
+                qint64 rowBytes = static_cast<qint64>(ex) * bytes;
+                qint64 voxels = static_cast<qint64>(ex) * ey * ez;
+
+                std::vector<char> &brick = batch[j];
+                brick.resize(voxels * bytes);
+                for(int z = 0; z < ez; z++)
+                    for(int y = 0; y < ey; y++)
+                        memcpy(brick.data() + (static_cast<qint64>(z) * ey + y) * rowBytes,
+                               data + ((static_cast<qint64>(oz + z) * height + oy + y) * width + ox) * bytes, rowBytes);
+
+                Brick &b = bricks[index];
+                VoxelKernels::swapMinMax(brick.data(), voxels, type, false, b.minValue, b.maxValue);
+                VoxelKernels::histogram(brick.data(), voxels, type, dataMin, dataMax, HISTOGRAM_BUCKETS, counts);
+                for(int k = 0; k < HISTOGRAM_BUCKETS; k++)
+                    histograms[static_cast<size_t>(index) * HISTOGRAM_BUCKETS + k] = static_cast<quint32>(counts[k]);
+
+                // the file stores little endian values
+                if(swapBytes) {
+                    double unused;
+                    VoxelKernels::swapMinMax(brick.data(), voxels, type, true, unused, unused);
+                }
+                b.size = b.minValue == b.maxValue ? 0 : voxels * bytes;
+                b.checksum = checksums && b.size > 0 ? crc32(brick.data(), b.size) : 0;
+            }
+        });
+
+        for(int j = 0; j < batchCount; j++) {
+            Brick &b = bricks[first + j];
+            if(b.size == 0) {
+                b.offset = 0;
+                uniform++;
+                continue;
+            }
+            // every brick starts aligned for unbuffered or mapped reads
+            qint64 pad = (VoxelBuffer::ALIGNMENT - file.pos() % VoxelBuffer::ALIGNMENT) % VoxelBuffer::ALIGNMENT;
+            out.writeRawData(padding.constData(), static_cast<int>(pad));
+            b.offset = file.pos();
+            out.writeRawData(batch[j].data(), static_cast<int>(b.size));
+        }
+    }
+
+    // append the index table and store its position in the header
+    quint64 indexOffset = static_cast<quint64>(file.pos());
+    for(int i = 0; i < count; i++) {
+        const Brick &b = bricks[i];
+        out << b.offset << b.size << b.minValue << b.maxValue << b.checksum;
+        for(int k = 0; k < HISTOGRAM_BUCKETS; k++)
+            out << histograms[static_cast<size_t>(i) * HISTOGRAM_BUCKETS + k];
+    }
+    qint64 fileSize = file.pos();
+    if(!file.seek(INDEX_OFFSET_POS))
+        return false;
+    out << indexOffset;
+    if(out.status() != QDataStream::Ok) {
+        qWarning() << "Writing the bricked volume" << path << "failed!";
+        return false;
+    }
+
+    qInfo() << "Wrote bricked volume" << path << ":" << count << "bricks of" << brickSize << "^3,"
+            << uniform << "uniform," << fileSize / (1024.0 * 1024.0) << "MiB in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool BrickedVolume::convert(QString rawPath, QString brickedPath, int brickSize, bool checksums) {
+    VolumeLoader loader(rawPath, VolumeReader::MMAP);
+    if(!loader.load())
+        return false;
+    VolumeLoader::Result &raw = loader.getResult();
+    return write(brickedPath, raw.data.data(), raw.properties.width, raw.properties.height, raw.properties.depth,
+                 raw.properties.aspectX, raw.properties.aspectY, raw.properties.aspectZ, raw.type, brickSize, checksums);
+}
+
+bool BrickedVolume::histogram(int buckets, std::vector<qint64> &counts) {
+    // only whole stored buckets can be merged
+    if(buckets <= 0 || HISTOGRAM_BUCKETS % buckets != 0)
+        return false;
+    int merge = HISTOGRAM_BUCKETS / buckets;
+    counts.assign(buckets, 0);
+    for(size_t i = 0; i < histograms.size(); i++)
+        counts[(i % HISTOGRAM_BUCKETS) / merge] += histograms[i];
+    return true;
+}
+
+QString BrickedVolume::getPath() {
+    return path;
+}
+
+int BrickedVolume::getWidth() {
+    return width;
+}
+
+int BrickedVolume::getHeight() {
+    return height;
+}
+
+int BrickedVolume::getDepth() {
+    return depth;
+}
+
+float BrickedVolume::getAspectX() {
+    return aspectX;
+}
+
+float BrickedVolume::getAspectY() {
+    return aspectY;
+}
+
+float BrickedVolume::getAspectZ() {
+    return aspectZ;
+}
+
+VoxelType::Type BrickedVolume::getVoxelType() {
+    return type;
+}
+
+double BrickedVolume::getDataMin() {
+    return dataMin;
+}
+
+double BrickedVolume::getDataMax() {
+    return dataMax;
+}
+
+bool BrickedVolume::hasChecksums() {
+    return (flags & FLAG_CHECKSUMS) != 0;
+}
+
+int BrickedVolume::getBrickSize() {
+    return brickSize;
+}
+
+int BrickedVolume::getBricksX() {
+    return bricksX;
+}
+
+int BrickedVolume::getBricksY() {
+    return bricksY;
+}
+
+int BrickedVolume::getBricksZ() {
+    return bricksZ;
+}
+
+int BrickedVolume::getBrickCount() {
+    return bricksX * bricksY * bricksZ;
+}
+
+int BrickedVolume::brickIndex(int bx, int by, int bz) {
+    return (bz * bricksY + by) * bricksX + bx;
+}
+
+const BrickedVolume::Brick& BrickedVolume::getBrick(int index) {
+    return bricks[index];
+}
@@ -0,0 +1,397 @@
+#include "compressedreader.hpp"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+
+#include <atomic>
+#include <cstring>
+
+#ifdef VOLLIGHT_ZLIB
+    #include <zlib.h>
+#endif
+#ifdef VOLLIGHT_ZSTD
+    #include <zstd.h>
+#endif
+
+#include "parallel.hpp"
+
+namespace {
+
+// zlib and zstd take at most this many bytes per call
+const qint64 MAX_CALL_BYTES = Q_INT64_C(1) << 30;
+
+quint32 readLittleEndian32(const uchar *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<quint32>(data[3]) << 24);
+}
+
+/**
+ * Writes the decompressed data of a stream into the target. The bytes before
+ * offset go into a scratch buffer, the rest straight into the target. The
+ * decoder is called with an output window and returns the bytes it wrote
+ * (or a negative value on errors or at the end of the data).
+ */
+template<typename Decoder>
+qint64 decodeStream(qint64 offset, qint64 size, char *target, qint64 frontStep, qint64 skipBufferSize,
+                    const CompressedReader::FrontCallback &front, Decoder decode) {
+    std::vector<char> scratch(static_cast<size_t>(skipBufferSize));
+    qint64 skipped = 0, written = 0, reported = 0;
+    while(written < size) {
+        bool skipping = skipped < offset;
+        char *out = skipping ? scratch.data() : target + written;
+        qint64 outSize = skipping ? qMin(skipBufferSize, offset - skipped) : qMin(size - written, MAX_CALL_BYTES);
+        qint64 produced = decode(out, outSize);
+        if(produced < 0)
+            break;
+        if(skipping)
+            skipped += produced;
+        else
+            written += produced;
+        if(front && (written - reported >= frontStep || written == size) && written > reported) {
+            reported = written;
+            if(!front(written))
+                return -1;
+        }
+    }
+    return written;
+}
+
+}
+
+CompressedReader::CompressedReader()
+{
+}
+
+CompressedReader::Codec CompressedReader::detect(QString path) {
+    QFile file(path);
+    uchar magic[4];
+    if(!file.open(QIODevice::ReadOnly) || file.read(reinterpret_cast<char*>(magic), 4) != 4)
+        return NONE;
+    if(magic[0] == 0x1f && magic[1] == 0x8b)
+        return GZIP;
+    if(readLittleEndian32(magic) == 0xFD2FB528)
+        return ZSTD;
+    return NONE;
+}
+
+QString CompressedReader::codecName(Codec codec) {
+    switch(codec) {
+    case GZIP:
+        return "gzip";
+    case ZSTD:
+        return "zstd";
+    default:
+        return "none";
+    }
+}
+
+bool CompressedReader::isAvailable(Codec codec) {
+    switch(codec) {
+    case GZIP:
+#ifdef VOLLIGHT_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case ZSTD:
+#ifdef VOLLIGHT_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    default:
+        return true;
+    }
+}
+
+QByteArray CompressedReader::readHead(QString path, qint64 maxBytes) {
+    QFile file(path);
+    Codec codec = detect(path);
+    if(codec == NONE || !isAvailable(codec) || !file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return QByteArray();
+    const uchar *data = file.map(0, file.size());
+    if(!data)
+        return QByteArray();
+    QByteArray head(static_cast<int>(maxBytes), Qt::Uninitialized);
+    qint64 written = readStream(codec, data, file.size(), 0, maxBytes, head.data(), FrontCallback());
+    head.resize(static_cast<int>(qMax(Q_INT64_C(0), written)));
+    return head;
+}
+
+qint64 CompressedReader::uncompressedSize(QString path) {
+    QFile file(path);
+    Codec codec = detect(path);
+    if(codec == NONE || !file.open(QIODevice::ReadOnly) || file.size() < 4)
+        return -1;
+    const uchar *data = file.map(0, file.size());
+    if(!data)
+        return -1;
+
+    std::vector<Block> blocks;
+    if(findBlocks(codec, data, file.size(), blocks))
+        return blocks.back().offset + blocks.back().size;
+    // the trailer of a single gzip member stores the size modulo 2^32
+    if(codec == GZIP && file.size() * MAX_DEFLATE_RATIO < (Q_INT64_C(1) << 32))
+        return readLittleEndian32(data + file.size() - 4);
+    return -1;
+}
+
+bool CompressedReader::read(QString path, qint64 offset, qint64 size, char *target, const FrontCallback &front) {
+    Codec codec = detect(path);
+    if(!isAvailable(codec)) {
+        qWarning() << "Reading" << path << "needs" << codecName(codec) << "support, which was not compiled in!";
+        return false;
+    }
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open file " << path << " !";
+        return false;
+    }
+    const uchar *data = file.size() > 0 ? file.map(0, file.size()) : nullptr;
+    if(!data) {
+        qWarning() << "Could not map the compressed file" << path << "!";
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<Block> blocks;
+    bool parallel = findBlocks(codec, data, file.size(), blocks) && blocks.size() > 1;
+    bool ok;
+    if(parallel) {
+        ok = readBlocks(codec, data, blocks, offset, size, target, front);
+    } else {
+        qint64 written = readStream(codec, data, file.size(), offset, size, target, front);
+        ok = written == size;
+        if(written >= 0 && written < size)
+            qWarning() << "The compressed data of" << path << "ends after" << written << "of" << size << "bytes!";
+    }
+    if(!ok)
+        return false;
+
+    double seconds = qMax(timer.nsecsElapsed(), Q_INT64_C(1)) / 1e9;
+    qInfo() << "Decompressed" << size / (1024.0 * 1024.0) << "MiB of" << codecName(codec) << "data"
+            << (parallel ? QString("in %1 parallel blocks").arg(blocks.size()) : QString("as a stream"))
+            << "in" << seconds * 1000.0 << "ms (" << size / seconds / (1024.0 * 1024.0) << "MiB/s,"
+            << file.size() / seconds / (1024.0 * 1024.0) << "MiB/s compressed )";
+    return true;
+}
+
+bool CompressedReader::findBlocks(Codec codec, const uchar *data, qint64 size, std::vector<Block> &blocks) {
+    blocks.clear();
+    bool ok = codec == GZIP ? findBgzfBlocks(data, size, blocks) : codec == ZSTD && findZstdFrames(data, size, blocks);
+    if(!ok)
+        blocks.clear();
+    return ok && !blocks.empty();
+}
+
+/**
+ * Every BGZF member has a "BC" extra field holding its compressed size
+ * minus one, its trailer holds its decompressed size.
+ */
+bool CompressedReader::findBgzfBlocks(const uchar *data, qint64 size, std::vector<Block> &blocks) {
+    qint64 pos = 0, out = 0;
+    while(pos < size) {
+        // gzip magic, deflate and the FEXTRA flag
+        if(size - pos < 18 || data[pos] != 0x1f || data[pos + 1] != 0x8b || data[pos + 2] != 8 || !(data[pos + 3] & 4))
+            return false;
+        qint64 extra = pos + 12;
+        qint64 extraEnd = extra + (data[pos + 10] | (data[pos + 11] << 8));
+        if(extraEnd > size)
+            return false;
+        qint64 blockSize = -1;
+        while(extra + 4 <= extraEnd) {
+            int length = data[extra + 2] | (data[extra + 3] << 8);
+            if(data[extra] == 'B' && data[extra + 1] == 'C' && length == 2 && extra + 6 <= extraEnd)
+                blockSize = (data[extra + 4] | (data[extra + 5] << 8)) + 1;
+            extra += 4 + length;
+        }
+        if(blockSize < extraEnd - pos + 8 || pos + blockSize > size)
+            return false;
+
+        Block block;
+        block.compressedOffset = pos;
+        block.compressedSize = blockSize;
+        block.offset = out;
+        block.size = readLittleEndian32(data + pos + blockSize - 4);
+        blocks.push_back(block);
+        out += block.size;
+        pos += blockSize;
+    }
+    return true;
+}
+
+bool CompressedReader::findZstdFrames(const uchar *data, qint64 size, std::vector<Block> &blocks) {
+#ifdef VOLLIGHT_ZSTD
+    qint64 pos = 0, out = 0;
+    while(pos < size) {
+        size_t frameSize = ZSTD_findFrameCompressedSize(data + pos, static_cast<size_t>(size - pos));
+        unsigned long long contentSize = ZSTD_getFrameContentSize(data + pos, static_cast<size_t>(size - pos));
+        if(ZSTD_isError(frameSize) || contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR)
+            return false;
+
+        Block block;
+        block.compressedOffset = pos;
+        block.compressedSize = static_cast<qint64>(frameSize);
+        block.offset = out;
+        block.size = static_cast<qint64>(contentSize);
+        blocks.push_back(block);
+        out += block.size;
+        pos += block.compressedSize;
+    }
+    return true;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    Q_UNUSED(blocks);
+    return false;
+#endif
+}
+
+/**
+ * Decompresses the blocks overlapping [offset, offset + size) on all threads.
+ * Blocks that lie completely inside the range are decompressed in place,
+ * the blocks at its borders through a scratch buffer. The front is the end
+ * of the completed blocks at the start of the range.
+ */
+bool CompressedReader::readBlocks(Codec codec, const uchar *data, const std::vector<Block> &blocks,
+                                  qint64 offset, qint64 size, char *target, const FrontCallback &front) {
+    if(blocks.back().offset + blocks.back().size < offset + size) {
+        qWarning() << "The compressed data is too small for" << size << "bytes at offset" << offset << "!";
+        return false;
+    }
+
+    std::vector<char> finished(blocks.size(), 0);
+    size_t frontBlock = 0;
+    qint64 reported = 0;
+    QMutex frontMutex;
+    std::atomic<bool> failed(false);
+    Parallel::forRange(static_cast<qint64>(blocks.size()), 1, [&](qint64 begin, qint64 end, int) {
+        std::vector<char> scratch;
+        for(qint64 i = begin; i < end && !failed; i++) {
+            const Block &block = blocks[i];
+            qint64 first = qMax(block.offset, offset);
+            qint64 last = qMin(block.offset + block.size, offset + size);
+            const uchar *src = data + block.compressedOffset;
+            if(first >= last) {
+                // outside of the range
+            } else if(first == block.offset && last == block.offset + block.size) {
+                if(!decompressBlock(codec, src, block.compressedSize, target + (block.offset - offset), block.size))
+                    failed = true;
+            } else {
+                scratch.resize(static_cast<size_t>(block.size));
+                if(decompressBlock(codec, src, block.compressedSize, scratch.data(), block.size))
+                    memcpy(target + (first - offset), scratch.data() + (first - block.offset), last - first);
+                else
+                    failed = true;
+            }
+
+            QMutexLocker lock(&frontMutex);
+            finished[i] = 1;
+            while(frontBlock < blocks.size() && finished[frontBlock])
+                frontBlock++;
+            qint64 done = frontBlock == blocks.size() ? size
+                    : qBound(Q_INT64_C(0), blocks[frontBlock].offset - offset, size);
+            if(front && !failed && done > reported && (done - reported >= FRONT_STEP || done == size)) {
+                reported = done;
+                if(!front(done))
+                    failed = true;
+            }
+        }
+    });
+    return !failed;
+}
+
+bool CompressedReader::decompressBlock(Codec codec, const uchar *src, qint64 srcSize, char *dst, qint64 dstSize) {
+    if(dstSize == 0)
+        return true;
+#ifdef VOLLIGHT_ZLIB
+    if(codec == GZIP) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if(inflateInit2(&stream, 15 + 16) != Z_OK)
+            return false;
+        stream.next_in = const_cast<Bytef*>(src);
+        stream.avail_in = static_cast<uInt>(srcSize);
+        stream.next_out = reinterpret_cast<Bytef*>(dst);
+        stream.avail_out = static_cast<uInt>(dstSize);
+        int ret = inflate(&stream, Z_FINISH);
+        qint64 produced = static_cast<qint64>(stream.total_out);
+        inflateEnd(&stream);
+        return ret == Z_STREAM_END && produced == dstSize;
+    }
+#endif
+#ifdef VOLLIGHT_ZSTD
+    if(codec == ZSTD) {
+        size_t produced = ZSTD_decompress(dst, static_cast<size_t>(dstSize), src, static_cast<size_t>(srcSize));
+        return !ZSTD_isError(produced) && static_cast<qint64>(produced) == dstSize;
+    }
+#endif
+    Q_UNUSED(codec);
+    Q_UNUSED(src);
+    Q_UNUSED(srcSize);
+    Q_UNUSED(dst);
+    return false;
+}
+
+qint64 CompressedReader::readStream(Codec codec, const uchar *data, qint64 dataSize,
+                                    qint64 offset, qint64 size, char *target, const FrontCallback &front) {
+#ifdef VOLLIGHT_ZLIB
+    if(codec == GZIP) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        // 15 + 32 detects the gzip header
+        if(inflateInit2(&stream, 15 + 32) != Z_OK)
+            return 0;
+        qint64 inPos = 0;
+        qint64 written = decodeStream(offset, size, target, FRONT_STEP, SKIP_BUFFER_SIZE, front, [&](char *out, qint64 outSize) {
+            if(stream.avail_in == 0 && inPos < dataSize) {
+                qint64 chunk = qMin(dataSize - inPos, MAX_CALL_BYTES);
+                stream.next_in = const_cast<Bytef*>(data + inPos);
+                stream.avail_in = static_cast<uInt>(chunk);
+                inPos += chunk;
+            }
+            stream.next_out = reinterpret_cast<Bytef*>(out);
+            stream.avail_out = static_cast<uInt>(outSize);
+            int ret = inflate(&stream, Z_NO_FLUSH);
+            qint64 produced = outSize - stream.avail_out;
+            bool inputLeft = stream.avail_in > 0 || inPos < dataSize;
+            if(ret == Z_STREAM_END) {
+                // concatenated members are decompressed one after another
+                if(inputLeft && inflateReset(&stream) != Z_OK)
+                    return Q_INT64_C(-1);
+                return produced > 0 || inputLeft ? produced : Q_INT64_C(-1);
+            }
+            if((ret != Z_OK && ret != Z_BUF_ERROR) || (produced == 0 && !inputLeft))
+                return Q_INT64_C(-1);
+            return produced;
+        });
+        inflateEnd(&stream);
+        return written;
+    }
+#endif
+#ifdef VOLLIGHT_ZSTD
+    if(codec == ZSTD) {
+        ZSTD_DCtx *context = ZSTD_createDCtx();
+        ZSTD_inBuffer in = { data, static_cast<size_t>(dataSize), 0 };
+        qint64 written = decodeStream(offset, size, target, FRONT_STEP, SKIP_BUFFER_SIZE, front, [&](char *out, qint64 outSize) {
+            ZSTD_outBuffer buffer = { out, static_cast<size_t>(outSize), 0 };
+            size_t ret = ZSTD_decompressStream(context, &buffer, &in);
+            if(ZSTD_isError(ret) || (buffer.pos == 0 && in.pos == in.size))
+                return Q_INT64_C(-1);
+            return static_cast<qint64>(buffer.pos);
+        });
+        ZSTD_freeDCtx(context);
+        return written;
+    }
+#endif
+    Q_UNUSED(codec);
+    Q_UNUSED(data);
+    Q_UNUSED(dataSize);
+    Q_UNUSED(offset);
+    Q_UNUSED(size);
+    Q_UNUSED(target);
+    Q_UNUSED(front);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "livesource.hpp"
+
+#include <QDebug>
+#include <QThread>
+
+#include <cerrno>
+
+#ifdef Q_OS_UNIX
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+LiveSource::LiveSource()
+{
+#ifdef Q_OS_UNIX
+    fd = -1;
+#endif
+}
+
+LiveSource::~LiveSource()
+{
+    close();
+}
+
+bool LiveSource::open(QString path) {
+    close();
+    this->path = path;
+#ifdef Q_OS_UNIX
+    // a pipe without data must not block the reader, so it can be canceled
+    fd = ::open(path.toLocal8Bit().constData(), O_RDONLY | O_NONBLOCK);
+    if(fd < 0) {
+        qWarning() << "Could not open" << path << "for live reading!";
+        return false;
+    }
+#else
+    file.setFileName(path);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        qWarning() << "Could not open" << path << "for live reading!";
+        return false;
+    }
+#endif
+    return true;
+}
+
+void LiveSource::close() {
+#ifdef Q_OS_UNIX
+    if(fd >= 0)
+        ::close(fd);
+    fd = -1;
+#else
+    file.close();
+#endif
+}
+
+QString LiveSource::getPath() {
+    return path;
+}
+
+bool LiveSource::read(char *target, qint64 size, const WaitCallback &callback) {
+    qint64 done = 0;
+    while(done < size) {
+        qint64 r = readAvailable(target + done, qMin(size - done, static_cast<qint64>(CHUNK_SIZE)));
+        if(r < 0) {
+            qWarning() << "Could not read from" << path << "!";
+            return false;
+        }
+        done += r;
+        if(callback && !callback(done))
+            return false;
+        // the writer has not caught up yet
+        if(r == 0)
+            QThread::msleep(POLL_INTERVAL);
+    }
+    return true;
+}
+
+bool LiveSource::readLine(QByteArray &line, const WaitCallback &callback) {
+    line.clear();
+    char c = 0;
+    while(c != '\n') {
+        if(!read(&c, 1, callback))
+            return false;
+        line.append(c);
+    }
+    return true;
+}
+
+bool LiveSource::skip(qint64 size, const WaitCallback &callback) {
+    QByteArray buffer(static_cast<int>(qMin(size, static_cast<qint64>(SKIP_BUFFER_SIZE))), Qt::Uninitialized);
+    qint64 done = 0;
+    while(done < size) {
+        qint64 count = qMin(size - done, static_cast<qint64>(SKIP_BUFFER_SIZE));
+        if(!read(buffer.data(), count, [&](qint64 bytesDone) { return !callback || callback(done + bytesDone); }))
+            return false;
+        done += count;
+    }
+    return true;
+}
+
+qint64 LiveSource::readAvailable(char *target, qint64 maxSize) {
+#ifdef Q_OS_UNIX
+    ssize_t r = ::read(fd, target, static_cast<size_t>(maxSize));
+    if(r < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    return r;
+#else
+    // the end of a growing file is left again once the writer appended data
+    return file.read(target, maxSize);
+#endif
+}
@@ -1,5 +1,10 @@
 #include "mainwindow.hpp"
 
+#include "brickedvolume.hpp"
+#include "sharedvolume.hpp"
+#include "volumecache.hpp"
+#include "volumeloader.hpp"
+
 #define SLIDER_TICKS 1000
 
 MainWindow::MainWindow(QWidget *parent) :
@@ -34,6 +39,18 @@ MainWindow::MainWindow(QWidget *parent) :
     addToolBar(Qt::RightToolBarArea, lightToolBar);
     // Status Bar
     statusBar = new QStatusBar();
+    // progress of background volume loads, hidden while no volume is loading
+    loadProgressBar = new QProgressBar();
+    loadProgressBar->setRange(0, 100);
+    loadProgressBar->setMaximumWidth(150);
+    loadProgressBar->hide();
+    statusBar->addPermanentWidget(loadProgressBar);
+    cancelLoadButton = new QPushButton("Cancel");
+    cancelLoadButton->hide();
+    statusBar->addPermanentWidget(cancelLoadButton);
+    connect(cancelLoadButton, SIGNAL(clicked()), scene->getVolume(), SLOT(cancelLoading()));
+    connect(scene->getVolume(), SIGNAL(loadProgress(int)), this, SLOT(volumeLoadProgress(int)));
+    connect(scene->getVolume(), SIGNAL(loadFinished(bool)), this, SLOT(volumeLoadFinished(bool)));
 
     // set up the file menu
     fileMenu = new QMenu("&File");
@@ -147,6 +164,150 @@ void MainWindow::initVolumeRenderingGui() {
    connect(openVolumeAction, SIGNAL(triggered()), this, SLOT(openVolumeData()));
    mainToolBar->addAction(openVolumeAction);
 
+   // open a directory of slice files as one volume
+   openSliceStackAction = new QAction(QString("Open Slice Stack..."), nullptr);
+   connect(openSliceStackAction, SIGNAL(triggered()), this, SLOT(openSliceStack()));
+   // load only a part of a large RAW volume
+   openVolumeRegionAction = new QAction(QString("Open Volume Region..."), nullptr);
+   connect(openVolumeRegionAction, SIGNAL(triggered()), this, SLOT(openVolumeRegion()));
+   // follow a volume while it is being acquired
+   openLiveVolumeAction = new QAction(QString("Open Live Volume..."), nullptr);
+   connect(openLiveVolumeAction, SIGNAL(triggered()), this, SLOT(openLiveVolume()));
+   // map a volume another process holds in shared memory
+   openSharedVolumeAction = new QAction(QString("Open Shared Memory Volume..."), nullptr);
+   connect(openSharedVolumeAction, SIGNAL(triggered()), this, SLOT(openSharedVolume()));
+
+   // play a time series of volumes at the selected frame rate
+   openSeriesAction = new QAction(QString("Open Volume Series..."), nullptr);
+   connect(openSeriesAction, SIGNAL(triggered()), this, SLOT(openVolumeSeries()));
+   playSeriesAction = new QAction(QString("Play Series"), nullptr);
+   playSeriesAction->setCheckable(true);
+   playSeriesAction->setEnabled(false);
+   connect(playSeriesAction, SIGNAL(toggled(bool)), this, SLOT(playSeriesToggled(bool)));
+   mainToolBar->addAction(playSeriesAction);
+   seriesFpsSpin = new QSpinBox();
+   seriesFpsSpin->setRange(1, 120);
+   seriesFpsSpin->setValue(qRound(scene->getSeries()->getTargetFps()));
+   seriesFpsSpin->setSuffix(" fps");
+   connect(seriesFpsSpin, SIGNAL(valueChanged(int)), this, SLOT(seriesFpsChanged(int)));
+   mainToolBar->addWidget(seriesFpsSpin);
+   connect(scene->getSeries(), SIGNAL(stepShown(int)), this, SLOT(seriesStepShown(int)));
+   connect(scene->getSeries(), SIGNAL(openChanged(bool)), this, SLOT(seriesOpenChanged(bool)));
+
+   // add the io backend selection for reading volume data
+   readerMenu = new QMenu(QString("Volume Reader"));
+   QActionGroup *readerGroup = new QActionGroup(this);
+   for(int i = 0; i < VolumeReader::BACKEND_COUNT; i++) {
+       VolumeReader::Backend backend = static_cast<VolumeReader::Backend>(i);
+       QAction *readerAction = new QAction(VolumeReader::backendName(backend), nullptr);
+       readerAction->setData(i);
+       readerAction->setCheckable(true);
+       readerAction->setChecked(backend == scene->getVolume()->getReaderBackend());
+       readerGroup->addAction(readerAction);
+   }
+   connect(readerGroup, SIGNAL(triggered(QAction*)), this, SLOT(readerBackendSelected(QAction*)));
+   readerMenu->addActions(readerGroup->actions());
+
+   // add the policy for the voxels in main memory once they were uploaded
+   memoryMenu = new QMenu(QString("Voxel Memory"));
+   QActionGroup *memoryGroup = new QActionGroup(this);
+   for(int i = 0; i < VolumeData::MEMORY_POLICY_COUNT; i++) {
+       VolumeData::MemoryPolicy policy = static_cast<VolumeData::MemoryPolicy>(i);
+       QAction *memoryAction = new QAction(VolumeData::memoryPolicyName(policy), nullptr);
+       memoryAction->setData(i);
+       memoryAction->setCheckable(true);
+       memoryAction->setChecked(policy == scene->getVolume()->getMemoryPolicy());
+       memoryGroup->addAction(memoryAction);
+   }
+   connect(memoryGroup, SIGNAL(triggered(QAction*)), this, SLOT(memoryPolicySelected(QAction*)));
+   memoryMenu->addActions(memoryGroup->actions());
+
+   // add the internal format of the volume textures
+   precisionMenu = new QMenu(QString("Texture Precision"));
+   QActionGroup *precisionGroup = new QActionGroup(this);
+   for(int i = 0; i < VolumeData::TEXTURE_PRECISION_COUNT; i++) {
+       VolumeData::TexturePrecision precision = static_cast<VolumeData::TexturePrecision>(i);
+       QAction *precisionAction = new QAction(VolumeData::texturePrecisionName(precision), nullptr);
+       precisionAction->setData(i);
+       precisionAction->setCheckable(true);
+       precisionAction->setChecked(precision == scene->getVolume()->getTexturePrecision());
+       precisionGroup->addAction(precisionAction);
+   }
+   connect(precisionGroup, SIGNAL(triggered(QAction*)), this, SLOT(texturePrecisionSelected(QAction*)));
+   precisionMenu->addActions(precisionGroup->actions());
+
+   // add the size of the slabs the volume textures are uploaded in
+   uploadSlabMenu = new QMenu(QString("Upload Slab Size"));
+   QActionGroup *uploadSlabGroup = new QActionGroup(this);
+   const int slabMiB[] = { 16, 64, 256 };
+   for(int mib : slabMiB) {
+       QAction *uploadSlabAction = new QAction(QString("%1 MiB").arg(mib), nullptr);
+       uploadSlabAction->setData(mib);
+       uploadSlabAction->setCheckable(true);
+       uploadSlabAction->setChecked(mib * Q_INT64_C(1024) * 1024 == scene->getVolume()->getUploadSlabBytes());
+       uploadSlabGroup->addAction(uploadSlabAction);
+   }
+   connect(uploadSlabGroup, SIGNAL(triggered(QAction*)), this, SLOT(uploadSlabSelected(QAction*)));
+   uploadSlabMenu->addActions(uploadSlabGroup->actions());
+   fileMenu->addAction(openSliceStackAction);
+   fileMenu->addAction(openVolumeRegionAction);
+   fileMenu->addAction(openLiveVolumeAction);
+   fileMenu->addAction(openSharedVolumeAction);
+   fileMenu->addAction(openSeriesAction);
+   fileMenu->addMenu(readerMenu);
+   fileMenu->addMenu(memoryMenu);
+   fileMenu->addMenu(precisionMenu);
+   fileMenu->addMenu(uploadSlabMenu);
+
+   // open RAW volumes from the preprocessed volume cache
+   volumeCacheAction = new QAction(QString("Use Volume Cache"), nullptr);
+   volumeCacheAction->setCheckable(true);
+   volumeCacheAction->setChecked(scene->getVolume()->isCacheEnabled());
+   connect(volumeCacheAction, SIGNAL(toggled(bool)), this, SLOT(volumeCacheToggled(bool)));
+   fileMenu->addAction(volumeCacheAction);
+   clearCacheAction = new QAction(QString("Clear Volume Cache"), nullptr);
+   connect(clearCacheAction, SIGNAL(triggered()), this, SLOT(clearVolumeCache()));
+   fileMenu->addAction(clearCacheAction);
+
+   // add the conversion of RAW files into the bricked format
+   convertVolumeAction = new QAction(QString("Convert to Bricked Volume..."), nullptr);
+   connect(convertVolumeAction, SIGNAL(triggered()), this, SLOT(convertVolumeData()));
+   fileMenu->addAction(convertVolumeAction);
+
+   // render volumes through the brick cache even if they fit into a single texture
+   virtualTextureAction = new QAction(QString("Force Virtual Texturing"), nullptr);
+   virtualTextureAction->setCheckable(true);
+   connect(virtualTextureAction, SIGNAL(toggled(bool)), scene->getVolumeRenderProps(), SLOT(setVirtualTexturing(bool)));
+   fileMenu->addAction(virtualTextureAction);
+
+   // sample distant parts and moving views from the coarser pyramid levels
+   levelOfDetailAction = new QAction(QString("Level of Detail"), nullptr);
+   levelOfDetailAction->setCheckable(true);
+   levelOfDetailAction->setChecked(scene->getVolumeRenderProps()->getLevelOfDetail());
+   connect(levelOfDetailAction, SIGNAL(toggled(bool)), scene->getVolumeRenderProps(), SLOT(setLevelOfDetail(bool)));
+   fileMenu->addAction(levelOfDetailAction);
+
+   // set up the rays in the shader instead of rendering entry and exit points
+   analyticRaysAction = new QAction(QString("Analytic Ray Setup"), nullptr);
+   analyticRaysAction->setCheckable(true);
+   analyticRaysAction->setChecked(scene->getVolumeRenderProps()->getAnalyticRays());
+   connect(analyticRaysAction, SIGNAL(toggled(bool)), scene->getVolumeRenderProps(), SLOT(setAnalyticRays(bool)));
+   fileMenu->addAction(analyticRaysAction);
+
+   // classify the segments between samples, so larger steps keep thin features
+   preIntegrationAction = new QAction(QString("Pre-Integrated Transfer Function"), nullptr);
+   preIntegrationAction->setCheckable(true);
+   preIntegrationAction->setChecked(scene->getVolumeRenderProps()->getPreIntegration());
+   connect(preIntegrationAction, SIGNAL(toggled(bool)), scene->getVolumeRenderProps(), SLOT(setPreIntegration(bool)));
+   fileMenu->addAction(preIntegrationAction);
+
+   // shade with the normals of a gradient volume baked on the CPU
+   gradientAction = new QAction(QString("Precomputed Gradients"), nullptr);
+   gradientAction->setCheckable(true);
+   gradientAction->setChecked(scene->getVolumeRenderProps()->getPrecomputedGradients());
+   connect(gradientAction, SIGNAL(toggled(bool)), scene->getVolumeRenderProps(), SLOT(setPrecomputedGradients(bool)));
+   fileMenu->addAction(gradientAction);
+
    mainToolBar->addSeparator();
 
    //add the mode selector
@@ -320,10 +481,169 @@ void MainWindow::saveProject() {
 // Volume Rendering
 
 void MainWindow::openVolumeData() {
-    QString file = QFileDialog::getOpenFileName(this, QString("Open Volume Data Set"), QString("../VolumeData"), QString("Volume Data (*.raw)"));
+    QString file = QFileDialog::getOpenFileName(this, QString("Open Volume Data Set"), QString("../VolumeData"), QString("Volume Data (*.raw *.raw.gz *.raw.zst *.vbrk *.vdesc *.mhd *.mha *.nhdr *.nrrd)"));
     scene->loadVolume(file);
 }
 
+void MainWindow::openSliceStack() {
+    QString directory = QFileDialog::getExistingDirectory(this, QString("Open Slice Stack"), QString("../VolumeData"));
+    if(!directory.isEmpty())
+        scene->loadVolume(directory);
+}
+
+void MainWindow::openVolumeRegion() {
+    QString file = QFileDialog::getOpenFileName(this, QString("Open Volume Region"), QString("../VolumeData"), QString("Volume Data (*.raw *.raw.gz *.raw.zst *.vdesc *.mhd *.mha *.nhdr *.nrrd)"));
+    VolumeLoader::Header header;
+    if(file.isEmpty() || !VolumeLoader::parseHeader(file, header)) {
+        if(!file.isEmpty())
+            statusBar->showMessage("Reading the header of " + file + " failed!", 5000);
+        return;
+    }
+
+    // the region is given as voxel ranges, the whole volume is preselected
+    QDialog dialog(this);
+    dialog.setWindowTitle("Volume Region");
+    QFormLayout *layout = new QFormLayout(&dialog);
+    const int size[3] = { header.width, header.height, header.depth };
+    const char *axes[3] = { "X", "Y", "Z" };
+    QSpinBox *first[3], *last[3];
+    for(int i = 0; i < 3; i++) {
+        first[i] = new QSpinBox();
+        first[i]->setRange(0, size[i] - 1);
+        last[i] = new QSpinBox();
+        last[i]->setRange(1, size[i]);
+        last[i]->setValue(size[i]);
+        QHBoxLayout *range = new QHBoxLayout();
+        range->addWidget(first[i]);
+        range->addWidget(new QLabel("to"));
+        range->addWidget(last[i]);
+        layout->addRow(QString(axes[i]) + QString(" (of %1)").arg(size[i]), range);
+    }
+    QSpinBox *stride = new QSpinBox();
+    stride->setRange(1, 64);
+    layout->addRow("Stride", stride);
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    connect(buttons, SIGNAL(accepted()), &dialog, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), &dialog, SLOT(reject()));
+    layout->addRow(buttons);
+    if(dialog.exec() != QDialog::Accepted)
+        return;
+    for(int i = 0; i < 3; i++) {
+        if(last[i]->value() <= first[i]->value()) {
+            statusBar->showMessage(QString("The %1 range of the region is empty!").arg(axes[i]), 5000);
+            return;
+        }
+    }
+
+    VolumeRegion region;
+    region.x0 = first[0]->value();
+    region.y0 = first[1]->value();
+    region.z0 = first[2]->value();
+    region.x1 = last[0]->value();
+    region.y1 = last[1]->value();
+    region.z1 = last[2]->value();
+    region.stride = stride->value();
+    scene->loadVolumeRegion(file, region);
+}
+
+void MainWindow::openLiveVolume() {
+    // named pipes are listed as well
+    QString file = QFileDialog::getOpenFileName(this, QString("Open Live Volume"), QString("../VolumeData"), QString("Volume Data (*.raw *.vdesc *.mhd *.mha *.nhdr *.nrrd);;All Files (*)"));
+    if(!file.isEmpty())
+        scene->loadVolumeLive(file);
+}
+
+void MainWindow::openSharedVolume() {
+    bool ok;
+    QString name = QInputDialog::getText(this, QString("Open Shared Memory Volume"), QString("Segment name:"),
+                                         QLineEdit::Normal, QString(), &ok);
+    if(ok && !name.trimmed().isEmpty())
+        scene->loadVolume(SharedVolume::PATH_PREFIX + name.trimmed());
+}
+
+void MainWindow::openVolumeSeries() {
+    QStringList files = QFileDialog::getOpenFileNames(this, QString("Open Volume Series"), QString("../VolumeData"), QString("Volume Data (*.raw *.raw.gz *.raw.zst *.vdesc *.mhd *.mha *.nhdr *.nrrd)"));
+    if(files.isEmpty())
+        return;
+    if(!scene->loadVolumeSeries(files))
+        statusBar->showMessage("Opening the volume series failed!", 5000);
+}
+
+void MainWindow::seriesOpenChanged(bool open) {
+    playSeriesAction->setChecked(false);
+    playSeriesAction->setEnabled(open);
+}
+
+void MainWindow::playSeriesToggled(bool play) {
+    if(play)
+        scene->getSeries()->play();
+    else
+        scene->getSeries()->stop();
+}
+
+void MainWindow::seriesFpsChanged(int fps) {
+    scene->getSeries()->setTargetFps(fps);
+}
+
+void MainWindow::seriesStepShown(int step) {
+    VolumeSeries *series = scene->getSeries();
+    statusBar->showMessage(QString("Step %1 of %2, %3 dropped frames").arg(step + 1).arg(series->getStepCount())
+                           .arg(series->getDroppedFrames()));
+}
+
+void MainWindow::convertVolumeData() {
+    QString rawFile = QFileDialog::getOpenFileName(this, QString("Convert Volume Data Set"), QString("../VolumeData"), QString("Volume Data (*.raw *.raw.gz *.raw.zst *.vdesc *.mhd *.mha *.nhdr *.nrrd)"));
+    if(rawFile.isEmpty())
+        return;
+    QString brickedFile = QFileDialog::getSaveFileName(this, QString("Save Bricked Volume"), rawFile.left(rawFile.lastIndexOf(".")) + ".vbrk", QString("Bricked Volume Data (*.vbrk)"));
+    if(brickedFile.isEmpty())
+        return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool ok = BrickedVolume::convert(rawFile, brickedFile);
+    QApplication::restoreOverrideCursor();
+    statusBar->showMessage(ok ? "Converted " + rawFile + " to " + brickedFile : "Converting " + rawFile + " failed!", 5000);
+}
+
+void MainWindow::volumeLoadProgress(int percent) {
+    loadProgressBar->setValue(percent);
+    loadProgressBar->show();
+    cancelLoadButton->show();
+}
+
+void MainWindow::volumeLoadFinished(bool success) {
+    loadProgressBar->hide();
+    cancelLoadButton->hide();
+    if(!success)
+        statusBar->showMessage("Loading the volume failed or was canceled.", 5000);
+}
+
+void MainWindow::readerBackendSelected(QAction *action) {
+    scene->getVolume()->setReaderBackend(static_cast<VolumeReader::Backend>(action->data().toInt()));
+}
+
+void MainWindow::memoryPolicySelected(QAction *action) {
+    scene->getVolume()->setMemoryPolicy(static_cast<VolumeData::MemoryPolicy>(action->data().toInt()));
+}
+
+void MainWindow::texturePrecisionSelected(QAction *action) {
+    scene->getVolume()->setTexturePrecision(static_cast<VolumeData::TexturePrecision>(action->data().toInt()));
+}
+
+void MainWindow::uploadSlabSelected(QAction *action) {
+    scene->getVolume()->setUploadSlabBytes(action->data().toInt() * Q_INT64_C(1024) * 1024);
+}
+
+void MainWindow::volumeCacheToggled(bool enabled) {
+    scene->getVolume()->setCacheEnabled(enabled);
+}
+
+void MainWindow::clearVolumeCache() {
+    VolumeCache cache;
+    bool ok = cache.clear();
+    statusBar->showMessage(ok ? "Cleared " + cache.getDirectory() : "Clearing " + cache.getDirectory() + " failed!", 5000);
+}
+
 void MainWindow::showTfEditor() {
     if(!tfEditor) {
         tfEditor = new TransFuncEditor(nullptr, scene->getVolumeRenderProps()->getTransFunc(), scene->getVolume());
@@ -0,0 +1,158 @@
+#include "occupancygrid.hpp"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "brickedvolume.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+// the value ranges of one row of cells (fixed y and z) per chunk, each
+// voxel row of the cells (with their borders) is read once
+template<typename T>
+struct CellRangeKernel {
+    static void run(const char *data, int width, int height, int depth, int cellsX, int cellsY,
+                    int cellsZ, double *minValues, double *maxValues) {
+        const T *d = reinterpret_cast<const T*>(data);
+        const int size = OccupancyGrid::CELL_SIZE;
+        Parallel::forRange(static_cast<qint64>(cellsY) * cellsZ, 1, [&](qint64 begin, qint64 end, int) {
+            std::vector<T> lo(cellsX), hi(cellsX);
+            for(qint64 row = begin; row < end; row++) {
+                int cy = static_cast<int>(row % cellsY), cz = static_cast<int>(row / cellsY);
+                int y0 = qMax(cy * size - 1, 0), y1 = qMin(cy * size + size, height - 1);
+                int z0 = qMax(cz * size - 1, 0), z1 = qMin(cz * size + size, depth - 1);
+                std::fill(lo.begin(), lo.end(), std::numeric_limits<T>::max());
+                std::fill(hi.begin(), hi.end(), std::numeric_limits<T>::lowest());
+                for(int z = z0; z <= z1; z++) {
+                    for(int y = y0; y <= y1; y++) {
+                        const T *r = d + (static_cast<qint64>(z) * height + y) * width;
+                        for(int cx = 0; cx < cellsX; cx++) {
+                            int x0 = qMax(cx * size - 1, 0), x1 = qMin(cx * size + size, width - 1);
+                            T l = lo[cx], h = hi[cx];
+                            // NaNs never replace the current values
+                            for(int x = x0; x <= x1; x++) {
+                                l = r[x] < l ? r[x] : l;
+                                h = r[x] > h ? r[x] : h;
+                            }
+                            lo[cx] = l;
+                            hi[cx] = h;
+                        }
+                    }
+                }
+                for(int cx = 0; cx < cellsX; cx++) {
+                    minValues[row * cellsX + cx] = lo[cx];
+                    maxValues[row * cellsX + cx] = hi[cx];
+                }
+            }
+        });
+    }
+};
+
+}
+
+OccupancyGrid::OccupancyGrid()
+{
+    cellsX = cellsY = cellsZ = 0;
+}
+
+bool OccupancyGrid::build(const char *data, int width, int height, int depth, VoxelType::Type type) {
+    if(data == nullptr || width <= 0 || height <= 0 || depth <= 0)
+        return false;
+    QElapsedTimer timer;
+    timer.start();
+    cellsX = (width + CELL_SIZE - 1) / CELL_SIZE;
+    cellsY = (height + CELL_SIZE - 1) / CELL_SIZE;
+    cellsZ = (depth + CELL_SIZE - 1) / CELL_SIZE;
+    minValues.assign(getCellCount(), 0.0);
+    maxValues.assign(getCellCount(), 0.0);
+    dispatchVoxelType<CellRangeKernel>(type, data, width, height, depth, cellsX, cellsY, cellsZ,
+                                       minValues.data(), maxValues.data());
+    qInfo() << "Occupancy grid of" << cellsX << cellsY << cellsZ << "cells took" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool OccupancyGrid::build(BrickedVolume &bricks) {
+    const int width = bricks.getWidth(), height = bricks.getHeight(), depth = bricks.getDepth();
+    const int brickSize = bricks.getBrickSize();
+    if(width <= 0 || height <= 0 || depth <= 0 || brickSize <= 0 || bricks.getBrickCount() == 0)
+        return false;
+    QElapsedTimer timer;
+    timer.start();
+    cellsX = (width + CELL_SIZE - 1) / CELL_SIZE;
+    cellsY = (height + CELL_SIZE - 1) / CELL_SIZE;
+    cellsZ = (depth + CELL_SIZE - 1) / CELL_SIZE;
+    minValues.assign(getCellCount(), 0.0);
+    maxValues.assign(getCellCount(), 0.0);
+    // the bricks covering the voxels [c * CELL_SIZE - 1, c * CELL_SIZE + CELL_SIZE] of a cell
+    auto firstBrick = [&](int c, int bricksAlong) {
+        return qMin(qMax(c * CELL_SIZE - 1, 0) / brickSize, bricksAlong - 1);
+    };
+    auto lastBrick = [&](int c, int size, int bricksAlong) {
+        return qMin(qMin(c * CELL_SIZE + CELL_SIZE, size - 1) / brickSize, bricksAlong - 1);
+    };
+    for(int cz = 0; cz < cellsZ; cz++) {
+        for(int cy = 0; cy < cellsY; cy++) {
+            for(int cx = 0; cx < cellsX; cx++) {
+                double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+                for(int bz = firstBrick(cz, bricks.getBricksZ()); bz <= lastBrick(cz, depth, bricks.getBricksZ()); bz++) {
+                    for(int by = firstBrick(cy, bricks.getBricksY()); by <= lastBrick(cy, height, bricks.getBricksY()); by++) {
+                        for(int bx = firstBrick(cx, bricks.getBricksX()); bx <= lastBrick(cx, width, bricks.getBricksX()); bx++) {
+                            const BrickedVolume::Brick &brick = bricks.getBrick(bricks.brickIndex(bx, by, bz));
+                            lo = qMin(lo, brick.minValue);
+                            hi = qMax(hi, brick.maxValue);
+                        }
+                    }
+                }
+                int i = (cz * cellsY + cy) * cellsX + cx;
+                minValues[i] = lo;
+                maxValues[i] = hi;
+            }
+        }
+    }
+    qInfo() << "Occupancy grid of" << cellsX << cellsY << cellsZ << "cells from the metadata of"
+            << bricks.getBrickCount() << "bricks took" << timer.elapsed() << "ms";
+    return true;
+}
+
+int OccupancyGrid::getCellsX() {
+    return cellsX;
+}
+
+int OccupancyGrid::getCellsY() {
+    return cellsY;
+}
+
+int OccupancyGrid::getCellsZ() {
+    return cellsZ;
+}
+
+int OccupancyGrid::getCellCount() {
+    return cellsX * cellsY * cellsZ;
+}
+
+int OccupancyGrid::classify(const float *tf, int size, float minValue, float maxValue,
+                            double domainMin, double domainMax, std::vector<uchar> &occupancy) {
+    occupancy.assign(getCellCount(), 0);
+    int empty = 0;
+    for(int i = 0; i < getCellCount(); i++) {
+        float n0 = static_cast<float>((minValues[i] - domainMin) / (domainMax - domainMin));
+        float n1 = static_cast<float>((maxValues[i] - domainMin) / (domainMax - domainMin));
+        float c0 = n0 / (maxValue - minValue) + minValue;
+        float c1 = n1 / (maxValue - minValue) + minValue;
+        // include the neighbouring entries used by the linear filtering
+        int i0 = qBound(0, static_cast<int>(std::floor(c0 * size - 0.5f)), size - 1);
+        int i1 = qBound(0, static_cast<int>(std::ceil(c1 * size - 0.5f)), size - 1);
+        bool visible = false;
+        for(int j = i0; j <= i1 && !visible; j++)
+            visible = tf[j * 4 + 3] > 0.f;
+        occupancy[i] = visible ? 255 : 0;
+        if(!visible)
+            empty++;
+    }
+    return empty;
+}
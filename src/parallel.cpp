@@ -0,0 +1,58 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+int Parallel::threads = 0;
+
+int Parallel::threadCount() {
+    if(threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    return threads;
+}
+
+void Parallel::setThreadCount(int count) {
+    threads = count;
+}
+
+void Parallel::forRange(qint64 count, qint64 grain, const std::function<void(qint64, qint64, int)> &func) {
+    if(count <= 0)
+        return;
+    if(grain < 1)
+        grain = 1;
+
+    // never start more threads than there are chunks
+    qint64 chunks = (count + grain - 1) / grain;
+    int threadNum = static_cast<int>(std::min<qint64>(threadCount(), chunks));
+
+    // the chunks are handed out dynamically so slow chunks (e.g. cold
+    // pages or network reads) do not stall the other threads
+    std::atomic<qint64> next(0);
+    run(threadNum, [&](int thread) {
+        qint64 begin;
+        while((begin = next.fetch_add(grain)) < count)
+            func(begin, std::min(begin + grain, count), thread);
+    });
+}
+
+void Parallel::run(int threadNum, const std::function<void(int)> &func) {
+    if(threadNum <= 1) {
+        func(0);
+        return;
+    }
+
+    // the calling thread works as thread 0
+    std::vector<std::thread> workers;
+    workers.reserve(threadNum - 1);
+    for(int i = 1; i < threadNum; i++)
+        workers.emplace_back(func, i);
+    func(0);
+    for(std::thread &t : workers)
+        t.join();
+}
+
+Parallel::Parallel()
+{
+}
@@ -0,0 +1,112 @@
+#include "preintegration.hpp"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <cmath>
+
+#include "parallel.hpp"
+
+namespace {
+
+// fully opaque entries would have an infinite extinction
+const float MAX_OPACITY = 0.9999f;
+// shorter segments use the transfer function at their center
+const double MIN_SEGMENT = 1e-6;
+
+// linear interpolation of the values at the entry centers, x in entries
+double interpolate(const std::vector<double> &v, double x) {
+    int i = qBound(0, static_cast<int>(std::floor(x)), static_cast<int>(v.size()) - 2);
+    double f = x - i;
+    return v[i] + (v[i + 1] - v[i]) * f;
+}
+
+}
+
+PreIntegrationTable::PreIntegrationTable()
+{
+    size = 0;
+}
+
+void PreIntegrationTable::build(const float *tf, int tfSize) {
+    if(tf == nullptr || tfSize <= 0) {
+        size = 0;
+        table.clear();
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+
+    // the extinction and the extinction weighted color at the entries, with
+    // one extra entry so the interpolation covers the last one
+    const int n = tfSize + 1;
+    std::vector<double> tau(n), color[3];
+    for(int c = 0; c < 3; c++)
+        color[c].resize(n);
+    for(int i = 0; i < n; i++) {
+        const float *e = tf + qMin(i, tfSize - 1) * 4;
+        tau[i] = -std::log(1.0 - qMin(e[3], MAX_OPACITY));
+        for(int c = 0; c < 3; c++)
+            color[c][i] = e[c];
+    }
+
+    // prefix integrals of the linearly interpolated values (trapezoids)
+    std::vector<double> tauSum(n, 0.0), colorSum[3];
+    for(int c = 0; c < 3; c++)
+        colorSum[c].assign(n, 0.0);
+    for(int i = 1; i < n; i++) {
+        tauSum[i] = tauSum[i - 1] + 0.5 * (tau[i - 1] + tau[i]);
+        for(int c = 0; c < 3; c++)
+            colorSum[c][i] = colorSum[c][i - 1] + 0.5 * (tau[i - 1] * color[c][i - 1] + tau[i] * color[c][i]);
+    }
+
+    // the entries of the table sample the transfer function like a texture
+    // lookup: entry j at (j + 0.5) / size, entry centers at integers
+    size = qMin(tfSize, static_cast<int>(MAX_SIZE));
+    std::vector<double> position(size);
+    for(int j = 0; j < size; j++)
+        position[j] = qBound(0.0, (j + 0.5) / size * tfSize - 0.5, tfSize - 1.0);
+
+    table.assign(static_cast<size_t>(size) * size * 4, 0.f);
+    Parallel::forRange(size, 16, [&](qint64 begin, qint64 end, int) {
+        for(qint64 f = begin; f < end; f++) {
+            double xf = position[f];
+            double tf0 = interpolate(tauSum, xf), cf0[3];
+            for(int c = 0; c < 3; c++)
+                cf0[c] = interpolate(colorSum[c], xf);
+            float *row = table.data() + f * size * 4;
+            for(int b = 0; b < size; b++) {
+                double xb = position[b];
+                double length = xb - xf;
+                double extinction = 0.0, rgb[3];
+                if(std::abs(length) < MIN_SEGMENT) {
+                    extinction = interpolate(tau, xf);
+                    for(int c = 0; c < 3; c++)
+                        rgb[c] = interpolate(color[c], xf);
+                } else {
+                    double t = interpolate(tauSum, xb) - tf0;
+                    extinction = t / length;
+                    for(int c = 0; c < 3; c++) {
+                        // transparent segments keep the average color
+                        if(std::abs(t) > MIN_SEGMENT)
+                            rgb[c] = (interpolate(colorSum[c], xb) - cf0[c]) / t;
+                        else
+                            rgb[c] = 0.5 * (interpolate(color[c], xf) + interpolate(color[c], xb));
+                    }
+                }
+                for(int c = 0; c < 3; c++)
+                    row[b * 4 + c] = static_cast<float>(qBound(0.0, rgb[c], 1.0));
+                row[b * 4 + 3] = static_cast<float>(qMax(extinction, 0.0));
+            }
+        }
+    });
+    qInfo() << "Pre-integration table of" << size << "x" << size << "entries took" << timer.elapsed() << "ms";
+}
+
+int PreIntegrationTable::getSize() {
+    return size;
+}
+
+const float* PreIntegrationTable::getData() {
+    return table.data();
+}
@@ -0,0 +1,224 @@
+#include "proxygeometry.hpp"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QOpenGLFunctions_4_0_Core>
+
+#include <algorithm>
+
+#include "glutils.hpp"
+
+namespace {
+
+// covers the set entries of the w*h mask (x fastest) with rectangles at most
+// maxHeight rows high and clears them. emit gets the first and the end
+// (exclusive) coordinates of every rectangle
+template<typename Emit>
+void mergeRectangles(std::vector<bool> &mask, int w, int h, int maxHeight, Emit emit) {
+    for(int y = 0; y < h; y++) {
+        for(int x = 0; x < w; x++) {
+            if(!mask[y * w + x])
+                continue;
+            int x1 = x + 1;
+            while(x1 < w && mask[y * w + x1])
+                x1++;
+            int y1 = y + 1;
+            while(y1 < h && y1 - y < maxHeight) {
+                bool full = true;
+                for(int i = x; i < x1 && full; i++)
+                    full = mask[y1 * w + i];
+                if(!full)
+                    break;
+                y1++;
+            }
+            for(int j = y; j < y1; j++)
+                for(int i = x; i < x1; i++)
+                    mask[j * w + i] = false;
+            emit(x, y, x1, y1);
+        }
+    }
+}
+
+}
+
+ProxyGeometry::ProxyGeometry()
+{
+    cellsX = cellsY = cellsZ = 0;
+    valid = false;
+    vertexCount = 0;
+    vao = GL_INVALID_VALUE;
+    vbo = GL_INVALID_VALUE;
+}
+
+ProxyGeometry::~ProxyGeometry() {
+    QOpenGLFunctions_4_0_Core* glf = GLUtils::glFunc();
+    if(vbo != GL_INVALID_VALUE)
+        glf->glDeleteBuffers(1, &vbo);
+    if(vao != GL_INVALID_VALUE)
+        glf->glDeleteVertexArrays(1, &vao);
+}
+
+void ProxyGeometry::clear() {
+    occupancy.clear();
+    layers.clear();
+    cellsX = cellsY = cellsZ = 0;
+    valid = false;
+    vertexCount = 0;
+}
+
+bool ProxyGeometry::isValid() {
+    return valid;
+}
+
+int ProxyGeometry::getQuadCount() {
+    return vertexCount / 6;
+}
+
+bool ProxyGeometry::isOccupied(int x, int y, int z) {
+    if(x < 0 || y < 0 || z < 0 || x >= cellsX || y >= cellsY || z >= cellsZ)
+        return false;
+    return occupancy[(static_cast<size_t>(z) * cellsY + y) * cellsX + x] != 0;
+}
+
+float ProxyGeometry::boundary(int axis, int i) {
+    // the cells at the far border end at the border of the volume
+    return qMin(i * cellSize[axis], 1.f) - 0.5f;
+}
+
+void ProxyGeometry::addQuad(std::vector<float> &vertices, QVector3D origin, QVector3D u, QVector3D v) {
+    // two counter clockwise triangles seen from the side u x v points to
+    const QVector3D corners[6] = { origin, origin + u, origin + u + v, origin, origin + u + v, origin + v };
+    for(const QVector3D &c : corners) {
+        vertices.push_back(c.x());
+        vertices.push_back(c.y());
+        vertices.push_back(c.z());
+    }
+}
+
+/**
+ * Generates the faces of the occupied cells of layer z that border on empty
+ * cells: the faces along z merged into rectangles, the side faces into runs
+ * along the layer.
+ */
+void ProxyGeometry::buildLayer(int z) {
+    std::vector<float> &vertices = layers[z];
+    vertices.clear();
+    const float z0 = boundary(2, z), z1 = boundary(2, z + 1);
+    std::vector<bool> mask;
+
+    // top (+z) and bottom (-z) faces
+    for(int side = 1; side >= -1; side -= 2) {
+        mask.assign(static_cast<size_t>(cellsX) * cellsY, false);
+        for(int y = 0; y < cellsY; y++)
+            for(int x = 0; x < cellsX; x++)
+                mask[y * cellsX + x] = isOccupied(x, y, z) && !isOccupied(x, y, z + side);
+        mergeRectangles(mask, cellsX, cellsY, cellsY, [&](int xa, int ya, int xb, int yb) {
+            QVector3D du(boundary(0, xb) - boundary(0, xa), 0.f, 0.f), dv(0.f, boundary(1, yb) - boundary(1, ya), 0.f);
+            if(side > 0)
+                addQuad(vertices, QVector3D(boundary(0, xa), boundary(1, ya), z1), du, dv);
+            else
+                addQuad(vertices, QVector3D(boundary(0, xa), boundary(1, ya), z0), dv, du);
+        });
+    }
+
+    // side faces along x as runs along y (the mask is y fastest)
+    const QVector3D dz(0.f, 0.f, z1 - z0);
+    for(int side = 1; side >= -1; side -= 2) {
+        mask.assign(static_cast<size_t>(cellsX) * cellsY, false);
+        for(int x = 0; x < cellsX; x++)
+            for(int y = 0; y < cellsY; y++)
+                mask[x * cellsY + y] = isOccupied(x, y, z) && !isOccupied(x + side, y, z);
+        mergeRectangles(mask, cellsY, cellsX, 1, [&](int ya, int x, int yb, int) {
+            QVector3D dy(0.f, boundary(1, yb) - boundary(1, ya), 0.f);
+            if(side > 0)
+                addQuad(vertices, QVector3D(boundary(0, x + 1), boundary(1, ya), z0), dy, dz);
+            else
+                addQuad(vertices, QVector3D(boundary(0, x), boundary(1, ya), z0), dz, dy);
+        });
+    }
+
+    // side faces along y as runs along x
+    for(int side = 1; side >= -1; side -= 2) {
+        mask.assign(static_cast<size_t>(cellsX) * cellsY, false);
+        for(int y = 0; y < cellsY; y++)
+            for(int x = 0; x < cellsX; x++)
+                mask[y * cellsX + x] = isOccupied(x, y, z) && !isOccupied(x, y + side, z);
+        mergeRectangles(mask, cellsX, cellsY, 1, [&](int xa, int y, int xb, int) {
+            QVector3D dx(boundary(0, xb) - boundary(0, xa), 0.f, 0.f);
+            if(side > 0)
+                addQuad(vertices, QVector3D(boundary(0, xa), boundary(1, y + 1), z0), dz, dx);
+            else
+                addQuad(vertices, QVector3D(boundary(0, xa), boundary(1, y), z0), dx, dz);
+        });
+    }
+}
+
+void ProxyGeometry::update(const std::vector<uchar> &occupancy, int cellsX, int cellsY, int cellsZ, QVector3D cellSize) {
+    QElapsedTimer timer;
+    timer.start();
+
+    // a layer changes with the occupancy of itself and of its neighbours
+    std::vector<bool> dirty(qMax(cellsZ, 0), true);
+    if(valid && cellsX == this->cellsX && cellsY == this->cellsY && cellsZ == this->cellsZ
+            && cellSize == this->cellSize) {
+        size_t layerCells = static_cast<size_t>(cellsX) * cellsY;
+        std::vector<bool> changed(cellsZ, false);
+        for(int z = 0; z < cellsZ; z++) {
+            changed[z] = !std::equal(occupancy.begin() + z * layerCells, occupancy.begin() + (z + 1) * layerCells,
+                                     this->occupancy.begin() + z * layerCells);
+        }
+        for(int z = 0; z < cellsZ; z++)
+            dirty[z] = changed[z] || (z > 0 && changed[z - 1]) || (z + 1 < cellsZ && changed[z + 1]);
+    } else {
+        layers.assign(qMax(cellsZ, 0), std::vector<float>());
+    }
+    this->occupancy = occupancy;
+    this->cellsX = cellsX;
+    this->cellsY = cellsY;
+    this->cellsZ = cellsZ;
+    this->cellSize = cellSize;
+
+    int rebuilt = 0;
+    for(int z = 0; z < cellsZ; z++) {
+        if(!dirty[z])
+            continue;
+        buildLayer(z);
+        rebuilt++;
+    }
+    if(rebuilt > 0 || !valid)
+        upload();
+    valid = true;
+    qInfo() << "Proxy geometry:" << getQuadCount() << "quads, rebuilt" << rebuilt << "of" << cellsZ
+            << "layers in" << timer.elapsed() << "ms";
+}
+
+void ProxyGeometry::upload() {
+    std::vector<float> vertices;
+    for(const std::vector<float> &layer : layers)
+        vertices.insert(vertices.end(), layer.begin(), layer.end());
+    vertexCount = static_cast<int>(vertices.size() / 3);
+
+    QOpenGLFunctions_4_0_Core* glf = GLUtils::glFunc();
+    if(vao == GL_INVALID_VALUE) {
+        glf->glGenVertexArrays(1, &vao);
+        glf->glGenBuffers(1, &vbo);
+        glf->glBindVertexArray(vao);
+        glf->glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glf->glEnableVertexAttribArray(0);
+        glf->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), 0); // vertex
+    } else {
+        glf->glBindVertexArray(vao);
+        glf->glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    }
+    glf->glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    // protect the vertex array from later changes
+    glf->glBindVertexArray(0);
+}
+
+void ProxyGeometry::render() {
+    if(!valid || vertexCount == 0)
+        return;
+    QOpenGLFunctions_4_0_Core* glf = GLUtils::glFunc();
+    glf->glBindVertexArray(vao);
+    glf->glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+}
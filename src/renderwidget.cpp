@@ -185,10 +185,15 @@ void RenderWidget::mouseMoveEvent(QMouseEvent *event)
 	// calculate the difference between the last and current mouse position
 	QLineF delta = QLineF(touchPrev, touchPos);
     QLineF deltaS = QLineF(touchPrevS, touchPosS);
+    // render coarser levels while the camera moves
+    if(volumeRenderer)
+        volumeRenderer->interacted();
     Controller::get()->mouseMove(this, deltaS, delta, event->buttons() & Qt::MouseButton::LeftButton, event->modifiers());
 }
 
 void RenderWidget::wheelEvent(QWheelEvent *e) {
+    if(volumeRenderer)
+        volumeRenderer->interacted();
     Controller::get()->mouseWheel(this, e->delta(), e->modifiers());
 }
 
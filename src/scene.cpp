@@ -11,10 +11,12 @@ Scene::Scene()
 {
     // volume rendering
     volume = new VolumeData();
+    series = new VolumeSeries(volume);
     renderProps = new VolumeRenderProps();
 }
 
 Scene::~Scene() {
+    delete series;
     delete volume;
     delete renderProps;
 }
@@ -72,11 +74,12 @@ void Scene::openProject(QString path) {
         volumeFile = QFileInfo(volumePath);
     }
 
-    // load new volume data if needed
-    if (volumePath != volume->getFilePath())
+    // load new volume data if needed (projects always show the whole volume)
+    if (volumePath != volume->getFilePath() || !volume->getRegion().isWhole())
     {
         qInfo() << "Loading volume from " << volumePath;
-        volume->loadFrom(volumePath);
+        series->close();
+        volume->loadAsync(volumePath);
     }
     else
     {
@@ -89,13 +92,33 @@ void Scene::openProject(QString path) {
 
 // volume rendering
 void Scene::loadVolume(QString path) {
-    volume->loadFrom(path);
+    series->close();
+    volume->loadAsync(path);
+}
+
+void Scene::loadVolumeRegion(QString path, const VolumeRegion &region) {
+    series->close();
+    volume->loadAsync(path, region);
+}
+
+void Scene::loadVolumeLive(QString path) {
+    series->close();
+    volume->loadLive(path);
+}
+
+bool Scene::loadVolumeSeries(QStringList paths) {
+    volume->cancelLoading();
+    return series->open(paths);
 }
 
 VolumeData* Scene::getVolume() {
     return volume;
 }
 
+VolumeSeries* Scene::getSeries() {
+    return series;
+}
+
 VolumeRenderProps* Scene::getVolumeRenderProps() {
     return renderProps;
 }
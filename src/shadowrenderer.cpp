@@ -2,6 +2,8 @@
 
 #include "glutils.hpp"
 
+#include <cmath>
+
 #define PI 3.141509f
 
 static const QString localOpacVPath = "tex3d.vert", localOpacFPath = "localopacity.frag";
@@ -48,6 +50,8 @@ ShadowRenderer::ShadowRenderer(VolumeRenderer *volumeRenderer)
     scatteringProgram->setUniformValue("globalOpacity", 3);
     scatteringProgram->release();
     scatteringTheta = scatteringPhi = 0.f;
+    dirtyBegin = 0.f;
+    dirtyEnd = 1.f;
 
     // create the textures---------------------------------------------------------
     glF->glActiveTexture(GL_TEXTURE0);
@@ -102,9 +106,59 @@ ShadowRenderer::ShadowRenderer(VolumeRenderer *volumeRenderer)
 }
 
 void ShadowRenderer::shadowPropsChanged() {
+    invalidate();
+}
+
+void ShadowRenderer::invalidate() {
     // to ensure that all shadow and opacity volumes are recomputed a
     // possible current scattering compuatation must be aborted.
     scatteringTheta = scatteringPhi = 0.f;
+    dirtyBegin = 0.f;
+    dirtyEnd = 1.f;
+}
+
+/**
+ * The opacities are integrated towards the light up to the border of the
+ * volume, so new slices change all layers on the side of the slices that
+ * faces away from the light, and the layers within a light segment (plus the
+ * filter footprint) of them. The scattered light is summed up over the whole
+ * volume, so with scattering everything is recomputed.
+ */
+void ShadowRenderer::invalidateSlices(float zBegin, float zEnd) {
+    VolumeRenderProps *renderProps = volumeRenderer->renderProps;
+    if(depth <= 0 || renderProps->getScatteringRadius() > 0.f) {
+        invalidate();
+        return;
+    }
+    float margin = renderProps->getLightSegmentLength() + 2.f / depth;
+    float begin = zBegin - margin;
+    float end = zEnd + margin;
+    QVector3D lightPos = renderProps->getLightPos();
+    if(renderProps->getLightDirectional()) {
+        // all rays point in the same direction
+        if(lightPos.z() > 0.f)
+            begin = 0.f;
+        if(lightPos.z() < 0.f)
+            end = 1.f;
+    } else {
+        // the layers below the light look up, the ones above it look down
+        if(lightPos.z() >= begin)
+            begin = 0.f;
+        if(lightPos.z() <= end)
+            end = 1.f;
+    }
+
+    // an empty range is a full update already
+    if(dirtyBegin < dirtyEnd) {
+        dirtyBegin = qMin(dirtyBegin, begin);
+        dirtyEnd = qMax(dirtyEnd, end);
+    } else {
+        dirtyBegin = begin;
+        dirtyEnd = end;
+    }
+    dirtyBegin = qMax(0.f, dirtyBegin);
+    dirtyEnd = qMin(1.f, dirtyEnd);
+    scatteringTheta = scatteringPhi = 0.f;
 }
 
 ///
@@ -120,10 +174,17 @@ bool ShadowRenderer::updateShadowVolume(PrimitiveUtils *primRenderer) {
     glCullFace(GL_BACK);
     glDisable(GL_DEPTH_TEST);
 
-    // for the first step, the initial opacity and shadow volumes are computed
+    // for the first step, the initial opacity and shadow volumes are computed.
+    // Only the invalidated layers are recomputed, all of them if none were
+    // invalidated explicitly
     if(scatteringTheta == 0.f && scatteringPhi == 0.f) {
-        renderOpacities(primRenderer);
-        renderShadowVolume(primRenderer);
+        if(dirtyBegin >= dirtyEnd)
+            invalidate();
+        int layerBegin = qBound(0, static_cast<int>(std::floor(dirtyBegin * depth)), depth);
+        int layerEnd = qBound(layerBegin, static_cast<int>(std::ceil(dirtyEnd * depth)), depth);
+        renderOpacities(primRenderer, layerBegin, layerEnd);
+        renderShadowVolume(primRenderer, layerBegin, layerEnd);
+        dirtyBegin = dirtyEnd = 0.f;
     }
     // for all other steps the scattered light is added to the shadow volume
     if(volumeRenderer->renderProps->getScatteringRadius() > 0.f) {
@@ -165,6 +226,8 @@ void ShadowRenderer::updateBaseTextures() {
     if(_width == width && _height == height && _depth == depth) {
         return; // the textures already have the correct size
     }
+    // the new textures are empty
+    invalidate();
 
     width = volumeRenderer->dataset->getProperties().width/dimin;
     height = volumeRenderer->dataset->getProperties().height/dimin;
@@ -206,7 +269,8 @@ void ShadowRenderer::updateBaseTextures() {
 }
 
 
-void ShadowRenderer::process3DTexture(QOpenGLShaderProgram *program, GLuint fbo, GLuint texture, PrimitiveUtils *primRenderer, bool blend) {
+void ShadowRenderer::process3DTexture(QOpenGLShaderProgram *program, GLuint fbo, GLuint texture, PrimitiveUtils *primRenderer,
+                                      int layerBegin, int layerEnd, bool blend) {
     QOpenGLFunctions_4_0_Core *glF = GLUtils::glFunc();
 
     // enable blending if needed (scattering)
@@ -225,8 +289,8 @@ void ShadowRenderer::process3DTexture(QOpenGLShaderProgram *program, GLuint fbo,
     // set the uniforms
     program->setUniformValue("layerCount", depth);
 
-    // render [layer] = [depth] times a plane
-    for(int i=0; i<depth; i++) {
+    // render a plane per layer
+    for(int i=layerBegin; i<layerEnd; i++) {
         program->setUniformValue("layer", i);
         glF->glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, i);
         primRenderer->renderPlaneXY();
@@ -242,12 +306,12 @@ void ShadowRenderer::process3DTexture(QOpenGLShaderProgram *program, GLuint fbo,
     glFlush();
 }
 
-void ShadowRenderer::renderOpacities(PrimitiveUtils *primRenderer) {
+void ShadowRenderer::renderOpacities(PrimitiveUtils *primRenderer, int layerBegin, int layerEnd) {
     // clear errors
     QString err = GLUtils::glError();
 
     QOpenGLFunctions_4_0_Core *glF = GLUtils::glFunc();
-    VolumeDataProps dataProps = volumeRenderer->dataset->getProperties();
+    VolumeDataProps dataProps = volumeRenderer->textureProperties();
     VolumeRenderProps *renderProps = volumeRenderer->renderProps;
 
     // Render the Local Opacity Volume -----------------------------
@@ -263,6 +327,7 @@ void ShadowRenderer::renderOpacities(PrimitiveUtils *primRenderer) {
     localProgram->setUniformValue("baseStep", renderProps->getLightOpacityBaseStep());
     localProgram->setUniformValue("directional", renderProps->getLightDirectional());
     localProgram->setUniformValue("segmentLength", renderProps->getLightSegmentLength());
+    localProgram->setUniformValue("volumeLod", volumeLod());
 
     // bind the textures
     glF->glActiveTexture(GL_TEXTURE0);
@@ -271,7 +336,7 @@ void ShadowRenderer::renderOpacities(PrimitiveUtils *primRenderer) {
     glF->glBindTexture(GL_TEXTURE_1D, volumeRenderer->transFuncTexture);
 
     // render the result to the 3D texture localOpac
-    process3DTexture(localProgram, localFBO, localOpacityTex, primRenderer);
+    process3DTexture(localProgram, localFBO, localOpacityTex, primRenderer, layerBegin, layerEnd);
     localProgram->release();
 
     err = GLUtils::glError();
@@ -296,7 +361,7 @@ void ShadowRenderer::renderOpacities(PrimitiveUtils *primRenderer) {
     glF->glBindTexture(GL_TEXTURE_3D, localOpacityTex);
 
     // render the result to the 3D texture globalOpac
-    process3DTexture(globalProgram, globalFBO, globalOpacityTex, primRenderer);
+    process3DTexture(globalProgram, globalFBO, globalOpacityTex, primRenderer, layerBegin, layerEnd);
     globalProgram->release();
 
     err = GLUtils::glError();
@@ -304,7 +369,7 @@ void ShadowRenderer::renderOpacities(PrimitiveUtils *primRenderer) {
         qInfo() << "Global Opacity Render Errors:" << err;
 }
 
-void ShadowRenderer::renderShadowVolume(PrimitiveUtils *primRenderer) {
+void ShadowRenderer::renderShadowVolume(PrimitiveUtils *primRenderer, int layerBegin, int layerEnd) {
     // clear errors
     QString err = GLUtils::glError();
 
@@ -325,7 +390,7 @@ void ShadowRenderer::renderShadowVolume(PrimitiveUtils *primRenderer) {
     glF->glBindTexture(GL_TEXTURE_3D, globalOpacityTex);
 
     // render the result to the 3D shadow/lighting texture
-    process3DTexture(shadowProgram, shadowFBO, shadowTex, primRenderer);
+    process3DTexture(shadowProgram, shadowFBO, shadowTex, primRenderer, layerBegin, layerEnd);
     shadowProgram->release();
 
     err = GLUtils::glError();
@@ -341,7 +406,7 @@ void ShadowRenderer::renderScattering(PrimitiveUtils *primRenderer) {
 
     scatteringProgram->bind();
     // bind the needed uniforms
-    VolumeDataProps dataProps = volumeRenderer->dataset->getProperties();
+    VolumeDataProps dataProps = volumeRenderer->textureProperties();
     VolumeRenderProps *renderProps = volumeRenderer->renderProps;
 
     // Render the Local Opacity Volume -----------------------------
@@ -360,6 +425,7 @@ void ShadowRenderer::renderScattering(PrimitiveUtils *primRenderer) {
     scatteringProgram->setUniformValue("theta", scatteringTheta);
     scatteringProgram->setUniformValue("phi", scatteringPhi);
     scatteringProgram->setUniformValue("radius", renderProps->getScatteringRadius());
+    scatteringProgram->setUniformValue("volumeLod", volumeLod());
     //shadowProgram->setUniformValue("stepCount", renderProps->?);
 
     // bind the textures
@@ -373,7 +439,7 @@ void ShadowRenderer::renderScattering(PrimitiveUtils *primRenderer) {
     glF->glBindTexture(GL_TEXTURE_3D, globalOpacityTex);
 
     // add the result to the 3D shadow/lighting texture with bleding
-    process3DTexture(scatteringProgram, shadowFBO, shadowTex, primRenderer, true); // true = additive blending!
+    process3DTexture(scatteringProgram, shadowFBO, shadowTex, primRenderer, 0, depth, true); // true = additive blending!
     scatteringProgram->release();
 
     err = GLUtils::glError();
@@ -381,6 +447,16 @@ void ShadowRenderer::renderScattering(PrimitiveUtils *primRenderer) {
         qInfo() << "Scattering Render Errors:" << err;
 }
 
+/**
+ * The opacity volumes are reduced by the shadow dimin factor, so they are
+ * computed from the pyramid level of the same resolution (if the volume
+ * texture has mip levels).
+ */
+float ShadowRenderer::volumeLod() {
+    int dimin = volumeRenderer->renderProps->getShadowDimin();
+    return qMax(0.f, std::log2(static_cast<float>(dimin)) - volumeRenderer->volumeTextureLevel);
+}
+
 GLuint ShadowRenderer::getShadowTexture() {
     return shadowTex;
 }
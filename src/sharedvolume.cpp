@@ -0,0 +1,95 @@
+#include "sharedvolume.hpp"
+
+#include <QDebug>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+const char SharedVolume::MAGIC[8] = { 'V', 'L', 'S', 'H', 'M', 'V', 'O', 'L' };
+const QString SharedVolume::PATH_PREFIX = "shm://";
+
+bool SharedVolume::isSharedVolume(QString path) {
+    return path.startsWith(PATH_PREFIX);
+}
+
+QString SharedVolume::segmentName(QString path) {
+    QString name = isSharedVolume(path) ? path.mid(PATH_PREFIX.size()) : path;
+    return name.startsWith('/') ? name : "/" + name;
+}
+
+int SharedVolume::openSegment(QString name, bool create, qint64 size) {
+#ifdef Q_OS_UNIX
+    QByteArray segment = segmentName(name).toLocal8Bit();
+    int fd = create ? ::shm_open(segment.constData(), O_RDWR | O_CREAT | O_EXCL, 0600)
+                    : ::shm_open(segment.constData(), O_RDONLY, 0);
+    if(fd < 0) {
+        qWarning() << "Could not open the shared memory segment" << segment << ":" << strerror(errno);
+        return -1;
+    }
+    if(create && ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        qWarning() << "Could not resize the shared memory segment" << segment << "to" << size << "bytes:" << strerror(errno);
+        ::close(fd);
+        ::shm_unlink(segment.constData());
+        return -1;
+    }
+    return fd;
+#else
+    Q_UNUSED(create);
+    Q_UNUSED(size);
+    qWarning() << "Shared memory volumes are not supported on this platform, cannot open" << name;
+    return -1;
+#endif
+}
+
+bool SharedVolume::removeSegment(QString name) {
+#ifdef Q_OS_UNIX
+    return ::shm_unlink(segmentName(name).toLocal8Bit().constData()) == 0;
+#else
+    Q_UNUSED(name);
+    return false;
+#endif
+}
+
+bool SharedVolume::readHeader(QString path, Header &header) {
+#ifdef Q_OS_UNIX
+    int fd = openSegment(path, false);
+    if(fd < 0)
+        return false;
+    struct stat info;
+    bool ok = ::fstat(fd, &info) == 0
+            && ::pread(fd, &header, sizeof(Header), 0) == static_cast<ssize_t>(sizeof(Header));
+    ::close(fd);
+    if(!ok || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        qWarning() << "The shared memory segment" << path << "does not hold a volume!";
+        return false;
+    }
+    if(header.byteOrder != BYTE_ORDER_MARK || header.version != VERSION) {
+        qWarning() << "The volume in" << path << "was written with a different byte order or header version!";
+        return false;
+    }
+    // the type tag may fill the whole field
+    header.type[sizeof(header.type) - 1] = '\0';
+    qint64 voxelCount = static_cast<qint64>(header.width) * header.height * header.depth;
+    if(header.width <= 0 || header.height <= 0 || header.depth <= 0 || header.dataOffset < static_cast<qint64>(sizeof(Header))
+            || header.dataSize < voxelCount || header.dataOffset + header.dataSize > info.st_size) {
+        qWarning() << "Invalid volume header in the shared memory segment" << path << "!";
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(header);
+    qWarning() << "Shared memory volumes are not supported on this platform, cannot open" << path;
+    return false;
+#endif
+}
+
+SharedVolume::SharedVolume()
+{
+}
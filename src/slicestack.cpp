@@ -0,0 +1,251 @@
+#include "slicestack.hpp"
+
+#include <QCollator>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QMap>
+#include <QRegularExpression>
+
+#include <algorithm>
+#include <cstring>
+
+#include "volumedescriptor.hpp"
+
+const QString SliceStack::DESCRIPTOR_NAME = "stack.vdesc";
+
+namespace {
+
+// reverses the bytes of count values of the given size in place
+void swapBytes(char *data, qint64 count, int size) {
+    for(qint64 i = 0; i < count; i++, data += size)
+        std::reverse(data, data + size);
+}
+
+// the next token of a PGM header, comments start with '#'
+QByteArray pgmToken(QFile &file) {
+    QByteArray token;
+    char c;
+    while(file.getChar(&c)) {
+        if(c == '#') {
+            file.readLine();
+        } else if(c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            if(!token.isEmpty())
+                break;
+        } else {
+            token.append(c);
+        }
+    }
+    return token;
+}
+
+}
+
+SliceStack::SliceStack()
+{
+    format = RAW;
+    header.width = header.height = header.depth = 0;
+    header.aspectX = header.aspectY = header.aspectZ = 1.f;
+    header.type = VoxelType::UINT8;
+    header.dataOffset = 0;
+    header.bigEndian = false;
+}
+
+bool SliceStack::isSliceStack(QString path) {
+    return QFileInfo(path).isDir();
+}
+
+bool SliceStack::open(QString directory) {
+    QDir dir(directory);
+    header.dataPath = directory;
+
+    // the slices are the files with the most common supported suffix
+    QStringList imageSuffixes;
+    for(const QByteArray &name : QImageReader::supportedImageFormats())
+        imageSuffixes << QString(name).toLower();
+    QMap<QString, QStringList> bySuffix;
+    for(const QFileInfo &info : dir.entryInfoList(QDir::Files, QDir::Name)) {
+        QString suffix = info.suffix().toLower();
+        if(suffix == "pgm" || suffix == "raw" || imageSuffixes.contains(suffix))
+            bySuffix[suffix] << info.fileName();
+    }
+    QString suffix;
+    for(auto it = bySuffix.constBegin(); it != bySuffix.constEnd(); ++it) {
+        if(suffix.isEmpty() || it.value().size() > bySuffix[suffix].size())
+            suffix = it.key();
+    }
+    if(suffix.isEmpty()) {
+        qWarning() << "No slices found in" << directory << "!";
+        return false;
+    }
+    format = suffix == "pgm" ? PGM : suffix == "raw" ? RAW : IMAGE;
+
+    // order the slices by the last number in their names. Without numbers
+    // the names are sorted naturally and there are no gaps
+    QStringList names = bySuffix[suffix];
+    QRegularExpression number("(\\d+)\\D*$");
+    QMap<qint64, QString> numbered;
+    for(const QString &name : names) {
+        QRegularExpressionMatch match = number.match(name);
+        if(!match.hasMatch() || numbered.contains(match.captured(1).toLongLong())) {
+            numbered.clear();
+            break;
+        }
+        numbered[match.captured(1).toLongLong()] = name;
+    }
+    // numbers far apart are no slice indices (e.g. dates)
+    if(!numbered.isEmpty() && numbered.lastKey() - numbered.firstKey() >= 2 * static_cast<qint64>(names.size()))
+        numbered.clear();
+    files.clear();
+    if(!numbered.isEmpty()) {
+        qint64 first = numbered.firstKey();
+        for(qint64 i = first; i <= numbered.lastKey(); i++)
+            files << (numbered.contains(i) ? dir.filePath(numbered[i]) : QString());
+    } else {
+        QCollator collator;
+        collator.setNumericMode(true);
+        std::sort(names.begin(), names.end(), collator);
+        for(const QString &name : names)
+            files << dir.filePath(name);
+    }
+    header.depth = files.size();
+
+    // the descriptor is required for RAW slices and provides the spacing otherwise
+    QString descriptor = dir.filePath(DESCRIPTOR_NAME);
+    if(QFile::exists(descriptor)) {
+        int depth = header.depth;
+        if(!VolumeDescriptor::readSlices(descriptor, header))
+            return false;
+        header.depth = depth;
+    } else if(format == RAW) {
+        qWarning() << "RAW slices need a" << DESCRIPTOR_NAME << "descriptor in" << directory << "!";
+        return false;
+    }
+
+    // the dimensions and the voxel type of images are taken from the first slice
+    if(format == PGM) {
+        if(!readPgmHeader(files.first(), header.width, header.height, header.type, header.dataOffset))
+            return false;
+        header.bigEndian = true;
+    } else if(format == IMAGE) {
+        QImageReader reader(files.first());
+        QImage first = reader.read();
+        if(first.isNull()) {
+            qWarning() << "Could not read the slice" << files.first() << ":" << reader.errorString();
+            return false;
+        }
+        header.width = first.width();
+        header.height = first.height();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+        header.type = first.format() == QImage::Format_Grayscale16 || first.format() == QImage::Format_RGBA64 ? VoxelType::UINT16 : VoxelType::UINT8;
+#else
+        header.type = VoxelType::UINT8;
+#endif
+    }
+    if(header.width <= 0 || header.height <= 0) {
+        qWarning() << "Invalid slice dimensions in" << directory << "!";
+        return false;
+    }
+
+    qInfo() << "Slice stack" << directory << ":" << header.depth << suffix << "slices of"
+            << header.width << "x" << header.height << VoxelType::name(header.type) << "values";
+    return true;
+}
+
+bool SliceStack::isMissing(int z) {
+    return files[z].isEmpty();
+}
+
+const VolumeLoader::Header& SliceStack::getHeader() {
+    return header;
+}
+
+qint64 SliceStack::getSliceBytes() {
+    return static_cast<qint64>(header.width) * header.height * VoxelType::size(header.type);
+}
+
+bool SliceStack::decodeSlice(int z, char *dst) {
+    if(isMissing(z))
+        return false;
+    switch(format) {
+    case PGM:
+        return decodePgm(files[z], dst);
+    case IMAGE:
+        return decodeImage(files[z], dst);
+    default:
+        return decodeRaw(files[z], header.dataOffset, dst);
+    }
+}
+
+bool SliceStack::readPgmHeader(QString path, int &width, int &height, VoxelType::Type &type, qint64 &dataOffset) {
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open file " << path << " !";
+        return false;
+    }
+    if(pgmToken(file) != "P5") {
+        qWarning() << "Only binary PGM slices (P5) are supported: " << path;
+        return false;
+    }
+    width = pgmToken(file).toInt();
+    height = pgmToken(file).toInt();
+    int maxValue = pgmToken(file).toInt();
+    // a single white space separates the header from the values
+    dataOffset = file.pos();
+    if(maxValue <= 0 || maxValue > 65535) {
+        qWarning() << "Invalid PGM header in " << path << " !";
+        return false;
+    }
+    type = maxValue < 256 ? VoxelType::UINT8 : VoxelType::UINT16;
+    return true;
+}
+
+bool SliceStack::decodePgm(QString path, char *dst) {
+    int width, height;
+    VoxelType::Type type;
+    qint64 offset;
+    if(!readPgmHeader(path, width, height, type, offset))
+        return false;
+    if(width != header.width || height != header.height || type != header.type) {
+        qWarning() << "The slice" << path << "does not match the first slice!";
+        return false;
+    }
+    return decodeRaw(path, offset, dst);
+}
+
+bool SliceStack::decodeImage(QString path, char *dst) {
+    QImageReader reader(path);
+    QImage image = reader.read();
+    if(image.isNull() || image.width() != header.width || image.height() != header.height) {
+        qWarning() << "Could not read the slice" << path << "or it does not match the first slice!";
+        return false;
+    }
+
+    // the rows of a QImage are padded to 4 bytes
+    QImage::Format gray = QImage::Format_Grayscale8;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    if(header.type == VoxelType::UINT16)
+        gray = QImage::Format_Grayscale16;
+#endif
+    if(image.format() != gray)
+        image = image.convertToFormat(gray);
+    qint64 rowBytes = static_cast<qint64>(header.width) * VoxelType::size(header.type);
+    for(int y = 0; y < header.height; y++, dst += rowBytes)
+        memcpy(dst, image.constScanLine(y), rowBytes);
+    return true;
+}
+
+bool SliceStack::decodeRaw(QString path, qint64 offset, char *dst) {
+    QFile file(path);
+    qint64 size = getSliceBytes();
+    if(!file.open(QIODevice::ReadOnly) || !file.seek(offset) || file.read(dst, size) != size) {
+        qWarning() << "Could not read the slice" << path << "!";
+        return false;
+    }
+    if(VoxelType::size(header.type) > 1 && header.bigEndian != (Q_BYTE_ORDER == Q_BIG_ENDIAN))
+        swapBytes(dst, size / VoxelType::size(header.type), VoxelType::size(header.type));
+    return true;
+}
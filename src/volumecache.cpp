@@ -0,0 +1,243 @@
+#include "volumecache.hpp"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QStandardPaths>
+
+#include <cstring>
+
+namespace {
+
+const char MAGIC[8] = { 'V', 'L', 'C', 'A', 'C', 'H', 'E', '1' };
+const QString ENTRY_SUFFIX = "vcache";
+
+qint64 alignUp(qint64 value) {
+    return (value + VoxelBuffer::ALIGNMENT - 1) / VoxelBuffer::ALIGNMENT * VoxelBuffer::ALIGNMENT;
+}
+
+QDataStream& setupStream(QDataStream &stream) {
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+    return stream;
+}
+
+}
+
+VolumeCache::VolumeCache(QString directory, qint64 maxBytes)
+{
+    this->directory = directory;
+    this->maxBytes = maxBytes;
+}
+
+QString VolumeCache::defaultDirectory() {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/volumes";
+}
+
+/**
+ * Hashes SAMPLE_COUNT blocks spread evenly over the file (including its
+ * header and its end) instead of the whole content, so the key of a
+ * large file is computed in a few milliseconds.
+ */
+QString VolumeCache::key(QString path, QString descriptor) {
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return QString();
+    QFileInfo info(path);
+    qint64 size = file.size();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QByteArray block;
+    qint64 span = qMax(Q_INT64_C(0), size - SAMPLE_BYTES);
+    for(int i = 0; i < SAMPLE_COUNT; i++) {
+        if(!file.seek(span * i / (SAMPLE_COUNT - 1)))
+            return QString();
+        block = file.read(SAMPLE_BYTES);
+        hash.addData(block);
+    }
+    if(!descriptor.isEmpty()) {
+        QFile descriptorFile(descriptor);
+        if(!descriptorFile.open(QIODevice::ReadOnly))
+            return QString();
+        hash.addData(descriptorFile.read(SAMPLE_BYTES));
+    }
+    return QString(hash.result().toHex().left(32)) + "-" + QString::number(size)
+            + "-" + QString::number(info.lastModified().toMSecsSinceEpoch());
+}
+
+QString VolumeCache::entryPath(QString key) {
+    return derivedPath(key, ENTRY_SUFFIX);
+}
+
+QString VolumeCache::derivedPath(QString key, QString suffix) {
+    return directory + "/" + key + "." + suffix;
+}
+
+bool VolumeCache::load(QString key, VolumeLoader::Result &result) {
+    QFile file(entryPath(key));
+    if(!file.exists() || !file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    setupStream(in);
+    char magic[sizeof(MAGIC)];
+    quint32 version, type, buckets;
+    qint32 width, height, depth;
+    double aspectX, aspectY, aspectZ;
+    in.readRawData(magic, sizeof(MAGIC));
+    in >> version >> width >> height >> depth >> aspectX >> aspectY >> aspectZ
+       >> type >> result.dataMin >> result.dataMax >> buckets;
+    if(in.status() != QDataStream::Ok || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION
+            || type >= static_cast<quint32>(VoxelType::TYPE_COUNT) || buckets > HISTOGRAM_BUCKETS) {
+        qWarning() << "Invalid volume cache entry" << file.fileName() << "!";
+        return false;
+    }
+    result.histogram.resize(buckets);
+    for(quint32 i = 0; i < buckets; i++)
+        in >> result.histogram[i];
+    quint64 offset;
+    in >> offset;
+    if(in.status() != QDataStream::Ok)
+        return false;
+
+    result.type = static_cast<VoxelType::Type>(type);
+    result.properties.width = width;
+    result.properties.height = height;
+    result.properties.depth = depth;
+    result.properties.aspectX = aspectX;
+    result.properties.aspectY = aspectY;
+    result.properties.aspectZ = aspectZ;
+
+    qint64 size = static_cast<qint64>(width) * height * depth * VoxelType::size(result.type);
+    if(!result.data.map(file.fileName(), offset, size, false)) {
+        qWarning() << "Could not map the volume cache entry" << file.fileName() << "!";
+        result.histogram.clear();
+        return false;
+    }
+
+    // the modification time of the entry orders the eviction
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    qInfo() << "Mapped the cached volume" << file.fileName();
+    return true;
+}
+
+bool VolumeCache::store(QString key, VolumeLoader::Result &result) {
+    qint64 size = result.data.size();
+    if(size > maxBytes) {
+        qInfo() << "The volume is larger than the cache size cap and is not cached";
+        return false;
+    }
+    if(!QDir().mkpath(directory)) {
+        qWarning() << "Could not create the volume cache directory" << directory << "!";
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // the entry is written under a temporary name, so an interrupted
+    // write never leaves an incomplete entry behind
+    QString path = entryPath(key);
+    QFile file(path + ".tmp");
+    if(!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not write the volume cache entry" << path << "!";
+        return false;
+    }
+
+    QDataStream out(&file);
+    setupStream(out);
+    out.writeRawData(MAGIC, sizeof(MAGIC));
+    out << VERSION << static_cast<qint32>(result.properties.width) << static_cast<qint32>(result.properties.height)
+        << static_cast<qint32>(result.properties.depth) << static_cast<double>(result.properties.aspectX)
+        << static_cast<double>(result.properties.aspectY) << static_cast<double>(result.properties.aspectZ)
+        << static_cast<quint32>(result.type) << result.dataMin << result.dataMax
+        << static_cast<quint32>(result.histogram.size());
+    for(size_t i = 0; i < result.histogram.size(); i++)
+        out << result.histogram[i];
+    qint64 offset = alignUp(file.pos() + static_cast<qint64>(sizeof(quint64)));
+    out << static_cast<quint64>(offset);
+
+    QByteArray padding(static_cast<int>(offset - file.pos()), '\0');
+    out.writeRawData(padding.constData(), padding.size());
+    // QDataStream writes at most 2 GiB at once
+    for(qint64 done = 0; done < size; ) {
+        int chunk = static_cast<int>(qMin(size - done, Q_INT64_C(1) << 30));
+        out.writeRawData(result.data.data() + done, chunk);
+        done += chunk;
+    }
+    file.close();
+
+    if(out.status() != QDataStream::Ok || file.error() != QFileDevice::NoError) {
+        qWarning() << "Could not write the volume cache entry" << path << "!";
+        file.remove();
+        return false;
+    }
+    QFile::remove(path);
+    if(!file.rename(path)) {
+        qWarning() << "Could not write the volume cache entry" << path << "!";
+        file.remove();
+        return false;
+    }
+    qInfo() << "Cached the volume as" << path << "in" << timer.elapsed() << "ms";
+
+    evict(key);
+    return true;
+}
+
+void VolumeCache::evict(QString keep) {
+    QDir dir(directory);
+    if(!dir.exists())
+        return;
+
+    // an entry and its derived files form one unit, it is as old as its newest file
+    QMap<QString, QDateTime> used;
+    QMap<QString, qint64> sizes;
+    qint64 total = 0;
+    for(const QFileInfo &info : dir.entryInfoList(QDir::Files)) {
+        QString key = info.fileName().section('.', 0, 0);
+        if(!used.contains(key) || info.lastModified() > used[key])
+            used[key] = info.lastModified();
+        sizes[key] += info.size();
+        total += info.size();
+    }
+    if(total <= maxBytes)
+        return;
+
+    QMultiMap<QDateTime, QString> byAge;
+    for(auto it = used.constBegin(); it != used.constEnd(); ++it)
+        byAge.insert(it.value(), it.key());
+
+    for(auto it = byAge.constBegin(); it != byAge.constEnd() && total > maxBytes; ++it) {
+        if(it.value() == keep)
+            continue;
+        for(const QFileInfo &info : dir.entryInfoList(QStringList(it.value() + ".*"), QDir::Files))
+            QFile::remove(info.absoluteFilePath());
+        total -= sizes[it.value()];
+        qInfo() << "Evicted" << it.value() << "from the volume cache";
+    }
+}
+
+bool VolumeCache::clear() {
+    QDir dir(directory);
+    if(!dir.exists())
+        return true;
+    bool ok = true;
+    for(const QFileInfo &info : dir.entryInfoList(QDir::Files))
+        ok = QFile::remove(info.absoluteFilePath()) && ok;
+    qInfo() << "Cleared the volume cache" << directory;
+    return ok;
+}
+
+QString VolumeCache::getDirectory() {
+    return directory;
+}
+
+qint64 VolumeCache::getMaxBytes() {
+    return maxBytes;
+}
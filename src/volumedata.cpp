@@ -1,15 +1,95 @@
 #include "volumedata.hpp"
 
+#include <QCoreApplication>
 #include <QDataStream>
 #include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
 
+#include <cerrno>
 #include <iostream>
 #include <vector>
 #include <fstream>
 
+#ifdef Q_OS_UNIX
+    #include <signal.h>
+#endif
+
 #include "renderwidget.hpp"
 #include "glutils.hpp"
+#include "occupancygrid.hpp"
+#include "parallel.hpp"
+#include "volumecache.hpp"
+#include "volumeloader.hpp"
+#include "volumepyramid.hpp"
+#include "voxelkernels.hpp"
+
+// numbers the spill files of this process
+static int spillCount = 0;
+
+// true unless the process with the given id is known to have exited
+static bool processAlive(qint64 pid) {
+#if defined(Q_OS_UNIX)
+    // EPERM: the process exists but belongs to another user
+    return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#elif defined(Q_OS_WIN)
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(pid));
+    if(process == nullptr)
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    DWORD exitCode = 0;
+    bool alive = GetExitCodeProcess(process, &exitCode) && exitCode == STILL_ACTIVE;
+    CloseHandle(process);
+    return alive;
+#else
+    Q_UNUSED(pid);
+    return true;
+#endif
+}
+
+QString VolumeData::memoryPolicyName(MemoryPolicy policy) {
+    switch(policy) {
+    case KEEP:
+        return "Keep in Memory";
+    case RELEASE:
+        return "Release after Upload";
+    case MAP_FILE:
+        return "Map from File";
+    }
+    return "unknown";
+}
+
+QString VolumeData::texturePrecisionName(TexturePrecision precision) {
+    switch(precision) {
+    case AUTO_PRECISION:
+        return "Automatic";
+    case R8:
+        return "R8 (quantized)";
+    case R16:
+        return "R16";
+    case R16F:
+        return "R16F";
+    case R32F:
+        return "R32F";
+    }
+    return "unknown";
+}
+
+int VolumeData::texelSize(TexturePrecision precision) {
+    switch(precision) {
+    case AUTO_PRECISION:
+        return 0;
+    case R8:
+        return 1;
+    case R16:
+    case R16F:
+        return 2;
+    case R32F:
+        return 4;
+    }
+    return 0;
+}
 
 VolumeData::VolumeData()
 {
@@ -17,94 +97,320 @@ VolumeData::VolumeData()
     // there is no histogram created
     lastBuckets = -1;
     histogram = nullptr;
+    voxelType = VoxelType::UINT8;
+    dataMin = dataMax = 0.0;
+    domainMin = 0.0;
+    domainMax = 1.0;
+    readerBackend = VolumeReader::MMAP;
+    cacheEnabled = true;
+    uploadSlabBytes = DEFAULT_UPLOAD_SLAB_BYTES;
+    memoryPolicy = KEEP;
+    policyApplies = false;
+    releaseAfterUse = false;
+    spillCanceled = false;
+    spillGeneration = 0;
+    releaseAfterSpill = false;
+    texturePrecision = AUTO_PRECISION;
+    activePrecision = R8;
+    textureBudget = DEFAULT_TEXTURE_BUDGET;
+    releaseTimer = new QTimer(this);
+    releaseTimer->setSingleShot(true);
+    connect(releaseTimer, SIGNAL(timeout()), this, SLOT(releaseVoxels()));
+    loader = nullptr;
+    preview = false;
+    streaming = false;
+    streamedDepth = 0;
+    removeStaleSpillFiles();
+}
+
+VolumeData::~VolumeData()
+{
+    stopLoading();
+    cancelSpill();
 }
 
+/**
+ * Loads the volume synchronously on the calling thread.
+ */
 void VolumeData::loadFrom(QString path) {
+    loadFrom(path, VolumeRegion());
+}
+
+void VolumeData::loadFrom(QString path, const VolumeRegion &region) {
+    stopLoading();
+    VolumeLoader volumeLoader(path, readerBackend);
+    volumeLoader.setCacheEnabled(cacheEnabled);
+    volumeLoader.setRegion(region);
+    if(volumeLoader.load())
+        adopt(&volumeLoader, false);
+}
+
+/**
+ * Loads the volume on a background thread. A strided preview is shown
+ * first (previewChanged) and replaced by the full data (dataChanged)
+ * once it is read completely. The current data stays valid meanwhile.
+ * Slice stacks replace the data with their decoded slices instead, which
+ * are streamed into the volume texture (slicesStreamed).
+ */
+void VolumeData::loadAsync(QString path) {
+    loadAsync(path, VolumeRegion());
+}
+
+void VolumeData::loadAsync(QString path, const VolumeRegion &region) {
+    stopLoading();
+    loader = new VolumeLoader(path, readerBackend);
+    loader->setPreviewStride(PREVIEW_STRIDE);
+    loader->setCacheEnabled(cacheEnabled);
+    loader->setRegion(region);
+    connect(loader, SIGNAL(progress(int)), this, SLOT(loaderProgress(int)));
+    connect(loader, SIGNAL(previewReady()), this, SLOT(loaderPreviewReady()));
+    connect(loader, SIGNAL(slabReady(int)), this, SLOT(loaderSlabReady(int)));
+    connect(loader, SIGNAL(loaded(bool)), this, SLOT(loaderLoaded(bool)));
+    connect(loader, SIGNAL(finished()), loader, SLOT(deleteLater()));
+    loader->start();
+}
+
+/**
+ * Follows a live volume like a slice stack: its slices replace the data and
+ * are streamed into the volume texture as they arrive. There is no preview
+ * and no cache, as the file is not complete yet.
+ */
+void VolumeData::loadLive(QString path) {
+    stopLoading();
+    loader = new VolumeLoader(path, readerBackend);
+    loader->setLive(true);
+    connect(loader, SIGNAL(progress(int)), this, SLOT(loaderProgress(int)));
+    connect(loader, SIGNAL(slabReady(int)), this, SLOT(loaderSlabReady(int)));
+    connect(loader, SIGNAL(loaded(bool)), this, SLOT(loaderLoaded(bool)));
+    connect(loader, SIGNAL(finished()), loader, SLOT(deleteLater()));
+    loader->start();
+}
 
-    // check if the file exists
-    QFile file(path);
-    if(!file.exists()) {
-        qWarning() << "File " << path << " does not exist!";
+void VolumeData::cancelLoading() {
+    if(loader == nullptr)
         return;
-    }
+    stopLoading();
+    emit loadFinished(false);
+}
 
-    // open the file
-    qInfo() << endl << "Loading volume from " << path;
-    if(!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Could not open file " << path << " !";
+/**
+ * Stops the running load without reporting it, a load that replaces it
+ * reports its own result.
+ */
+void VolumeData::stopLoading() {
+    if(loader == nullptr)
         return;
-    }
+    // the loader is detached, its queued signals are ignored from now on
+    VolumeLoader *canceled = loader;
+    loader = nullptr;
+    canceled->cancel();
+    canceled->wait();
+    qInfo() << "Loading" << canceled->getPath() << "canceled";
+    if(streaming)
+        dropStream();
+}
 
-    filePath = path;
-
-    // load resolution and apsect ratio from the first two lines
-    int resX, resY, resZ;
-    float aspectX, aspectY, aspectZ;
-
-    QString strResolution = file.readLine();
-    QString strAspect = file.readLine();
-    QTextStream tsResolution(&strResolution, QIODevice::ReadOnly);
-    QTextStream tsAspect(&strAspect, QIODevice::ReadOnly);
-    tsResolution >> resX >> resY >> resZ;
-    tsAspect >> aspectX >> aspectY >> aspectZ;
-
-    // load the volume data as byte array
-    volumeData = file.readAll();
-    byteCount = volumeData.size()/(resX*resY*resZ);   // bytes per value
-
-    // close the file
-    file.close();
-
-    // update properties
-    properties.width = resX;
-    properties.height = resY;
-    properties.depth = resZ;
-    properties.aspectX = aspectX;
-    properties.aspectY = aspectY;
-    properties.aspectZ = aspectZ;
-
-    // determine max and min values of the data for normalizing
-    // and correct the byte order
-    uchar* d = reinterpret_cast<uchar*>(volumeData.data());
-    int domain = pow(256, byteCount);
-    int maxV = 0, minV = domain, v;
-    int tmp, l, r;
-    for(int i = 0; i < volumeData.size(); i += byteCount) {
-        // determine current Value
-        v = 0;
-        for(int b=0; b < byteCount; b++)//byteCount-1; b>=0; b--)
-            v = (v << 8) | static_cast<int>(d[i+b]);
-
-        if(v > maxV)
-            maxV = v;
-        if(v < minV)
-            minV = v;
-
-        // fix the byte order to big endian and find max and min values
-        for(int n = 0; n < (byteCount+1)/2; n++) {
-            l = i + n;
-            r = i + byteCount - 1 - n;
-            tmp = volumeData[l];
-            volumeData[l] = volumeData[r];
-            volumeData[r] = tmp;
+bool VolumeData::isLoading() {
+    return loader != nullptr;
+}
+
+bool VolumeData::isPreview() {
+    return preview;
+}
+
+bool VolumeData::isStreaming() {
+    return streaming;
+}
+
+int VolumeData::getStreamedDepth() {
+    return streamedDepth;
+}
+
+void VolumeData::loaderProgress(int percent) {
+    if(sender() == loader)
+        emit loadProgress(percent);
+}
+
+void VolumeData::loaderPreviewReady() {
+    if(sender() != loader)
+        return;
+    adopt(loader, true);
+}
+
+void VolumeData::loaderSlabReady(int depth) {
+    if(sender() != loader)
+        return;
+    if(!streaming)
+        adoptStream(loader);
+    streamedDepth = depth;
+
+    // a live volume provides the statistics of its slabs so far
+    double streamMin, streamMax;
+    std::vector<qint64> counts;
+    if(loader->getStreamStatistics(streamMin, streamMax, counts)) {
+        double oldDomainMin = domainMin, oldDomainMax = domainMax;
+        dataMin = streamMin;
+        dataMax = streamMax;
+        updateDomain();
+        histogramCounts.swap(counts);
+        lastBuckets = -1;
+        // the slices in the texture are normalized to the domain (floats),
+        // so they are streamed in again if it changes
+        if(domainMin != oldDomainMin || domainMax != oldDomainMax) {
+            emit previewChanged();
+            return;
         }
     }
-    // normalize the max and min intensity values
-    properties.minValue = minV / (float) domain;
-    properties.maxValue = maxV / (float) domain;
+    emit slicesStreamed();
+}
+
+void VolumeData::loaderLoaded(bool success) {
+    if(sender() != loader)
+        return;
+    VolumeLoader *finished = loader;
+    loader = nullptr;
+    if(success)
+        adopt(finished, false);
+    else if(streaming)
+        dropStream();
+    emit loadFinished(success);
+}
 
-    // log properties
-    qInfo() << "Dataset Dimension: " << resX << resY << resZ
-            << " Aspect: " << aspectX << aspectY << aspectZ
-            << " Bytes per value: " << byteCount
-            << "Intensity values between " << properties.minValue << "and" << properties.maxValue;
+/**
+ * Takes over the data of a loader that loaded a step of a series. The
+ * textures of the renderers can be refilled instead of recreated if the
+ * full data of the same shape is shown already.
+ */
+void VolumeData::adoptStep(VolumeLoader *source) {
+    stopLoading();
+    VolumeLoader::Result &result = source->getResult();
+    // the textures of volumes with a pyramid have mip levels the steps do not provide
+    bool sameShape = ready && !preview && !streaming && bricks.isNull() && pyramid.isNull() && voxelType == result.type
+            && properties.width == result.properties.width && properties.height == result.properties.height
+            && properties.depth == result.properties.depth && properties.aspectX == result.properties.aspectX
+            && properties.aspectY == result.properties.aspectY && properties.aspectZ == result.properties.aspectZ;
+    adopt(source, false, sameShape);
+}
+
+/**
+ * Takes over the preview or the full data of a loader. The old data stays valid until here.
+ */
+void VolumeData::adopt(VolumeLoader *source, bool isPreview, bool isStep) {
+    VolumeLoader::Result &result = isPreview ? source->getPreview() : source->getResult();
+    cancelSpill();
+    volumeData.swap(result.data);
+    result.data.release();
+
+    filePath = source->getPath();
+    region = source->getRegion();
+    preview = isPreview;
+    streaming = false;
+    voxelType = result.type;
+    properties = result.properties;
+    dataMin = result.dataMin;
+    dataMax = result.dataMax;
+    domainMin = result.domainMin;
+    domainMax = result.domainMax;
+    bricks = result.bricks;
+    pyramid = result.pyramid;
+    occupancy = result.occupancy;
+    histogramCounts.swap(result.histogram);
+    result.histogram.clear();
+    choosePrecision(!isStep);
+    updateDomain();
+
+    // log properties (once per series)
+    if(!isStep)
+        qInfo() << (preview ? "Preview Dimension: " : "Dataset Dimension: ")
+                << properties.width << properties.height << properties.depth
+                << " Aspect: " << properties.aspectX << properties.aspectY << properties.aspectZ
+                << " Voxel type: " << VoxelType::name(voxelType)
+                << "Intensity values between " << properties.minValue << "and" << properties.maxValue;
 
     ready = true;
 
-    histogram = nullptr;
+    // force the creation of a new histogram
+    lastBuckets = -1;
     createHistogram(256);
 
-    // calculate the normalize matrix
+    updateNormalizeMatrix();
+
+    // previews are replaced soon, the steps of a series too often
+    releaseTimer->stop();
+    releaseAfterUse = false;
+    policyApplies = !isPreview && !isStep;
+    if(policyApplies)
+        applyMemoryPolicy();
+
+    // listeners of dataChanged can rely on the full resolution data
+    if(preview)
+        emit previewChanged();
+    else if(isStep)
+        emit stepChanged();
+    else
+        emit dataChanged();
+}
+
+/**
+ * Replaces the data with the slices the loader decodes. Their values stay in
+ * the buffer of the loader (which only writes slices that were not announced
+ * yet) until the full data is adopted, so the texture is filled slab by slab
+ * without a copy. The old data is released here.
+ */
+void VolumeData::adoptStream(VolumeLoader *source) {
+    VolumeLoader::Result &result = source->getResult();
+    cancelSpill();
+    volumeData.release();
+
+    filePath = source->getPath();
+    region = source->getRegion();
+    preview = true;
+    streaming = true;
+    streamedDepth = 0;
+    voxelType = result.type;
+    properties = result.properties;
+    dataMin = result.dataMin;
+    dataMax = result.dataMax;
+    domainMin = result.domainMin;
+    domainMax = result.domainMax;
+    bricks.clear();
+    pyramid.clear();
+    occupancy.clear();
+    histogramCounts.clear();
+    ready = true;
+    lastBuckets = -1;
+    releaseTimer->stop();
+    releaseAfterUse = false;
+    policyApplies = false;
+    choosePrecision();
+    updateNormalizeMatrix();
+    qInfo() << "Streaming" << properties.width << properties.height << properties.depth << "slices of" << filePath;
+    emit previewChanged();
+}
+
+void VolumeData::dropStream() {
+    // the streamed slices are released with the loader
+    streaming = false;
+    streamedDepth = 0;
+    ready = false;
+    emit dataChanged();
+}
+
+int VolumeData::uploadStreamedSlices(GLuint texture, int uploadedDepth) {
+    if(!streaming || loader == nullptr || texture == GL_INVALID_VALUE || uploadedDepth >= streamedDepth)
+        return uploadedDepth;
+    QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
+    glF->glActiveTexture(GL_TEXTURE0);
+    glF->glBindTexture(GL_TEXTURE_3D, texture);
+    glF->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    // an incomplete upload is repeated with the next slices
+    bool complete = uploadSlices(0, loader->getResult().data.data(), properties.width, properties.height,
+                                 uploadedDepth, streamedDepth) >= 0;
+    glF->glBindTexture(GL_TEXTURE_3D, 0);
+    return complete ? streamedDepth : uploadedDepth;
+}
+
+void VolumeData::updateNormalizeMatrix() {
     float realWidth = properties.width * properties.aspectX;
     float realHeight = properties.height * properties.aspectY;
     float realDepth = properties.depth * properties.aspectZ;
@@ -122,19 +428,350 @@ void VolumeData::loadFrom(QString path) {
     }
     normalizeMatrix.setToIdentity();
     normalizeMatrix.scale(realWidth/max, realHeight/max, realDepth/max);
-
-    emit dataChanged();
 }
 
 QString VolumeData::getFilePath() {
     return filePath;
 }
 
+VolumeRegion VolumeData::getRegion() {
+    return region;
+}
+
+void VolumeData::setReaderBackend(VolumeReader::Backend backend) {
+    readerBackend = backend;
+}
+
+VolumeReader::Backend VolumeData::getReaderBackend() {
+    return readerBackend;
+}
+
+void VolumeData::setCacheEnabled(bool enabled) {
+    cacheEnabled = enabled;
+}
+
+bool VolumeData::isCacheEnabled() {
+    return cacheEnabled;
+}
+
+void VolumeData::setMemoryPolicy(MemoryPolicy policy) {
+    memoryPolicy = policy;
+    if(policy != RELEASE) {
+        releaseTimer->stop();
+        // released voxels are kept resident or mapped from now on
+        residentData();
+    }
+    if(ready && policyApplies)
+        applyMemoryPolicy();
+}
+
+VolumeData::MemoryPolicy VolumeData::getMemoryPolicy() {
+    return memoryPolicy;
+}
+
+void VolumeData::textureUploaded(bool allVoxels) {
+    releaseAfterUse = allVoxels;
+    if(!allVoxels)
+        releaseTimer->stop();
+    else if(memoryPolicy == RELEASE && policyApplies && !volumeData.isPagedOut())
+        releaseTimer->start(RELEASE_DELAY);
+}
+
+/**
+ * Unmaps the voxels after they were uploaded. Allocated voxels are spilled
+ * into a file first, so any later access (another view, a reduced texture,
+ * a histogram with a new bucket count) can map them again transparently.
+ */
+void VolumeData::releaseVoxels() {
+    if(memoryPolicy != RELEASE || !policyApplies || volumeData.isEmpty() || volumeData.isPagedOut())
+        return;
+    cacheDerivedData();
+    spillVoxels(true);
+}
+
+void VolumeData::applyMemoryPolicy() {
+    if(memoryPolicy != MAP_FILE)
+        return;
+    cacheDerivedData();
+    spillVoxels(false);
+}
+
+void VolumeData::cacheDerivedData() {
+    // the value range is known since loading, the histogram counts are only
+    // missing if the loader did not compute them (bricked volumes keep them
+    // in their metadata)
+    if(!histogramCounts.empty() || !bricks.isNull())
+        return;
+    const char *data = residentData();
+    if(data != nullptr)
+        VoxelKernels::histogram(data, volumeData.size() / VoxelType::size(voxelType), voxelType,
+                                dataMin, dataMax, VolumeCache::HISTOGRAM_BUCKETS, histogramCounts);
+}
+
+/**
+ * Writing gigabytes would block the main thread for seconds, so the spill
+ * file is written on a worker thread while the voxels stay in use, and the
+ * mapping replaces them in spillWritten. Voxels that are mapped from a file
+ * already (e.g. by the mmap backend in their native byte order) are paged
+ * out from their source file without a copy.
+ */
+void VolumeData::spillVoxels(bool release) {
+    if(volumeData.isPageable()) {
+        if(release)
+            pageOutVoxels();
+        return;
+    }
+    if(spillThread.joinable()) {
+        releaseAfterSpill = releaseAfterSpill || release;
+        return;
+    }
+    QString directory = QDir(VolumeCache::defaultDirectory()).filePath("spill");
+    if(!QDir().mkpath(directory)) {
+        qWarning() << "Could not create the spill directory" << directory << "!";
+        return;
+    }
+    spillPath = QDir(directory).filePath(QString("%1-%2.voxels").arg(QCoreApplication::applicationPid()).arg(spillCount++));
+    releaseAfterSpill = release;
+    spillCanceled = false;
+    int generation = ++spillGeneration;
+    spillThread = std::thread([this, generation]() {
+        QElapsedTimer timer;
+        timer.start();
+        bool success = volumeData.writeSpillFile(spillPath, spillCanceled);
+        if(success)
+            qInfo() << "Spilled" << volumeData.size() / (1024.0 * 1024.0) << "MiB of voxels into" << spillPath
+                    << "in" << timer.elapsed() << "ms";
+        QMetaObject::invokeMethod(this, "spillWritten", Qt::QueuedConnection, Q_ARG(int, generation), Q_ARG(bool, success));
+    });
+}
+
+void VolumeData::spillWritten(int generation, bool success) {
+    if(generation != spillGeneration || !spillThread.joinable())
+        return;
+    spillThread.join();
+    // the voxels stay allocated if they were kept in memory meanwhile
+    if(!success || memoryPolicy == KEEP || !policyApplies || !volumeData.mapSpillFile(spillPath)) {
+        if(!success)
+            qWarning() << "The voxels of" << filePath << "could not be spilled, they are kept in memory";
+        QFile::remove(spillPath);
+        return;
+    }
+    if(releaseAfterSpill && memoryPolicy == RELEASE)
+        pageOutVoxels();
+}
+
+void VolumeData::cancelSpill() {
+    if(!spillThread.joinable())
+        return;
+    spillCanceled = true;
+    spillThread.join();
+    // the queued spillWritten of the canceled spill is ignored
+    spillGeneration++;
+    QFile::remove(spillPath);
+}
+
+void VolumeData::pageOutVoxels() {
+    if(!volumeData.pageOut()) {
+        qWarning() << "The voxels of" << filePath << "could not be released, they are kept in memory";
+        return;
+    }
+    qInfo() << "Released" << volumeData.size() / (1024.0 * 1024.0) << "MiB of voxels after the upload,"
+            << "they are mapped again when needed";
+}
+
+/**
+ * Removes the spill files of processes that exited without releasing their
+ * voxels, e.g. after a crash. The files are named after the process id.
+ */
+void VolumeData::removeStaleSpillFiles() {
+    QDir directory(QDir(VolumeCache::defaultDirectory()).filePath("spill"));
+    if(!directory.exists())
+        return;
+    qint64 removedBytes = 0;
+    int removed = 0;
+    for(const QFileInfo &file : directory.entryInfoList(QStringList("*.voxels"), QDir::Files)) {
+        bool ok = false;
+        qint64 pid = file.baseName().section('-', 0, 0).toLongLong(&ok);
+        if(!ok || pid == QCoreApplication::applicationPid() || processAlive(pid))
+            continue;
+        if(QFile::remove(file.filePath())) {
+            removedBytes += file.size();
+            removed++;
+        }
+    }
+    if(removed > 0)
+        qInfo() << "Removed" << removed << "stale spill files with" << removedBytes / (1024.0 * 1024.0) << "MiB";
+}
+
+char* VolumeData::residentData() {
+    if(volumeData.isPagedOut()) {
+        if(!volumeData.pageIn())
+            return nullptr;
+        qInfo() << "Mapped the released voxels of" << filePath << "again";
+        // the CPU passes run on this thread before the timer fires, so the
+        // voxels are released again once the pass that needed them is done
+        if(releaseAfterUse && memoryPolicy == RELEASE && policyApplies)
+            releaseTimer->start(RELEASE_DELAY);
+    }
+    return volumeData.data();
+}
+
+void VolumeData::setTexturePrecision(TexturePrecision precision) {
+    texturePrecision = precision;
+    updatePrecision();
+}
+
+VolumeData::TexturePrecision VolumeData::getTexturePrecision() {
+    return texturePrecision;
+}
+
+void VolumeData::setTextureBudget(qint64 bytes) {
+    textureBudget = bytes;
+    if(texturePrecision == AUTO_PRECISION)
+        updatePrecision();
+}
+
+qint64 VolumeData::getTextureBudget() {
+    return textureBudget;
+}
+
+VolumeData::TexturePrecision VolumeData::getActivePrecision() {
+    return activePrecision;
+}
+
+GLenum VolumeData::getTextureFormat() {
+    switch(activePrecision) {
+    case R16:
+        return GL_R16;
+    case R16F:
+        return GL_R16F;
+    case R32F:
+        return GL_R32F;
+    default:
+        return GL_R8;
+    }
+}
+
+GLenum VolumeData::getUploadType() {
+    return isQuantized() ? GL_UNSIGNED_BYTE : VoxelType::uploadType(voxelType);
+}
+
+int VolumeData::getUploadSize() {
+    return isQuantized() ? 1 : VoxelType::uploadSize(voxelType);
+}
+
+void VolumeData::convertForTexture(const char *src, qint64 count, char *dst) {
+    if(isQuantized())
+        VoxelKernels::quantize(src, count, voxelType, domainMin, domainMax, dst);
+    else
+        VoxelKernels::convertForUpload(src, count, voxelType, domainMin, domainMax, dst);
+}
+
+/**
+ * Uses the most precise texture format of the voxel type whose textures fit
+ * into the budget, unless a precision was chosen explicitly. The footprint
+ * covers the volume texture with its mip levels and the maximum texture.
+ */
+void VolumeData::choosePrecision(bool log) {
+    qint64 texels = static_cast<qint64>(properties.width) * properties.height * properties.depth;
+    if(!pyramid.isNull()) {
+        for(int level = 1; level <= pyramid->getLevelCount(); level++)
+            texels += 2 * static_cast<qint64>(pyramid->getWidth(level)) * pyramid->getHeight(level) * pyramid->getDepth(level);
+    }
+    const double budgetMiB = textureBudget / (1024.0 * 1024.0);
+
+    if(texturePrecision != AUTO_PRECISION) {
+        activePrecision = texturePrecision;
+        qint64 bytes = texels * texelSize(activePrecision);
+        if(bytes > textureBudget)
+            qWarning() << "The" << texturePrecisionName(activePrecision) << "textures take" << bytes / (1024.0 * 1024.0)
+                       << "MiB, more than the texture budget of" << budgetMiB << "MiB";
+        else if(log)
+            qInfo() << "Texture precision" << texturePrecisionName(activePrecision) << ":" << bytes / (1024.0 * 1024.0) << "MiB";
+        return;
+    }
+
+    // the formats that can hold the values of the type, the most precise first
+    std::vector<TexturePrecision> candidates;
+    switch(voxelType) {
+    case VoxelType::UINT8:
+        candidates = { R8 };
+        break;
+    case VoxelType::UINT16:
+    case VoxelType::INT16:
+        candidates = { R16, R8 };
+        break;
+    case VoxelType::UINT32:
+        candidates = { R32F, R16, R8 };
+        break;
+    case VoxelType::FLOAT32:
+        candidates = { R32F, R16F, R8 };
+        break;
+    }
+    // the least precise format is used if nothing fits
+    activePrecision = candidates.back();
+    bool chosen = false;
+    for(TexturePrecision candidate : candidates) {
+        qint64 bytes = texels * texelSize(candidate);
+        if(log)
+            qInfo() << "Texture precision" << texturePrecisionName(candidate) << ":" << bytes / (1024.0 * 1024.0) << "MiB"
+                    << (bytes <= textureBudget ? "(fits into" : "(exceeds") << "the budget of" << budgetMiB << "MiB)";
+        if(!chosen && bytes <= textureBudget) {
+            activePrecision = candidate;
+            chosen = true;
+        }
+    }
+    if(log)
+        qInfo() << "Using" << texturePrecisionName(activePrecision) << "textures for the" << VoxelType::name(voxelType) << "values";
+}
+
+void VolumeData::updatePrecision() {
+    // a streamed volume gets the precision once it is complete
+    if(!ready || streaming)
+        return;
+    TexturePrecision oldPrecision = activePrecision;
+    choosePrecision();
+    if(activePrecision == oldPrecision)
+        return;
+    updateDomain();
+    // the renderers create new textures
+    if(preview)
+        emit previewChanged();
+    else
+        emit dataChanged();
+}
+
+bool VolumeData::isQuantized() {
+    // 8 bit values are uploaded as they are, the range of a streamed volume is not final
+    return activePrecision == R8 && voxelType != VoxelType::UINT8 && !streaming;
+}
+
+void VolumeData::updateDomain() {
+    if(isQuantized()) {
+        domainMin = dataMin;
+        domainMax = dataMax > dataMin ? dataMax : dataMin + 1.0;
+    } else {
+        VoxelType::domain(voxelType, dataMin, dataMax, domainMin, domainMax);
+    }
+    properties.minValue = (dataMin - domainMin) / (domainMax - domainMin);
+    properties.maxValue = (dataMax - domainMin) / (domainMax - domainMin);
+}
+
+void VolumeData::setUploadSlabBytes(qint64 bytes) {
+    uploadSlabBytes = bytes;
+}
+
+qint64 VolumeData::getUploadSlabBytes() {
+    return uploadSlabBytes;
+}
+
 /**
  * Creates a new 3D texture for this volume dataset. The caller has
  * to make sure that the texture is disposed correctly when it is no
  * longer used. This method uses texture unit 0. If the creation
  * fails, GL_INVALID_VALUE is returned, the name of the texture otherwise.
+ * The texture of a streamed volume is created empty and filled with
+ * uploadStreamedSlices.
  *
  * @return the name of the created 3D volume texture
  */
@@ -143,10 +780,171 @@ GLuint VolumeData::createTexture() {
         qWarning() << "Volume Data not ready! Unable to create texture.";
         return GL_INVALID_VALUE;
     }
+    if(streaming)
+        return createEmptyTexture();
+    const char *data = residentData();
+    if(data == nullptr)
+        return GL_INVALID_VALUE;
+    return uploadTexture(data, properties.width, properties.height, properties.depth, 0, false);
+}
+
+/**
+ * Creates the 3D texture of the volume like createTexture(), but only
+ * allocates its storage. The caller owns the texture.
+ */
+GLuint VolumeData::createEmptyTexture() {
+    if(!ready) {
+        qWarning() << "Volume Data not ready! Unable to create texture.";
+        return GL_INVALID_VALUE;
+    }
+    return uploadTexture(nullptr, properties.width, properties.height, properties.depth, -1, false);
+}
+
+/**
+ * Streams the voxels of the slices [filledDepth, depth) into level 0 of a
+ * texture that was created by createTexture() or createEmptyTexture() for
+ * data of the same shape. At most maxBytes are uploaded per call, so the
+ * texture can be filled over several frames. Uses texture unit 0.
+ */
+int VolumeData::fillTexture(GLuint texture, int filledDepth, qint64 maxBytes) {
+    const char *data = ready && !streaming ? residentData() : nullptr;
+    if(data == nullptr || texture == GL_INVALID_VALUE)
+        return -1;
+    if(filledDepth >= properties.depth)
+        return properties.depth;
+    qint64 sliceBytes = static_cast<qint64>(properties.width) * properties.height * getUploadSize();
+    int zEnd = filledDepth + VoxelType::uploadSlabDepth(sliceBytes, maxBytes, properties.depth - filledDepth);
+    QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
+    glF->glActiveTexture(GL_TEXTURE0);
+    glF->glBindTexture(GL_TEXTURE_3D, texture);
+    glF->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    bool complete = uploadSlices(0, data, properties.width, properties.height, filledDepth, zEnd) >= 0;
+    glF->glBindTexture(GL_TEXTURE_3D, 0);
+    return complete ? zEnd : -1;
+}
+
+/**
+ * Creates a 3D texture of the volume with the resolution reduced by the
+ * given factor along each axis (blocks of factor^3 voxels are averaged).
+ * Power of two factors are taken from the pyramid, which also provides the
+ * mip levels then. Like createTexture, the caller owns the texture.
+ *
+ * @return the name of the created 3D texture
+ */
+GLuint VolumeData::createReducedTexture(int factor) {
+    if(!ready) {
+        qWarning() << "Volume Data not ready! Unable to create texture.";
+        return GL_INVALID_VALUE;
+    }
+    if(factor <= 1)
+        return createTexture();
+    if(!pyramid.isNull()) {
+        for(int level = 1; level <= pyramid->getLevelCount(); level++) {
+            if(1 << level == factor)
+                return uploadTexture(pyramid->getAverage(level), pyramid->getWidth(level), pyramid->getHeight(level),
+                                     pyramid->getDepth(level), level, false);
+        }
+    }
+
+    const char *data = residentData();
+    if(data == nullptr)
+        return GL_INVALID_VALUE;
+    int width = qMax(1, properties.width / factor);
+    int height = qMax(1, properties.height / factor);
+    int depth = qMax(1, properties.depth / factor);
+    VoxelBuffer reduced;
+    if(!reduced.allocate(static_cast<qint64>(width) * height * depth * VoxelType::size(voxelType)))
+        return GL_INVALID_VALUE;
+
+    QElapsedTimer timer;
+    timer.start();
+    VoxelKernels::downsample(data, properties.width, properties.height, properties.depth,
+                             voxelType, factor, false, reduced.data());
+    qInfo() << "Reduced the volume by" << factor << "to" << width << height << depth << "in" << timer.elapsed() << "ms";
+
+    // the pyramid levels do not match the blocks of other factors, so there are no mip levels
+    return uploadTexture(reduced.data(), width, height, depth, -1, false);
+}
+
+/**
+ * Creates a 3D texture of the maximum pyramid levels. The base level holds
+ * the maximum of 2^3 voxels (pyramid level 1), so mip level n of the volume
+ * texture corresponds to level n-1 of this texture. Without a pyramid
+ * GL_INVALID_VALUE is returned.
+ */
+GLuint VolumeData::createMaxTexture() {
+    if(!ready || pyramid.isNull() || pyramid->getLevelCount() < 1)
+        return GL_INVALID_VALUE;
+    return uploadTexture(pyramid->getMaximum(1), pyramid->getWidth(1), pyramid->getHeight(1),
+                         pyramid->getDepth(1), 1, true);
+}
+
+/**
+ * Bakes the gradients of the voxels on the CPU and uploads them, so the
+ * shading needs one texture fetch per sample instead of six. Like
+ * createTexture, the caller owns the texture. Uses texture unit 0.
+ */
+GLuint VolumeData::createGradientTexture() {
+    if(!ready || streaming)
+        return GL_INVALID_VALUE;
+    const char *data = residentData();
+    if(data == nullptr)
+        return GL_INVALID_VALUE;
+    VoxelBuffer gradients;
+    if(!gradients.allocate(static_cast<qint64>(properties.width) * properties.height * properties.depth * 4))
+        return GL_INVALID_VALUE;
+
+    QElapsedTimer timer;
+    timer.start();
+    // the magnitudes relative to the value range of the data, not to the domain
+    // of the voxel type, so the lighting fades out alike for every type
+    VoxelKernels::gradients(data, properties.width, properties.height, properties.depth, voxelType, dataMin, dataMax,
+                            properties.aspectX, properties.aspectY, properties.aspectZ, gradients.data());
+    double bakeTime = timer.nsecsElapsed() / 1e6;
 
     // clear errors
     QString err = GLUtils::glError();
 
+    QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
+    GLuint texName = GL_INVALID_VALUE;
+    glF->glActiveTexture(GL_TEXTURE0);
+    glGenTextures(1, &texName);
+    glF->glBindTexture(GL_TEXTURE_3D, texName);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glF->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    timer.start();
+    // signed normalized directions stay valid under linear filtering
+    glF->glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8_SNORM, properties.width, properties.height, properties.depth,
+                      0, GL_RGBA, GL_BYTE, gradients.data());
+    glF->glBindTexture(GL_TEXTURE_3D, 0);
+    qInfo() << "Gradient texture:" << gradients.size() / (1024.0 * 1024.0) << "MiB, baked in" << bakeTime
+            << "ms with" << VoxelKernels::instructionSet() << "on" << Parallel::threadCount() << "threads, uploaded in"
+            << timer.nsecsElapsed() / 1e6 << "ms";
+
+    // log GL errors
+    err = GLUtils::glError();
+    if(!err.isEmpty()) {
+        qWarning() << "Gradient texture errors:" << err;
+        glDeleteTextures(1, &texName);
+        return GL_INVALID_VALUE;
+    }
+    return texName;
+}
+
+/**
+ * Creates a 3D texture from the data of the given pyramid level (-1 if the
+ * data is not part of the pyramid). The pyramid levels below baseLevel are
+ * uploaded as mip levels (the maximum levels if maximum is set, the averages
+ * otherwise).
+ */
+GLuint VolumeData::uploadTexture(const char *data, int width, int height, int depth, int baseLevel, bool maximum) {
+    // clear errors
+    QString err = GLUtils::glError();
+
     // set up the OpenGL texture ----------------------------------------------------
     QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
 
@@ -159,37 +957,41 @@ GLuint VolumeData::createTexture() {
         qWarning() << "Texture name invalid!";
     glF->glBindTexture(GL_TEXTURE_3D, texName);
 
+    // the pyramid levels below the base level are the mip levels
+    int mipLevels = pyramid.isNull() || baseLevel < 0 ? 0 : qMax(0, pyramid->getLevelCount() - baseLevel);
+
     // set up wrapping, filtering and pixel alignment
     glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, mipLevels > 0 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+    glF->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, mipLevels);
     glF->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    // determine the data type
-    GLenum dataType = GL_INVALID_ENUM;
-    switch(byteCount) {
-    case 1:
-        dataType = GL_UNSIGNED_BYTE;
-        break;
-    case 2:
-        dataType = GL_UNSIGNED_SHORT;
-        break;
-    case 4:
-        dataType = GL_UNSIGNED_INT;
-        break;
-    default:
-        qWarning() << "Can not upload volume data to texture. No suitable datatype for" <<
-                      byteCount << "bytes per value. Using default type unsigned byte.";
-        dataType = GL_UNSIGNED_BYTE;
-        byteCount = 1;
-        break;
-    }
+    // check if the volume fits into a single 3D texture
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+    if(width > maxSize || height > maxSize || depth > maxSize)
+        qWarning() << "Volume dimensions exceed the maximum 3D texture size of" << maxSize << "!";
 
-    // load the data to the GPU
-    glF->glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, properties.width, properties.height, properties.depth,
-                      0, GL_RED, dataType , volumeData.data());
+    QElapsedTimer timer;
+    timer.start();
+    qint64 bytes = uploadLevel(0, data, width, height, depth), levelBytes;
+    for(int mip = 1; mip <= mipLevels && bytes >= 0; mip++) {
+        int level = baseLevel + mip;
+        levelBytes = uploadLevel(mip, maximum ? pyramid->getMaximum(level) : pyramid->getAverage(level),
+                                 pyramid->getWidth(level), pyramid->getHeight(level), pyramid->getDepth(level));
+        bytes = levelBytes < 0 ? -1 : bytes + levelBytes;
+    }
+    if(bytes < 0) {
+        glF->glBindTexture(GL_TEXTURE_3D, 0);
+        glDeleteTextures(1, &texName);
+        return GL_INVALID_VALUE;
+    }
+    qInfo() << texturePrecisionName(activePrecision) << "volume texture with" << mipLevels << "mip levels:" << bytes / (1024.0 * 1024.0) << "MiB in"
+            << timer.nsecsElapsed() / 1e6 << "ms";
 
     // unbind the texture
     glF->glBindTexture(GL_TEXTURE_3D, 0);
@@ -202,12 +1004,125 @@ GLuint VolumeData::createTexture() {
     return texName;
 }
 
+/**
+ * Allocates the given level of the bound texture and streams the data into it.
+ *
+ * @return the number of uploaded bytes, -1 if the level is incomplete
+ */
+qint64 VolumeData::uploadLevel(int level, const char *data, int width, int height, int depth) {
+    QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
+
+    // allocate the texture storage without any data
+    glF->glTexImage3D(GL_TEXTURE_3D, level, getTextureFormat(), width, height, depth,
+                      0, GL_RED, getUploadType(), nullptr);
+    if(data == nullptr)
+        return 0;
+    return uploadSlices(level, data, width, height, 0, depth);
+}
+
+qint64 VolumeData::uploadSlices(int level, const char *data, int width, int height, int zBegin, int zEnd) {
+    QOpenGLFunctions_4_0_Core* glF = GLUtils::glFunc();
+
+    // stream the data in slabs of whole z slices through a ring of pixel buffer
+    // objects. While the GPU copies one slab from its PBO into the texture the
+    // next slab is already converted and copied into the next PBO. A single call
+    // with more than 2 GiB of client data would fail on many drivers anyway
+    qint64 sliceCount = static_cast<qint64>(width) * height;
+    qint64 sliceBytes = sliceCount * getUploadSize();
+    int slabDepth = VoxelType::uploadSlabDepth(sliceBytes, uploadSlabBytes, zEnd - zBegin);
+    qint64 slabBytes = slabDepth * sliceBytes;
+
+    GLuint pbos[UPLOAD_PBO_COUNT];
+    glF->glGenBuffers(UPLOAD_PBO_COUNT, pbos);
+
+    QElapsedTimer slabTimer, totalTimer;
+    totalTimer.start();
+    qint64 fillTime, submitTime;
+    const char *src;
+    void *dst;
+    // the slab buffer in client memory once a PBO could not be mapped
+    VoxelBuffer fallback;
+    bool mapped = true;
+    int slabSize, slab = 0;
+    for(int z = zBegin; z < zEnd; z += slabDepth, slab++) {
+        slabSize = qMin(slabDepth, zEnd - z);
+        src = data + z * sliceCount * VoxelType::size(voxelType);
+
+        // map the next PBO of the ring. Invalidating the buffer lets the driver
+        // hand out fresh memory if the previous upload from it is still running
+        slabTimer.start();
+        dst = nullptr;
+        if(mapped) {
+            glF->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[slab % UPLOAD_PBO_COUNT]);
+            glF->glBufferData(GL_PIXEL_UNPACK_BUFFER, slabBytes, nullptr, GL_STREAM_DRAW);
+            dst = glF->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slabSize * sliceBytes,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if(!dst) {
+                // upload this and the remaining slabs from client memory
+                qWarning() << "Could not map the pixel buffer for slab" << slab << ", uploading the remaining slabs without PBOs";
+                glF->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                mapped = false;
+                if(!fallback.allocate(slabBytes)) {
+                    qWarning() << "Could not allocate the upload slab, the texture is incomplete!";
+                    glF->glDeleteBuffers(UPLOAD_PBO_COUNT, pbos);
+                    return -1;
+                }
+            }
+        }
+
+        // convert the values into the PBO or the slab buffer (a plain parallel
+        // copy for unsigned values)
+        convertForTexture(src, slabSize * sliceCount, mapped ? static_cast<char*>(dst) : fallback.data());
+        if(mapped)
+            glF->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        fillTime = slabTimer.nsecsElapsed();
+
+        // the upload from a bound PBO returns without waiting for the copy
+        glF->glTexSubImage3D(GL_TEXTURE_3D, level, 0, 0, z, width, height, slabSize,
+                             GL_RED, getUploadType(), mapped ? nullptr : fallback.data());
+        submitTime = slabTimer.nsecsElapsed() - fillTime;
+
+        qInfo() << "Upload level" << level << "slab" << slab << "( z" << z << "-" << z + slabSize - 1 << "):"
+                << (slabSize * sliceBytes) / (1024.0 * 1024.0) << "MiB, fill" << fillTime / 1e6
+                << "ms, submit" << submitTime / 1e6 << "ms";
+    }
+    glF->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glF->glDeleteBuffers(UPLOAD_PBO_COUNT, pbos);
+    qInfo() << "Volume upload of level" << level << "with" << slab << "slabs took" << totalTimer.nsecsElapsed() / 1e6 << "ms";
+
+    return static_cast<qint64>(zEnd - zBegin) * sliceBytes;
+}
+
 bool VolumeData::isReady() {
     return ready;
 }
 
 char* VolumeData::getData() {
-    return volumeData.data();
+    return residentData();
+}
+
+double VolumeData::getDomainMin() {
+    return domainMin;
+}
+
+double VolumeData::getDomainMax() {
+    return domainMax;
+}
+
+VoxelType::Type VolumeData::getVoxelType() {
+    return voxelType;
+}
+
+QSharedPointer<BrickedVolume> VolumeData::getBricks() {
+    return bricks;
+}
+
+QSharedPointer<VolumePyramid> VolumeData::getPyramid() {
+    return pyramid;
+}
+
+QSharedPointer<OccupancyGrid> VolumeData::getOccupancyGrid() {
+    return occupancy;
 }
 
 VolumeDataProps VolumeData::getProperties() {
@@ -224,36 +1139,34 @@ float* VolumeData::createHistogram(int buckets) {
     if(histogram != nullptr && lastBuckets == buckets)
         return histogram;
 
-    // obtain the volume data array and max. possibly occuring value
-    uchar* d = reinterpret_cast<uchar*>(volumeData.data());
-    int domain = static_cast<int>(pow(256, byteCount));
-
     // create a new histogram array
     if(histogram != nullptr)
         delete[] histogram;
     histogram = new float[buckets];
-    for(int i=0; i<buckets; i++)
-        histogram[i] = 0;
-
-    uint v;
-    int bucketId, maxBucket=0;
-    for(int i=0; i<volumeData.size(); i+=byteCount) {
-        // get the value from the next byteCount bytes from d
-        v = 0;
-        for(int b=byteCount-1; b>=0; b--)
-            v = (v << 8) | static_cast<int>(d[i+b]);
-
-        // increase the bucket for this value
-        bucketId = (v / (float) domain  - properties.minValue) / (properties.maxValue - properties.minValue) * buckets ;
-        histogram[bucketId] += 1;
-
-        // update max value
-        if(histogram[bucketId] > maxBucket)
-            maxBucket = histogram[bucketId];
+
+    // count the values over the range that actually occurs in the data.
+    // Bricked volumes provide the counts in their metadata, the loader
+    // provides them for RAW volumes (finer counts are summed up)
+    std::vector<qint64> counts;
+    if(!histogramCounts.empty() && histogramCounts.size() % buckets == 0) {
+        counts.assign(buckets, 0);
+        size_t factor = histogramCounts.size() / buckets;
+        for(size_t i = 0; i < histogramCounts.size(); i++)
+            counts[i / factor] += histogramCounts[i];
+    } else if(bricks.isNull() || !bricks->histogram(buckets, counts)) {
+        const char *data = residentData();
+        VoxelKernels::histogram(data, data != nullptr ? volumeData.size() / VoxelType::size(voxelType) : 0, voxelType,
+                                dataMin, dataMax, buckets, counts);
+    }
+    qint64 maxCount = 0;
+    for(int i=0; i<buckets; i++) {
+        histogram[i] = counts[i];
+        if(counts[i] > maxCount)
+            maxCount = counts[i];
     }
 
     // normalize the buckets (logarithmic)
-    maxBucket = log(maxBucket);
+    float maxBucket = maxCount > 1 ? log(static_cast<double>(maxCount)) : 1.f;
     for(int i=0; i<buckets; i++)  {
         if(histogram[i] > 0)
         histogram[i] = log(histogram[i]) / maxBucket;
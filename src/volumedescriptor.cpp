@@ -0,0 +1,333 @@
+#include "volumedescriptor.hpp"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QVector3D>
+
+#include "compressedreader.hpp"
+
+const QString VolumeDescriptor::SIDECAR_SUFFIX = "vdesc";
+
+namespace {
+
+// the voxel types of MetaImage and NRRD headers
+bool typeFromMetaImage(QString name, VoxelType::Type &type) {
+    if(name == "MET_UCHAR")
+        type = VoxelType::UINT8;
+    else if(name == "MET_USHORT")
+        type = VoxelType::UINT16;
+    else if(name == "MET_UINT")
+        type = VoxelType::UINT32;
+    else if(name == "MET_SHORT")
+        type = VoxelType::INT16;
+    else if(name == "MET_FLOAT")
+        type = VoxelType::FLOAT32;
+    else
+        return false;
+    return true;
+}
+
+bool typeFromNrrd(QString name, VoxelType::Type &type) {
+    name = name.simplified();
+    if(name == "uchar" || name == "unsigned char" || name == "uint8" || name == "uint8_t")
+        type = VoxelType::UINT8;
+    else if(name == "ushort" || name == "unsigned short" || name == "unsigned short int"
+            || name == "uint16" || name == "uint16_t")
+        type = VoxelType::UINT16;
+    else if(name == "uint" || name == "unsigned int" || name == "uint32" || name == "uint32_t")
+        type = VoxelType::UINT32;
+    else if(name == "short" || name == "short int" || name == "signed short" || name == "signed short int"
+            || name == "int16" || name == "int16_t")
+        type = VoxelType::INT16;
+    else if(name == "float")
+        type = VoxelType::FLOAT32;
+    else
+        return false;
+    return true;
+}
+
+// parses three numbers separated by white space
+bool parseTriple(QString value, float &x, float &y, float &z) {
+    QStringList parts = value.simplified().split(' ');
+    if(parts.size() < 3)
+        return false;
+    bool okX, okY, okZ;
+    x = parts[0].toFloat(&okX);
+    y = parts[1].toFloat(&okY);
+    z = parts[2].toFloat(&okZ);
+    return okX && okY && okZ;
+}
+
+bool parseDims(QString value, VolumeLoader::Header &header) {
+    // the depth of a single slice may be left out
+    QStringList parts = value.simplified().split(' ');
+    if(parts.size() < 2)
+        return false;
+    bool okX, okY, okZ = true;
+    header.width = parts[0].toInt(&okX);
+    header.height = parts[1].toInt(&okY);
+    header.depth = parts.size() > 2 ? parts[2].toInt(&okZ) : 1;
+    return okX && okY && okZ;
+}
+
+}
+
+VolumeDescriptor::VolumeDescriptor()
+{
+}
+
+QString VolumeDescriptor::find(QString path) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if(suffix == SIDECAR_SUFFIX || suffix == "mhd" || suffix == "mha" || suffix == "nhdr" || suffix == "nrrd")
+        return path;
+    QString sidecar = path + "." + SIDECAR_SUFFIX;
+    return QFile::exists(sidecar) ? sidecar : QString();
+}
+
+bool VolumeDescriptor::read(QString path, VolumeLoader::Header &header, bool complete) {
+    // the defaults of a RAW file without header
+    header.width = header.height = header.depth = 0;
+    header.aspectX = header.aspectY = header.aspectZ = 1.f;
+    header.type = VoxelType::UINT8;
+    header.dataOffset = 0;
+    header.bigEndian = false;
+
+    QString suffix = QFileInfo(path).suffix().toLower();
+    bool ok;
+    if(suffix == "mhd" || suffix == "mha")
+        ok = readMetaImage(path, header, complete);
+    else if(suffix == "nhdr" || suffix == "nrrd")
+        ok = readNrrd(path, header, complete);
+    else
+        ok = readSidecar(path, header, complete);
+    if(ok)
+        qInfo() << "Read the volume descriptor" << path << "for" << header.dataPath << "at offset" << header.dataOffset;
+    return ok;
+}
+
+bool VolumeDescriptor::readFields(QString path, QString separator, QString lastKey,
+                                  QMap<QString, QString> &fields, qint64 &headerEnd) {
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open file " << path << " !";
+        return false;
+    }
+    for(int i = 0; i < MAX_HEADER_LINES && !file.atEnd(); i++) {
+        QString line = QString::fromLatin1(file.readLine()).trimmed();
+        if(line.isEmpty())
+            break;
+        if(line.startsWith('#'))
+            continue;
+        int split = line.indexOf(separator);
+        if(split < 0)
+            continue;
+        QString key = line.left(split).trimmed().toLower();
+        fields[key] = line.mid(split + separator.length()).trimmed();
+        if(key == lastKey)
+            break;
+    }
+    headerEnd = file.pos();
+    return true;
+}
+
+bool VolumeDescriptor::readSlices(QString path, VolumeLoader::Header &header) {
+    header.aspectX = header.aspectY = header.aspectZ = 1.f;
+    header.type = VoxelType::UINT8;
+    QMap<QString, QString> fields;
+    qint64 headerEnd;
+    if(!readFields(path, ":", QString(), fields, headerEnd))
+        return false;
+    header.dataPath = QFileInfo(path).path();
+    return readSidecarFields(path, fields, header);
+}
+
+bool VolumeDescriptor::readSidecar(QString path, VolumeLoader::Header &header, bool complete) {
+    QMap<QString, QString> fields;
+    qint64 headerEnd;
+    if(!readFields(path, ":", QString(), fields, headerEnd) || !readSidecarFields(path, fields, header))
+        return false;
+
+    // the sidecar of foo.raw is foo.raw.vdesc
+    QString dataFile = fields.value("data");
+    if(dataFile.isEmpty())
+        dataFile = QFileInfo(path).completeBaseName();
+    return finish(path, dataFile, header, complete);
+}
+
+bool VolumeDescriptor::readSidecarFields(QString path, const QMap<QString, QString> &fields, VolumeLoader::Header &header) {
+    if(!parseDims(fields.value("dims"), header)) {
+        qWarning() << "The volume descriptor" << path << "has no valid dims!";
+        return false;
+    }
+    if(fields.contains("spacing") && !parseTriple(fields["spacing"], header.aspectX, header.aspectY, header.aspectZ)) {
+        qWarning() << "Invalid spacing in " << path << " !";
+        return false;
+    }
+    if(fields.contains("type") && !VoxelType::fromName(fields["type"], header.type)) {
+        qWarning() << "Unknown voxel type" << fields["type"] << "in " << path << " !";
+        return false;
+    }
+    header.bigEndian = fields.value("endian", "little").toLower() == "big";
+    header.dataOffset = fields.value("offset", "0").toLongLong();
+    return true;
+}
+
+bool VolumeDescriptor::readMetaImage(QString path, VolumeLoader::Header &header, bool complete) {
+    QMap<QString, QString> fields;
+    qint64 headerEnd;
+    // the data of .mha files follows the ElementDataFile line
+    if(!readFields(path, "=", "elementdatafile", fields, headerEnd))
+        return false;
+
+    if(fields.value("ndims", "3").toInt() != 3 || !parseDims(fields.value("dimsize"), header)) {
+        qWarning() << "Only three dimensional MetaImage volumes are supported: " << path;
+        return false;
+    }
+    if(fields.value("compresseddata", "false").toLower() == "true") {
+        qWarning() << "Compressed MetaImage data is not supported: " << path;
+        return false;
+    }
+    if(fields.value("elementnumberofchannels", "1").toInt() != 1) {
+        qWarning() << "Only single channel MetaImage volumes are supported: " << path;
+        return false;
+    }
+    QString spacing = fields.contains("elementspacing") ? fields["elementspacing"] : fields.value("elementsize");
+    if(!spacing.isEmpty() && !parseTriple(spacing, header.aspectX, header.aspectY, header.aspectZ)) {
+        qWarning() << "Invalid element spacing in " << path << " !";
+        return false;
+    }
+    if(!typeFromMetaImage(fields.value("elementtype"), header.type)) {
+        qWarning() << "Unsupported element type" << fields.value("elementtype") << "in " << path << " !";
+        return false;
+    }
+    QString msb = fields.contains("binarydatabyteordermsb") ? fields["binarydatabyteordermsb"]
+                                                            : fields.value("elementbyteordermsb", "false");
+    header.bigEndian = msb.toLower() == "true";
+
+    QString dataFile = fields.value("elementdatafile");
+    if(dataFile.isEmpty()) {
+        qWarning() << "The MetaImage header" << path << "has no ElementDataFile!";
+        return false;
+    }
+    if(dataFile.toUpper() == "LOCAL") {
+        dataFile = QFileInfo(path).fileName();
+        header.dataOffset = headerEnd;
+    } else {
+        header.dataOffset = fields.value("headersize", "0").toLongLong();
+    }
+    return finish(path, dataFile, header, complete);
+}
+
+bool VolumeDescriptor::readNrrd(QString path, VolumeLoader::Header &header, bool complete) {
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly) || !file.readLine().startsWith("NRRD")) {
+        qWarning() << "Invalid NRRD header in " << path << " !";
+        return false;
+    }
+    file.close();
+
+    QMap<QString, QString> fields;
+    qint64 headerEnd;
+    if(!readFields(path, ":", QString(), fields, headerEnd))
+        return false;
+
+    if(fields.value("dimension").toInt() != 3 || !parseDims(fields.value("sizes"), header)) {
+        qWarning() << "Only three dimensional NRRD volumes are supported: " << path;
+        return false;
+    }
+    // gzip data is decompressed on the fly, see CompressedReader
+    QString encoding = fields.value("encoding").toLower();
+    bool gzip = encoding == "gzip" || encoding == "gz";
+    if(encoding != "raw" && !gzip) {
+        qWarning() << "Only the raw and gzip NRRD encodings are supported: " << path;
+        return false;
+    }
+    if(!typeFromNrrd(fields.value("type").toLower(), header.type)) {
+        qWarning() << "Unsupported NRRD type" << fields.value("type") << "in " << path << " !";
+        return false;
+    }
+    header.bigEndian = fields.value("endian", "little").toLower() == "big";
+
+    if(fields.contains("spacings")) {
+        if(!parseTriple(fields["spacings"], header.aspectX, header.aspectY, header.aspectZ)) {
+            qWarning() << "Invalid spacings in " << path << " !";
+            return false;
+        }
+    } else if(fields.contains("space directions")) {
+        // the spacing is the length of the direction vectors, e.g. (1,0,0) (0,1,0) (0,0,1.4)
+        QStringList vectors = fields["space directions"].split(')', QString::SkipEmptyParts);
+        float spacing[3];
+        for(int i = 0; i < 3; i++) {
+            QStringList components = i < vectors.size() ? vectors[i].remove('(').split(',') : QStringList();
+            if(components.size() != 3) {
+                qWarning() << "Invalid space directions in " << path << " !";
+                return false;
+            }
+            spacing[i] = QVector3D(components[0].toFloat(), components[1].toFloat(), components[2].toFloat()).length();
+        }
+        header.aspectX = spacing[0];
+        header.aspectY = spacing[1];
+        header.aspectZ = spacing[2];
+    }
+
+    QString dataFile = fields.contains("data file") ? fields["data file"] : fields.value("datafile");
+    if(dataFile.isEmpty()) {
+        // the data follows the empty line after the header
+        dataFile = QFileInfo(path).fileName();
+        header.dataOffset = headerEnd;
+        if(gzip) {
+            qWarning() << "Attached gzip NRRD data is not supported, use a detached header: " << path;
+            return false;
+        }
+    } else if(dataFile.startsWith("LIST") || dataFile.contains('%')) {
+        qWarning() << "Multiple NRRD data files are not supported: " << path;
+        return false;
+    } else {
+        header.dataOffset = 0;
+    }
+    if(fields.value("line skip", "0").toInt() != 0) {
+        qWarning() << "NRRD line skips are not supported: " << path;
+        return false;
+    }
+    if(fields.contains("byte skip"))
+        header.dataOffset += fields["byte skip"].toLongLong();
+    return finish(path, dataFile, header, complete);
+}
+
+bool VolumeDescriptor::finish(QString path, QString dataFile, VolumeLoader::Header &header, bool complete) {
+    header.dataPath = QFileInfo(dataFile).isAbsolute() ? dataFile : QFileInfo(path).dir().filePath(dataFile);
+    QFileInfo data(header.dataPath);
+    if(!data.exists()) {
+        qWarning() << "File " << header.dataPath << " does not exist!";
+        return false;
+    }
+
+    qint64 voxelCount = static_cast<qint64>(header.width) * header.height * header.depth;
+    if(header.width <= 0 || header.height <= 0 || header.depth <= 0) {
+        qWarning() << "Invalid volume header in " << path << " !";
+        return false;
+    }
+    // files that are still being written (or pipes) can only be checked
+    // once complete, they are not even opened here
+    if(!complete && header.dataOffset >= 0)
+        return true;
+    // an offset of -1 means the data is at the end of the file. Compressed data
+    // files are checked against their decompressed size if it is known
+    qint64 size = voxelCount * VoxelType::size(header.type);
+    qint64 dataSize = data.size();
+    if(CompressedReader::detect(header.dataPath) != CompressedReader::NONE) {
+        dataSize = CompressedReader::uncompressedSize(header.dataPath);
+        if(dataSize < 0 && header.dataOffset >= 0)
+            return true;
+    }
+    if(header.dataOffset < 0)
+        header.dataOffset = dataSize - size;
+    if(header.dataOffset < 0 || dataSize - header.dataOffset < size) {
+        qWarning() << "File " << header.dataPath << " is too small for" << voxelCount << VoxelType::name(header.type) << "values!";
+        return false;
+    }
+    return true;
+}
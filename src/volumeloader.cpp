@@ -0,0 +1,914 @@
+#include "volumeloader.hpp"
+
+#include <QBuffer>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QTextStream>
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "compressedreader.hpp"
+#include "livesource.hpp"
+#include "parallel.hpp"
+#include "sharedvolume.hpp"
+#include "slicestack.hpp"
+#include "volumecache.hpp"
+#include "volumedescriptor.hpp"
+#include "voxelkernels.hpp"
+
+namespace {
+
+/**
+ * The histogram of the slabs of a live volume, which is updated with every new
+ * slab instead of counting all slabs again. 8 and 16 bit values are counted
+ * exactly with a bin per value, other types in FINE_BINS bins over the range
+ * seen so far, which are redistributed when a slab widens the range.
+ */
+class RunningHistogram
+{
+public:
+    RunningHistogram(VoxelType::Type type) {
+        this->type = type;
+        exact = VoxelType::size(type) <= 2;
+        empty = true;
+        lo = hi = 0.0;
+        if(exact) {
+            VoxelType::domain(type, 0.0, 0.0, lo, hi);
+            bins.assign(static_cast<size_t>(hi - lo), 0);
+        }
+    }
+
+    void add(const char *data, qint64 count, double slabMin, double slabMax) {
+        if(count <= 0)
+            return;
+        if(!exact && empty) {
+            lo = slabMin;
+            hi = slabMax;
+            bins.assign(FINE_BINS, 0);
+        } else if(!exact && (slabMin < lo || slabMax > hi)) {
+            std::vector<qint64> widened;
+            counts(qMin(lo, slabMin), qMax(hi, slabMax), FINE_BINS, widened);
+            bins.swap(widened);
+            lo = qMin(lo, slabMin);
+            hi = qMax(hi, slabMax);
+        }
+        std::vector<qint64> slab;
+        VoxelKernels::histogram(data, count, type, lo, hi, static_cast<int>(bins.size()), slab);
+        for(size_t i = 0; i < bins.size(); i++)
+            bins[i] += slab[i];
+        empty = false;
+    }
+
+    // sums the bins up to buckets over [minV, maxV] the way VoxelKernels::histogram
+    // counts values, fine bins are represented by their center
+    void counts(double minV, double maxV, int buckets, std::vector<qint64> &out) const {
+        out.assign(buckets, 0);
+        double scale = maxV > minV ? buckets / (maxV - minV) : 0.0;
+        double binWidth = bins.empty() ? 0.0 : (hi - lo) / bins.size();
+        for(size_t i = 0; i < bins.size(); i++) {
+            if(bins[i] == 0)
+                continue;
+            double value = exact ? lo + i : lo + (i + 0.5) * binWidth;
+            double b = qMin((value - minV) * scale, buckets - 1.0);
+            out[b > 0.0 ? static_cast<int>(b) : 0] += bins[i];
+        }
+    }
+
+private:
+    static const int FINE_BINS = 65536;
+
+    VoxelType::Type type;
+    bool exact, empty;
+    // the range covered by the bins
+    double lo, hi;
+    std::vector<qint64> bins;
+};
+
+}
+
+VolumeLoader::VolumeLoader(QString path, VolumeReader::Backend backend)
+{
+    this->path = path;
+    this->dataPath = path;
+    this->backend = backend;
+    previewStride = 0;
+    cacheEnabled = false;
+    pyramidEnabled = true;
+    live = false;
+    streamStatistics = false;
+    streamMin = streamMax = 0.0;
+    canceled = 0;
+    lastProgress = -1;
+}
+
+void VolumeLoader::setPreviewStride(int stride) {
+    previewStride = stride;
+}
+
+void VolumeLoader::setCacheEnabled(bool enabled) {
+    cacheEnabled = enabled;
+}
+
+void VolumeLoader::setRegion(const VolumeRegion &region) {
+    this->region = region;
+}
+
+void VolumeLoader::setPyramidEnabled(bool enabled) {
+    pyramidEnabled = enabled;
+}
+
+void VolumeLoader::setLive(bool live) {
+    this->live = live;
+}
+
+bool VolumeLoader::parseHeader(QString path, Header &header) {
+
+    // volumes in shared memory describe themselves, in the byte order of the machine
+    if(SharedVolume::isSharedVolume(path)) {
+        SharedVolume::Header shared;
+        if(!SharedVolume::readHeader(path, shared))
+            return false;
+        if(!VoxelType::fromName(shared.type, header.type)) {
+            qWarning() << "Unknown voxel type" << shared.type << "in " << path << " !";
+            return false;
+        }
+        header.width = shared.width;
+        header.height = shared.height;
+        header.depth = shared.depth;
+        header.aspectX = shared.aspectX;
+        header.aspectY = shared.aspectY;
+        header.aspectZ = shared.aspectZ;
+        header.dataPath = path;
+        header.dataOffset = shared.dataOffset;
+        header.bigEndian = Q_BYTE_ORDER == Q_BIG_ENDIAN;
+        qint64 voxelCount = static_cast<qint64>(header.width) * header.height * header.depth;
+        if(shared.dataSize < voxelCount * VoxelType::size(header.type)) {
+            qWarning() << "The shared memory segment" << path << "is too small for" << voxelCount << VoxelType::name(header.type) << "values!";
+            return false;
+        }
+        return true;
+    }
+
+    // headerless files are described by a sidecar or a detached header
+    QString descriptor = VolumeDescriptor::find(path);
+    if(!descriptor.isEmpty())
+        return VolumeDescriptor::read(descriptor, header);
+
+    // check if the file exists
+    QFile file(path);
+    if(!file.exists()) {
+        qWarning() << "File " << path << " does not exist!";
+        return false;
+    }
+
+    // open the file
+    if(!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open file " << path << " !";
+        return false;
+    }
+
+    // compressed files are parsed from the start of their decompressed data
+    CompressedReader::Codec codec = CompressedReader::detect(path);
+    if(!CompressedReader::isAvailable(codec)) {
+        qWarning() << "Reading" << path << "needs" << CompressedReader::codecName(codec) << "support, which was not compiled in!";
+        return false;
+    }
+    QBuffer head;
+    QIODevice *device = &file;
+    if(codec != CompressedReader::NONE) {
+        head.setData(CompressedReader::readHead(path, COMPRESSED_HEADER_BYTES));
+        head.open(QIODevice::ReadOnly);
+        device = &head;
+    }
+
+    // load resolution, the optional voxel type tag and apsect ratio from the first two lines
+    header.width = header.height = header.depth = 0;
+    header.aspectX = header.aspectY = header.aspectZ = 1.f;
+    QString typeTag;
+
+    QString strResolution = device->readLine();
+    QString strAspect = device->readLine();
+    QTextStream tsResolution(&strResolution, QIODevice::ReadOnly);
+    QTextStream tsAspect(&strAspect, QIODevice::ReadOnly);
+    tsResolution >> header.width >> header.height >> header.depth >> typeTag;
+    tsAspect >> header.aspectX >> header.aspectY >> header.aspectZ;
+
+    // the voxel data follows directly after the header in big endian byte order
+    header.dataPath = path;
+    header.dataOffset = device->pos();
+    header.bigEndian = true;
+    // the decompressed size is -1 if it cannot be known without decompressing
+    qint64 dataSize = codec != CompressedReader::NONE ? CompressedReader::uncompressedSize(path) : file.size();
+    if(dataSize >= 0)
+        dataSize -= header.dataOffset;
+
+    // close the file
+    file.close();
+
+    qint64 voxelCount = static_cast<qint64>(header.width) * header.height * header.depth;
+    if(header.width <= 0 || header.height <= 0 || header.depth <= 0 || (dataSize >= 0 && dataSize < voxelCount)) {
+        qWarning() << "Invalid volume header in " << path << " !";
+        return false;
+    }
+    // without a type tag the values are unsigned and the bytes
+    // per value are derived from the file size
+    if(!typeTag.isEmpty()) {
+        if(!VoxelType::fromName(typeTag, header.type)) {
+            qWarning() << "Unknown voxel type" << typeTag << "in " << path << " !";
+            return false;
+        }
+    } else if(dataSize < 0) {
+        qWarning() << "The size of the compressed data in" << path << "is unknown, a voxel type tag is needed!";
+        return false;
+    } else if(!VoxelType::fromSize(dataSize/voxelCount, header.type)) {
+        qWarning() << "Unsupported number of" << dataSize/voxelCount << "bytes per value in " << path << " !";
+        return false;
+    }
+    if(dataSize >= 0 && dataSize < voxelCount * VoxelType::size(header.type)) {
+        qWarning() << "File " << path << " is too small for" << voxelCount << VoxelType::name(header.type) << "values!";
+        return false;
+    }
+    return true;
+}
+
+bool VolumeLoader::load() {
+    QElapsedTimer timer;
+    timer.start();
+    qInfo() << endl << "Loading volume from " << path;
+    reportProgress(0);
+
+    bool shared = SharedVolume::isSharedVolume(path);
+    bool bricked = !live && !shared && BrickedVolume::isBricked(path);
+    if(live || shared || bricked || SliceStack::isSliceStack(path)) {
+        if(!region.isWhole() || region.stride > 1) {
+            qWarning() << "Regions can only be loaded from complete RAW volume files, loading all of" << path;
+            region = VolumeRegion();
+        }
+        if(!(live ? loadLive() : shared ? loadShared() : bricked ? loadBricked() : loadSliceStack()))
+            return false;
+        reportProgress(PREVIEW_PROGRESS + READ_PROGRESS + PASS_PROGRESS);
+        deriveData();
+        if(isCanceled())
+            return false;
+        reportProgress(100);
+        qInfo() << "Loading" << path << "took" << timer.elapsed() << "ms";
+        return true;
+    }
+
+    Header header;
+    if(!parseHeader(path, header))
+        return false;
+    dataPath = header.dataPath;
+    // a stride without a box applies to the whole volume
+    if(region.isWhole() && region.stride > 1) {
+        region.x0 = region.y0 = region.z0 = 0;
+        region.x1 = header.width;
+        region.y1 = header.height;
+        region.z1 = header.depth;
+    }
+    if(!region.isWhole() && !clampRegion(header))
+        return false;
+
+    // a warm open only maps the preprocessed volume. A region is
+    // read on its own, without the cache and without a preview
+    if(cacheEnabled && region.isWhole() && loadCached(VolumeDescriptor::find(path))) {
+        deriveData();
+        if(isCanceled())
+            return false;
+        reportProgress(100);
+        qInfo() << "Loading" << path << "from the cache took" << timer.elapsed() << "ms";
+        return true;
+    }
+
+    // the voxels of the result, the region if there is one
+    Header target = regionHeader(header, region);
+    qint64 voxelCount = static_cast<qint64>(target.width) * target.height * target.depth;
+    qint64 size = voxelCount * VoxelType::size(header.type);
+
+    // the values have to be modified in place if their byte order differs
+    // from the one of the machine and a value has more than one byte. Otherwise
+    // the mmap backend maps the voxels at their offset without a copy
+    bool swapBytes = VoxelType::size(header.type) > 1 && header.bigEndian != (Q_BYTE_ORDER == Q_BIG_ENDIAN);
+
+    // compressed data cannot be read at arbitrary positions, it is
+    // streamed slab by slab instead of showing a strided preview
+    bool compressed = CompressedReader::detect(header.dataPath) != CompressedReader::NONE;
+    if(!compressed && region.isWhole() && previewStride > 1 && loadPreview(header, swapBytes)) {
+        qInfo() << "Preview of" << path << "ready after" << timer.elapsed() << "ms";
+        emit previewReady();
+    }
+    if(isCanceled())
+        return false;
+    reportProgress(PREVIEW_PROGRESS);
+
+    // load the volume data with the selected io backend
+    QElapsedTimer readTimer;
+    readTimer.start();
+    bool ok = !region.isWhole() ? readRegion(header, region, result.data, true)
+            : compressed ? loadCompressed(header, swapBytes)
+                         : VolumeReader::read(backend, header.dataPath, header.dataOffset, size, swapBytes, result.data, [&](qint64 bytesRead) {
+        reportProgress(PREVIEW_PROGRESS + static_cast<int>(bytesRead * READ_PROGRESS / size));
+        return !isCanceled();
+    });
+    if(!ok || isCanceled()) {
+        result.data.release();
+        return false;
+    }
+    result.readTime = readTimer.nsecsElapsed();
+    reportProgress(PREVIEW_PROGRESS + READ_PROGRESS);
+
+    // determine max and min values of the data for normalizing
+    // and correct the byte order in one pass (compressed volumes
+    // went through this pass slab by slab while decompressing)
+    QElapsedTimer passTimer;
+    passTimer.start();
+    if(!compressed || !region.isWhole()) {
+        finishResult(result, target, region.stride, swapBytes);
+        double seconds = qMax(passTimer.nsecsElapsed(), Q_INT64_C(1)) / 1e9;
+        qInfo() << "Byte order and min/max pass:" << size / seconds / 1e9 << "GB/s ("
+                << Parallel::threadCount() << "threads," << VoxelKernels::instructionSet() << ")";
+    }
+
+    // the histogram is computed here so it can be cached and
+    // does not have to be computed on the main thread
+    VoxelKernels::histogram(result.data.data(), voxelCount, result.type, result.dataMin, result.dataMax,
+                            VolumeCache::HISTOGRAM_BUCKETS, result.histogram);
+    result.decodeTime = passTimer.nsecsElapsed();
+    if(!cacheKey.isEmpty())
+        VolumeCache().store(cacheKey, result);
+    reportProgress(PREVIEW_PROGRESS + READ_PROGRESS + PASS_PROGRESS);
+
+    deriveData();
+    if(isCanceled())
+        return false;
+    reportProgress(100);
+    qInfo() << "Loading" << path << "took" << timer.elapsed() << "ms";
+    return true;
+}
+
+/**
+ * Loads every previewStride-th voxel along each axis. Only every stride-th
+ * row of every stride-th slice is read from the file, so the preview reads
+ * about 1/stride^2 of the data. The stride is raised for very large volumes
+ * to keep the preview fast.
+ */
+bool VolumeLoader::loadPreview(const Header &header, bool swapBytes) {
+    const int bytes = VoxelType::size(header.type);
+    const qint64 rowBytes = static_cast<qint64>(header.width) * bytes;
+    const qint64 size = rowBytes * header.height * header.depth;
+    if(size <= PREVIEW_MAX_BYTES)
+        return false;  // small enough to be loaded completely right away
+
+    VolumeRegion whole;
+    whole.x1 = header.width;
+    whole.y1 = header.height;
+    whole.z1 = header.depth;
+    whole.stride = qMax(previewStride, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(size) / PREVIEW_MAX_BYTES))));
+    if(!readRegion(header, whole, preview.data, false))
+        return false;
+
+    Header previewHeader = regionHeader(header, whole);
+    finishResult(preview, previewHeader, whole.stride, swapBytes);
+    qInfo() << "Preview with stride" << whole.stride << ":" << previewHeader.width
+            << previewHeader.height << previewHeader.depth << "voxels";
+    return true;
+}
+
+bool VolumeLoader::clampRegion(const Header &header) {
+    region.x0 = qBound(0, region.x0, header.width);
+    region.y0 = qBound(0, region.y0, header.height);
+    region.z0 = qBound(0, region.z0, header.depth);
+    region.x1 = qBound(0, region.x1, header.width);
+    region.y1 = qBound(0, region.y1, header.height);
+    region.z1 = qBound(0, region.z1, header.depth);
+    region.stride = qMax(1, region.stride);
+    if(region.x1 <= region.x0 || region.y1 <= region.y0 || region.z1 <= region.z0) {
+        qWarning() << "The region" << region.x0 << region.y0 << region.z0 << "to" << region.x1 << region.y1 << region.z1
+                   << "is outside of" << path << "!";
+        return false;
+    }
+    qInfo() << "Loading the region" << region.x0 << region.y0 << region.z0 << "to" << region.x1 << region.y1 << region.z1
+            << "with stride" << region.stride;
+    return true;
+}
+
+VolumeLoader::Header VolumeLoader::regionHeader(const Header &header, const VolumeRegion &region) {
+    if(region.isWhole())
+        return header;
+    Header target = header;
+    target.width = (region.x1 - region.x0 + region.stride - 1) / region.stride;
+    target.height = (region.y1 - region.y0 + region.stride - 1) / region.stride;
+    target.depth = (region.z1 - region.z0 + region.stride - 1) / region.stride;
+    return target;
+}
+
+/**
+ * Reads every stride-th voxel along each axis of a region. Only the needed
+ * rows of the file are touched: the mmap backend maps the slices covered by
+ * the region and copies the rows out of the mapping, the other backends read
+ * every row with a positioned read on several threads. Compressed data
+ * cannot be read at arbitrary positions, it is decompressed up to the end of
+ * the region into a temporary buffer.
+ */
+bool VolumeLoader::readRegion(const Header &header, const VolumeRegion &region, VoxelBuffer &target, bool reportRead) {
+    const int bytes = VoxelType::size(header.type);
+    const Header targetHeader = regionHeader(header, region);
+    const qint64 rowBytes = static_cast<qint64>(header.width) * bytes;
+    const qint64 sliceBytes = rowBytes * header.height;
+    if(!target.allocate(static_cast<qint64>(targetHeader.width) * targetHeader.height * targetHeader.depth * bytes))
+        return false;
+
+    // the part of a row inside the region and the range of the data covered by the region
+    const qint64 segmentBytes = static_cast<qint64>(region.x1 - region.x0) * bytes;
+    const qint64 firstByte = region.z0 * sliceBytes + region.y0 * rowBytes + region.x0 * bytes;
+    const qint64 lastByte = (region.z1 - 1) * sliceBytes + (region.y1 - 1) * rowBytes + region.x0 * bytes + segmentBytes;
+
+    // the rows are copied out of the window if there is one
+    VoxelBuffer window;
+    bool compressed = CompressedReader::detect(header.dataPath) != CompressedReader::NONE;
+    if(compressed) {
+        if(!window.allocate(lastByte - firstByte))
+            return false;
+        bool ok = CompressedReader::read(header.dataPath, header.dataOffset + firstByte, lastByte - firstByte, window.data(), [&](qint64 bytesDone) {
+            if(reportRead)
+                reportProgress(PREVIEW_PROGRESS + static_cast<int>(bytesDone * READ_PROGRESS / (lastByte - firstByte)));
+            return !isCanceled();
+        });
+        if(!ok) {
+            target.release();
+            return false;
+        }
+    } else if(backend == VolumeReader::MMAP && !window.map(header.dataPath, header.dataOffset + firstByte, lastByte - firstByte, false)) {
+        qWarning() << "Could not map the region of" << header.dataPath << ", reading its rows instead";
+    }
+
+    // every thread copies a range of target slices, with its own file handle for positioned reads
+    std::atomic<bool> failed(false);
+    std::atomic<int> done(0);
+    Parallel::forRange(targetHeader.depth, 1, [&](qint64 begin, qint64 end, int) {
+        QFile file(header.dataPath);
+        if(window.isEmpty() && !file.open(QIODevice::ReadOnly)) {
+            failed = true;
+            return;
+        }
+        QByteArray segment(window.isEmpty() ? static_cast<int>(segmentBytes) : 0, Qt::Uninitialized);
+        char *dst = target.data() + begin * targetHeader.width * targetHeader.height * bytes;
+        for(qint64 z = begin; z < end && !failed && !isCanceled(); z++) {
+            for(int y = 0; y < targetHeader.height; y++) {
+                qint64 position = (region.z0 + z * region.stride) * sliceBytes
+                        + (region.y0 + static_cast<qint64>(y) * region.stride) * rowBytes + region.x0 * bytes;
+                const char *src;
+                if(!window.isEmpty()) {
+                    src = window.data() + (position - firstByte);
+                } else if(file.seek(header.dataOffset + position) && file.read(segment.data(), segmentBytes) == segmentBytes) {
+                    src = segment.constData();
+                } else {
+                    failed = true;
+                    return;
+                }
+                if(region.stride == 1) {
+                    memcpy(dst, src, segmentBytes);
+                    dst += segmentBytes;
+                } else {
+                    for(int x = 0; x < targetHeader.width; x++, dst += bytes)
+                        memcpy(dst, src + static_cast<qint64>(x) * region.stride * bytes, bytes);
+                }
+            }
+            if(reportRead && !compressed)
+                reportProgress(PREVIEW_PROGRESS + static_cast<int>(static_cast<qint64>(++done) * READ_PROGRESS / targetHeader.depth));
+        }
+    });
+    if(failed)
+        qWarning() << "Could not read the region of" << header.dataPath << "!";
+    if(failed || isCanceled()) {
+        target.release();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads a bricked volume file. The min/max values are taken from the
+ * brick metadata, so the voxels only have to be touched on big endian
+ * machines where the byte order has to be corrected.
+ */
+bool VolumeLoader::loadBricked() {
+    QSharedPointer<BrickedVolume> bricks(new BrickedVolume());
+    if(!bricks->open(path))
+        return false;
+
+    qint64 size = static_cast<qint64>(bricks->getWidth()) * bricks->getHeight() * bricks->getDepth()
+            * VoxelType::size(bricks->getVoxelType());
+    bool ok = bricks->readVolume(result.data, true, [&](qint64 bytesRead) {
+        reportProgress(static_cast<int>(bytesRead * (PREVIEW_PROGRESS + READ_PROGRESS) / size));
+        return !isCanceled();
+    });
+    if(!ok || isCanceled()) {
+        result.data.release();
+        return false;
+    }
+
+    Header header;
+    header.width = bricks->getWidth();
+    header.height = bricks->getHeight();
+    header.depth = bricks->getDepth();
+    header.aspectX = bricks->getAspectX();
+    header.aspectY = bricks->getAspectY();
+    header.aspectZ = bricks->getAspectZ();
+    header.type = bricks->getVoxelType();
+    header.dataPath = path;
+    header.dataOffset = 0;
+    header.bigEndian = false;
+
+    // the bricks store little endian values
+    bool swapBytes = VoxelType::size(header.type) > 1 && Q_BYTE_ORDER == Q_BIG_ENDIAN;
+    if(swapBytes) {
+        finishResult(result, header, 1, true);
+    } else {
+        result.type = header.type;
+        result.properties.width = header.width;
+        result.properties.height = header.height;
+        result.properties.depth = header.depth;
+        result.properties.aspectX = header.aspectX;
+        result.properties.aspectY = header.aspectY;
+        result.properties.aspectZ = header.aspectZ;
+        result.dataMin = bricks->getDataMin();
+        result.dataMax = bricks->getDataMax();
+        finishRange(result);
+    }
+    result.bricks = bricks;
+    return true;
+}
+
+/**
+ * Decodes the slices of a slice stack in parallel directly into their place
+ * in the volume buffer. Whenever the decoded slices at the front of the stack
+ * grow by a slab, they are announced with slabReady(), so they can be uploaded
+ * while the remaining slices are decoded. Missing or broken slices are filled
+ * with zeros and the decoding resumes with the next slice.
+ */
+bool VolumeLoader::loadSliceStack() {
+    SliceStack stack;
+    if(!stack.open(path))
+        return false;
+    const Header &header = stack.getHeader();
+    const qint64 sliceBytes = stack.getSliceBytes();
+    if(!result.data.allocate(sliceBytes * header.depth))
+        return false;
+
+    // the announced slices are shown with the properties of the full data
+    fillProperties(result, header, 1);
+    result.dataMin = result.dataMax = 0.0;
+    finishRange(result);
+
+    QElapsedTimer timer;
+    timer.start();
+    const int slabSlices = static_cast<int>(qMax(Q_INT64_C(1), STREAM_SLAB_BYTES / sliceBytes));
+    std::vector<char> decoded(header.depth, 0);
+    int front = 0, announced = 0;
+    QMutex frontMutex;
+    std::atomic<int> done(0), missing(0);
+    Parallel::forRange(header.depth, 1, [&](qint64 begin, qint64 end, int) {
+        for(qint64 z = begin; z < end && !isCanceled(); z++) {
+            char *dst = result.data.data() + z * sliceBytes;
+            if(!stack.decodeSlice(static_cast<int>(z), dst)) {
+                qWarning() << "Slice" << z << "is missing and filled with zeros";
+                memset(dst, 0, sliceBytes);
+                missing++;
+            }
+            reportProgress(static_cast<int>(static_cast<qint64>(++done) * (PREVIEW_PROGRESS + READ_PROGRESS) / header.depth));
+
+            // the slices are handed out in order, so the front grows steadily
+            QMutexLocker lock(&frontMutex);
+            decoded[z] = 1;
+            while(front < header.depth && decoded[front])
+                front++;
+            if(front == header.depth || front - announced >= slabSlices) {
+                announced = front;
+                emit slabReady(front);
+            }
+        }
+    });
+    if(isCanceled()) {
+        result.data.release();
+        return false;
+    }
+    double seconds = qMax(timer.nsecsElapsed(), Q_INT64_C(1)) / 1e9;
+    qInfo() << "Decoded" << header.depth << "slices in" << seconds * 1000.0 << "ms (" << header.depth / seconds
+            << "slices/s," << sliceBytes * header.depth / seconds / (1024.0 * 1024.0) << "MiB/s ),"
+            << missing.load() << "missing";
+
+    // the slices are decoded in host byte order
+    finishResult(result, header, 1, false);
+    VoxelKernels::histogram(result.data.data(), result.data.size() / VoxelType::size(result.type), result.type,
+                            result.dataMin, result.dataMax, VolumeCache::HISTOGRAM_BUCKETS, result.histogram);
+    return true;
+}
+
+/**
+ * Decompresses the voxels straight into the volume buffer. As soon as a slab
+ * of slices is complete, its byte order is corrected, its min/max values are
+ * merged and it is announced with slabReady(), so the pass and the upload
+ * overlap with the decompression of the remaining data.
+ */
+bool VolumeLoader::loadCompressed(const Header &header, bool swapBytes) {
+    const qint64 sliceBytes = static_cast<qint64>(header.width) * header.height * VoxelType::size(header.type);
+    const qint64 size = sliceBytes * header.depth;
+    if(!result.data.allocate(size))
+        return false;
+    fillProperties(result, header, 1);
+    result.dataMin = result.dataMax = 0.0;
+    finishRange(result);
+
+    double dataMin = 0.0, dataMax = 0.0;
+    qint64 passed = 0;
+    bool ok = CompressedReader::read(header.dataPath, header.dataOffset, size, result.data.data(), [&](qint64 bytesDone) {
+        // only whole slices are passed and announced
+        qint64 end = bytesDone / sliceBytes * sliceBytes;
+        if(end > passed) {
+            double slabMin, slabMax;
+            VoxelKernels::swapMinMax(result.data.data() + passed, (end - passed) / VoxelType::size(header.type),
+                                     header.type, swapBytes, slabMin, slabMax);
+            dataMin = passed == 0 ? slabMin : qMin(dataMin, slabMin);
+            dataMax = passed == 0 ? slabMax : qMax(dataMax, slabMax);
+            passed = end;
+            emit slabReady(static_cast<int>(end / sliceBytes));
+        }
+        reportProgress(PREVIEW_PROGRESS + static_cast<int>(bytesDone * READ_PROGRESS / size));
+        return !isCanceled();
+    });
+    if(!ok || passed != size)
+        return false;
+    result.dataMin = dataMin;
+    result.dataMax = dataMax;
+    finishRange(result);
+    return true;
+}
+
+/**
+ * Follows a RAW volume that is still being written (e.g. by an acquisition)
+ * or that is read from a pipe. The voxels are read front to back as they
+ * arrive. Whenever whole slices were added, their byte order is corrected,
+ * the min/max values and the histogram are updated with the new slices only
+ * and the slices are announced with slabReady(). The header is taken from a
+ * descriptor if there is one (its data file is not checked, as it is not
+ * complete yet), otherwise it is read from the stream and needs a voxel type
+ * tag. Compressed live volumes are not supported.
+ */
+bool VolumeLoader::loadLive() {
+    Header header;
+    LiveSource source;
+    LiveSource::WaitCallback waiting = [&](qint64) { return !isCanceled(); };
+    QString descriptor = VolumeDescriptor::find(path);
+    if(!descriptor.isEmpty()) {
+        if(!VolumeDescriptor::read(descriptor, header, false) || !source.open(header.dataPath)
+                || !source.skip(header.dataOffset, waiting))
+            return false;
+    } else {
+        if(!source.open(path))
+            return false;
+        QByteArray resolution, aspect;
+        if(!source.readLine(resolution, waiting) || !source.readLine(aspect, waiting))
+            return false;
+
+        header.width = header.height = header.depth = 0;
+        header.aspectX = header.aspectY = header.aspectZ = 1.f;
+        QString typeTag;
+        QString strResolution = resolution;
+        QString strAspect = aspect;
+        QTextStream tsResolution(&strResolution, QIODevice::ReadOnly);
+        QTextStream tsAspect(&strAspect, QIODevice::ReadOnly);
+        tsResolution >> header.width >> header.height >> header.depth >> typeTag;
+        tsAspect >> header.aspectX >> header.aspectY >> header.aspectZ;
+        header.dataPath = path;
+        header.dataOffset = resolution.size() + aspect.size();
+        header.bigEndian = true;
+
+        if(header.width <= 0 || header.height <= 0 || header.depth <= 0) {
+            qWarning() << "Invalid volume header in " << path << " !";
+            return false;
+        }
+        // the size of the data is not known yet, so the type cannot be derived from it
+        if(typeTag.isEmpty()) {
+            qWarning() << "The live volume" << path << "needs a voxel type tag in its header!";
+            return false;
+        }
+        if(!VoxelType::fromName(typeTag, header.type)) {
+            qWarning() << "Unknown voxel type" << typeTag << "in " << path << " !";
+            return false;
+        }
+    }
+    dataPath = header.dataPath;
+
+    const int bytes = VoxelType::size(header.type);
+    const qint64 sliceBytes = static_cast<qint64>(header.width) * header.height * bytes;
+    const qint64 size = sliceBytes * header.depth;
+    if(!result.data.allocate(size))
+        return false;
+    bool swapBytes = bytes > 1 && header.bigEndian != (Q_BYTE_ORDER == Q_BIG_ENDIAN);
+
+    // the announced slices are shown with the properties of the full data
+    fillProperties(result, header, 1);
+    result.dataMin = result.dataMax = 0.0;
+    finishRange(result);
+    qInfo() << "Following" << header.dataPath << ":" << header.width << header.height << header.depth
+            << VoxelType::name(header.type) << "values";
+
+    QElapsedTimer timer;
+    timer.start();
+    RunningHistogram histogram(header.type);
+    double dataMin = 0.0, dataMax = 0.0;
+    qint64 passed = 0;
+    bool ok = source.read(result.data.data(), size, [&](qint64 bytesDone) {
+        // only whole slices are passed and announced
+        qint64 end = bytesDone / sliceBytes * sliceBytes;
+        if(end > passed) {
+            char *slab = result.data.data() + passed;
+            qint64 count = (end - passed) / bytes;
+            double slabMin, slabMax;
+            VoxelKernels::swapMinMax(slab, count, header.type, swapBytes, slabMin, slabMax);
+            histogram.add(slab, count, slabMin, slabMax);
+            dataMin = passed == 0 ? slabMin : qMin(dataMin, slabMin);
+            dataMax = passed == 0 ? slabMax : qMax(dataMax, slabMax);
+            passed = end;
+            {
+                QMutexLocker lock(&streamMutex);
+                streamMin = dataMin;
+                streamMax = dataMax;
+                histogram.counts(dataMin, dataMax, VolumeCache::HISTOGRAM_BUCKETS, streamHistogram);
+                streamStatistics = true;
+            }
+            emit slabReady(static_cast<int>(end / sliceBytes));
+        }
+        reportProgress(static_cast<int>(bytesDone * (PREVIEW_PROGRESS + READ_PROGRESS + PASS_PROGRESS) / size));
+        return !isCanceled();
+    });
+    if(!ok || isCanceled()) {
+        result.data.release();
+        return false;
+    }
+    double seconds = qMax(timer.nsecsElapsed(), Q_INT64_C(1)) / 1e9;
+    qInfo() << "Followed" << header.depth << "slices in" << seconds * 1000.0 << "ms (" << header.depth / seconds
+            << "slices/s," << size / seconds / (1024.0 * 1024.0) << "MiB/s )";
+
+    result.dataMin = dataMin;
+    result.dataMax = dataMax;
+    finishRange(result);
+    histogram.counts(dataMin, dataMax, VolumeCache::HISTOGRAM_BUCKETS, result.histogram);
+    return true;
+}
+
+/**
+ * Maps the voxels of a volume in shared memory read only and uses the
+ * mapping as the voxel store, so they are not copied before the texture
+ * upload. Only the min/max pass and the histogram read them here.
+ */
+bool VolumeLoader::loadShared() {
+    Header header;
+    if(!parseHeader(path, header))
+        return false;
+    dataPath = header.dataPath;
+    const qint64 size = static_cast<qint64>(header.width) * header.height * header.depth * VoxelType::size(header.type);
+
+    QElapsedTimer readTimer;
+    readTimer.start();
+    if(!result.data.mapSharedMemory(path, header.dataOffset, size, false))
+        return false;
+    result.readTime = readTimer.nsecsElapsed();
+    reportProgress(PREVIEW_PROGRESS + READ_PROGRESS);
+
+    QElapsedTimer passTimer;
+    passTimer.start();
+    finishResult(result, header, 1, false);
+    VoxelKernels::histogram(result.data.data(), size / VoxelType::size(header.type), result.type,
+                            result.dataMin, result.dataMax, VolumeCache::HISTOGRAM_BUCKETS, result.histogram);
+    result.decodeTime = passTimer.nsecsElapsed();
+    qInfo() << "Mapped" << size / (1024.0 * 1024.0) << "MiB of the shared memory segment"
+            << SharedVolume::segmentName(path) << "without a copy, min/max pass and histogram took"
+            << result.decodeTime / 1e6 << "ms";
+    return true;
+}
+
+bool VolumeLoader::loadCached(QString descriptor) {
+    cacheKey = VolumeCache::key(dataPath, descriptor);
+    if(cacheKey.isEmpty() || !VolumeCache().load(cacheKey, result))
+        return false;
+    finishRange(result);
+    return true;
+}
+
+void VolumeLoader::deriveData() {
+    loadPyramid();
+    if(isCanceled())
+        return;
+    // bricked volumes know the value range of every brick, so their voxels
+    // are not scanned again
+    QSharedPointer<OccupancyGrid> occupancy(new OccupancyGrid());
+    bool built = !result.bricks.isNull() ? occupancy->build(*result.bricks)
+            : occupancy->build(result.data.data(), result.properties.width, result.properties.height,
+                               result.properties.depth, result.type);
+    if(built)
+        result.occupancy = occupancy;
+}
+
+void VolumeLoader::loadPyramid() {
+    if(!pyramidEnabled)
+        return;
+    VolumeDataProps &props = result.properties;
+    // the pyramid is derived data of the cache entry if the cache is used
+    VolumeCache cache;
+    QString pyramidPath = cacheKey.isEmpty() ? VolumePyramid::cachePath(path) : cache.derivedPath(cacheKey, "pyramid");
+    // a slice stack has no single file the stored pyramid could be validated
+    // against, the pyramid of a region is only valid for that region, and
+    // live and shared memory volumes are no files that stay the same
+    bool persistent = !live && !SharedVolume::isSharedVolume(path) && !SliceStack::isSliceStack(dataPath) && region.isWhole();
+    QSharedPointer<VolumePyramid> pyramid(new VolumePyramid());
+    if(!persistent || !pyramid->load(pyramidPath, dataPath, props.width, props.height, props.depth, result.type)) {
+        if(!pyramid->build(result.data.data(), props.width, props.height, props.depth, result.type))
+            return;
+        // the pyramid is still usable if the cache cannot be written
+        if(persistent && pyramid->save(pyramidPath, dataPath) && !cacheKey.isEmpty())
+            cache.evict(cacheKey);
+    }
+    result.pyramid = pyramid;
+}
+
+void VolumeLoader::fillProperties(Result &result, const Header &header, int stride) {
+    result.type = header.type;
+    result.properties.width = header.width;
+    result.properties.height = header.height;
+    result.properties.depth = header.depth;
+    // the voxels of a preview or a strided region cover stride voxels of the file
+    result.properties.aspectX = header.aspectX * stride;
+    result.properties.aspectY = header.aspectY * stride;
+    result.properties.aspectZ = header.aspectZ * stride;
+}
+
+void VolumeLoader::finishResult(Result &result, const Header &header, int stride, bool swapBytes) {
+    fillProperties(result, header, stride);
+
+    qint64 voxelCount = static_cast<qint64>(header.width) * header.height * header.depth;
+    VoxelKernels::swapMinMax(result.data.data(), voxelCount, result.type, swapBytes, result.dataMin, result.dataMax);
+    finishRange(result);
+}
+
+void VolumeLoader::finishRange(Result &result) {
+    // normalize the max and min intensity values
+    VoxelType::domain(result.type, result.dataMin, result.dataMax, result.domainMin, result.domainMax);
+    result.properties.minValue = (result.dataMin - result.domainMin) / (result.domainMax - result.domainMin);
+    result.properties.maxValue = (result.dataMax - result.domainMin) / (result.domainMax - result.domainMin);
+}
+
+void VolumeLoader::cancel() {
+    canceled = 1;
+}
+
+bool VolumeLoader::isCanceled() {
+    return canceled.load() != 0;
+}
+
+QString VolumeLoader::getPath() {
+    return path;
+}
+
+VolumeRegion VolumeLoader::getRegion() {
+    return region;
+}
+
+VolumeLoader::Result& VolumeLoader::getPreview() {
+    return preview;
+}
+
+VolumeLoader::Result& VolumeLoader::getResult() {
+    return result;
+}
+
+bool VolumeLoader::getStreamStatistics(double &dataMin, double &dataMax, std::vector<qint64> &histogram) {
+    QMutexLocker lock(&streamMutex);
+    if(!streamStatistics)
+        return false;
+    dataMin = streamMin;
+    dataMax = streamMax;
+    histogram = streamHistogram;
+    return true;
+}
+
+void VolumeLoader::run() {
+    emit loaded(load());
+}
+
+void VolumeLoader::reportProgress(int percent) {
+    // the reader reports from several threads, only emit when the value grows
+    int last = lastProgress.load();
+    while(percent > last) {
+        if(lastProgress.testAndSetOrdered(last, percent)) {
+            emit progress(percent);
+            return;
+        }
+        last = lastProgress.load();
+    }
+}
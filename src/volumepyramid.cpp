@@ -0,0 +1,217 @@
+#include "volumepyramid.hpp"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+
+#include <cstring>
+#include <vector>
+
+#include "voxelkernels.hpp"
+
+namespace {
+
+const char MAGIC[8] = { 'V', 'L', 'P', 'Y', 'R', 'A', 'M', '1' };
+const quint32 HOST_BYTE_ORDER = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? 0 : 1;
+
+qint64 alignUp(qint64 value) {
+    return (value + VoxelBuffer::ALIGNMENT - 1) / VoxelBuffer::ALIGNMENT * VoxelBuffer::ALIGNMENT;
+}
+
+}
+
+VolumePyramid::VolumePyramid()
+{
+    type = VoxelType::UINT8;
+    levelCount = 0;
+    widths[0] = heights[0] = depths[0] = 0;
+}
+
+QString VolumePyramid::cachePath(QString path) {
+    return path + ".pyramid";
+}
+
+void VolumePyramid::setDimensions(int width, int height, int depth, VoxelType::Type type) {
+    this->type = type;
+    widths[0] = width;
+    heights[0] = height;
+    depths[0] = depth;
+    levelCount = 0;
+    while(levelCount < MAX_LEVELS
+          && qMax(widths[levelCount], qMax(heights[levelCount], depths[levelCount])) > MIN_LEVEL_SIZE) {
+        levelCount++;
+        widths[levelCount] = qMax(1, widths[levelCount - 1] / 2);
+        heights[levelCount] = qMax(1, heights[levelCount - 1] / 2);
+        depths[levelCount] = qMax(1, depths[levelCount - 1] / 2);
+    }
+}
+
+qint64 VolumePyramid::levelSize(int level) {
+    return static_cast<qint64>(widths[level]) * heights[level] * depths[level] * VoxelType::size(type);
+}
+
+/**
+ * Builds every level from the previous one, the averages from the
+ * averages and the maximums from the maximums.
+ */
+bool VolumePyramid::build(const char *data, int width, int height, int depth, VoxelType::Type type) {
+    QElapsedTimer timer;
+    timer.start();
+    setDimensions(width, height, depth, type);
+
+    for(int level = 1; level <= levelCount; level++) {
+        if(!averages[level].allocate(levelSize(level)) || !maximums[level].allocate(levelSize(level))) {
+            qWarning() << "Could not allocate level" << level << "of the volume pyramid!";
+            levelCount = 0;
+            return false;
+        }
+        const char *avgSrc = level == 1 ? data : averages[level - 1].data();
+        const char *maxSrc = level == 1 ? data : maximums[level - 1].data();
+        VoxelKernels::downsample(avgSrc, widths[level - 1], heights[level - 1], depths[level - 1],
+                                 type, 2, false, averages[level].data());
+        VoxelKernels::downsample(maxSrc, widths[level - 1], heights[level - 1], depths[level - 1],
+                                 type, 2, true, maximums[level].data());
+    }
+    qInfo() << "Built a volume pyramid with" << levelCount << "levels ("
+            << getSize() / (1024.0 * 1024.0) << "MiB) in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool VolumePyramid::load(QString cacheFile, QString path, int width, int height, int depth, VoxelType::Type type) {
+    QFile file(cacheFile);
+    if(!file.exists() || !file.open(QIODevice::ReadOnly))
+        return false;
+
+    QFileInfo source(path);
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    char magic[sizeof(MAGIC)];
+    quint32 version, byteOrder, fileType, fileLevels;
+    qint64 sourceSize, sourceModified;
+    qint32 fileWidth, fileHeight, fileDepth;
+    in.readRawData(magic, sizeof(MAGIC));
+    in >> version >> byteOrder >> sourceSize >> sourceModified
+       >> fileWidth >> fileHeight >> fileDepth >> fileType >> fileLevels;
+
+    setDimensions(width, height, depth, type);
+    if(in.status() != QDataStream::Ok || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION
+            || byteOrder != HOST_BYTE_ORDER || sourceSize != source.size()
+            || sourceModified != source.lastModified().toMSecsSinceEpoch()
+            || fileWidth != width || fileHeight != height || fileDepth != depth
+            || fileType != static_cast<quint32>(type) || fileLevels != static_cast<quint32>(levelCount)) {
+        qInfo() << "The volume pyramid cache" << file.fileName() << "is outdated";
+        levelCount = 0;
+        return false;
+    }
+
+    std::vector<quint64> offsets(levelCount * 2);
+    for(size_t i = 0; i < offsets.size(); i++)
+        in >> offsets[i];
+    if(in.status() != QDataStream::Ok) {
+        levelCount = 0;
+        return false;
+    }
+    file.close();
+
+    // the levels are mapped, so only the pages that are used are read
+    for(int level = 1; level <= levelCount; level++) {
+        if(!averages[level].map(file.fileName(), offsets[2 * (level - 1)], levelSize(level), false)
+                || !maximums[level].map(file.fileName(), offsets[2 * (level - 1) + 1], levelSize(level), false)) {
+            qWarning() << "Could not map the volume pyramid cache" << file.fileName() << "!";
+            levelCount = 0;
+            return false;
+        }
+    }
+    qInfo() << "Mapped a volume pyramid with" << levelCount << "levels from" << file.fileName();
+    return true;
+}
+
+bool VolumePyramid::save(QString cacheFile, QString path) {
+    QElapsedTimer timer;
+    timer.start();
+
+    QFileInfo source(path);
+    QFile file(cacheFile);
+    if(!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not write the volume pyramid cache" << file.fileName() << "!";
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(MAGIC, sizeof(MAGIC));
+    out << VERSION << HOST_BYTE_ORDER << static_cast<qint64>(source.size())
+        << static_cast<qint64>(source.lastModified().toMSecsSinceEpoch())
+        << static_cast<qint32>(widths[0]) << static_cast<qint32>(heights[0]) << static_cast<qint32>(depths[0])
+        << static_cast<quint32>(type) << static_cast<quint32>(levelCount);
+
+    // the level table is followed by the aligned levels
+    qint64 offset = alignUp(sizeof(MAGIC) + 11 * sizeof(quint32) + levelCount * 2 * sizeof(quint64));
+    for(int level = 1; level <= levelCount; level++) {
+        out << static_cast<quint64>(offset);
+        offset = alignUp(offset + levelSize(level));
+        out << static_cast<quint64>(offset);
+        offset = alignUp(offset + levelSize(level));
+    }
+
+    QByteArray padding(static_cast<int>(VoxelBuffer::ALIGNMENT), '\0');
+    for(int level = 1; level <= levelCount; level++) {
+        for(VoxelBuffer *buffer : { &averages[level], &maximums[level] }) {
+            out.writeRawData(padding.constData(), static_cast<int>(alignUp(file.pos()) - file.pos()));
+            // QDataStream writes at most 2 GiB at once
+            for(qint64 done = 0; done < buffer->size(); ) {
+                int chunk = static_cast<int>(qMin(buffer->size() - done, Q_INT64_C(1) << 30));
+                out.writeRawData(buffer->data() + done, chunk);
+                done += chunk;
+            }
+        }
+    }
+
+    if(out.status() != QDataStream::Ok) {
+        qWarning() << "Could not write the volume pyramid cache" << file.fileName() << "!";
+        file.close();
+        file.remove();
+        return false;
+    }
+    qInfo() << "Wrote the volume pyramid cache" << file.fileName() << "in" << timer.elapsed() << "ms";
+    return true;
+}
+
+int VolumePyramid::getLevelCount() {
+    return levelCount;
+}
+
+int VolumePyramid::getWidth(int level) {
+    return widths[level];
+}
+
+int VolumePyramid::getHeight(int level) {
+    return heights[level];
+}
+
+int VolumePyramid::getDepth(int level) {
+    return depths[level];
+}
+
+VoxelType::Type VolumePyramid::getVoxelType() {
+    return type;
+}
+
+const char* VolumePyramid::getAverage(int level) {
+    return averages[level].data();
+}
+
+const char* VolumePyramid::getMaximum(int level) {
+    return maximums[level].data();
+}
+
+qint64 VolumePyramid::getSize() {
+    qint64 size = 0;
+    for(int level = 1; level <= levelCount; level++)
+        size += 2 * levelSize(level);
+    return size;
+}
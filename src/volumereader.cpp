@@ -0,0 +1,200 @@
+#include "volumereader.hpp"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <atomic>
+#include <cerrno>
+
+#ifdef Q_OS_UNIX
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include "parallel.hpp"
+
+QString VolumeReader::backendName(Backend backend) {
+    switch(backend) {
+    case BUFFERED:
+        return "buffered";
+    case MMAP:
+        return "mmap";
+    case PARALLEL:
+        return "parallel pread";
+    case DIRECT:
+        return "O_DIRECT";
+    }
+    return "unknown";
+}
+
+bool VolumeReader::read(Backend backend, QString path, qint64 offset, qint64 size, bool modify, VoxelBuffer &target,
+                        const ProgressCallback &progress) {
+    QElapsedTimer timer;
+    timer.start();
+
+    bool ok;
+    switch(backend) {
+    case MMAP:
+        ok = readMapped(path, offset, size, modify, target, progress);
+        break;
+    case PARALLEL:
+        ok = readParallel(path, offset, size, false, target, progress);
+        break;
+    case DIRECT:
+        ok = readParallel(path, offset, size, true, target, progress);
+        break;
+    default:
+        ok = readBuffered(path, offset, size, target, progress);
+        break;
+    }
+
+    if(!ok) {
+        qWarning() << "Reading" << path << "with the" << backendName(backend) << "backend failed!";
+        target.release();
+        return false;
+    }
+
+    // log the throughput of the backend
+    double seconds = qMax(timer.nsecsElapsed(), Q_INT64_C(1)) / 1e9;
+    double mb = size / (1024.0 * 1024.0);
+    qInfo() << "Read" << mb << "MiB with the" << backendName(backend) << "backend in"
+            << seconds * 1000.0 << "ms (" << mb / seconds << "MiB/s )";
+    return true;
+}
+
+bool VolumeReader::readBuffered(QString path, qint64 offset, qint64 size, VoxelBuffer &target, const ProgressCallback &progress) {
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly) || !file.seek(offset))
+        return false;
+    if(!target.allocate(size))
+        return false;
+
+    // QFile::read takes 64 bit sizes but may return less than requested.
+    // The data is read in chunks to be able to report the progress
+    qint64 pos = 0, r;
+    while(pos < size) {
+        r = file.read(target.data() + pos, size - pos < CHUNK_SIZE ? size - pos : CHUNK_SIZE);
+        if(r <= 0)
+            return false;
+        pos += r;
+        if(progress && !progress(pos))
+            return false;
+    }
+    return true;
+}
+
+bool VolumeReader::readMapped(QString path, qint64 offset, qint64 size, bool modify, VoxelBuffer &target, const ProgressCallback &progress) {
+    if(!target.map(path, offset, size, modify))
+        return false;
+
+    // fault the pages in on all threads. Otherwise the cost of the read only
+    // shows up in the first pass over the data and cannot be compared. The
+    // chunks fold their bytes into an atomic, so the reads are not optimized away
+    std::atomic<char> sink(0);
+    const char *d = target.data();
+    std::atomic<qint64> done(0);
+    std::atomic<bool> canceled(false);
+    Parallel::forRange(size, CHUNK_SIZE, [&](qint64 begin, qint64 end, int) {
+        if(canceled)
+            return;
+        char s = 0;
+        for(qint64 i = begin; i < end; i += VoxelBuffer::ALIGNMENT)
+            s ^= d[i];
+        sink.fetch_xor(s, std::memory_order_relaxed);
+        if(progress && !progress(done += end - begin))
+            canceled = true;
+    });
+    return !canceled;
+}
+
+bool VolumeReader::readParallel(QString path, qint64 offset, qint64 size, bool direct, VoxelBuffer &target, const ProgressCallback &progress) {
+    // unbuffered reads need file offsets, sizes and memory aligned to the
+    // logical block size, so the read is extended to whole pages and the
+    // voxel data starts lead bytes into the buffer
+    qint64 start = offset, lead = 0, total = size;
+    if(direct) {
+        start = offset / VoxelBuffer::ALIGNMENT * VoxelBuffer::ALIGNMENT;
+        lead = offset - start;
+        total = (lead + size + VoxelBuffer::ALIGNMENT - 1) / VoxelBuffer::ALIGNMENT * VoxelBuffer::ALIGNMENT;
+    }
+    if(!target.allocate(size, lead))
+        return false;
+    char *dst = target.data() - lead;
+    // the (possibly aligned) read must at least cover this many bytes
+    const qint64 required = lead + size;
+
+    std::atomic<bool> failed(false);
+    std::atomic<qint64> done(0);
+    // the progress counts the voxel bytes of a chunk, not the alignment padding
+    auto voxelBytes = [&](qint64 begin, qint64 end) {
+        return qMax<qint64>(0, qMin(end, required) - qMax(begin, lead));
+    };
+
+#ifdef Q_OS_UNIX
+    int flags = O_RDONLY;
+#ifdef O_DIRECT
+    if(direct)
+        flags |= O_DIRECT;
+#else
+    if(direct)
+        qWarning() << "O_DIRECT is not supported on this platform, using cached reads.";
+#endif
+    int fd = ::open(path.toLocal8Bit().constData(), flags);
+    if(fd < 0 && direct) {
+        // e.g. tmpfs does not support unbuffered io
+        qWarning() << "Could not open" << path << "for unbuffered reads, using cached reads.";
+        fd = ::open(path.toLocal8Bit().constData(), O_RDONLY);
+    }
+    if(fd < 0)
+        return false;
+
+    Parallel::forRange(total, CHUNK_SIZE, [&](qint64 begin, qint64 end, int) {
+        qint64 pos = begin;
+        while(pos < end && !failed) {
+            ssize_t r = ::pread(fd, dst + pos, static_cast<size_t>(end - pos), static_cast<off_t>(start + pos));
+            if(r < 0 && errno == EINTR)
+                continue;
+            if(r < 0 || (r == 0 && pos < required)) {
+                failed = true;
+                return;
+            }
+            if(r == 0)
+                break; // end of file inside the alignment padding
+            pos += r;
+        }
+        if(progress && !failed && !progress(done += voxelBytes(begin, end)))
+            failed = true;
+    });
+    ::close(fd);
+#else
+    if(direct)
+        qWarning() << "Unbuffered reads are not supported on this platform, using cached reads.";
+
+    // every thread uses its own file handle for seeking
+    Parallel::forRange(total, CHUNK_SIZE, [&](qint64 begin, qint64 end, int) {
+        QFile file(path);
+        if(!file.open(QIODevice::ReadOnly) || !file.seek(start + begin)) {
+            failed = true;
+            return;
+        }
+        qint64 pos = begin, r;
+        while(pos < end && !failed) {
+            r = file.read(dst + pos, end - pos);
+            if(r <= 0) {
+                failed = r < 0 || pos < required;
+                break;
+            }
+            pos += r;
+        }
+        if(progress && !failed && !progress(done += voxelBytes(begin, end)))
+            failed = true;
+    });
+#endif
+
+    return !failed;
+}
+
+VolumeReader::VolumeReader()
+{
+}
@@ -1,11 +1,18 @@
 #include "volumerenderer.hpp"
 
+#include "brickcache.hpp"
 #include "glutils.hpp"
+#include "occupancygrid.hpp"
+#include "preintegration.hpp"
+#include "proxygeometry.hpp"
 #include "shadowrenderer.hpp"
+#include "volumepyramid.hpp"
 #include <QImage>
 
 static const QString entryExitVPath = "entryExit.vert", entryExitFPath = "entryExit.frag";
 static const QString volumeVPath = "volume.vert", volumeFPath = "volume.frag";
+// added to the level of detail while the camera is moved
+static const float INTERACTION_LOD_BIAS = 1.f;
 
 VolumeRenderer::VolumeRenderer(QOpenGLWidget *renderWidget, VolumeData *volumeData, VolumeRenderProps *renderProps, int width, int height)
 {
@@ -15,12 +22,40 @@ VolumeRenderer::VolumeRenderer(QOpenGLWidget *renderWidget, VolumeData *volumeDa
     // store the dataset and the renderprops
     this->dataset = volumeData;
     connect(dataset, SIGNAL(dataChanged()), this, SLOT(datasetChanged()));
+    connect(dataset, SIGNAL(previewChanged()), this, SLOT(datasetChanged()));
+    connect(dataset, SIGNAL(slicesStreamed()), this, SLOT(datasetSlicesStreamed()));
+    connect(dataset, SIGNAL(stepChanged()), this, SLOT(datasetStepChanged()));
     this->renderProps = renderProps;
 
     volumeTexture = GL_INVALID_VALUE;
+    volumeTexDirty = true;
+    volumeTextureLevel = 0;
+    maxVolumeTexture = GL_INVALID_VALUE;
+    gradientTexture = GL_INVALID_VALUE;
+    gradientDirty = true;
+    gradientDeferred = false;
+    reportGradientTiming = false;
+    streamedDepth = 0;
+    streamedMinValue = streamedMaxValue = 0.f;
+    stepTexture = GL_INVALID_VALUE;
+    stepDirty = false;
+    stepFilledDepth = 0;
+    textureMinValue = textureMaxValue = 0.f;
+    brickCache = nullptr;
+    feedbackFBO = nullptr;
+    virtualTexture = false;
+    virtualForced = false;
+    frameIndex = 0;
+    occupancyTexture = GL_INVALID_VALUE;
+    occupancyDirty = true;
+    occupancyReady = false;
+    reportSamples = false;
+    proxyGeometry = new ProxyGeometry();
     transFunc = nullptr;
     transFuncTexture = GL_INVALID_VALUE;
     tfTexDirty = true;
+    preIntegrationTexture = GL_INVALID_VALUE;
+    preIntegrationDirty = true;
     entryExitFBO = nullptr;
 
     // create the entry/exit points shader program ---------------------
@@ -35,6 +70,12 @@ VolumeRenderer::VolumeRenderer(QOpenGLWidget *renderWidget, VolumeData *volumeDa
     volumeShaderProg->setUniformValue("exitPoints", 2);
     volumeShaderProg->setUniformValue("transferFunction", 3);
     volumeShaderProg->setUniformValue("shadowVolume", 4);
+    volumeShaderProg->setUniformValue("pageTable", 5);
+    volumeShaderProg->setUniformValue("brickAtlas", 6);
+    volumeShaderProg->setUniformValue("maxVolume", 7);
+    volumeShaderProg->setUniformValue("occupancy", 8);
+    volumeShaderProg->setUniformValue("preIntegrationTable", 9);
+    volumeShaderProg->setUniformValue("gradientVolume", 10);
     volumeShaderProg->release();
 
     // create the FBOs through the resize method
@@ -48,6 +89,10 @@ VolumeRenderer::VolumeRenderer(QOpenGLWidget *renderWidget, VolumeData *volumeDa
     timer = new QTimer(this);
     timer->setSingleShot(true);
     connect(timer, SIGNAL(timeout()), this, SLOT(actualShadowUpdate()));
+    // create the interaction timer
+    interactionTimer = new QTimer(this);
+    interactionTimer->setSingleShot(true);
+    connect(interactionTimer, SIGNAL(timeout()), this, SLOT(interactionEnded()));
 
     // update the volume texture
     datasetChanged();
@@ -57,20 +102,31 @@ VolumeRenderer::~VolumeRenderer() {
     // delete the textures
     if(volumeTexture != GL_INVALID_VALUE)
         glDeleteTextures(1, &volumeTexture);
+    if(maxVolumeTexture != GL_INVALID_VALUE)
+        glDeleteTextures(1, &maxVolumeTexture);
+    if(gradientTexture != GL_INVALID_VALUE)
+        glDeleteTextures(1, &gradientTexture);
+    if(stepTexture != GL_INVALID_VALUE)
+        glDeleteTextures(1, &stepTexture);
     if(transFuncTexture != GL_INVALID_VALUE)
         glDeleteTextures(1, &transFuncTexture);
+    if(occupancyTexture != GL_INVALID_VALUE)
+        glDeleteTextures(1, &occupancyTexture);
+    if(preIntegrationTexture != GL_INVALID_VALUE)
+        glDeleteTextures(1, &preIntegrationTexture);
+    delete brickCache;
+    delete feedbackFBO;
+    delete entryExitFBO;
+    delete proxyGeometry;
 }
 
 void VolumeRenderer::resizeCanvas(int width, int height) {
     this->width = width;
     this->height = height;
 
-    // generate new entry exit frame buffer objects
-    entryExitFBO = new QOpenGLFramebufferObject(width, height, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, GL_RGB12);
-    entryExitFBO->addColorAttachment(width, height);
-
-    if(!entryExitFBO->isValid())
-        qInfo() << this << "Volume Entry/Exit FBO not valid!";
+    // the entry exit frame buffer object is created again in the new size when needed
+    delete entryExitFBO;
+    entryExitFBO = nullptr;
 }
 
 void VolumeRenderer::updateTransFuncFrom(TransferFunction *tf) {
@@ -116,8 +172,258 @@ void VolumeRenderer::updateTransFuncFrom(TransferFunction *tf) {
         if(!err.isEmpty())
             qWarning() << "TF Texture Data: " << err;
 
+        // bricks that became transparent are no longer loaded
+        if(brickCache)
+            brickCache->setTransferFunction(transFunc);
+        occupancyDirty = true;
+        preIntegrationDirty = true;
+
         tfTexDirty = false;
     }
+    // the occupancy grid of a step that is still being uploaded does not fit volumeTexture
+    if(occupancyDirty && !stepDirty)
+        updateOccupancyTexture();
+    if(preIntegrationDirty && renderProps->getPreIntegration())
+        updatePreIntegrationTexture();
+}
+
+void VolumeRenderer::updatePreIntegrationTexture() {
+    preIntegrationDirty = false;
+    // clear errors
+    QString err = GLUtils::glError();
+
+    float *data = transFunc->toData();
+    PreIntegrationTable table;
+    table.build(data, transFunc->getSize());
+    delete[] data;
+
+    QOpenGLFunctions_4_0_Core* glf = GLUtils::glFunc();
+    glf->glActiveTexture(GL_TEXTURE0);
+    if(preIntegrationTexture == GL_INVALID_VALUE) {
+        glf->glGenTextures(1, &preIntegrationTexture);
+        glf->glBindTexture(GL_TEXTURE_2D, preIntegrationTexture);
+        glf->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glf->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glf->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glf->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    } else {
+        glf->glBindTexture(GL_TEXTURE_2D, preIntegrationTexture);
+    }
+    glf->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glf->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, table.getSize(), table.getSize(), 0, GL_RGBA, GL_FLOAT, table.getData());
+
+    err = GLUtils::glError();
+    if(!err.isEmpty())
+        qWarning() << "Pre-integration texture errors:" << err;
+}
+
+/**
+ * Classifies the cells of the occupancy grid of the dataset with the current
+ * transfer function and uploads the result. Without a grid (previews and
+ * streamed volumes) the rays sample every step.
+ */
+void VolumeRenderer::updateOccupancyTexture() {
+    occupancyDirty = false;
+    occupancyReady = false;
+    QSharedPointer<OccupancyGrid> grid = dataset->getOccupancyGrid();
+    if(grid.isNull() || grid->getCellCount() == 0 || !transFunc) {
+        proxyGeometry->clear();
+        return;
+    }
+
+    // clear errors
+    QString err = GLUtils::glError();
+
+    float *data = transFunc->toData();
+    std::vector<uchar> occupancy;
+    int empty = grid->classify(data, transFunc->getSize(), dataset->getProperties().minValue, dataset->getProperties().maxValue,
+                               dataset->getDomainMin(), dataset->getDomainMax(), occupancy);
+    delete[] data;
+
+    QOpenGLFunctions_4_0_Core* glf = GLUtils::glFunc();
+    glf->glActiveTexture(GL_TEXTURE0);
+    if(occupancyTexture == GL_INVALID_VALUE) {
+        glf->glGenTextures(1, &occupancyTexture);
+        glf->glBindTexture(GL_TEXTURE_3D, occupancyTexture);
+        glf->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glf->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glf->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glf->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glf->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    } else {
+        glf->glBindTexture(GL_TEXTURE_3D, occupancyTexture);
+    }
+    glf->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glf->glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, grid->getCellsX(), grid->getCellsY(), grid->getCellsZ(), 0,
+                      GL_RED, GL_UNSIGNED_BYTE, occupancy.data());
+    glf->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    err = GLUtils::glError();
+    if(!err.isEmpty()) {
+        qWarning() << "Occupancy texture errors:" << err;
+        proxyGeometry->clear();
+        return;
+    }
+    occupancyReady = true;
+
+    // only the layers of cells around changed cells get new faces
+    VolumeDataProps props = dataset->getProperties();
+    float cell = static_cast<float>(OccupancyGrid::CELL_SIZE);
+    proxyGeometry->update(occupancy, grid->getCellsX(), grid->getCellsY(), grid->getCellsZ(),
+                          QVector3D(cell / props.width, cell / props.height, cell / props.depth));
+    qInfo() << "Empty space skipping:" << empty << "of" << grid->getCellCount() << "cells are empty under the transfer function";
+}
+
+void VolumeRenderer::updateVolumeTexture() {
+    QOpenGLFunctions_4_0_Core* glf = GLUtils::glFunc();
+
+    // delete the old texture and brick cache if they exist
+    if(volumeTexture != GL_INVALID_VALUE)
+        glf->glDeleteTextures(1, &volumeTexture);
+    if(maxVolumeTexture != GL_INVALID_VALUE)
+        glf->glDeleteTextures(1, &maxVolumeTexture);
+    if(gradientTexture != GL_INVALID_VALUE)
+        glf->glDeleteTextures(1, &gradientTexture);
+    gradientTexture = GL_INVALID_VALUE;
+    if(stepTexture != GL_INVALID_VALUE)
+        glf->glDeleteTextures(1, &stepTexture);
+    stepTexture = GL_INVALID_VALUE;
+    stepDirty = false;
+    stepFilledDepth = 0;
+    delete brickCache;
+    brickCache = nullptr;
+
+    // obtain a new texture from the dataset. Volumes that are too large for a
+    // single texture are rendered through the brick cache, the texture then
+    // only holds a reduced version for the shadows and missing bricks
+    virtualForced = renderProps->getVirtualTexturing();
+    virtualTexture = useVirtualTexture();
+    if(virtualTexture) {
+        VolumeDataProps props = dataset->getProperties();
+        int maxDim = qMax(props.width, qMax(props.height, props.depth));
+        // a power of two factor, so the texture is a level of the pyramid
+        volumeTextureLevel = 0;
+        while(maxDim >> volumeTextureLevel > REDUCED_TEXTURE_SIZE)
+            volumeTextureLevel++;
+        volumeTexture = dataset->createReducedTexture(1 << volumeTextureLevel);
+        brickCache = new BrickCache(dataset);
+        // classify the bricks with the current transfer function
+        tfTexDirty = true;
+    } else {
+        volumeTextureLevel = 0;
+        volumeTexture = dataset->createTexture();
+    }
+    maxVolumeTexture = dataset->createMaxTexture();
+    // the occupancy grid and the gradients belong to the new data
+    occupancyDirty = true;
+    gradientDirty = true;
+    gradientDeferred = false;
+    // the brick cache keeps reading the voxels, a single texture holds all of them
+    if(volumeTexture != GL_INVALID_VALUE)
+        dataset->textureUploaded(!virtualTexture);
+    streamedDepth = 0;
+    streamedMinValue = dataset->getProperties().minValue;
+    streamedMaxValue = dataset->getProperties().maxValue;
+    volumeTexDirty = false;
+
+    // update the shadow map
+    shadowRenderer->invalidate();
+    shadowVolumeReady = false;
+}
+
+/**
+ * Uploads the new step of a series into the texture that the frames do not
+ * render from, STEP_UPLOAD_SLABS slabs per frame, and swaps it in once it is
+ * complete. The frames meanwhile show the previous step, so neither the
+ * upload waits for the rendering from the current texture nor the swap for
+ * the upload. Volumes rendered through the brick cache get all new textures
+ * instead.
+ */
+void VolumeRenderer::updateStepTexture() {
+    if(virtualTexture) {
+        stepDirty = false;
+        updateVolumeTexture();
+        return;
+    }
+    if(stepTexture == GL_INVALID_VALUE) {
+        stepTexture = dataset->createEmptyTexture();
+        stepFilledDepth = 0;
+    }
+    stepFilledDepth = dataset->fillTexture(stepTexture, stepFilledDepth,
+                                           STEP_UPLOAD_SLABS * dataset->getUploadSlabBytes());
+    if(stepFilledDepth < 0) {
+        // a texture that could not be filled is created again at once
+        if(stepTexture != GL_INVALID_VALUE)
+            glDeleteTextures(1, &stepTexture);
+        stepTexture = dataset->createTexture();
+    } else if(stepFilledDepth < dataset->getProperties().depth) {
+        // the next slabs follow with the next frame
+        renderWidget->update();
+        return;
+    }
+    stepDirty = false;
+    stepFilledDepth = 0;
+    qSwap(volumeTexture, stepTexture);
+    // the step brings its own occupancy grid and value range
+    occupancyDirty = true;
+    gradientDirty = true;
+
+    // the gradients and the shadows follow once the playback pauses
+    gradientDeferred = true;
+    shadowRenderer->invalidate();
+    timer->start(SHADOW_UPDATE_DELAY);
+}
+
+VolumeDataProps VolumeRenderer::textureProperties() {
+    VolumeDataProps props = dataset->getProperties();
+    props.minValue = textureMinValue;
+    props.maxValue = textureMaxValue;
+    return props;
+}
+
+/**
+ * The proxy geometry only bounds the samples that can be visible under the
+ * transfer function, the maximum intensity projection needs all of them.
+ */
+bool VolumeRenderer::useProxyGeometry() {
+    return occupancyReady && proxyGeometry->isValid() && renderProps->getMode() != 1;
+}
+
+/**
+ * The gradient texture needs the full resolution voxels on the CPU and as
+ * much GPU memory as an RGBA8 copy of the volume, volumes rendered through
+ * the brick cache keep computing their gradients from the samples.
+ */
+bool VolumeRenderer::useGradientTexture() {
+    int lighting = renderProps->getLightingMode();
+    return renderProps->getPrecomputedGradients() && !virtualTexture && !dataset->isStreaming()
+            && (lighting == VolumeRenderProps::PHONG || lighting == VolumeRenderProps::GLOBAL_PHONG);
+}
+
+void VolumeRenderer::updateGradientTexture() {
+    if(gradientTexture != GL_INVALID_VALUE)
+        GLUtils::glFunc()->glDeleteTextures(1, &gradientTexture);
+    gradientTexture = dataset->createGradientTexture();
+    gradientDirty = false;
+}
+
+bool VolumeRenderer::useAnalyticRays() {
+    return renderProps->getAnalyticRays() && renderProps->getMode() <= VolumeRenderProps::MIP;
+}
+
+bool VolumeRenderer::useVirtualTexture() {
+    if(dataset->isPreview() || dataset->getData() == nullptr)
+        return false;
+    if(renderProps->getVirtualTexturing())
+        return true;
+
+    VolumeDataProps props = dataset->getProperties();
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+    qint64 textureBytes = static_cast<qint64>(props.width) * props.height * props.depth
+            * VolumeData::texelSize(dataset->getActivePrecision());
+    return props.width > maxSize || props.height > maxSize || props.depth > maxSize
+            || textureBytes > VIRTUAL_TEXTURE_THRESHOLD;
 }
 
 void VolumeRenderer::render(Camera *camera, PrimitiveUtils *primRenderer) {
@@ -131,13 +437,53 @@ void VolumeRenderer::render(Camera *camera, PrimitiveUtils *primRenderer) {
         return;
     }
 
+    // update the volume texture if the data or the texture mode changed
+    if(volumeTexDirty || renderProps->getVirtualTexturing() != virtualForced)
+        updateVolumeTexture();
+    else if(stepDirty)
+        updateStepTexture();
+    // the value range of a step takes effect with its texture
+    if(!stepDirty) {
+        textureMinValue = dataset->getProperties().minValue;
+        textureMaxValue = dataset->getProperties().maxValue;
+    }
+
+    // add the slices of a streamed volume that were decoded since the last frame
+    if(dataset->isStreaming() && streamedDepth < dataset->getStreamedDepth()) {
+        int uploadedDepth = streamedDepth;
+        streamedDepth = dataset->uploadStreamedSlices(volumeTexture, streamedDepth);
+        // only the shadows around the new slices change, unless the value
+        // range the transfer function is stretched over grew with them
+        VolumeDataProps props = dataset->getProperties();
+        if(props.minValue != streamedMinValue || props.maxValue != streamedMaxValue) {
+            shadowRenderer->invalidate();
+            streamedMinValue = props.minValue;
+            streamedMaxValue = props.maxValue;
+        } else {
+            shadowRenderer->invalidateSlices(static_cast<float>(uploadedDepth) / props.depth,
+                                             static_cast<float>(streamedDepth) / props.depth);
+        }
+        if(!timer->isActive())
+            timer->start(SHADOW_UPDATE_DELAY);
+    }
+
     // update the transfer function (texture) if changes were made
     updateTransFuncFrom(renderProps->getTransFunc());
 
+    // bake the gradients once the lighting needs them
+    if(gradientDirty && !gradientDeferred && useGradientTexture())
+        updateGradientTexture();
+
     // update the shadow volume if necessary
     if(!shadowVolumeReady) {
-        if(timer->isActive())
+        if(timer->isActive()) {
             timer->stop();
+            // the timer does not end the deferred bake then, the next frame does
+            if(gradientDeferred) {
+                gradientDeferred = false;
+                renderWidget->update();
+            }
+        }
         shadowVolumeReady = shadowRenderer->updateShadowVolume(primRenderer);
     }
 
@@ -147,7 +493,20 @@ void VolumeRenderer::render(Camera *camera, PrimitiveUtils *primRenderer) {
 
     // Render the entry and exit points in the two fbo textures
     // using the "entryExit" shader program
-    renderEntryExitPoints(camera, primRenderer);
+    if(!useAnalyticRays())
+        renderEntryExitPoints(camera, primRenderer);
+
+    // stream the bricks the rays need into the brick cache
+    if(brickCache)
+        renderBrickFeedback(camera, primRenderer);
+
+    // measure the effect of the empty space skipping
+    if(reportSamples && occupancyReady && renderProps->getMode() == 0)
+        reportSamplesPerRay(camera, primRenderer);
+
+    if(reportGradientTiming && renderProps->getMode() == VolumeRenderProps::DIRECT && useGradientTexture()
+            && !gradientDirty && gradientTexture != GL_INVALID_VALUE)
+        measureGradientTiming(camera, primRenderer);
 
     // render the volume using all the parameters and precalculated
     // textures and the "volume" shader program
@@ -161,11 +520,21 @@ void VolumeRenderer::render(Camera *camera, PrimitiveUtils *primRenderer) {
 /**
  * Renders the entry and exit points in the entryExitFBO color attachment 0 and 1
  * respectively of the volume as color coded rgb values (xyz in volume space).
+ * With the proxy geometry the nearest front face is the entry and the farthest
+ * back face the exit point, pixels it does not cover launch no rays.
  */
 void VolumeRenderer::renderEntryExitPoints(Camera *camera, PrimitiveUtils *primRenderer)  {
     // clear errors
     QString err = GLUtils::glError();
 
+    // generate the entry exit frame buffer object
+    if(!entryExitFBO) {
+        entryExitFBO = new QOpenGLFramebufferObject(width, height, QOpenGLFramebufferObject::Depth, GL_TEXTURE_2D, GL_RGB12);
+        entryExitFBO->addColorAttachment(width, height);
+        if(!entryExitFBO->isValid())
+            qInfo() << this << "Volume Entry/Exit FBO not valid!";
+    }
+
     // setup the shader program and the fbo
     entryExitShaderProg->bind();
     entryExitFBO->bind();
@@ -174,21 +543,34 @@ void VolumeRenderer::renderEntryExitPoints(Camera *camera, PrimitiveUtils *primR
     entryExitShaderProg->setUniformValue("modelViewMatrix", *(camera->getViewMatrix()) * dataset->getNormalizeMatrix());
     entryExitShaderProg->setUniformValue("projectionMatrix", *(camera->getProjectionMatrix()));
 
+    bool proxy = useProxyGeometry();
+
     // Render Entry Points ------------------- //
     glCullFace(GL_BACK);
     GLUtils::glFunc()->glDrawBuffer(GL_COLOR_ATTACHMENT0); // entry texture
     glClearColor(0.f, 0.f, 0.f, 0.f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    primRenderer->renderCube();
+    if(proxy)
+        proxyGeometry->render();
+    else
+        primRenderer->renderCube();
 
     // Render Exit Points
     glCullFace(GL_FRONT);
     GLUtils::glFunc()->glDrawBuffer(GL_COLOR_ATTACHMENT1); // exit texture
     glClearColor(0.f, 0.f, 0.f, 0.f);
+    GLUtils::glFunc()->glClearDepth(0.0);
+    glDepthFunc(GL_GREATER);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    primRenderer->renderCube();
+    if(proxy)
+        proxyGeometry->render();
+    else
+        primRenderer->renderCube();
+
+    GLUtils::glFunc()->glClearDepth(1.0);
+    glDepthFunc(GL_LESS);
 
     // Release the Entry/Exit-program and all related objects
     GLUtils::glFunc()->glDisableVertexAttribArray(0);
@@ -213,6 +595,180 @@ void VolumeRenderer::renderVolume(Camera *camera, PrimitiveUtils *primRenderer)
     GLUtils::glFunc()->glDrawBuffer(GL_FRONT_LEFT);
     err = GLUtils::glError();
 
+    setupVolumeShader(camera);
+
+    // render the dummy plane to invoke the fragment shader program ----------------------------
+    GLUtils::glFunc()->glEnableVertexAttribArray(0);
+    primRenderer->renderPlaneXY();
+    GLUtils::glFunc()->glDisableVertexAttribArray(0);
+
+    volumeShaderProg->release();
+
+    err = GLUtils::glError();
+    if(!err.isEmpty())
+        qInfo() << "volume final errors:" << err;
+}
+
+/**
+ * Renders the rays at a reduced resolution into the feedbackFBO, where every
+ * pixel encodes a brick the ray needs, and lets the brick cache load them.
+ */
+void VolumeRenderer::renderBrickFeedback(Camera *camera, PrimitiveUtils *primRenderer) {
+    // clear errors
+    QString err = GLUtils::glError();
+
+    int feedbackWidth = qMax(1, width / FEEDBACK_DIVISOR), feedbackHeight = qMax(1, height / FEEDBACK_DIVISOR);
+    if(!feedbackFBO || feedbackFBO->width() != feedbackWidth || feedbackFBO->height() != feedbackHeight) {
+        delete feedbackFBO;
+        feedbackFBO = new QOpenGLFramebufferObject(feedbackWidth, feedbackHeight, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, GL_RGBA8);
+    }
+
+    volumeShaderProg->bind();
+    feedbackFBO->bind();
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glCullFace(GL_BACK);
+
+    setupVolumeShader(camera);
+    volumeShaderProg->setUniformValue("feedbackPass", true);
+    volumeShaderProg->setUniformValue("frameIndex", frameIndex++);
+
+    GLUtils::glFunc()->glEnableVertexAttribArray(0);
+    primRenderer->renderPlaneXY();
+    GLUtils::glFunc()->glDisableVertexAttribArray(0);
+
+    // read back the requested bricks
+    std::vector<uchar> feedback(static_cast<size_t>(feedbackWidth) * feedbackHeight * 4);
+    GLUtils::glFunc()->glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, feedback.data());
+
+    volumeShaderProg->setUniformValue("feedbackPass", false);
+    feedbackFBO->release();
+    volumeShaderProg->release();
+    glViewport(0, 0, width, height);
+
+    err = GLUtils::glError();
+    if(!err.isEmpty())
+        qInfo() << "Brick feedback errors:" << err;
+
+    // keep rendering frames while bricks are streamed in
+    if(brickCache->update(feedback))
+        renderWidget->update();
+}
+
+/**
+ * Renders the rays once without and once with empty space skipping at the
+ * feedback resolution, where every pixel encodes the number of volume
+ * samples of its ray, and logs the averages over the rays that hit the volume.
+ */
+void VolumeRenderer::reportSamplesPerRay(Camera *camera, PrimitiveUtils *primRenderer) {
+    reportSamples = false;
+    // clear errors
+    QString err = GLUtils::glError();
+
+    int countWidth = qMax(1, width / FEEDBACK_DIVISOR), countHeight = qMax(1, height / FEEDBACK_DIVISOR);
+    QOpenGLFramebufferObject countFBO(countWidth, countHeight, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, GL_RGBA8);
+
+    volumeShaderProg->bind();
+    countFBO.bind();
+    glViewport(0, 0, countWidth, countHeight);
+    glCullFace(GL_BACK);
+    setupVolumeShader(camera);
+    volumeShaderProg->setUniformValue("countSamples", true);
+
+    double average[2] = {0.0, 0.0};
+    std::vector<uchar> counts(static_cast<size_t>(countWidth) * countHeight * 4);
+    GLUtils::glFunc()->glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for(int skipping = 0; skipping < 2; skipping++) {
+        glClearColor(0.f, 0.f, 0.f, 0.f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        volumeShaderProg->setUniformValue("emptySkipping", skipping == 1);
+
+        GLUtils::glFunc()->glEnableVertexAttribArray(0);
+        primRenderer->renderPlaneXY();
+        GLUtils::glFunc()->glDisableVertexAttribArray(0);
+
+        glReadPixels(0, 0, countWidth, countHeight, GL_RGBA, GL_UNSIGNED_BYTE, counts.data());
+        qint64 samples = 0, rays = 0;
+        for(size_t i = 0; i + 3 < counts.size(); i += 4) {
+            if(counts[i + 3] != 255)
+                continue;
+            samples += counts[i] | (counts[i + 1] << 8) | (counts[i + 2] << 16);
+            rays++;
+        }
+        average[skipping] = rays > 0 ? static_cast<double>(samples) / rays : 0.0;
+    }
+
+    volumeShaderProg->setUniformValue("countSamples", false);
+    countFBO.release();
+    volumeShaderProg->release();
+    glViewport(0, 0, width, height);
+
+    err = GLUtils::glError();
+    if(!err.isEmpty())
+        qInfo() << "Sample count errors:" << err;
+    else
+        qInfo() << "Samples per ray:" << average[0] << "without and" << average[1] << "with empty space skipping";
+}
+
+/**
+ * Renders the volume pass into an offscreen target of the canvas size a few
+ * times with the normals from six samples and from the gradient texture and
+ * logs the fastest GPU time of both.
+ */
+void VolumeRenderer::measureGradientTiming(Camera *camera, PrimitiveUtils *primRenderer) {
+    reportGradientTiming = false;
+    // clear errors
+    QString err = GLUtils::glError();
+    QOpenGLFunctions_4_0_Core* glf = GLUtils::glFunc();
+
+    QOpenGLFramebufferObject timingFBO(width, height, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, GL_RGBA8);
+    GLuint query;
+    glf->glGenQueries(1, &query);
+
+    volumeShaderProg->bind();
+    timingFBO.bind();
+    glCullFace(GL_BACK);
+    setupVolumeShader(camera);
+
+    const int runs = 3;
+    double fastest[2] = {0.0, 0.0};
+    for(int baked = 0; baked < 2; baked++) {
+        volumeShaderProg->setUniformValue("gradientReady", baked == 1);
+        for(int run = 0; run < runs; run++) {
+            glClear(GL_COLOR_BUFFER_BIT);
+            glf->glBeginQuery(GL_TIME_ELAPSED, query);
+            glf->glEnableVertexAttribArray(0);
+            primRenderer->renderPlaneXY();
+            glf->glDisableVertexAttribArray(0);
+            glf->glEndQuery(GL_TIME_ELAPSED);
+            GLuint64 nanoseconds = 0;
+            glf->glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            double ms = nanoseconds / 1e6;
+            fastest[baked] = run == 0 ? ms : qMin(fastest[baked], ms);
+        }
+    }
+
+    timingFBO.release();
+    volumeShaderProg->release();
+    glf->glDeleteQueries(1, &query);
+
+    err = GLUtils::glError();
+    if(!err.isEmpty())
+        qInfo() << "Gradient timing errors:" << err;
+    else
+        qInfo() << "Volume pass:" << fastest[0] << "ms with six samples per gradient," << fastest[1]
+                << "ms with the gradient texture";
+}
+
+/**
+ * Sets the uniforms of the volume shader program and binds its textures.
+ */
+void VolumeRenderer::setupVolumeShader(Camera *camera) {
+    // clear errors
+    QString err = GLUtils::glError();
+
     // set the volume rendering property uniforms
     volumeShaderProg->setUniformValue("displayMode", renderProps->getMode());
     volumeShaderProg->setUniformValue("step", renderProps->getStepSize());
@@ -239,11 +795,12 @@ void VolumeRenderer::renderVolume(Camera *camera, PrimitiveUtils *primRenderer)
     }
 
     // set the volume data property uniform
-    volumeShaderProg->setUniformValue("properties.width", dataset->getProperties().width);
-    volumeShaderProg->setUniformValue("properties.height", dataset->getProperties().height);
-    volumeShaderProg->setUniformValue("properties.depth", dataset->getProperties().depth);
-    volumeShaderProg->setUniformValue("properties.minValue", dataset->getProperties().minValue);
-    volumeShaderProg->setUniformValue("properties.maxValue", dataset->getProperties().maxValue);
+    VolumeDataProps props = textureProperties();
+    volumeShaderProg->setUniformValue("properties.width", props.width);
+    volumeShaderProg->setUniformValue("properties.height", props.height);
+    volumeShaderProg->setUniformValue("properties.depth", props.depth);
+    volumeShaderProg->setUniformValue("properties.minValue", props.minValue);
+    volumeShaderProg->setUniformValue("properties.maxValue", props.maxValue);
 
     // view matrix uniforms
     volumeShaderProg->setUniformValue("mvMat", *(camera->getViewMatrix()));
@@ -258,11 +815,20 @@ void VolumeRenderer::renderVolume(Camera *camera, PrimitiveUtils *primRenderer)
     GLUtils::glFunc()->glActiveTexture(GL_TEXTURE0);
     GLUtils::glFunc()->glBindTexture(GL_TEXTURE_3D, volumeTexture);
 
-    // entry exit points
-    GLUtils::glFunc()->glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, entryExitFBO->textures().at(0));
-    GLUtils::glFunc()->glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, entryExitFBO->textures().at(1));
+    // entry exit points, or the inverse transformation of the rays
+    bool analytic = useAnalyticRays();
+    volumeShaderProg->setUniformValue("analyticRays", analytic);
+    if(analytic) {
+        // the texture coordinates [0,1] map to the unit cube around the origin
+        QMatrix4x4 texToClip = *(camera->getProjectionMatrix()) * *(camera->getViewMatrix()) * dataset->getNormalizeMatrix();
+        texToClip.translate(-0.5f, -0.5f, -0.5f);
+        volumeShaderProg->setUniformValue("clipToTex", texToClip.inverted());
+    } else if(entryExitFBO) {
+        GLUtils::glFunc()->glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, entryExitFBO->textures().at(0));
+        GLUtils::glFunc()->glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, entryExitFBO->textures().at(1));
+    }
 
     // transfer function
     GLUtils::glFunc()->glActiveTexture(GL_TEXTURE3);
@@ -272,41 +838,115 @@ void VolumeRenderer::renderVolume(Camera *camera, PrimitiveUtils *primRenderer)
     GLUtils::glFunc()->glActiveTexture(GL_TEXTURE4);
     glBindTexture(GL_TEXTURE_3D, shadowRenderer->getShadowTexture());
 
+    // virtual texture
+    if(brickCache)
+        brickCache->bind(volumeShaderProg, 5, 6);
+    else
+        volumeShaderProg->setUniformValue("virtualTexture", false);
+
+    // maximum pyramid levels
+    volumeShaderProg->setUniformValue("maxVolumeReady", maxVolumeTexture != GL_INVALID_VALUE);
+    if(maxVolumeTexture != GL_INVALID_VALUE) {
+        GLUtils::glFunc()->glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_3D, maxVolumeTexture);
+    }
+    setupLevelOfDetail(camera);
+
+    // baked gradients
+    bool gradientReady = useGradientTexture() && !gradientDirty && gradientTexture != GL_INVALID_VALUE;
+    volumeShaderProg->setUniformValue("gradientReady", gradientReady);
+    if(gradientReady) {
+        GLUtils::glFunc()->glActiveTexture(GL_TEXTURE10);
+        glBindTexture(GL_TEXTURE_3D, gradientTexture);
+    }
+
+    // pre-integrated transfer function
+    bool preIntegrated = renderProps->getPreIntegration() && preIntegrationTexture != GL_INVALID_VALUE;
+    volumeShaderProg->setUniformValue("preIntegrated", preIntegrated);
+    if(preIntegrated) {
+        GLUtils::glFunc()->glActiveTexture(GL_TEXTURE9);
+        glBindTexture(GL_TEXTURE_2D, preIntegrationTexture);
+    }
+
+    // occupancy of the cells for the empty space skipping
+    QSharedPointer<OccupancyGrid> grid = dataset->getOccupancyGrid();
+    volumeShaderProg->setUniformValue("emptySkipping", occupancyReady && !grid.isNull());
+    if(occupancyReady && !grid.isNull()) {
+        float cell = static_cast<float>(OccupancyGrid::CELL_SIZE);
+        volumeShaderProg->setUniformValue("occupancyCell", QVector3D(cell / props.width, cell / props.height, cell / props.depth));
+        GLUtils::glFunc()->glActiveTexture(GL_TEXTURE8);
+        glBindTexture(GL_TEXTURE_3D, occupancyTexture);
+    }
+
     err = GLUtils::glError();
     if(!err.isEmpty())
         qInfo() << "volume tex errors:" << err;
+}
 
-    // render the dummy plane to invoke the fragment shader program ----------------------------
-    GLUtils::glFunc()->glEnableVertexAttribArray(0);
-    primRenderer->renderPlaneXY();
-    GLUtils::glFunc()->glDisableVertexAttribArray(0);
 
-    volumeShaderProg->release();
+/**
+ * Sets the uniforms that let the shader select the pyramid level of a sample.
+ * The level is chosen so a voxel of the level covers about one pixel: the
+ * footprint of a pixel in voxels is lodScale at view depth 1 (perspective)
+ * or everywhere (orthographic), and log2 of the footprint is the level.
+ */
+void VolumeRenderer::setupLevelOfDetail(Camera *camera) {
+    QSharedPointer<VolumePyramid> pyramid = dataset->getPyramid();
+    int levels = pyramid.isNull() ? 0 : pyramid->getLevelCount();
+    if(!renderProps->getLevelOfDetail() || levels == 0) {
+        volumeShaderProg->setUniformValue("lodScale", 0.f);
+        volumeShaderProg->setUniformValue("maxLod", 0.f);
+        volumeShaderProg->setUniformValue("volumeLevel", static_cast<float>(volumeTextureLevel));
+        return;
+    }
 
-    err = GLUtils::glError();
-    if(!err.isEmpty())
-        qInfo() << "volume final errors:" << err;
+    // the texture coordinates [0,1] map to the unit cube around the origin
+    QMatrix4x4 texToView = *(camera->getViewMatrix()) * dataset->getNormalizeMatrix();
+    texToView.translate(-0.5f, -0.5f, -0.5f);
+
+    // the largest extent of a voxel in view space
+    VolumeDataProps props = dataset->getProperties();
+    float voxelSize = qMax(texToView.column(0).toVector3D().length() / props.width,
+                           qMax(texToView.column(1).toVector3D().length() / props.height,
+                                texToView.column(2).toVector3D().length() / props.depth));
+    // the extent of a pixel in view space (at depth 1 for the perspective projection)
+    float pixelSize = 2.f / ((*camera->getProjectionMatrix())(1, 1) * height);
+
+    volumeShaderProg->setUniformValue("lodScale", pixelSize / voxelSize);
+    volumeShaderProg->setUniformValue("lodPerspective", camera->isPerspective());
+    // the view depth is the negative z coordinate in view space
+    volumeShaderProg->setUniformValue("viewDepth", -texToView.row(2));
+    volumeShaderProg->setUniformValue("lodBias", interactionTimer->isActive() ? INTERACTION_LOD_BIAS : 0.f);
+    volumeShaderProg->setUniformValue("maxLod", static_cast<float>(levels));
+    volumeShaderProg->setUniformValue("volumeLevel", static_cast<float>(volumeTextureLevel));
 }
 
+void VolumeRenderer::interacted() {
+    interactionTimer->start(INTERACTION_DELAY);
+}
 
 
 // **** SLOTS ****************************** //
 
 void VolumeRenderer::datasetChanged() {
-    QOpenGLFunctions_4_0_Core* glf = GLUtils::glFunc();
-
-    if(!dataset->isReady())
-        return;
-
-    // delete the old texture if one exists
-    if(volumeTexture != GL_INVALID_VALUE)
-        glf->glDeleteTextures(1, &volumeTexture);
+    // the data may change while no GL context is current (e.g. when a
+    // background load finishes), so the texture is recreated in render()
+    volumeTexDirty = true;
+    // the preview of a loading volume is replaced soon
+    if(!dataset->isPreview())
+        reportGradientTiming = reportSamples = true;
+    renderWidget->update();
+}
 
-    // obtain a new texture from the dataset
-    volumeTexture = dataset->createTexture();
+void VolumeRenderer::datasetSlicesStreamed() {
+    renderWidget->update();
+}
 
-    // update the shadow map
-    shadowVolumeReady = false;
+void VolumeRenderer::datasetStepChanged() {
+    // a step that replaces one still being uploaded starts over
+    stepDirty = true;
+    stepFilledDepth = 0;
+    renderWidget->update();
 }
 
 void VolumeRenderer::shadowPropsChanged() {
@@ -317,6 +957,12 @@ void VolumeRenderer::shadowPropsChanged() {
 
 void VolumeRenderer::actualShadowUpdate() {
     shadowVolumeReady = false;
+    gradientDeferred = false;
+    renderWidget->update();
+}
+
+void VolumeRenderer::interactionEnded() {
+    // render the final frame at full detail
     renderWidget->update();
 }
 
@@ -28,6 +28,11 @@ VolumeRenderProps::VolumeRenderProps() {
     lightOpacityBaseStep = (LIGHT_BASE_OPAC_MIN + LIGHT_BASE_OPAC_MAX)/2.f;
     scatteringStepCount = MIN_SCATTERING_STEP_COUNT;
     scatteringRadius = MIN_SCATTERING_RADIUS;
+    virtualTexturing = false;
+    levelOfDetail = true;
+    analyticRays = false;
+    preIntegration = false;
+    precomputedGradients = true;
 
     transFunc = new TransferFunction();
     connect(transFunc, SIGNAL(transFuncChangedAlpha()), this, SLOT(transFuncChangedAlphaSlot()));
@@ -247,6 +252,51 @@ void VolumeRenderProps::setLightSegmentLength(float v) {
     emit volumePropsChanged();
 }
 
+void VolumeRenderProps::setVirtualTexturing(bool v) {
+    virtualTexturing = v;
+    emit volumePropsChanged();
+}
+
+bool VolumeRenderProps::getVirtualTexturing() {
+    return virtualTexturing;
+}
+
+void VolumeRenderProps::setLevelOfDetail(bool v) {
+    levelOfDetail = v;
+    emit volumePropsChanged();
+}
+
+bool VolumeRenderProps::getLevelOfDetail() {
+    return levelOfDetail;
+}
+
+void VolumeRenderProps::setAnalyticRays(bool v) {
+    analyticRays = v;
+    emit volumePropsChanged();
+}
+
+bool VolumeRenderProps::getAnalyticRays() {
+    return analyticRays;
+}
+
+void VolumeRenderProps::setPreIntegration(bool v) {
+    preIntegration = v;
+    emit volumePropsChanged();
+}
+
+bool VolumeRenderProps::getPreIntegration() {
+    return preIntegration;
+}
+
+void VolumeRenderProps::setPrecomputedGradients(bool v) {
+    precomputedGradients = v;
+    emit volumePropsChanged();
+}
+
+bool VolumeRenderProps::getPrecomputedGradients() {
+    return precomputedGradients;
+}
+
 void VolumeRenderProps::setLightDirectional(bool v) {
     lightDirectional = v;
     emit shadowPropsChanged();
@@ -0,0 +1,250 @@
+#include "volumeseries.hpp"
+
+#include <QCollator>
+#include <QDebug>
+
+#include <algorithm>
+
+#include "volumedata.hpp"
+
+static const double DEFAULT_FPS = 10.0;
+
+VolumeSeries::VolumeSeries(VolumeData *volume)
+{
+    this->volume = volume;
+    ring.resize(RING_SIZE);
+    for(Slot &slot : ring) {
+        slot.step = -1;
+        slot.loader = nullptr;
+        slot.loaded = slot.failed = false;
+    }
+    shownStep = -1;
+    nextStep = 0;
+    seeking = false;
+
+    timer = new QTimer(this);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, SIGNAL(timeout()), this, SLOT(nextFrame()));
+    targetFps = DEFAULT_FPS;
+    shownFrames = droppedFrames = 0;
+    readTime = decodeTime = 0;
+    timedSteps = 0;
+}
+
+VolumeSeries::~VolumeSeries()
+{
+    close();
+}
+
+bool VolumeSeries::open(QStringList paths) {
+    close();
+    if(paths.isEmpty())
+        return false;
+    QCollator collator;
+    collator.setNumericMode(true);
+    std::sort(paths.begin(), paths.end(), collator);
+
+    // the renderers refill their textures, so all steps need the shape of the first one
+    VolumeLoader::Header first, header;
+    for(int i = 0; i < paths.size(); i++) {
+        if(!VolumeLoader::parseHeader(paths[i], i == 0 ? first : header))
+            return false;
+        if(i > 0 && (header.width != first.width || header.height != first.height
+                     || header.depth != first.depth || header.type != first.type)) {
+            qWarning() << "The step" << paths[i] << "does not have the shape of the first step" << paths[0] << "!";
+            return false;
+        }
+    }
+    this->paths = paths;
+    emit openChanged(true);
+    qInfo() << "Volume series of" << paths.size() << "steps of" << first.width << first.height << first.depth
+            << VoxelType::name(first.type) << "values";
+    setStep(0);
+    return true;
+}
+
+void VolumeSeries::close() {
+    stop();
+    for(Slot &slot : ring)
+        release(slot);
+    shownStep = -1;
+    nextStep = 0;
+    seeking = false;
+    if(!paths.isEmpty()) {
+        paths.clear();
+        emit openChanged(false);
+    }
+}
+
+bool VolumeSeries::isOpen() {
+    return !paths.isEmpty();
+}
+
+int VolumeSeries::getStepCount() {
+    return paths.size();
+}
+
+int VolumeSeries::getStep() {
+    return shownStep;
+}
+
+void VolumeSeries::setStep(int step) {
+    if(paths.isEmpty())
+        return;
+    nextStep = qBound(0, step, paths.size() - 1);
+    seeking = true;
+    prefetch();
+    Slot *slot = findSlot(nextStep);
+    if(slot && slot->loaded)
+        show(*slot);
+}
+
+void VolumeSeries::play() {
+    if(paths.isEmpty() || timer->isActive())
+        return;
+    shownFrames = droppedFrames = 0;
+    readTime = decodeTime = 0;
+    timedSteps = 0;
+    timer->start(qMax(1, qRound(1000.0 / targetFps)));
+}
+
+void VolumeSeries::stop() {
+    if(!timer->isActive())
+        return;
+    timer->stop();
+    logStatistics();
+}
+
+bool VolumeSeries::isPlaying() {
+    return timer->isActive();
+}
+
+void VolumeSeries::setTargetFps(double fps) {
+    targetFps = qBound(0.1, fps, 1000.0);
+    if(timer->isActive())
+        timer->setInterval(qMax(1, qRound(1000.0 / targetFps)));
+}
+
+double VolumeSeries::getTargetFps() {
+    return targetFps;
+}
+
+int VolumeSeries::getDroppedFrames() {
+    return droppedFrames;
+}
+
+/**
+ * Shows the next step if it is loaded. Otherwise the frame is dropped and
+ * the shown step stays until the next tick.
+ */
+void VolumeSeries::nextFrame() {
+    Slot *slot = findSlot(nextStep);
+    if(slot && slot->loaded) {
+        show(*slot);
+        return;
+    }
+    droppedFrames++;
+    qInfo() << "Dropped a frame, step" << nextStep << "is not loaded yet";
+}
+
+void VolumeSeries::stepLoaded(bool success) {
+    // loaders that left the ring meanwhile are ignored
+    VolumeLoader *loader = qobject_cast<VolumeLoader*>(sender());
+    Slot *slot = nullptr;
+    for(Slot &candidate : ring) {
+        if(loader != nullptr && candidate.loader == loader)
+            slot = &candidate;
+    }
+    if(slot == nullptr)
+        return;
+
+    slot->loaded = true;
+    slot->failed = !success;
+    if(success) {
+        const VolumeLoader::Result &result = loader->getResult();
+        readTime += result.readTime;
+        decodeTime += result.decodeTime;
+        timedSteps++;
+        qInfo() << "Step" << slot->step << "loaded: read" << result.readTime / 1e6 << "ms, decode"
+                << result.decodeTime / 1e6 << "ms";
+    } else {
+        qWarning() << "Could not load step" << slot->step << "from" << paths[slot->step] << ", it is skipped";
+    }
+    if(seeking && slot->step == nextStep)
+        show(*slot);
+}
+
+/**
+ * Starts loaders for the steps following nextStep (wrapping around at the
+ * end of the series) in the free slots of the ring. Slots holding steps
+ * outside of this window, e.g. after a seek, are freed first.
+ */
+void VolumeSeries::prefetch() {
+    if(paths.isEmpty())
+        return;
+    const int count = paths.size();
+    const int window = qMin(static_cast<int>(RING_SIZE), count);
+    for(Slot &slot : ring) {
+        if(slot.loader != nullptr && (slot.step - nextStep + count) % count >= window)
+            release(slot);
+    }
+    for(int i = 0; i < window; i++) {
+        int step = (nextStep + i) % count;
+        if(findSlot(step) != nullptr)
+            continue;
+        Slot *slot = findSlot(-1);
+        if(slot == nullptr)
+            break;
+        slot->step = step;
+        slot->loaded = slot->failed = false;
+        slot->loader = new VolumeLoader(paths[step], volume->getReaderBackend());
+        // every step is shown briefly, so neither the cache nor a pyramid pays off
+        slot->loader->setPyramidEnabled(false);
+        connect(slot->loader, SIGNAL(loaded(bool)), this, SLOT(stepLoaded(bool)));
+        // the shown step is rendered on the main thread meanwhile
+        slot->loader->start(QThread::LowPriority);
+    }
+}
+
+void VolumeSeries::release(Slot &slot) {
+    if(slot.loader != nullptr) {
+        slot.loader->cancel();
+        slot.loader->wait();
+        // deleted after its queued signals, which are ignored from now on
+        slot.loader->deleteLater();
+    }
+    slot.step = -1;
+    slot.loader = nullptr;
+    slot.loaded = slot.failed = false;
+}
+
+VolumeSeries::Slot* VolumeSeries::findSlot(int step) {
+    for(Slot &slot : ring) {
+        if(slot.step == step)
+            return &slot;
+    }
+    return nullptr;
+}
+
+void VolumeSeries::show(Slot &slot) {
+    bool failed = slot.failed;
+    int step = slot.step;
+    if(!failed) {
+        // the data is swapped out of the loader, the loader is released afterwards
+        volume->adoptStep(slot.loader);
+        shownStep = step;
+        shownFrames++;
+    }
+    nextStep = (step + 1) % paths.size();
+    seeking = false;
+    release(slot);
+    prefetch();
+    if(!failed)
+        emit stepShown(step);
+}
+
+void VolumeSeries::logStatistics() {
+    qInfo() << "Series playback at" << targetFps << "fps:" << shownFrames << "frames shown," << droppedFrames << "dropped";
+    if(timedSteps > 0)
+        qInfo() << "Average step: read" << readTime / timedSteps / 1e6 << "ms, decode" << decodeTime / timedSteps / 1e6 << "ms";
+}
@@ -0,0 +1,268 @@
+#include "voxelbuffer.hpp"
+
+#include <QDebug>
+#include <QFile>
+
+#include <limits>
+#include <utility>
+
+#ifdef Q_OS_UNIX
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+#include "sharedvolume.hpp"
+
+VoxelBuffer::VoxelBuffer()
+{
+    base = nullptr;
+    ptr = nullptr;
+    bytes = 0;
+    mappedFile = nullptr;
+    sharedLength = 0;
+    mappedOffset = 0;
+    privateMapping = false;
+    pagedOut = false;
+    spilled = false;
+}
+
+VoxelBuffer::~VoxelBuffer() {
+    release();
+}
+
+bool VoxelBuffer::allocate(qint64 size, qint64 lead) {
+    release();
+
+    // round the allocation up to whole pages for unbuffered io
+    qint64 total = (lead + size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if(static_cast<quint64>(total) > static_cast<quint64>(std::numeric_limits<size_t>::max())) {
+        qWarning() << "Voxel buffer of" << size << "bytes exceeds the address space!";
+        return false;
+    }
+
+    base = static_cast<char*>(qMallocAligned(static_cast<size_t>(total), ALIGNMENT));
+    if(!base) {
+        qWarning() << "Could not allocate" << size << "bytes for the voxel data!";
+        return false;
+    }
+    ptr = base + lead;
+    bytes = size;
+    return true;
+}
+
+bool VoxelBuffer::map(QString path, qint64 offset, qint64 size, bool privateCopy) {
+    release();
+
+    mappedFile = new QFile(path);
+    if(!mappedFile->open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open file" << path << "for mapping!";
+        delete mappedFile;
+        mappedFile = nullptr;
+        return false;
+    }
+
+    uchar *m = mappedFile->map(offset, size, privateCopy ? QFileDevice::MapPrivateOption : QFileDevice::NoOptions);
+    if(!m) {
+        qWarning() << "Could not map" << path << ":" << mappedFile->errorString();
+        delete mappedFile;
+        mappedFile = nullptr;
+        return false;
+    }
+
+    base = reinterpret_cast<char*>(m);
+    ptr = base;
+    bytes = size;
+    mappedOffset = offset;
+    privateMapping = privateCopy;
+    return true;
+}
+
+bool VoxelBuffer::mapSharedMemory(QString name, qint64 offset, qint64 size, bool privateCopy) {
+    release();
+    sharedName = name;
+    mappedOffset = offset;
+    bytes = size;
+    privateMapping = privateCopy;
+    if(!mapSegment()) {
+        release();
+        return false;
+    }
+    return true;
+}
+
+bool VoxelBuffer::mapSegment() {
+#ifdef Q_OS_UNIX
+    int fd = SharedVolume::openSegment(sharedName, false);
+    if(fd < 0)
+        return false;
+    // mappings start on a page boundary
+    qint64 pageSize = sysconf(_SC_PAGESIZE);
+    qint64 lead = mappedOffset % pageSize;
+    void *m = ::mmap(nullptr, static_cast<size_t>(lead + bytes), privateMapping ? PROT_READ | PROT_WRITE : PROT_READ,
+                     privateMapping ? MAP_PRIVATE : MAP_SHARED, fd, static_cast<off_t>(mappedOffset - lead));
+    ::close(fd);
+    if(m == MAP_FAILED) {
+        qWarning() << "Could not map" << bytes << "bytes of the shared memory segment" << sharedName << "!";
+        return false;
+    }
+    base = static_cast<char*>(m);
+    ptr = base + lead;
+    sharedLength = lead + bytes;
+    return true;
+#else
+    qWarning() << "Shared memory is not supported on this platform, cannot map" << sharedName;
+    return false;
+#endif
+}
+
+void VoxelBuffer::release() {
+    if(sharedLength > 0) {
+#ifdef Q_OS_UNIX
+        if(!pagedOut)
+            ::munmap(base, static_cast<size_t>(sharedLength));
+#endif
+        sharedLength = 0;
+    } else if(mappedFile) {
+        if(!pagedOut)
+            mappedFile->unmap(reinterpret_cast<uchar*>(base));
+        mappedFile->close();
+        if(spilled)
+            mappedFile->remove();
+        delete mappedFile;
+        mappedFile = nullptr;
+    } else if(base) {
+        qFreeAligned(base);
+    }
+    base = nullptr;
+    ptr = nullptr;
+    bytes = 0;
+    sharedName.clear();
+    mappedOffset = 0;
+    privateMapping = false;
+    pagedOut = false;
+    spilled = false;
+}
+
+/**
+ * Writes allocated data into a file in chunks, so a cancel takes effect
+ * after at most one chunk.
+ */
+bool VoxelBuffer::writeSpillFile(QString path, const std::atomic<bool> &canceled) {
+    if(isEmpty() || isPagedOut() || isPageable())
+        return false;
+
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Could not create the spill file" << path << "!";
+        return false;
+    }
+    for(qint64 written = 0; written < bytes; ) {
+        if(canceled) {
+            file.remove();
+            return false;
+        }
+        qint64 w = file.write(ptr + written, qMin(bytes - written, static_cast<qint64>(SPILL_CHUNK)));
+        if(w <= 0) {
+            qWarning() << "Could not write the spill file" << path << ":" << file.errorString();
+            file.remove();
+            return false;
+        }
+        written += w;
+    }
+    file.close();
+    return true;
+}
+
+/**
+ * Maps the spill file of the allocated data. The heap memory is only freed
+ * once the mapping succeeded, so the data is never lost.
+ */
+bool VoxelBuffer::mapSpillFile(QString path) {
+    if(isEmpty() || isPagedOut() || isPageable()) {
+        QFile::remove(path);
+        return false;
+    }
+    VoxelBuffer spilledBuffer;
+    if(!spilledBuffer.map(path, 0, bytes, false)) {
+        QFile::remove(path);
+        return false;
+    }
+    spilledBuffer.spilled = true;
+    // the allocation is freed with spilledBuffer
+    swap(spilledBuffer);
+    return true;
+}
+
+bool VoxelBuffer::isPageable() {
+    return (mappedFile != nullptr || sharedLength > 0) && !privateMapping;
+}
+
+bool VoxelBuffer::pageOut() {
+    if(pagedOut)
+        return true;
+    if(!isPageable())
+        return false;
+    if(sharedLength > 0) {
+#ifdef Q_OS_UNIX
+        ::munmap(base, static_cast<size_t>(sharedLength));
+#endif
+    } else {
+        mappedFile->unmap(reinterpret_cast<uchar*>(base));
+    }
+    base = nullptr;
+    ptr = nullptr;
+    pagedOut = true;
+    return true;
+}
+
+bool VoxelBuffer::pageIn() {
+    if(!pagedOut)
+        return true;
+    if(sharedLength > 0) {
+        if(!mapSegment())
+            return false;
+    } else {
+        uchar *m = mappedFile->map(mappedOffset, bytes, QFileDevice::NoOptions);
+        if(!m) {
+            qWarning() << "Could not map" << mappedFile->fileName() << "again:" << mappedFile->errorString();
+            return false;
+        }
+        base = reinterpret_cast<char*>(m);
+        ptr = base;
+    }
+    pagedOut = false;
+    return true;
+}
+
+bool VoxelBuffer::isPagedOut() {
+    return pagedOut;
+}
+
+char* VoxelBuffer::data() {
+    return ptr;
+}
+
+qint64 VoxelBuffer::size() {
+    return bytes;
+}
+
+bool VoxelBuffer::isEmpty() {
+    return ptr == nullptr && !pagedOut;
+}
+
+bool VoxelBuffer::isMapped() {
+    return mappedFile != nullptr || sharedLength > 0;
+}
+
+void VoxelBuffer::swap(VoxelBuffer &other) {
+    std::swap(base, other.base);
+    std::swap(ptr, other.ptr);
+    std::swap(bytes, other.bytes);
+    std::swap(mappedFile, other.mappedFile);
+    std::swap(sharedLength, other.sharedLength);
+    std::swap(sharedName, other.sharedName);
+    std::swap(mappedOffset, other.mappedOffset);
+    std::swap(privateMapping, other.privateMapping);
+    std::swap(pagedOut, other.pagedOut);
+    std::swap(spilled, other.spilled);
+}
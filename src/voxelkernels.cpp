@@ -0,0 +1,584 @@
+#include "voxelkernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE4_1__)
+    #include <smmintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#include "parallel.hpp"
+
+namespace {
+
+// number of values each thread processes at once
+const qint64 GRAIN = 1 << 20;
+
+inline quint8 byteSwap(quint8 v) {
+    return v;
+}
+
+inline quint16 byteSwap(quint16 v) {
+    return static_cast<quint16>((v >> 8) | (v << 8));
+}
+
+inline quint32 byteSwap(quint32 v) {
+    return (v >> 24) | ((v >> 8) & 0x0000FF00u) | ((v << 8) & 0x00FF0000u) | (v << 24);
+}
+
+inline qint16 byteSwap(qint16 v) {
+    return static_cast<qint16>(byteSwap(static_cast<quint16>(v)));
+}
+
+inline float byteSwap(float v) {
+    quint32 u;
+    std::memcpy(&u, &v, sizeof(u));
+    u = byteSwap(u);
+    std::memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+// scalar version, also used for the remainders of the vectorized loops. The
+// range is kept in locals, the references might alias the swapped values and
+// would be reloaded after every store
+template<typename T>
+void scalarSwapMinMax(T *d, qint64 n, bool swap, T &minV, T &maxV) {
+    T v, lo = minV, hi = maxV;
+    for(qint64 i = 0; i < n; i++) {
+        v = d[i];
+        if(swap) {
+            v = byteSwap(v);
+            d[i] = v;
+        }
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+    }
+    minV = lo;
+    maxV = hi;
+}
+
+// reduces the lanes of a vector register stored to memory
+template<typename T, int N>
+void reduceLanes(const T (&minLanes)[N], const T (&maxLanes)[N], T &minV, T &maxV) {
+    for(int i = 0; i < N; i++) {
+        minV = std::min(minV, minLanes[i]);
+        maxV = std::max(maxV, maxLanes[i]);
+    }
+}
+
+// generic kernel: falls back to the scalar loop
+template<typename T>
+void swapMinMaxChunk(T *d, qint64 n, bool swap, T &minV, T &maxV) {
+    scalarSwapMinMax(d, n, swap, minV, maxV);
+}
+
+#if defined(__AVX2__)
+
+template<>
+void swapMinMaxChunk<quint8>(quint8 *d, qint64 n, bool, quint8 &minV, quint8 &maxV) {
+    __m256i vMin = _mm256_set1_epi8(static_cast<char>(0xFF)), vMax = _mm256_setzero_si256(), v;
+    qint64 i = 0;
+    for(; i + 32 <= n; i += 32) {
+        v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + i));
+        vMin = _mm256_min_epu8(vMin, v);
+        vMax = _mm256_max_epu8(vMax, v);
+    }
+    quint8 minLanes[32], maxLanes[32];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(minLanes), vMin);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(maxLanes), vMax);
+    reduceLanes(minLanes, maxLanes, minV, maxV);
+    scalarSwapMinMax(d + i, n - i, false, minV, maxV);
+}
+
+template<>
+void swapMinMaxChunk<quint16>(quint16 *d, qint64 n, bool swap, quint16 &minV, quint16 &maxV) {
+    __m256i vMin = _mm256_set1_epi16(static_cast<short>(0xFFFF)), vMax = _mm256_setzero_si256(), v;
+    qint64 i = 0;
+    for(; i + 16 <= n; i += 16) {
+        v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + i));
+        if(swap) {
+            v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), v);
+        }
+        vMin = _mm256_min_epu16(vMin, v);
+        vMax = _mm256_max_epu16(vMax, v);
+    }
+    quint16 minLanes[16], maxLanes[16];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(minLanes), vMin);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(maxLanes), vMax);
+    reduceLanes(minLanes, maxLanes, minV, maxV);
+    scalarSwapMinMax(d + i, n - i, swap, minV, maxV);
+}
+
+template<>
+void swapMinMaxChunk<qint16>(qint16 *d, qint64 n, bool swap, qint16 &minV, qint16 &maxV) {
+    __m256i vMin = _mm256_set1_epi16(0x7FFF), vMax = _mm256_set1_epi16(static_cast<short>(0x8000)), v;
+    qint64 i = 0;
+    for(; i + 16 <= n; i += 16) {
+        v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + i));
+        if(swap) {
+            v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), v);
+        }
+        vMin = _mm256_min_epi16(vMin, v);
+        vMax = _mm256_max_epi16(vMax, v);
+    }
+    qint16 minLanes[16], maxLanes[16];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(minLanes), vMin);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(maxLanes), vMax);
+    reduceLanes(minLanes, maxLanes, minV, maxV);
+    scalarSwapMinMax(d + i, n - i, swap, minV, maxV);
+}
+
+template<>
+void swapMinMaxChunk<quint32>(quint32 *d, qint64 n, bool swap, quint32 &minV, quint32 &maxV) {
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i vMin = _mm256_set1_epi32(-1), vMax = _mm256_setzero_si256(), v;
+    qint64 i = 0;
+    for(; i + 8 <= n; i += 8) {
+        v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + i));
+        if(swap) {
+            v = _mm256_shuffle_epi8(v, mask);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), v);
+        }
+        vMin = _mm256_min_epu32(vMin, v);
+        vMax = _mm256_max_epu32(vMax, v);
+    }
+    quint32 minLanes[8], maxLanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(minLanes), vMin);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(maxLanes), vMax);
+    reduceLanes(minLanes, maxLanes, minV, maxV);
+    scalarSwapMinMax(d + i, n - i, swap, minV, maxV);
+}
+
+#elif defined(__SSE2__)
+
+template<>
+void swapMinMaxChunk<quint8>(quint8 *d, qint64 n, bool, quint8 &minV, quint8 &maxV) {
+    __m128i vMin = _mm_set1_epi8(static_cast<char>(0xFF)), vMax = _mm_setzero_si128(), v;
+    qint64 i = 0;
+    for(; i + 16 <= n; i += 16) {
+        v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+        vMin = _mm_min_epu8(vMin, v);
+        vMax = _mm_max_epu8(vMax, v);
+    }
+    quint8 minLanes[16], maxLanes[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(minLanes), vMin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maxLanes), vMax);
+    reduceLanes(minLanes, maxLanes, minV, maxV);
+    scalarSwapMinMax(d + i, n - i, false, minV, maxV);
+}
+
+template<>
+void swapMinMaxChunk<quint16>(quint16 *d, qint64 n, bool swap, quint16 &minV, quint16 &maxV) {
+#if defined(__SSE4_1__)
+    __m128i vMin = _mm_set1_epi16(static_cast<short>(0xFFFF)), vMax = _mm_setzero_si128(), v;
+#else
+    // SSE2 only offers signed 16 bit min/max, so the values are compared
+    // with a flipped sign bit
+    const __m128i sign = _mm_set1_epi16(static_cast<short>(0x8000));
+    __m128i vMin = _mm_set1_epi16(0x7FFF), vMax = _mm_set1_epi16(static_cast<short>(0x8000)), v;
+#endif
+    qint64 i = 0;
+    for(; i + 8 <= n; i += 8) {
+        v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+        if(swap) {
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), v);
+        }
+#if defined(__SSE4_1__)
+        vMin = _mm_min_epu16(vMin, v);
+        vMax = _mm_max_epu16(vMax, v);
+#else
+        v = _mm_xor_si128(v, sign);
+        vMin = _mm_min_epi16(vMin, v);
+        vMax = _mm_max_epi16(vMax, v);
+#endif
+    }
+#if !defined(__SSE4_1__)
+    vMin = _mm_xor_si128(vMin, sign);
+    vMax = _mm_xor_si128(vMax, sign);
+#endif
+    quint16 minLanes[8], maxLanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(minLanes), vMin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maxLanes), vMax);
+    reduceLanes(minLanes, maxLanes, minV, maxV);
+    scalarSwapMinMax(d + i, n - i, swap, minV, maxV);
+}
+
+template<>
+void swapMinMaxChunk<qint16>(qint16 *d, qint64 n, bool swap, qint16 &minV, qint16 &maxV) {
+    __m128i vMin = _mm_set1_epi16(0x7FFF), vMax = _mm_set1_epi16(static_cast<short>(0x8000)), v;
+    qint64 i = 0;
+    for(; i + 8 <= n; i += 8) {
+        v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+        if(swap) {
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), v);
+        }
+        vMin = _mm_min_epi16(vMin, v);
+        vMax = _mm_max_epi16(vMax, v);
+    }
+    qint16 minLanes[8], maxLanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(minLanes), vMin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maxLanes), vMax);
+    reduceLanes(minLanes, maxLanes, minV, maxV);
+    scalarSwapMinMax(d + i, n - i, swap, minV, maxV);
+}
+
+#if defined(__SSE4_1__)
+template<>
+void swapMinMaxChunk<quint32>(quint32 *d, qint64 n, bool swap, quint32 &minV, quint32 &maxV) {
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m128i vMin = _mm_set1_epi32(-1), vMax = _mm_setzero_si128(), v;
+    qint64 i = 0;
+    for(; i + 4 <= n; i += 4) {
+        v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+        if(swap) {
+            v = _mm_shuffle_epi8(v, mask);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), v);
+        }
+        vMin = _mm_min_epu32(vMin, v);
+        vMax = _mm_max_epu32(vMax, v);
+    }
+    quint32 minLanes[4], maxLanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(minLanes), vMin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maxLanes), vMax);
+    reduceLanes(minLanes, maxLanes, minV, maxV);
+    scalarSwapMinMax(d + i, n - i, swap, minV, maxV);
+}
+#endif
+
+#endif
+
+// splits the pass over all threads and combines their min/max values
+template<typename T>
+struct SwapMinMaxKernel {
+    static void run(char *data, qint64 count, bool swap, double &minV, double &maxV) {
+        T *d = reinterpret_cast<T*>(data);
+        int threads = Parallel::threadCount();
+        std::vector<T> mins(threads, std::numeric_limits<T>::max());
+        std::vector<T> maxs(threads, std::numeric_limits<T>::lowest());
+
+        Parallel::forRange(count, GRAIN, [&](qint64 begin, qint64 end, int thread) {
+            swapMinMaxChunk<T>(d + begin, end - begin, swap, mins[thread], maxs[thread]);
+        });
+
+        minV = *std::min_element(mins.begin(), mins.end());
+        maxV = *std::max_element(maxs.begin(), maxs.end());
+    }
+};
+
+// every thread counts into its own histogram, the results are summed up
+template<typename T>
+struct HistogramKernel {
+    static void run(const char *data, qint64 count, double minV, double maxV, int buckets, std::vector<qint64> &counts) {
+        const T *d = reinterpret_cast<const T*>(data);
+        int threads = Parallel::threadCount();
+        std::vector<std::vector<qint64> > local(threads, std::vector<qint64>(buckets, 0));
+        double scale = maxV > minV ? buckets / (maxV - minV) : 0.0;
+        const double lastBucket = buckets - 1;
+
+        Parallel::forRange(count, GRAIN, [&](qint64 begin, qint64 end, int thread) {
+            qint64 *h = local[thread].data();
+            double b;
+            for(qint64 i = begin; i < end; i++) {
+                b = (d[i] - minV) * scale;
+                // the maximum value (and NaNs) would fall outside of the buckets
+                b = b < lastBucket ? b : lastBucket;
+                h[b > 0.0 ? static_cast<int>(b) : 0]++;
+            }
+        });
+
+        counts.assign(buckets, 0);
+        for(int t = 0; t < threads; t++)
+            for(int i = 0; i < buckets; i++)
+                counts[i] += local[t][i];
+    }
+};
+
+// unsigned values are uploaded as they are
+template<typename T>
+struct UploadKernel {
+    static void run(const char *src, qint64 count, double, double, char *dst) {
+        Parallel::forRange(count, GRAIN, [&](qint64 begin, qint64 end, int) {
+            std::memcpy(dst + begin * sizeof(T), src + begin * sizeof(T), (end - begin) * sizeof(T));
+        });
+    }
+};
+
+// signed values are biased to the unsigned range: [-32768, 32767] -> [0, 65535]
+template<>
+struct UploadKernel<qint16> {
+    static void run(const char *src, qint64 count, double, double, char *dst) {
+        const quint16 *s = reinterpret_cast<const quint16*>(src);
+        quint16 *d = reinterpret_cast<quint16*>(dst);
+        Parallel::forRange(count, GRAIN, [&](qint64 begin, qint64 end, int) {
+            for(qint64 i = begin; i < end; i++)
+                d[i] = s[i] ^ 0x8000;
+        });
+    }
+};
+
+// floating point values are normalized to [0,1]
+template<>
+struct UploadKernel<float> {
+    static void run(const char *src, qint64 count, double domainMin, double domainMax, char *dst) {
+        const float *s = reinterpret_cast<const float*>(src);
+        float *d = reinterpret_cast<float*>(dst);
+        const float offset = static_cast<float>(domainMin);
+        const float scale = static_cast<float>(1.0 / (domainMax - domainMin));
+        Parallel::forRange(count, GRAIN, [&](qint64 begin, qint64 end, int) {
+            for(qint64 i = begin; i < end; i++)
+                d[i] = (s[i] - offset) * scale;
+        });
+    }
+};
+
+// maps the window [windowMin, windowMax] onto the full 8 bit range, values
+// outside of the window (and NaNs) are clamped. Doubles keep the offset exact
+// for 32 bit values far from zero
+template<typename T>
+struct QuantizeKernel {
+    static void run(const char *src, qint64 count, double windowMin, double windowMax, char *dst) {
+        const T *s = reinterpret_cast<const T*>(src);
+        quint8 *d = reinterpret_cast<quint8*>(dst);
+        const double scale = windowMax > windowMin ? 255.0 / (windowMax - windowMin) : 0.0;
+        Parallel::forRange(count, GRAIN, [&](qint64 begin, qint64 end, int) {
+            double v;
+            for(qint64 i = begin; i < end; i++) {
+                v = (s[i] - windowMin) * scale + 0.5;
+                d[i] = v > 0.0 ? (v < 255.0 ? static_cast<quint8>(v) : 255) : 0;
+            }
+        });
+    }
+};
+
+// averages blocks of factor^3 values or takes their maximum. Like OpenGL mip
+// levels the result has floor(size/factor) values, the last block along each
+// axis takes the remaining values
+template<typename T>
+struct DownsampleKernel {
+    static void run(const char *src, int width, int height, int depth, int factor, bool maximum, char *dst) {
+        const T *s = reinterpret_cast<const T*>(src);
+        T *d = reinterpret_cast<T*>(dst);
+        const int w = qMax(1, width / factor);
+        const int h = qMax(1, height / factor);
+        const int dd = qMax(1, depth / factor);
+        const bool integer = std::numeric_limits<T>::is_integer;
+        const double init = maximum ? std::numeric_limits<double>::lowest() : 0.0;
+
+        Parallel::forRange(dd, 1, [&](qint64 begin, qint64 end, int) {
+            std::vector<double> row(w);
+            std::vector<int> blockX(w);
+            for(int x = 0; x < w; x++)
+                blockX[x] = (x == w - 1 ? width : (x + 1) * factor) - x * factor;
+            for(qint64 z = begin; z < end; z++) {
+                qint64 z0 = z * factor, z1 = z == dd - 1 ? depth : z0 + factor;
+                for(int y = 0; y < h; y++) {
+                    int y0 = y * factor, y1 = y == h - 1 ? height : y0 + factor;
+                    std::fill(row.begin(), row.end(), init);
+                    // combine the source rows of the block row
+                    for(qint64 sz = z0; sz < z1; sz++) {
+                        for(int sy = y0; sy < y1; sy++) {
+                            const T *line = s + (sz * height + sy) * width;
+                            if(maximum) {
+                                for(int x = 0; x < width; x++) {
+                                    double &m = row[qMin(x / factor, w - 1)];
+                                    m = line[x] > m ? line[x] : m;
+                                }
+                            } else {
+                                for(int x = 0; x < width; x++)
+                                    row[qMin(x / factor, w - 1)] += line[x];
+                            }
+                        }
+                    }
+                    T *out = d + (z * h + y) * w;
+                    if(maximum) {
+                        for(int x = 0; x < w; x++)
+                            out[x] = static_cast<T>(row[x]);
+                    } else {
+                        double blockYZ = static_cast<double>(z1 - z0) * (y1 - y0);
+                        for(int x = 0; x < w; x++) {
+                            double v = row[x] / (blockYZ * blockX[x]);
+                            out[x] = static_cast<T>(integer ? std::floor(v + 0.5) : v);
+                        }
+                    }
+                }
+            }
+        });
+    }
+};
+
+// converts a row of voxels to floats normalized to a value range
+template<typename T>
+void normalizeRow(const T *src, int width, float offset, float scale, float *dst) {
+    for(int x = 0; x < width; x++)
+        dst[x] = (static_cast<float>(src[x]) - offset) * scale;
+}
+
+// maps [-1,1] to a signed normalized byte, rounded like _mm_cvtps_epi32
+inline qint8 toSnorm(float v) {
+    return static_cast<qint8>(std::nearbyint(v * 127.f));
+}
+
+// encodes the gradient of one voxel as its direction and its relative magnitude
+void encodeGradient(float gx, float gy, float gz, qint8 *dst) {
+    float length = std::sqrt(gx * gx + gy * gy + gz * gz);
+    float inv = length > 0.f ? 1.f / length : 0.f;
+    dst[0] = toSnorm(gx * inv);
+    dst[1] = toSnorm(gy * inv);
+    dst[2] = toSnorm(gz * inv);
+    dst[3] = toSnorm(std::sqrt(std::min(length / VoxelKernels::GRADIENT_MAGNITUDE_MAX, 1.f)));
+}
+
+// encodes the gradients of a row, four voxels at once with SSE2
+void encodeGradientRow(const float *gx, const float *gy, const float *gz, int width, qint8 *dst) {
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128 one = _mm_set1_ps(1.f), zero = _mm_setzero_ps(), snormScale = _mm_set1_ps(127.f);
+    const __m128 magnitudeScale = _mm_set1_ps(1.f / VoxelKernels::GRADIENT_MAGNITUDE_MAX);
+    for(; x + 4 <= width; x += 4) {
+        __m128 vx = _mm_loadu_ps(gx + x), vy = _mm_loadu_ps(gy + x), vz = _mm_loadu_ps(gz + x);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+        __m128 valid = _mm_cmpgt_ps(length, zero);
+        __m128 inv = _mm_and_ps(valid, _mm_div_ps(snormScale, _mm_or_ps(length, _mm_andnot_ps(valid, one))));
+        __m128 magnitude = _mm_mul_ps(_mm_sqrt_ps(_mm_min_ps(_mm_mul_ps(length, magnitudeScale), one)), snormScale);
+        // round to 32 bit integers and pack them with saturation into bytes in xyzw order
+        __m128i ix = _mm_cvtps_epi32(_mm_mul_ps(vx, inv)), iy = _mm_cvtps_epi32(_mm_mul_ps(vy, inv));
+        __m128i iz = _mm_cvtps_epi32(_mm_mul_ps(vz, inv)), iw = _mm_cvtps_epi32(magnitude);
+        __m128i xy = _mm_unpacklo_epi32(ix, iy), xyHigh = _mm_unpackhi_epi32(ix, iy);
+        __m128i zw = _mm_unpacklo_epi32(iz, iw), zwHigh = _mm_unpackhi_epi32(iz, iw);
+        __m128i v01 = _mm_packs_epi32(_mm_unpacklo_epi64(xy, zw), _mm_unpackhi_epi64(xy, zw));
+        __m128i v23 = _mm_packs_epi32(_mm_unpacklo_epi64(xyHigh, zwHigh), _mm_unpackhi_epi64(xyHigh, zwHigh));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packs_epi16(v01, v23));
+    }
+#endif
+    for(; x < width; x++)
+        encodeGradient(gx[x], gy[x], gz[x], dst + x * 4);
+}
+
+// central differences of the normalized values row by row, the borders
+// repeat the outermost voxels. Every thread converts the slices of its chunk
+// of z into a ring of three slices (z-1, z, z+1), so each row is converted
+// once plus the two neighbouring slices of the chunk
+template<typename T>
+struct GradientKernel {
+    static void run(const char *src, int width, int height, int depth, double rangeMin, double rangeMax,
+                    float spacingX, float spacingY, float spacingZ, char *dst) {
+        const T *s = reinterpret_cast<const T*>(src);
+        qint8 *d = reinterpret_cast<qint8*>(dst);
+        const float offset = static_cast<float>(rangeMin);
+        const float scale = rangeMax > rangeMin ? static_cast<float>(1.0 / (rangeMax - rangeMin)) : 0.f;
+        const float fx = 0.5f / spacingX, fy = 0.5f / spacingY, fz = 0.5f / spacingZ;
+        const qint64 sliceSize = static_cast<qint64>(width) * height;
+        // a few chunks per thread balance the load, longer ones convert fewer slices twice
+        const qint64 grain = qMax<qint64>(1, depth / (Parallel::threadCount() * 4));
+
+        Parallel::forRange(depth, grain, [&](qint64 begin, qint64 end, int) {
+            std::vector<float> slices(static_cast<size_t>(sliceSize) * 3), rows(static_cast<size_t>(width) * 3);
+            float *gx = rows.data(), *gy = gx + width, *gz = gy + width;
+            qint64 converted[3] = { -1, -1, -1 };
+            // three consecutive slices never share a place in the ring
+            auto slice = [&](qint64 z) {
+                float *normalized = slices.data() + (z % 3) * sliceSize;
+                if(converted[z % 3] != z) {
+                    for(int y = 0; y < height; y++)
+                        normalizeRow(s + (z * height + y) * width, width, offset, scale, normalized + y * width);
+                    converted[z % 3] = z;
+                }
+                return normalized;
+            };
+            for(qint64 z = begin; z < end; z++) {
+                const float *zPrevSlice = slice(qMax<qint64>(z - 1, 0)), *current = slice(z);
+                const float *zNextSlice = slice(qMin<qint64>(z + 1, depth - 1));
+                for(int y = 0; y < height; y++) {
+                    const float *row = current + y * width;
+                    const float *yPrev = current + qMax(y - 1, 0) * width, *yNext = current + qMin(y + 1, height - 1) * width;
+                    const float *zPrev = zPrevSlice + y * width, *zNext = zNextSlice + y * width;
+                    gx[0] = (row[qMin(1, width - 1)] - row[0]) * fx;
+                    for(int x = 1; x < width - 1; x++)
+                        gx[x] = (row[x + 1] - row[x - 1]) * fx;
+                    if(width > 1)
+                        gx[width - 1] = (row[width - 1] - row[width - 2]) * fx;
+                    for(int x = 0; x < width; x++) {
+                        gy[x] = (yNext[x] - yPrev[x]) * fy;
+                        gz[x] = (zNext[x] - zPrev[x]) * fz;
+                    }
+                    encodeGradientRow(gx, gy, gz, width, d + ((z * height + y) * width) * 4);
+                }
+            }
+        });
+    }
+};
+
+}
+
+const float VoxelKernels::GRADIENT_MAGNITUDE_MAX = 0.8660254f;
+
+QString VoxelKernels::instructionSet() {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE4_1__)
+    return "SSE4.1";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+void VoxelKernels::swapMinMax(char *data, qint64 count, VoxelType::Type type, bool swap, double &minV, double &maxV) {
+    minV = maxV = 0.0;
+    if(count <= 0)
+        return;
+    dispatchVoxelType<SwapMinMaxKernel>(type, data, count, swap, minV, maxV);
+}
+
+void VoxelKernels::histogram(const char *data, qint64 count, VoxelType::Type type, double minV, double maxV, int buckets, std::vector<qint64> &counts) {
+    counts.assign(buckets, 0);
+    if(count <= 0 || buckets <= 0)
+        return;
+    dispatchVoxelType<HistogramKernel>(type, data, count, minV, maxV, buckets, counts);
+}
+
+void VoxelKernels::convertForUpload(const char *src, qint64 count, VoxelType::Type type, double domainMin, double domainMax, char *dst) {
+    if(count <= 0)
+        return;
+    dispatchVoxelType<UploadKernel>(type, src, count, domainMin, domainMax, dst);
+}
+
+void VoxelKernels::quantize(const char *src, qint64 count, VoxelType::Type type, double windowMin, double windowMax, char *dst) {
+    if(count <= 0)
+        return;
+    dispatchVoxelType<QuantizeKernel>(type, src, count, windowMin, windowMax, dst);
+}
+
+void VoxelKernels::downsample(const char *src, int width, int height, int depth, VoxelType::Type type, int factor, bool maximum, char *dst) {
+    if(width <= 0 || height <= 0 || depth <= 0 || factor < 1)
+        return;
+    dispatchVoxelType<DownsampleKernel>(type, src, width, height, depth, factor, maximum, dst);
+}
+
+void VoxelKernels::gradients(const char *src, int width, int height, int depth, VoxelType::Type type, double rangeMin,
+                             double rangeMax, float aspectX, float aspectY, float aspectZ, char *dst) {
+    if(width <= 0 || height <= 0 || depth <= 0)
+        return;
+    float smallest = qMin(aspectX, qMin(aspectY, aspectZ));
+    if(smallest <= 0.f)
+        aspectX = aspectY = aspectZ = smallest = 1.f;
+    dispatchVoxelType<GradientKernel>(type, src, width, height, depth, rangeMin, rangeMax,
+                                      aspectX / smallest, aspectY / smallest, aspectZ / smallest, dst);
+}
+
+VoxelKernels::VoxelKernels()
+{
+}
@@ -0,0 +1,142 @@
+#include "voxellayout.hpp"
+
+#include <algorithm>
+
+#include "parallel.hpp"
+
+namespace {
+
+// spreads the bits of v so that bit i moves to bit 3i
+qint64 spreadBits(int v) {
+    qint64 r = 0;
+    for(int i = 0; i < VoxelLayout::BRICK_BITS; i++)
+        r |= static_cast<qint64>((v >> i) & 1) << (3 * i);
+    return r;
+}
+
+// copies the voxels brick by brick, the rows of a brick are contiguous in
+// the linear source
+template<typename T>
+struct ReorderKernel {
+    static void run(const char *src, const VoxelLayout &layout, char *dst) {
+        const T *s = reinterpret_cast<const T*>(src);
+        T *d = reinterpret_cast<T*>(dst);
+        const int size = VoxelLayout::BRICK_SIZE;
+        const int width = layout.getWidth(), height = layout.getHeight(), depth = layout.getDepth();
+        const int bricksX = (width + size - 1) / size, bricksY = (height + size - 1) / size;
+        const int bricksZ = (depth + size - 1) / size;
+        const qint64 brickVoxels = static_cast<qint64>(size) * size * size;
+
+        Parallel::forRange(static_cast<qint64>(bricksX) * bricksY * bricksZ, 16, [&](qint64 begin, qint64 end, int) {
+            for(qint64 brick = begin; brick < end; brick++) {
+                int x0 = static_cast<int>(brick % bricksX) * size;
+                int y0 = static_cast<int>((brick / bricksX) % bricksY) * size;
+                int z0 = static_cast<int>(brick / (static_cast<qint64>(bricksX) * bricksY)) * size;
+                // the padding of the border bricks is zero
+                if(x0 + size > width || y0 + size > height || z0 + size > depth)
+                    std::fill(d + brick * brickVoxels, d + (brick + 1) * brickVoxels, T(0));
+                int x1 = qMin(x0 + size, width), y1 = qMin(y0 + size, height), z1 = qMin(z0 + size, depth);
+                for(int z = z0; z < z1; z++) {
+                    for(int y = y0; y < y1; y++) {
+                        const T *row = s + (static_cast<qint64>(z) * height + y) * width;
+                        for(int x = x0; x < x1; x++)
+                            d[layout.index(x, y, z)] = row[x];
+                    }
+                }
+            }
+        });
+    }
+};
+
+}
+
+QString VoxelLayout::name(Type type) {
+    switch(type) {
+    case LINEAR:
+        return "Linear";
+    case MORTON_BRICKS:
+        return "Morton Bricks";
+    }
+    return "unknown";
+}
+
+VoxelLayout::VoxelLayout()
+{
+    type = LINEAR;
+    width = height = depth = 0;
+    voxelCount = 0;
+}
+
+VoxelLayout::VoxelLayout(Type type, int width, int height, int depth)
+{
+    this->type = type;
+    this->width = width;
+    this->height = height;
+    this->depth = depth;
+    xOffsets.resize(qMax(width, 0));
+    yOffsets.resize(qMax(height, 0));
+    zOffsets.resize(qMax(depth, 0));
+
+    if(type == LINEAR) {
+        for(int x = 0; x < width; x++)
+            xOffsets[x] = x;
+        for(int y = 0; y < height; y++)
+            yOffsets[y] = static_cast<qint64>(y) * width;
+        for(int z = 0; z < depth; z++)
+            zOffsets[z] = static_cast<qint64>(z) * width * height;
+        voxelCount = static_cast<qint64>(width) * height * depth;
+        return;
+    }
+
+    // the brick coordinates select the brick, the low bits are interleaved
+    // into the Morton code of the voxel inside of the brick
+    const int mask = BRICK_SIZE - 1;
+    const qint64 brickVoxels = static_cast<qint64>(BRICK_SIZE) * BRICK_SIZE * BRICK_SIZE;
+    const qint64 bricksX = (width + mask) / BRICK_SIZE, bricksY = (height + mask) / BRICK_SIZE;
+    const qint64 bricksZ = (depth + mask) / BRICK_SIZE;
+    for(int x = 0; x < width; x++)
+        xOffsets[x] = (x >> BRICK_BITS) * brickVoxels + spreadBits(x & mask);
+    for(int y = 0; y < height; y++)
+        yOffsets[y] = (y >> BRICK_BITS) * bricksX * brickVoxels + (spreadBits(y & mask) << 1);
+    for(int z = 0; z < depth; z++)
+        zOffsets[z] = (z >> BRICK_BITS) * bricksX * bricksY * brickVoxels + (spreadBits(z & mask) << 2);
+    voxelCount = bricksX * bricksY * bricksZ * brickVoxels;
+}
+
+VoxelLayout::Type VoxelLayout::getType() const {
+    return type;
+}
+
+int VoxelLayout::getWidth() const {
+    return width;
+}
+
+int VoxelLayout::getHeight() const {
+    return height;
+}
+
+int VoxelLayout::getDepth() const {
+    return depth;
+}
+
+qint64 VoxelLayout::getVoxelCount() const {
+    return voxelCount;
+}
+
+const qint64* VoxelLayout::getXOffsets() const {
+    return xOffsets.data();
+}
+
+const qint64* VoxelLayout::getYOffsets() const {
+    return yOffsets.data();
+}
+
+const qint64* VoxelLayout::getZOffsets() const {
+    return zOffsets.data();
+}
+
+void VoxelLayout::fromLinear(const char *src, VoxelType::Type type, char *dst) const {
+    if(voxelCount <= 0)
+        return;
+    dispatchVoxelType<ReorderKernel>(type, src, *this, dst);
+}
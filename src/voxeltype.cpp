@@ -0,0 +1,136 @@
+#include "voxeltype.hpp"
+
+int VoxelType::size(Type type) {
+    switch(type) {
+    case UINT8:
+        return 1;
+    case UINT16:
+    case INT16:
+        return 2;
+    case UINT32:
+    case FLOAT32:
+        return 4;
+    }
+    return 1;
+}
+
+QString VoxelType::name(Type type) {
+    switch(type) {
+    case UINT8:
+        return "uint8";
+    case UINT16:
+        return "uint16";
+    case UINT32:
+        return "uint32";
+    case INT16:
+        return "int16";
+    case FLOAT32:
+        return "float32";
+    }
+    return "unknown";
+}
+
+bool VoxelType::fromName(QString name, Type &type) {
+    name = name.trimmed().toLower();
+    for(int i = 0; i < TYPE_COUNT; i++) {
+        if(name == VoxelType::name(static_cast<Type>(i))) {
+            type = static_cast<Type>(i);
+            return true;
+        }
+    }
+    // common aliases
+    if(name == "uchar" || name == "ubyte") {
+        type = UINT8;
+        return true;
+    }
+    if(name == "ushort") {
+        type = UINT16;
+        return true;
+    }
+    if(name == "short") {
+        type = INT16;
+        return true;
+    }
+    if(name == "uint") {
+        type = UINT32;
+        return true;
+    }
+    if(name == "float") {
+        type = FLOAT32;
+        return true;
+    }
+    return false;
+}
+
+bool VoxelType::fromSize(int bytes, Type &type) {
+    switch(bytes) {
+    case 1:
+        type = UINT8;
+        return true;
+    case 2:
+        type = UINT16;
+        return true;
+    case 4:
+        type = UINT32;
+        return true;
+    }
+    return false;
+}
+
+void VoxelType::domain(Type type, double dataMin, double dataMax, double &domainMin, double &domainMax) {
+    switch(type) {
+    case UINT8:
+        domainMin = 0.0;
+        domainMax = 256.0;
+        break;
+    case UINT16:
+        domainMin = 0.0;
+        domainMax = 65536.0;
+        break;
+    case UINT32:
+        domainMin = 0.0;
+        domainMax = 4294967296.0;
+        break;
+    case INT16:
+        domainMin = -32768.0;
+        domainMax = 32768.0;
+        break;
+    case FLOAT32:
+        domainMin = dataMin;
+        domainMax = dataMax > dataMin ? dataMax : dataMin + 1.0;
+        break;
+    }
+}
+
+GLenum VoxelType::uploadType(Type type) {
+    switch(type) {
+    case UINT8:
+        return GL_UNSIGNED_BYTE;
+    case UINT16:
+    case INT16:
+        return GL_UNSIGNED_SHORT;
+    case UINT32:
+        return GL_UNSIGNED_INT;
+    case FLOAT32:
+        return GL_FLOAT;
+    }
+    return GL_UNSIGNED_BYTE;
+}
+
+int VoxelType::uploadSize(Type type) {
+    return size(type);
+}
+
+bool VoxelType::needsUploadConversion(Type type) {
+    return type == INT16 || type == FLOAT32;
+}
+
+int VoxelType::uploadSlabDepth(qint64 sliceBytes, qint64 maxBytes, int depth) {
+    if(sliceBytes <= 0)
+        return qMax(depth, 1);
+    return static_cast<int>(qBound(Q_INT64_C(1), maxBytes / sliceBytes, static_cast<qint64>(qMax(depth, 1))));
+}
+
+VoxelType::VoxelType()
+{
+}
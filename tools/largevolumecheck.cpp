@@ -0,0 +1,117 @@
+/**
+ * Checks the 64 bit arithmetic of the CPU passes on a volume of more than
+ * 4 GiB: the min/max pass, the histogram and the split of the upload into
+ * slabs. The voxel buffer is allocated but never written except for a few
+ * marker voxels, so its pages stay sparse (zero pages) and the check needs
+ * little physical memory. Returns 0 if all checks pass.
+ *
+ *   vollight-large-volume-check [GiB > 4] [uint8|uint16|int16|uint32|float32]
+ */
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "parallel.hpp"
+#include "voxelbuffer.hpp"
+#include "voxelkernels.hpp"
+#include "voxeltype.hpp"
+
+namespace {
+
+// the texture upload splits a volume into slabs of at most this size
+const qint64 SLAB_BYTES = 64 * 1024 * 1024;
+const int BUCKETS = 256;
+
+// writes value into voxel index
+template<typename T>
+struct StoreKernel {
+    static void run(char *data, qint64 index, double value) {
+        T v = static_cast<T>(value);
+        std::memcpy(data + index * static_cast<qint64>(sizeof(T)), &v, sizeof(T));
+    }
+};
+
+int failures = 0;
+
+void check(bool passed, const std::string &what) {
+    std::cout << (passed ? "passed: " : "FAILED: ") << what << std::endl;
+    if(!passed)
+        failures++;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    double gib = argc > 1 ? QString(argv[1]).toDouble() : 4.5;
+    VoxelType::Type type = VoxelType::UINT8;
+    if(gib <= 4.0 || (argc > 2 && !VoxelType::fromName(argv[2], type))) {
+        std::cerr << "usage: " << argv[0] << " [GiB > 4] [uint8|uint16|int16|uint32|float32]" << std::endl;
+        return 1;
+    }
+
+    // slices of 2048^2 voxels, enough of them for the requested size
+    const int width = 2048, height = 2048;
+    const qint64 sliceCount = static_cast<qint64>(width) * height;
+    const qint64 sliceBytes = sliceCount * VoxelType::size(type);
+    const int depth = static_cast<int>(gib * 1024.0 * 1024.0 * 1024.0 / sliceBytes) + 1;
+    const qint64 count = sliceCount * depth;
+    const qint64 bytes = count * VoxelType::size(type);
+
+    VoxelBuffer buffer;
+    if(!buffer.allocate(bytes))
+        return 1;
+    std::cout << width << " x " << height << " x " << depth << " " << VoxelType::name(type).toStdString() << " voxels, "
+              << bytes / (1024.0 * 1024.0 * 1024.0) << " GiB, " << Parallel::threadCount() << " threads" << std::endl;
+
+    // markers just beyond 2 and 4 GiB and in the last voxel, the untouched
+    // voxels are zero. The maximum lies beyond 4 GiB, the minimum of the
+    // signed types at the end
+    const bool isSigned = type == VoxelType::INT16 || type == VoxelType::FLOAT32;
+    const qint64 beyond2GiB = (Q_INT64_C(1) << 31) / VoxelType::size(type) + 7;
+    const qint64 beyond4GiB = (Q_INT64_C(1) << 32) / VoxelType::size(type) + 11;
+    const double high = 200.0, middle = 100.0, low = isSigned ? -100.0 : 50.0;
+    dispatchVoxelType<StoreKernel>(type, buffer.data(), beyond2GiB, middle);
+    dispatchVoxelType<StoreKernel>(type, buffer.data(), beyond4GiB, high);
+    dispatchVoxelType<StoreKernel>(type, buffer.data(), count - 1, low);
+
+    QElapsedTimer timer;
+    timer.start();
+    double minV, maxV;
+    VoxelKernels::swapMinMax(buffer.data(), count, type, false, minV, maxV);
+    std::cout << "min/max pass: " << timer.nsecsElapsed() / 1e6 << " ms" << std::endl;
+    check(maxV == high, "the maximum beyond 4 GiB is found");
+    check(minV == (isSigned ? low : 0.0), "the minimum is found");
+
+    timer.start();
+    std::vector<qint64> counts;
+    VoxelKernels::histogram(buffer.data(), count, type, minV, maxV, BUCKETS, counts);
+    std::cout << "histogram: " << timer.nsecsElapsed() / 1e6 << " ms" << std::endl;
+    qint64 total = 0;
+    for(qint64 c : counts)
+        total += c;
+    check(static_cast<int>(counts.size()) == BUCKETS && total == count, "the histogram counts every voxel");
+    check(counts[BUCKETS - 1] == 1, "the histogram counts the maximum beyond 4 GiB");
+    check(counts[0] == (isSigned ? 1 : count - 3), "the histogram counts the minimum");
+
+    // the slabs of the upload: whole slices, contiguous and covering the volume
+    int slabDepth = VoxelType::uploadSlabDepth(sliceBytes, SLAB_BYTES, depth);
+    qint64 offset = 0, slabs = 0;
+    bool contiguous = true;
+    for(int z = 0; z < depth; z += slabDepth, slabs++) {
+        int slabSize = qMin(slabDepth, depth - z);
+        contiguous = contiguous && z * sliceCount * VoxelType::size(type) == offset;
+        offset += slabSize * sliceBytes;
+    }
+    std::cout << slabs << " slabs of " << slabDepth << " slices" << std::endl;
+    check(slabDepth >= 1 && slabDepth * sliceBytes <= qMax(SLAB_BYTES, sliceBytes), "a slab fits into the slab size");
+    check(contiguous && offset == bytes, "the slabs cover the volume");
+    check(VoxelType::uploadSlabDepth(sliceBytes, Q_INT64_C(1) << 40, depth) == depth, "a single slab holds the whole volume");
+    check(VoxelType::uploadSlabDepth(sliceBytes, 1, depth) == 1, "a slab holds at least one slice");
+
+    std::cout << (failures == 0 ? "all checks passed" : "checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/**
+ * Compares the CPU side voxel layouts (see VoxelLayout) with two
+ * neighbourhood heavy kernels on a synthetic volume: central difference
+ * gradients of all voxels and trilinear ray marching along random rays.
+ * Both kernels read through the same VoxelAccessor, so only the order of
+ * the voxels in memory differs.
+ *
+ *   vollight-layout-bench [size] [uint8|uint16|int16|uint32|float32] [rays]
+ */
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "parallel.hpp"
+#include "voxelbuffer.hpp"
+#include "voxellayout.hpp"
+#include "voxeltype.hpp"
+
+namespace {
+
+// smooth blobs with some noise, so the values vary in all directions
+template<typename T>
+struct FillKernel {
+    static void run(char *data, int size, double scale) {
+        T *d = reinterpret_cast<T*>(data);
+        Parallel::forRange(size, 1, [&](qint64 begin, qint64 end, int) {
+            std::minstd_rand noise(static_cast<unsigned>(begin));
+            for(qint64 z = begin; z < end; z++) {
+                for(int y = 0; y < size; y++) {
+                    for(int x = 0; x < size; x++) {
+                        double v = 0.5 + 0.25 * std::sin(x * 0.05) * std::cos(y * 0.07) + 0.2 * std::sin(z * 0.03 + x * 0.01)
+                                + 0.05 * (noise() % 1000) / 1000.0;
+                        d[(z * size + y) * size + x] = static_cast<T>(qBound(0.0, v, 1.0) * scale);
+                    }
+                }
+            }
+        });
+    }
+};
+
+// sums the gradient magnitudes of all voxels, visiting them slice by slice
+template<typename T>
+struct GradientKernel {
+    static void run(const char *data, const VoxelLayout &layout, double &sum) {
+        VoxelAccessor<T> v(data, layout);
+        std::vector<double> sums(Parallel::threadCount(), 0.0);
+        Parallel::forRange(v.getDepth(), 1, [&](qint64 begin, qint64 end, int thread) {
+            double s = 0.0;
+            for(int z = static_cast<int>(begin); z < end; z++) {
+                for(int y = 0; y < v.getHeight(); y++) {
+                    for(int x = 0; x < v.getWidth(); x++) {
+                        float gx = static_cast<float>(v.clampedAt(x + 1, y, z)) - static_cast<float>(v.clampedAt(x - 1, y, z));
+                        float gy = static_cast<float>(v.clampedAt(x, y + 1, z)) - static_cast<float>(v.clampedAt(x, y - 1, z));
+                        float gz = static_cast<float>(v.clampedAt(x, y, z + 1)) - static_cast<float>(v.clampedAt(x, y, z - 1));
+                        s += std::sqrt(gx * gx + gy * gy + gz * gz);
+                    }
+                }
+            }
+            sums[thread] += s;
+        });
+        sum = 0.0;
+        for(double s : sums)
+            sum += s;
+    }
+};
+
+// marches random rays through the volume with half voxel steps and sums
+// their maximum intensity
+template<typename T>
+struct RayMarchKernel {
+    static void run(const char *data, const VoxelLayout &layout, int rays, double &sum) {
+        VoxelAccessor<T> v(data, layout);
+        const float size = static_cast<float>(v.getWidth());
+        const float step = 0.5f;
+        std::vector<double> sums(Parallel::threadCount(), 0.0);
+        Parallel::forRange(rays, 64, [&](qint64 begin, qint64 end, int thread) {
+            double s = 0.0;
+            for(qint64 ray = begin; ray < end; ray++) {
+                // the same rays for every layout
+                std::minstd_rand random(static_cast<unsigned>(ray + 1));
+                std::uniform_real_distribution<float> unit(-1.f, 1.f);
+                float dx, dy, dz, length;
+                do {
+                    dx = unit(random);
+                    dy = unit(random);
+                    dz = unit(random);
+                    length = std::sqrt(dx * dx + dy * dy + dz * dz);
+                } while(length < 0.1f || length > 1.f);
+                dx *= step / length;
+                dy *= step / length;
+                dz *= step / length;
+                float px = (unit(random) + 1.f) * 0.5f * size, py = (unit(random) + 1.f) * 0.5f * size;
+                float pz = (unit(random) + 1.f) * 0.5f * size;
+                float maximum = 0.f;
+                while(px >= 0.f && py >= 0.f && pz >= 0.f && px < size && py < size && pz < size) {
+                    maximum = qMax(maximum, v.sample(px, py, pz));
+                    px += dx;
+                    py += dy;
+                    pz += dz;
+                }
+                s += maximum;
+            }
+            sums[thread] += s;
+        });
+        sum = 0.0;
+        for(double s : sums)
+            sum += s;
+    }
+};
+
+}
+
+int main(int argc, char *argv[]) {
+    int size = argc > 1 ? QString(argv[1]).toInt() : 384;
+    VoxelType::Type type = VoxelType::UINT16;
+    int rays = argc > 3 ? QString(argv[3]).toInt() : 1 << 16;
+    if(size < 2 || rays < 1 || (argc > 2 && !VoxelType::fromName(argv[2], type))) {
+        std::cerr << "usage: " << argv[0] << " [size] [uint8|uint16|int16|uint32|float32] [rays]" << std::endl;
+        return 1;
+    }
+
+    qint64 voxels = static_cast<qint64>(size) * size * size;
+    VoxelBuffer linear;
+    if(!linear.allocate(voxels * VoxelType::size(type)))
+        return 1;
+    double scale = type == VoxelType::FLOAT32 ? 1.0 : type == VoxelType::UINT8 ? 255.0 : 30000.0;
+    dispatchVoxelType<FillKernel>(type, linear.data(), size, scale);
+    std::cout << size << "^3 " << VoxelType::name(type).toStdString() << " voxels, " << Parallel::threadCount()
+              << " threads, " << rays << " rays" << std::endl;
+
+    for(int i = 0; i < VoxelLayout::LAYOUT_COUNT; i++) {
+        VoxelLayout layout(static_cast<VoxelLayout::Type>(i), size, size, size);
+        QElapsedTimer timer;
+        timer.start();
+        // the linear layout reads the voxels in place
+        VoxelBuffer reordered;
+        const char *data = linear.data();
+        if(layout.getType() != VoxelLayout::LINEAR) {
+            if(!reordered.allocate(layout.getVoxelCount() * VoxelType::size(type)))
+                return 1;
+            layout.fromLinear(linear.data(), type, reordered.data());
+            data = reordered.data();
+        }
+        double convertTime = timer.nsecsElapsed() / 1e6;
+
+        double gradientSum, raySum;
+        timer.start();
+        dispatchVoxelType<GradientKernel>(type, data, layout, gradientSum);
+        double gradientTime = timer.nsecsElapsed() / 1e6;
+        timer.start();
+        dispatchVoxelType<RayMarchKernel>(type, data, layout, rays, raySum);
+        double rayTime = timer.nsecsElapsed() / 1e6;
+
+        std::cout << VoxelLayout::name(layout.getType()).toStdString() << ": conversion " << convertTime
+                  << " ms, gradients " << gradientTime << " ms, ray marching " << rayTime
+                  << " ms (checksums " << gradientSum << " " << raySum << ")" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * Times the byte order and min/max pass of the loader on a synthetic
+ * buffer: a plain scalar loop on one thread against VoxelKernels::swapMinMax
+ * (vectorized for the instruction set it was compiled for, see
+ * VoxelKernels::instructionSet) on one and on all threads, with and without
+ * byte swapping. Reports the best of the repetitions in GB/s and checks that
+ * all paths find the same range.
+ *
+ *   vollight-minmax-bench [MiB] [uint8|uint16|int16|uint32|float32] [repetitions]
+ */
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include "parallel.hpp"
+#include "voxelbuffer.hpp"
+#include "voxelkernels.hpp"
+#include "voxeltype.hpp"
+
+namespace {
+
+// random values over the whole range of the type (floats in [-1000, 1000])
+template<typename T>
+struct FillKernel {
+    static void run(char *data, qint64 count) {
+        T *d = reinterpret_cast<T*>(data);
+        Parallel::forRange(count, 1 << 20, [&](qint64 begin, qint64 end, int) {
+            std::minstd_rand random(static_cast<unsigned>(begin));
+            for(qint64 i = begin; i < end; i++) {
+                if(std::numeric_limits<T>::is_integer)
+                    d[i] = static_cast<T>(random());
+                else
+                    d[i] = static_cast<T>(random() % 2000001) / static_cast<T>(1000) - static_cast<T>(1000);
+            }
+        });
+    }
+};
+
+// the per value loop the kernels replace: swap the bytes, then compare
+template<typename T>
+struct ScalarKernel {
+    static void run(char *data, qint64 count, bool swap, double &minV, double &maxV) {
+        T *d = reinterpret_cast<T*>(data);
+        T lo = std::numeric_limits<T>::max(), hi = std::numeric_limits<T>::lowest(), v;
+        uchar *bytes;
+        for(qint64 i = 0; i < count; i++) {
+            if(swap) {
+                bytes = reinterpret_cast<uchar*>(d + i);
+                std::reverse(bytes, bytes + sizeof(T));
+            }
+            v = d[i];
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+        minV = lo;
+        maxV = hi;
+    }
+};
+
+}
+
+int main(int argc, char *argv[]) {
+    qint64 mib = argc > 1 ? QString(argv[1]).toLongLong() : 512;
+    VoxelType::Type type = VoxelType::UINT16;
+    int repetitions = argc > 3 ? QString(argv[3]).toInt() : 5;
+    if(mib < 1 || repetitions < 1 || (argc > 2 && !VoxelType::fromName(argv[2], type))) {
+        std::cerr << "usage: " << argv[0] << " [MiB] [uint8|uint16|int16|uint32|float32] [repetitions]" << std::endl;
+        return 1;
+    }
+
+    const qint64 count = mib * 1024 * 1024 / VoxelType::size(type);
+    const qint64 bytes = count * VoxelType::size(type);
+    // every run starts from the original values, swapping changes them in place
+    VoxelBuffer original, buffer;
+    if(!original.allocate(bytes) || !buffer.allocate(bytes))
+        return 1;
+    dispatchVoxelType<FillKernel>(type, original.data(), count);
+
+    const int threads = Parallel::threadCount();
+    std::cout << bytes / (1024 * 1024) << " MiB of " << VoxelType::name(type).toStdString() << ", "
+              << VoxelKernels::instructionSet().toStdString() << ", " << threads << " threads, best of "
+              << repetitions << std::endl;
+
+    bool consistent = true;
+    double reference[2] = { 0.0, 0.0 };
+    for(int swap = 0; swap < 2; swap++) {
+        // the swapping runs read the values in the foreign byte order, like
+        // a big endian file, so they find the same range
+        if(swap) {
+            double minV, maxV;
+            VoxelKernels::swapMinMax(original.data(), count, type, true, minV, maxV);
+        }
+        double scalarTime = 0.0;
+        // 0: scalar, 1: the kernel on one thread, 2: the kernel on all threads
+        for(int path = 0; path < 3; path++) {
+            Parallel::setThreadCount(path == 2 ? threads : 1);
+            double best = std::numeric_limits<double>::max(), minV = 0.0, maxV = 0.0;
+            for(int i = 0; i < repetitions; i++) {
+                std::memcpy(buffer.data(), original.data(), bytes);
+                QElapsedTimer timer;
+                timer.start();
+                if(path == 0)
+                    dispatchVoxelType<ScalarKernel>(type, buffer.data(), count, swap != 0, minV, maxV);
+                else
+                    VoxelKernels::swapMinMax(buffer.data(), count, type, swap != 0, minV, maxV);
+                best = qMin(best, timer.nsecsElapsed() / 1e6);
+            }
+            if(path == 0)
+                scalarTime = best;
+            if(swap == 0 && path == 0) {
+                reference[0] = minV;
+                reference[1] = maxV;
+            } else if(minV != reference[0] || maxV != reference[1]) {
+                consistent = false;
+            }
+            const char *names[] = { "scalar, 1 thread", "swapMinMax, 1 thread", "swapMinMax, all threads" };
+            std::cout << (swap ? "swap    " : "no swap ") << names[path] << ": " << best << " ms, "
+                      << bytes / (best * 1e6) << " GB/s, " << scalarTime / best << "x (range " << minV << " - "
+                      << maxV << ")" << std::endl;
+        }
+    }
+    Parallel::setThreadCount(threads);
+
+    if(!consistent) {
+        std::cerr << "swapMinMax found a different range than the scalar loop!" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * A minimal producer of shared memory volumes (see SharedVolume) for testing
+ * the zero copy ingest without a reconstruction service. It copies a RAW
+ * volume (with the usual two header lines) or a synthetic sphere into a new
+ * segment, keeps the segment until enter is pressed and removes it then.
+ *
+ *   vollight-shm-producer <name> <volume.raw>
+ *   vollight-shm-producer <name> --sphere <size> [uint8|uint16|int16|uint32|float32]
+ *
+ * The volume is opened in vollight with File > Open Shared Memory Volume...
+ * or as the path shm://<name>.
+ */
+
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sharedvolume.hpp"
+#include "voxeltype.hpp"
+
+namespace {
+
+// reverses the bytes of every value
+void swapBytes(char *data, qint64 count, int bytes) {
+    for(qint64 i = 0; i < count; i++, data += bytes)
+        std::reverse(data, data + bytes);
+}
+
+// a sphere whose values fall off from the center to the border
+void fillSphere(char *data, int size, VoxelType::Type type) {
+    double scale = type == VoxelType::FLOAT32 ? 1.0 : type == VoxelType::UINT8 ? 255.0 : 30000.0;
+    double center = (size - 1) / 2.0;
+    for(int z = 0; z < size; z++) {
+        for(int y = 0; y < size; y++) {
+            for(int x = 0; x < size; x++, data += VoxelType::size(type)) {
+                double r = std::sqrt((x - center) * (x - center) + (y - center) * (y - center) + (z - center) * (z - center));
+                double v = scale * qMax(0.0, 1.0 - r / center);
+                switch(type) {
+                case VoxelType::UINT8: *reinterpret_cast<quint8*>(data) = static_cast<quint8>(v); break;
+                case VoxelType::UINT16: *reinterpret_cast<quint16*>(data) = static_cast<quint16>(v); break;
+                case VoxelType::INT16: *reinterpret_cast<qint16*>(data) = static_cast<qint16>(v); break;
+                case VoxelType::UINT32: *reinterpret_cast<quint32*>(data) = static_cast<quint32>(v); break;
+                case VoxelType::FLOAT32: *reinterpret_cast<float*>(data) = static_cast<float>(v); break;
+                }
+            }
+        }
+    }
+}
+
+// reads the two header lines of a RAW file, the voxels follow in big endian byte order
+bool readRawHeader(QFile &file, SharedVolume::Header &header, VoxelType::Type &type) {
+    QString strResolution = file.readLine();
+    QString strAspect = file.readLine();
+    QTextStream tsResolution(&strResolution, QIODevice::ReadOnly);
+    QTextStream tsAspect(&strAspect, QIODevice::ReadOnly);
+    QString typeTag;
+    header.aspectX = header.aspectY = header.aspectZ = 1.f;
+    tsResolution >> header.width >> header.height >> header.depth >> typeTag;
+    tsAspect >> header.aspectX >> header.aspectY >> header.aspectZ;
+    qint64 voxelCount = static_cast<qint64>(header.width) * header.height * header.depth;
+    if(header.width <= 0 || header.height <= 0 || header.depth <= 0)
+        return false;
+    qint64 dataSize = file.size() - file.pos();
+    return typeTag.isEmpty() ? VoxelType::fromSize(static_cast<int>(dataSize / voxelCount), type)
+                             : VoxelType::fromName(typeTag, type);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    if(argc < 3 || (QString(argv[2]) == "--sphere" && argc < 4)) {
+        std::cerr << "usage: " << argv[0] << " <name> <volume.raw>" << std::endl
+                  << "       " << argv[0] << " <name> --sphere <size> [uint8|uint16|int16|uint32|float32]" << std::endl;
+        return 1;
+    }
+    QString name = argv[1];
+    bool sphere = QString(argv[2]) == "--sphere";
+
+    SharedVolume::Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SharedVolume::MAGIC, sizeof(header.magic));
+    header.byteOrder = SharedVolume::BYTE_ORDER_MARK;
+    header.version = SharedVolume::VERSION;
+    VoxelType::Type type = VoxelType::UINT8;
+
+    QFile file;
+    if(sphere) {
+        header.width = header.height = header.depth = QString(argv[3]).toInt();
+        header.aspectX = header.aspectY = header.aspectZ = 1.f;
+        if(header.width <= 1 || (argc > 4 && !VoxelType::fromName(argv[4], type))) {
+            std::cerr << "Invalid sphere size or voxel type" << std::endl;
+            return 1;
+        }
+    } else {
+        file.setFileName(argv[2]);
+        if(!file.open(QIODevice::ReadOnly) || !readRawHeader(file, header, type)) {
+            std::cerr << "Could not read the RAW volume " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+    strncpy(header.type, VoxelType::name(type).toLatin1().constData(), sizeof(header.type) - 1);
+    qint64 voxelCount = static_cast<qint64>(header.width) * header.height * header.depth;
+    header.dataOffset = SharedVolume::DATA_OFFSET;
+    header.dataSize = voxelCount * VoxelType::size(type);
+
+    // create and fill the segment
+    qint64 segmentSize = header.dataOffset + header.dataSize;
+    int fd = SharedVolume::openSegment(name, true, segmentSize);
+    if(fd < 0)
+        return 1;
+    void *m = mmap(nullptr, static_cast<size_t>(segmentSize), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED) {
+        std::cerr << "Could not map the shared memory segment" << std::endl;
+        SharedVolume::removeSegment(name);
+        return 1;
+    }
+    char *segment = static_cast<char*>(m);
+    char *voxels = segment + header.dataOffset;
+    if(sphere) {
+        fillSphere(voxels, header.width, type);
+    } else {
+        if(file.read(voxels, header.dataSize) != header.dataSize) {
+            std::cerr << "The RAW volume is too small" << std::endl;
+            munmap(m, static_cast<size_t>(segmentSize));
+            SharedVolume::removeSegment(name);
+            return 1;
+        }
+        if(VoxelType::size(type) > 1 && Q_BYTE_ORDER != Q_BIG_ENDIAN)
+            swapBytes(voxels, voxelCount, VoxelType::size(type));
+    }
+    // the header is written last, so a reader never sees a half filled volume
+    memcpy(segment, &header, sizeof(header));
+
+    std::cout << "Serving " << header.width << "x" << header.height << "x" << header.depth << " " << header.type
+              << " values as " << SharedVolume::PATH_PREFIX.toStdString() << name.toStdString()
+              << ", press enter to remove it" << std::endl;
+    std::cin.get();
+
+    munmap(m, static_cast<size_t>(segmentSize));
+    SharedVolume::removeSegment(name);
+    return 0;
+}